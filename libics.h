@@ -50,7 +50,7 @@ extern "C" {
 #endif
 
 /* Library versioning is in the form major, minor, patch: */
-#define ICSLIB_VERSION "1.7.1" /* also defined in configure.ac */
+#define ICSLIB_VERSION "1.8.0" /* also defined in configure.ac */
 
 #if defined(__WIN32__) && !defined(WIN32)
 #define WIN32
@@ -66,9 +66,11 @@ extern "C" {
 #if defined(WIN32) || defined(WIN64)
 #define ICSSTRCASECMP _stricmp
 #define ICSFSEEK      _fseeki64
+#define ICSFTELL      _ftelli64
 #else
 #define ICSSTRCASECMP strcasecmp
 #define ICSFSEEK      fseek
+#define ICSFTELL      ftell
 #endif
 
 
@@ -208,7 +210,8 @@ extern "C" {
 
 
 /* These are the known data types for imels. If you use another type, you can't
-   use the top-level functions: */
+   use the top-level functions. Binary imels are packed eight to a byte in the
+   file, but take one byte each in memory, where any non-zero value is 1: */
 typedef enum {
     Ics_unknown = 0,
     Ics_uint8,     /* integer, unsigned,  8 bpp */
@@ -223,7 +226,8 @@ typedef enum {
     Ics_real32,    /* real,    signed,   32 bpp */
     Ics_real64,    /* real,    signed,   64 bpp */
     Ics_complex32, /* complex, signed, 2*32 bpp */
-    Ics_complex64  /* complex, signed, 2*64 bpp */
+    Ics_complex64, /* complex, signed, 2*64 bpp */
+    Ics_binary     /* integer, unsigned,  1 bpp */
 } Ics_DataType;
 
 
@@ -231,10 +235,27 @@ typedef enum {
 typedef enum {
     IcsCompr_uncompressed = 0, /* No compression                              */
     IcsCompr_compress,         /* Using 'compress' (writing converts to gzip) */
-    IcsCompr_gzip              /* Using zlib (ICS_ZLIB must be defined)       */
+    IcsCompr_gzip,             /* Using zlib (ICS_ZLIB must be defined)       */
+    IcsCompr_chunked_gzip,     /* Independently gzipped chunks (ICS_ZLIB)     */
+    IcsCompr_zstd              /* Using Zstandard (ICS_ZSTD must be defined)  */
 } Ics_Compression;
 
 
+/* Filters applied to the data before compression. */
+typedef enum {
+    IcsFilter_none = 0,        /* No filter                                   */
+    IcsFilter_shuffle,         /* Group the n-th byte of all imels in a line  */
+    IcsFilter_bitshuffle       /* Group the n-th bit of all imels in a line   */
+} Ics_Filter;
+
+
+/* Predictors applied to integer data before compression. */
+typedef enum {
+    IcsPredictor_none = 0,     /* No predictor                                */
+    IcsPredictor_horizontal    /* Difference with the previous imel in a line */
+} Ics_Predictor;
+
+
 /* File modes. */
 typedef enum {
     IcsFileMode_write, /* write mode                                  */
@@ -534,6 +555,32 @@ typedef struct _ICS {
 
         /* SCIL_Image compatibility parameter: */
     char                    scilType[ICS_STRLEN_TOKEN];
+
+        /* The fields below were added in libics 1.8.0. They follow all older
+           fields, such that these keep their offsets. */
+        /* Type of the data to write, if it is to be converted (writing only): */
+    Ics_DataType            dataType;
+        /* Number of threads used for compression (0 = one per processor): */
+    int                     compThreads;
+        /* Chunk size in each dim, for chunked compression (0 = default): */
+    size_t                  chunkSize[ICS_MAXDIM];
+        /* Filter applied before compression: */
+    Ics_Filter              filter;
+        /* Predictor applied before the filter: */
+    Ics_Predictor           predictor;
+        /* Scale and offset applied when converting imels to another type: */
+    double                  convScale;
+    double                  convOffset;
+        /* Status of the data file when writing in blocks: */
+    void*                   blockWrite;
+        /* Status of the memory-mapped data: */
+    void*                   dataMap;
+        /* Random-access index into gzip-compressed data: */
+    void*                   zipIndex;
+        /* The ICS file in memory, if opened with IcsOpenMemory: */
+    void*                   memory;
+        /* ICS2: Bytes of padding written after the header: */
+    size_t                  headerPadding;
 } ICS;
 
 
@@ -663,6 +710,30 @@ typedef struct _Ics_HistoryIterator {
 } Ics_HistoryIterator;
 
 
+/* Callbacks through which the library does its file I/O, see IcsSetIoVTable.
+   `open` gets the path and a mode as given to fopen ("rb", "wb", "ab" or
+   "r+b"), and returns a handle or NULL on failure. `read` and `write` return
+   the number of bytes transferred, or -1 on error; `read` returns 0 at the end
+   of the file. `seek` takes `whence` as fseek does, and returns the new
+   position or -1 on error. `close` returns 0 on success. The other members are
+   optional: without `write` files can only be read; `readAt` reads at an
+   offset without using the position of the handle, it must be safe to call
+   from several threads and is needed by IcsReadIdsAt; `remove` and `rename`
+   are used when updating a file, return 0 on success, and default to the c
+   library functions. `userData` is passed to `open`, `remove` and `rename`. */
+typedef struct {
+    void*     (*open)(void *userData, const char *path, const char *mode);
+    ptrdiff_t (*read)(void *handle, void *buf, size_t n);
+    ptrdiff_t (*write)(void *handle, const void *buf, size_t n);
+    ptrdiff_t (*seek)(void *handle, ptrdiff_t offset, int whence);
+    int       (*close)(void *handle);
+    ptrdiff_t (*readAt)(void *handle, void *buf, size_t n, size_t offset);
+    int       (*remove)(void *userData, const char *path);
+    int       (*rename)(void *userData, const char *from, const char *to);
+    void*       userData;
+} Ics_IoVTable;
+
+
 /* Returns a string that can be used to compare with ICSLIB_VERSION to check if
    the version of the library is the same as that of the headers. */
 ICSEXPORT const char* IcsGetLibVersion(void);
@@ -674,6 +745,18 @@ ICSEXPORT int IcsVersion(const char *filename,
                          int         forceName);
 
 
+/* Do all file I/O through the callbacks in vtable, which is copied. Pass NULL
+   to return to the built-in I/O through the c library, memory mapping and
+   positional reads. The setting is global: it applies to every file the
+   process opens with the library afterwards, also those opened by other code
+   using libics. Set it before any other thread uses the library; files opened
+   before the call keep using the I/O they were opened with, but an ICS opened
+   for writing or updating may then open its other files through different
+   I/O. Not available where the c library cannot create streams from callbacks
+   (fopencookie or funopen), such as on Windows. */
+ICSEXPORT Ics_Error IcsSetIoVTable(const Ics_IoVTable *vtable);
+
+
 /* Read a preview (2D) image out of an ICS file. The buffer is malloc'd, xsize
    and ysize are set to the image size. The data type is always uint8. You need
    to free() the data block when you're done. */
@@ -700,6 +783,26 @@ ICSEXPORT Ics_Error IcsOpen(ICS        **ics,
 ICSEXPORT Ics_Error IcsClose(ICS* ics);
 
 
+/* Open an ICS file held in memory. For reading (mode = "r", optionally with
+   "l" appended as for IcsOpen), buf points to len bytes of an ICS version 2.0
+   file that contains its image data; the buffer is not copied and must remain
+   valid until IcsClose is called. For writing (mode = "w" or "w2"), buf must be
+   NULL and len 0: nothing is written to disk, use IcsWriteMemory to obtain the
+   file. */
+ICSEXPORT Ics_Error IcsOpenMemory(ICS        **ics,
+                                  const void  *buf,
+                                  size_t       len,
+                                  const char  *mode);
+
+
+/* Write the header and image data of a version 2.0 ICS file into a newly
+   allocated buffer. *buf is set to the buffer and *len to its length. You need
+   to free() the buffer when you're done. Only valid if writing. */
+ICSEXPORT Ics_Error IcsWriteMemory(ICS    *ics,
+                                   void  **buf,
+                                   size_t *len);
+
+
 /* Retrieve the layout of an ICS image. Only valid if reading. */
 ICSEXPORT Ics_Error IcsGetLayout(const ICS    *ics,
                                  Ics_DataType *dt,
@@ -737,6 +840,37 @@ ICSEXPORT Ics_Error IcsGetROIData(ICS          *ics,
                                   size_t        n);
 
 
+/* Read a square region of the image from an ICS file into a sub-block of a
+   memory block. stride gives the distance, in imels, between neighbouring
+   imels of dest along each of the nDims dimensions, and can be negative. To use
+   the defaults in one of the parameters, set the pointer to NULL; n is the
+   size of dest in bytes, and is used only if stride is NULL. Only valid if
+   reading. */
+ICSEXPORT Ics_Error IcsGetROIDataWithStrides(ICS             *ics,
+                                             const size_t    *offset,
+                                             const size_t    *size,
+                                             const size_t    *sampling,
+                                             void            *dest,
+                                             size_t           n,
+                                             const ptrdiff_t *stride,
+                                             int              nDims);
+
+
+/* Read a square region of the image from an ICS file as IcsGetROIData does,
+   using nThreads threads, or one per processor if nThreads is 0. Uncompressed
+   data is read by all threads at once, each reading a different set of lines;
+   the chunks of data compressed with IcsCompr_chunked_gzip are decompressed
+   by all threads. Other data is read by the calling thread. Only valid if
+   reading. */
+ICSEXPORT Ics_Error IcsGetROIDataParallel(ICS          *ics,
+                                          const size_t *offset,
+                                          const size_t *size,
+                                          const size_t *sampling,
+                                          void         *dest,
+                                          size_t        n,
+                                          int           nThreads);
+
+
 /* Read the image from an ICS file into a sub-block of a memory block. To use
    the defaults in one of the parameters, set the pointer to NULL. Only valid if
    reading. */
@@ -747,6 +881,67 @@ ICSEXPORT Ics_Error IcsGetDataWithStrides(ICS             *ics,
                                           int              nDims);
 
 
+/* These four functions do the same as IcsGetData, IcsGetROIData,
+   IcsGetROIDataWithStrides and IcsGetDataWithStrides, but convert the imels to
+   the data type `type` as they are read, without an intermediate copy of the
+   image. n is the size of dest in bytes. Values are multiplied by the scale and
+   added to the offset set with IcsSetConversionScale. When converting to an
+   integer type, values are rounded to nearest, and values out of range are
+   clipped. Complex data can only be converted to a complex type. Only valid if
+   reading. */
+ICSEXPORT Ics_Error IcsGetDataAs(ICS          *ics,
+                                 Ics_DataType  type,
+                                 void         *dest,
+                                 size_t        n);
+ICSEXPORT Ics_Error IcsGetROIDataAs(ICS          *ics,
+                                    const size_t *offset,
+                                    const size_t *size,
+                                    const size_t *sampling,
+                                    Ics_DataType  type,
+                                    void         *dest,
+                                    size_t        n);
+ICSEXPORT Ics_Error IcsGetROIDataWithStridesAs(ICS             *ics,
+                                               const size_t    *offset,
+                                               const size_t    *size,
+                                               const size_t    *sampling,
+                                               Ics_DataType     type,
+                                               void            *dest,
+                                               size_t           n,
+                                               const ptrdiff_t *stride,
+                                               int              nDims);
+ICSEXPORT Ics_Error IcsGetDataWithStridesAs(ICS             *ics,
+                                            Ics_DataType     type,
+                                            void            *dest,
+                                            size_t           n, // ignored
+                                            const ptrdiff_t *stride,
+                                            int              nDims);
+
+
+/* Set the scale and offset applied to imels converted to another data type,
+   when reading or when writing data given with IcsSetDataAs: the result is
+   value * scale + offset. The default is 1 and 0. */
+ICSEXPORT Ics_Error IcsSetConversionScale(ICS    *ics,
+                                          double  scale,
+                                          double  offset);
+
+
+/* Map the image data of an ICS file into memory. `data` is set to point at the
+   read-only data, and, if not NULL, `strides` (an array with as many elements
+   as the image has dimensions) is filled with the strides of the data, in
+   imels. Uncompressed data is mapped directly from the file, and pages are read
+   on demand; if its byte order differs from the machine's, a private copy of
+   the mapping is reordered. Compressed data is read into a newly allocated
+   buffer. The pointer is valid until IcsUnmapData or IcsClose is called. Only
+   valid if reading. */
+ICSEXPORT Ics_Error IcsMapData(ICS         *ics,
+                               const void **data,
+                               ptrdiff_t   *strides);
+
+
+/* Release the memory obtained through IcsMapData. Only valid if reading. */
+ICSEXPORT Ics_Error IcsUnmapData(ICS *ics);
+
+
 /* Read a portion of the image data from an ICS file. Only valid if reading. */
 ICSEXPORT Ics_Error IcsGetDataBlock(ICS   *ics,
                                     void  *dest,
@@ -781,6 +976,36 @@ ICSEXPORT Ics_Error IcsSetDataWithStrides(ICS             *ics,
                                           const ptrdiff_t *strides,
                                           int              nDims);
 
+
+/* Set the image data for an ICS image, given as imels of type `type`. The data
+   is converted to the type set with IcsSetLayout while it is written, a block
+   at a time, applying the scale and offset set with IcsSetConversionScale.
+   When converting to an integer type, values are rounded to nearest, and
+   values out of range are clipped. n is the size of src in bytes. The pointer
+   to this data must be accessible until IcsClose has been called. Only valid
+   if writing. */
+ICSEXPORT Ics_Error IcsSetDataAs(ICS          *ics,
+                                 Ics_DataType  type,
+                                 const void   *src,
+                                 size_t        n);
+
+/* Write the header and prepare for writing the image data in blocks with
+   IcsWriteDataBlock, instead of giving all data with IcsSetData. All other
+   parameters must have been set before this call. Only valid if writing. */
+ICSEXPORT Ics_Error IcsOpenWriteStream(ICS *ics);
+
+/* Append n bytes of image data, in the order in which they are stored in the
+   file. The blocks need not contain whole lines or planes. Only valid after
+   IcsOpenWriteStream. */
+ICSEXPORT Ics_Error IcsWriteDataBlock(ICS        *ics,
+                                      const void *src,
+                                      size_t      n);
+
+/* Finish writing the image data started with IcsOpenWriteStream. Called by
+   IcsClose if needed. Returns IcsErr_FSizeConflict if less data was written
+   than the image size. */
+ICSEXPORT Ics_Error IcsFinishWrite(ICS *ics);
+
 /* Set the image source parameter for an ICS version 2.0 file. Only valid if
    writing. */
 ICSEXPORT Ics_Error IcsSetSource(ICS        *ics,
@@ -794,6 +1019,13 @@ ICSEXPORT Ics_Error IcsSetSource(ICS        *ics,
 ICSEXPORT Ics_Error IcsSetByteOrder(ICS           *ics,
                                     Ics_ByteOrder  order);
 
+/* Reserve n bytes of padding after the header of an ICS version 2.0 file that
+   contains the image data. When the file is later opened for updating, the
+   header is rewritten in place if it still fits, instead of copying the data.
+   Valid if writing or updating. */
+ICSEXPORT Ics_Error IcsSetHeaderPadding(ICS    *ics,
+                                        size_t  n);
+
 
 /* Set the compression method and compression parameter. Only valid if
    writing. */
@@ -802,6 +1034,58 @@ ICSEXPORT Ics_Error IcsSetCompression(ICS             *ics,
                                       int              level);
 
 
+/* Set the number of threads used to compress the data. With more than one
+   thread, gzip data is compressed in independent blocks that together form a
+   standard gzip stream. When reading chunked data, this is the number of
+   threads used to decompress chunks. 0 means one thread per processor. The
+   default is 1. Valid if writing or reading. */
+ICSEXPORT Ics_Error IcsSetCompressionThreads(ICS *ics,
+                                             int  nThreads);
+
+
+/* Set the size of the chunks that the data is split into when using
+   IcsCompr_chunked_gzip. The chunkSize array has one element per dimension; a
+   value of 0 selects the default size of ICS_CHUNK_SIZE imels. Only valid if
+   writing, after calling IcsSetLayout. */
+ICSEXPORT Ics_Error IcsSetChunkSize(ICS          *ics,
+                                    const size_t *chunkSize);
+
+
+/* Get the size of the chunks in which the data is stored, one element per
+   dimension. Only meaningful for IcsCompr_chunked_gzip. */
+ICSEXPORT Ics_Error IcsGetChunkSize(const ICS *ics,
+                                    size_t    *chunkSize);
+
+
+/* Set the filter applied to the data before compression. The filter rearranges
+   the bytes or bits of each image line (or of each chunk, for
+   IcsCompr_chunked_gzip) so that similar bytes are stored together, which
+   usually compresses better. It is ignored for uncompressed data. Only valid if
+   writing. */
+ICSEXPORT Ics_Error IcsSetFilter(ICS        *ics,
+                                 Ics_Filter  filter);
+
+
+/* Get the filter applied to the data before compression. */
+ICSEXPORT Ics_Error IcsGetFilter(const ICS  *ics,
+                                 Ics_Filter *filter);
+
+
+/* Set the predictor applied to the data before compression. With
+   IcsPredictor_horizontal, each imel is replaced by its difference with the
+   previous imel in the same image line, which makes smooth integer images
+   compress better. Each line starts anew, so random access is not affected. It
+   is ignored for uncompressed data and for data types other than integers, and
+   is applied before the filter. Only valid if writing. */
+ICSEXPORT Ics_Error IcsSetPredictor(ICS           *ics,
+                                    Ics_Predictor  predictor);
+
+
+/* Get the predictor applied to the data before compression. */
+ICSEXPORT Ics_Error IcsGetPredictor(const ICS     *ics,
+                                    Ics_Predictor *predictor);
+
+
 /* Get the position of the image in the real world: the origin of the first
    pixel, the distances between pixels and the units in which to measure.  If
    you are not interested in one of the parameters, set the pointer to NULL.
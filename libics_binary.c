@@ -37,28 +37,350 @@
  * The following library functions are contained in this file:
  *
  *   IcsWriteIds()
+ *   IcsWriteIdsStream()
  *   IcsCopyIds()
+ *   IcsOpenIdsWrite()
+ *   IcsWriteIdsBlock()
+ *   IcsCloseIdsWrite()
  *   IcsOpenIds()
  *   IcsCloseIds()
  *   IcsReadIdsBlock()
  *   IcsSkipIdsBlock()
  *   IcsSetIdsBlock()
  *   IcsReadIds()
+ *   IcsReadIdsAt()
+ *   IcsReadIdsExtents()
+ *   IcsMapIds()
+ *   IcsUnmapIds()
+ *   IcsReorderIds()
  *
  * The following internal functions are contained in this file:
  *
  *   IcsWritePlainWithStrides()
+ *   IcsWriteIdsConverted()
+ *   IcsGatherImels()
+ *   IcsTransposeImels()
  *   IcsFillByteOrder()
  */
 
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* glibc declares copy_file_range() and preadv() only for
+                       GNU sources. This can't depend on HAVE_COPY_FILE_RANGE
+                       or HAVE_PREADV: with configure, those are defined in
+                       libics_conf.h, which is included later */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "libics_intern.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#if defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(HAVE_MMAP) || defined(HAVE_PREAD)
+#include <unistd.h>
+#endif
+#if defined(HAVE_PREADV)
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+/* Kernel-side copying of the image data, used by IcsCopyIds(). */
+#if defined(__linux__) && (defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE))
+#define ICS_KERNEL_COPY
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+#endif
+#endif
+
+/* Vector instructions for byte swapping. On x86 the instruction set is selected
+   at run time. */
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define ICS_X86_SIMD
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define ICS_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+
+/* Side of the square tiles in which IcsTransposeImels copies the data, in
+   imels. A tile of the largest imels fits comfortably in the L1 cache. */
+#define ICS_TRANSPOSE_TILE 32
+
+/* Number of bytes into which binary imels are packed at a time when they are
+   written. */
+#define ICS_PACK_BUF_SIZE 4096
+
+
+/* Copy n imels of nBytes bytes each, stride bytes apart, to the contiguous
+   buffer dest. */
+void IcsGatherImels(const char *src,
+                    ptrdiff_t   stride,
+                    size_t      n,
+                    int         nBytes,
+                    char       *dest)
+{
+    size_t i;
+
+
+    if (stride == nBytes) {
+        memcpy(dest, src, n * (size_t)nBytes);
+        return;
+    }
+        /* Constant sizes let the compiler replace memcpy with a single move */
+    switch (nBytes) {
+        case 1:
+            for (i = 0; i < n; i++, src += stride) dest[i] = *src;
+            break;
+        case 2:
+            for (i = 0; i < n; i++, src += stride) memcpy(dest + 2 * i, src, 2);
+            break;
+        case 4:
+            for (i = 0; i < n; i++, src += stride) memcpy(dest + 4 * i, src, 4);
+            break;
+        case 8:
+            for (i = 0; i < n; i++, src += stride) memcpy(dest + 8 * i, src, 8);
+            break;
+        default:
+            for (i = 0; i < n; i++, src += stride) {
+                memcpy(dest + i * (size_t)nBytes, src, (size_t)nBytes);
+            }
+    }
+}
+
+
+#if defined(ICS_X86_SIMD)
+
+/* Transpose an 8x8 block of 2-byte imels using SSE2 instructions. The rows of
+   the block are srcRow bytes apart in src, and the rows of the result destRow
+   bytes apart in dest. */
+__attribute__((target("sse2")))
+static void icsTranspose8x8SSE2(const char *src,
+                                ptrdiff_t   srcRow,
+                                char       *dest,
+                                ptrdiff_t   destRow)
+{
+    __m128i a[8], b[8];
+    int     k;
+
+
+    for (k = 0; k < 8; k++) {
+        a[k] = _mm_loadu_si128((const __m128i*)(src + k * srcRow));
+    }
+    for (k = 0; k < 8; k += 2) {
+        b[k] = _mm_unpacklo_epi16(a[k], a[k + 1]);
+        b[k + 1] = _mm_unpackhi_epi16(a[k], a[k + 1]);
+    }
+    for (k = 0; k < 8; k += 4) {
+        a[k] = _mm_unpacklo_epi32(b[k], b[k + 2]);
+        a[k + 1] = _mm_unpackhi_epi32(b[k], b[k + 2]);
+        a[k + 2] = _mm_unpacklo_epi32(b[k + 1], b[k + 3]);
+        a[k + 3] = _mm_unpackhi_epi32(b[k + 1], b[k + 3]);
+    }
+    for (k = 0; k < 4; k++) {
+        b[2 * k] = _mm_unpacklo_epi64(a[k], a[k + 4]);
+        b[2 * k + 1] = _mm_unpackhi_epi64(a[k], a[k + 4]);
+    }
+    for (k = 0; k < 8; k++) {
+        _mm_storeu_si128((__m128i*)(dest + k * destRow), b[k]);
+    }
+}
+
+
+/* Transpose a 4x4 block of 4-byte imels using SSE2 instructions, as
+   icsTranspose8x8SSE2. */
+__attribute__((target("sse2")))
+static void icsTranspose4x4SSE2(const char *src,
+                                ptrdiff_t   srcRow,
+                                char       *dest,
+                                ptrdiff_t   destRow)
+{
+    __m128i a0, a1, a2, a3, b0, b1, b2, b3;
+
+
+    a0 = _mm_loadu_si128((const __m128i*)src);
+    a1 = _mm_loadu_si128((const __m128i*)(src + srcRow));
+    a2 = _mm_loadu_si128((const __m128i*)(src + 2 * srcRow));
+    a3 = _mm_loadu_si128((const __m128i*)(src + 3 * srcRow));
+    b0 = _mm_unpacklo_epi32(a0, a1);
+    b1 = _mm_unpackhi_epi32(a0, a1);
+    b2 = _mm_unpacklo_epi32(a2, a3);
+    b3 = _mm_unpackhi_epi32(a2, a3);
+    _mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi64(b0, b2));
+    _mm_storeu_si128((__m128i*)(dest + destRow), _mm_unpackhi_epi64(b0, b2));
+    _mm_storeu_si128((__m128i*)(dest + 2 * destRow), _mm_unpacklo_epi64(b1, b3));
+    _mm_storeu_si128((__m128i*)(dest + 3 * destRow), _mm_unpackhi_epi64(b1, b3));
+}
+
+#endif
+
+
+/* Copy the imels [i0, iEnd) of the lines [j0, jEnd), for IcsTransposeImels.
+   The loops are specialised for the common imel sizes. */
+static void icsCopyImels(const char *src,
+                         ptrdiff_t   srcStride,
+                         ptrdiff_t   srcLineStride,
+                         char       *dest,
+                         ptrdiff_t   destStride,
+                         ptrdiff_t   destLineStride,
+                         size_t      i0,
+                         size_t      iEnd,
+                         size_t      j0,
+                         size_t      jEnd,
+                         int         nBytes)
+{
+    size_t      i, j;
+    const char *s;
+    char       *d;
+
+
+    for (i = i0; i < iEnd; i++) {
+        s = src + (ptrdiff_t)i * srcStride + (ptrdiff_t)j0 * srcLineStride;
+        d = dest + (ptrdiff_t)i * destStride + (ptrdiff_t)j0 * destLineStride;
+        switch (nBytes) {
+            case 1:
+                for (j = j0; j < jEnd; j++) {
+                    *d = *s;
+                    s += srcLineStride;
+                    d += destLineStride;
+                }
+                break;
+            case 2:
+                for (j = j0; j < jEnd; j++) {
+                    memcpy(d, s, 2);
+                    s += srcLineStride;
+                    d += destLineStride;
+                }
+                break;
+            case 4:
+                for (j = j0; j < jEnd; j++) {
+                    memcpy(d, s, 4);
+                    s += srcLineStride;
+                    d += destLineStride;
+                }
+                break;
+            case 8:
+                for (j = j0; j < jEnd; j++) {
+                    memcpy(d, s, 8);
+                    s += srcLineStride;
+                    d += destLineStride;
+                }
+                break;
+            case 16:
+                for (j = j0; j < jEnd; j++) {
+                    memcpy(d, s, 16);
+                    s += srcLineStride;
+                    d += destLineStride;
+                }
+                break;
+            default:
+                for (j = j0; j < jEnd; j++) {
+                    memcpy(d, s, (size_t)nBytes);
+                    s += srcLineStride;
+                    d += destLineStride;
+                }
+        }
+    }
+}
+
+
+/* Copy nLines lines of n imels each from src to dest. Imel i of line j is
+   found at byte offset i * srcStride + j * srcLineStride in src, and written
+   at i * destStride + j * destLineStride in dest. This is used to gather lines
+   from, or scatter them to, memory in which the lines are closer together
+   than the imels within a line, as in a transposed image. The copy is done
+   in square tiles, so that both the reads and the writes stay within a few
+   cache lines. Where one side is contiguous along the lines and the other
+   along the imels, 2- and 4-byte imels are transposed in vector registers. */
+void IcsTransposeImels(const char *src,
+                       ptrdiff_t   srcStride,
+                       ptrdiff_t   srcLineStride,
+                       char       *dest,
+                       ptrdiff_t   destStride,
+                       ptrdiff_t   destLineStride,
+                       size_t      n,
+                       size_t      nLines,
+                       int         nBytes)
+{
+    size_t    i0, j0, iEnd, jEnd;
+#if defined(ICS_X86_SIMD)
+    size_t    i, j, iBlocks, jBlocks, block = 0;
+    ptrdiff_t srcRow = 0, destRow = 0;
+#endif
+
+
+#if defined(ICS_X86_SIMD)
+    if ((nBytes == 2 || nBytes == 4) && __builtin_cpu_supports("sse2")) {
+        if (srcLineStride == nBytes && destStride == nBytes) {
+                /* Rows of the block are lines of dest */
+            srcRow = srcStride;
+            destRow = destLineStride;
+            block = nBytes == 2 ? 8 : 4;
+        } else if (srcStride == nBytes && destLineStride == nBytes) {
+                /* Rows of the block are lines of src */
+            srcRow = srcLineStride;
+            destRow = destStride;
+            block = nBytes == 2 ? 8 : 4;
+        }
+    }
+#endif
+
+    for (i0 = 0; i0 < n; i0 += ICS_TRANSPOSE_TILE) {
+        iEnd = i0 + ICS_TRANSPOSE_TILE < n ? i0 + ICS_TRANSPOSE_TILE : n;
+        for (j0 = 0; j0 < nLines; j0 += ICS_TRANSPOSE_TILE) {
+            jEnd = j0 + ICS_TRANSPOSE_TILE < nLines ?
+                   j0 + ICS_TRANSPOSE_TILE : nLines;
+#if defined(ICS_X86_SIMD)
+            if (block > 0) {
+                iBlocks = i0 + (iEnd - i0) / block * block;
+                jBlocks = j0 + (jEnd - j0) / block * block;
+                for (i = i0; i < iBlocks; i += block) {
+                    for (j = j0; j < jBlocks; j += block) {
+                        const char *s = src + (ptrdiff_t)i * srcStride +
+                                        (ptrdiff_t)j * srcLineStride;
+                        char       *d = dest + (ptrdiff_t)i * destStride +
+                                        (ptrdiff_t)j * destLineStride;
+                        if (block == 8) {
+                            icsTranspose8x8SSE2(s, srcRow, d, destRow);
+                        } else {
+                            icsTranspose4x4SSE2(s, srcRow, d, destRow);
+                        }
+                    }
+                }
+                    /* The edges of the tile that do not fill a block */
+                icsCopyImels(src, srcStride, srcLineStride, dest, destStride,
+                             destLineStride, i0, iBlocks, jBlocks, jEnd,
+                             nBytes);
+                icsCopyImels(src, srcStride, srcLineStride, dest, destStride,
+                             destLineStride, iBlocks, iEnd, j0, jEnd, nBytes);
+                continue;
+            }
+#endif
+            icsCopyImels(src, srcStride, srcLineStride, dest, destStride,
+                         destLineStride, i0, iEnd, j0, jEnd, nBytes);
+        }
+    }
+}
+
 
-/* Write uncompressed data, with strides. */
+/* Write uncompressed data, with strides. The lines along the first dimension
+   are gathered in a buffer, which is written when full. If the second
+   dimension is closer together in memory than the first, as when the two are
+   swapped, consecutive lines are gathered together by a transposing copy. */
 Ics_Error IcsWritePlainWithStrides(const void      *src,
                                    const size_t    *dim,
                                    const ptrdiff_t *stride,
@@ -69,10 +391,27 @@ Ics_Error IcsWritePlainWithStrides(const void      *src,
     ICSINIT;
     size_t      curpos[ICS_MAXDIM];
     const char *data;
-    int         i;
-    size_t      j;
+    char       *buf;
+    int         i, transposed;
+    size_t      lineSize = dim[0] * (size_t)nBytes;
+    size_t      bufLines, nLines, count = 0;
 
 
+    if (lineSize == 0) return error;
+    if (stride[0] == 1 && lineSize >= ICS_STRIDE_BUF_SIZE) {
+            /* Lines are long enough to be written directly */
+        buf = NULL;
+        bufLines = 1;
+    } else {
+        bufLines = lineSize < ICS_STRIDE_BUF_SIZE ?
+                   ICS_STRIDE_BUF_SIZE / lineSize : 1;
+        buf = (char*)malloc(bufLines * lineSize);
+        if (buf == NULL) return IcsErr_Alloc;
+    }
+    transposed = nDims > 1 && stride[0] != 1 &&
+                 (stride[1] < 0 ? -stride[1] : stride[1]) <
+                 (stride[0] < 0 ? -stride[0] : stride[0]);
+
     for (i = 0; i < nDims; i++) {
         curpos[i] = 0;
     }
@@ -81,17 +420,31 @@ Ics_Error IcsWritePlainWithStrides(const void      *src,
         for (i = 1; i < nDims; i++) {
             data += (ptrdiff_t)curpos[i] * stride[i] * nBytes;
         }
-        if (stride[0] == 1) {
+        if (buf == NULL) {
             if (fwrite(data, (size_t)nBytes, dim[0], file) != dim[0]) {
-                return IcsErr_FWriteIds;
+                error = IcsErr_FWriteIds;
+                break;
             }
+        } else if (transposed) {
+                /* As many lines along the 2nd dimension as fit */
+            nLines = dim[1] - curpos[1];
+            if (nLines > bufLines - count) nLines = bufLines - count;
+            IcsTransposeImels(data, stride[0] * nBytes, stride[1] * nBytes,
+                              buf + count * lineSize, nBytes,
+                              (ptrdiff_t)lineSize, dim[0], nLines, nBytes);
+            count += nLines;
+            curpos[1] += nLines - 1;
         } else {
-            for (j = 0; j < dim[0]; j++) {
-                if (fwrite(data, (size_t)nBytes, 1, file) != 1) {
-                    return IcsErr_FWriteIds;
-                }
-                data += stride[0] * nBytes;
-         }
+            IcsGatherImels(data, stride[0] * nBytes, dim[0], nBytes,
+                           buf + count * lineSize);
+            count++;
+        }
+        if (count == bufLines) {
+            if (fwrite(buf, lineSize, count, file) != count) {
+                error = IcsErr_FWriteIds;
+                break;
+            }
+            count = 0;
         }
         for (i = 1; i < nDims; i++) {
             curpos[i]++;
@@ -104,7 +457,13 @@ Ics_Error IcsWritePlainWithStrides(const void      *src,
             break;
         }
     }
+    if (!error && count > 0) {
+        if (fwrite(buf, lineSize, count, file) != count) {
+            error = IcsErr_FWriteIds;
+        }
+    }
 
+    free(buf);
     return error;
 }
 
@@ -113,11 +472,9 @@ Ics_Error IcsWritePlainWithStrides(const void      *src,
 Ics_Error IcsWriteIds(const Ics_Header *icsStruct)
 {
     ICSINIT;
-    FILE   *fp;
-    char    filename[ICS_MAXPATHLEN];
-    char    mode[3] = "wb";
-    int     i;
-    size_t  dim[ICS_MAXDIM];
+    FILE            *fp;
+    char             filename[ICS_MAXPATHLEN];
+    char             mode[4] = "wb";
 
 
     if (icsStruct->version == 1) {
@@ -126,7 +483,11 @@ Ics_Error IcsWriteIds(const Ics_Header *icsStruct)
         if (icsStruct->srcFile[0] != '\0') return IcsErr_Ok;
             /* Do nothing: the data is in another file somewhere */
         IcsStrCpy(filename, icsStruct->filename, ICS_MAXPATHLEN);
-        mode[0] = 'a'; /* Open for append */
+        if (icsStruct->compression == IcsCompr_chunked_gzip) {
+            strcpy(mode, "r+b"); /* Need to go back to write the table */
+        } else {
+            mode[0] = 'a'; /* Open for append */
+        }
     }
     if ((icsStruct->data == NULL) || (icsStruct->dataLength == 0))
         return IcsErr_MissingData;
@@ -134,9 +495,49 @@ Ics_Error IcsWriteIds(const Ics_Header *icsStruct)
     fp = IcsFOpen(filename, mode);
     if (fp == NULL) return IcsErr_FOpenIds;
 
+    error = IcsWriteIdsStream(icsStruct, fp);
+
+    if (fclose (fp) == EOF) {
+        if (!error) error = IcsErr_FCloseIds; /* Don't overwrite any previous error. */
+    }
+    return error;
+}
+
+
+/* Write the data to fp, at the end of what has been written so far. */
+Ics_Error IcsWriteIdsStream(const Ics_Header *icsStruct,
+                            FILE             *fp)
+{
+    ICSINIT;
+    int              i;
+    size_t           dim[ICS_MAXDIM];
+    ptrdiff_t        stride[ICS_MAXDIM];
+    const ptrdiff_t *strides = icsStruct->dataStrides;
+    Ics_Filter       filter  = IcsGetActiveFilter(icsStruct);
+    Ics_Predictor    predictor = IcsGetActivePredictor(icsStruct);
+
+
+    if (((icsStruct->dataType != Ics_unknown) &&
+         ((icsStruct->dataType != icsStruct->imel.dataType) ||
+          (icsStruct->convScale != 1.0) || (icsStruct->convOffset != 0.0))) ||
+        (icsStruct->imel.dataType == Ics_binary)) {
+            /* The data is given in another type, see IcsSetDataAs, or needs
+               to be packed into bits */
+        return IcsWriteIdsConverted(icsStruct, fp);
+    }
     for (i=0; i<icsStruct->dimensions; i++) {
         dim[i] = icsStruct->dim[i].size;
     }
+    if ((filter != IcsFilter_none || predictor != IcsPredictor_none) &&
+        strides == NULL) {
+            /* The filter and predictor are applied line by line by the strided
+               writers */
+        stride[0] = 1;
+        for (i = 1; i < icsStruct->dimensions; i++) {
+            stride[i] = stride[i - 1] * (ptrdiff_t)dim[i - 1];
+        }
+        strides = stride;
+    }
     switch (icsStruct->compression) {
         case IcsCompr_uncompressed:
             if (icsStruct->dataStrides) {
@@ -170,29 +571,126 @@ Ics_Error IcsWriteIds(const Ics_Header *icsStruct)
             break;
 #ifdef ICS_ZLIB
         case IcsCompr_gzip:
-            if (icsStruct->dataStrides) {
+            if (IcsGetCompressionThreads(icsStruct) > 1) {
                 size_t size = IcsGetDataTypeSize(icsStruct->imel.dataType);
-                error = IcsWriteZipWithStrides(icsStruct->data, dim,
-                                               icsStruct->dataStrides,
+                error = IcsWriteZipParallel(icsStruct->data,
+                                            IcsGetDataSize(icsStruct), dim,
+                                            strides, icsStruct->dimensions,
+                                            (int)size, filter, predictor,
+                                            fp, icsStruct->compLevel,
+                                            IcsGetCompressionThreads(icsStruct));
+            } else if (strides) {
+                size_t size = IcsGetDataTypeSize(icsStruct->imel.dataType);
+                error = IcsWriteZipWithStrides(icsStruct->data, dim, strides,
                                                icsStruct->dimensions,
-                                               (int)size, fp, icsStruct->compLevel);
+                                               (int)size, filter, predictor,
+                                               fp, icsStruct->compLevel);
             } else {
                 error = IcsWriteZip(icsStruct->data, icsStruct->dataLength, fp,
                                     icsStruct->compLevel);
             }
             break;
+        case IcsCompr_chunked_gzip:
+            error = IcsWriteChunks(icsStruct, icsStruct->data,
+                                   icsStruct->dataStrides, fp);
+            break;
+#endif
+#ifdef ICS_ZSTD
+        case IcsCompr_zstd:
+            if (strides) {
+                size_t size = IcsGetDataTypeSize(icsStruct->imel.dataType);
+                error = IcsWriteZstdWithStrides(icsStruct->data, dim, strides,
+                                                icsStruct->dimensions,
+                                                (int)size, filter, predictor,
+                                                fp, icsStruct->compLevel,
+                                                IcsGetCompressionThreads(icsStruct));
+            } else {
+                error = IcsWriteZstd(icsStruct->data, icsStruct->dataLength,
+                                     fp, icsStruct->compLevel,
+                                     IcsGetCompressionThreads(icsStruct));
+            }
+            break;
 #endif
         default:
             error = IcsErr_UnknownCompression;
     }
 
-    if (fclose (fp) == EOF) {
-        if (!error) error = IcsErr_FCloseIds; /* Don't overwrite any previous error. */
-    }
     return error;
 }
 
 
+#ifdef ICS_KERNEL_COPY
+/* Append the data in `in` from inoffset to the end of `out` without moving it
+   through user space. copy_file_range() is tried first; on file systems that
+   support it (XFS, btrfs) it shares the blocks between the two files instead of
+   copying them. sendfile() is tried next. Any failure simply stops the kernel
+   copy; the streams are then positioned so that the caller can copy the
+   remainder with stdio, which also reports genuine I/O errors. *done is set if
+   all data was copied. */
+static Ics_Error icsKernelCopy(FILE   *in,
+                               size_t  inoffset,
+                               FILE   *out,
+                               int    *done)
+{
+    int         inFd   = fileno(in);
+    int         outFd  = fileno(out);
+    int         flags;
+    struct stat st;
+    size_t      inPos  = inoffset;
+    size_t      outPos;
+    size_t      inSize;
+    ssize_t     n;
+
+
+    *done = 0;
+    if (fstat(inFd, &st) != 0) return IcsErr_Ok;
+    inSize = (size_t)st.st_size;
+    if (fflush(out) != 0 || fstat(outFd, &st) != 0) return IcsErr_Ok;
+    outPos = (size_t)st.st_size;
+
+        /* The output is opened for appending, which copy_file_range()
+           refuses. We write at explicit offsets past its end instead. */
+    flags = fcntl(outFd, F_GETFL);
+    if (flags == -1 || fcntl(outFd, F_SETFL, flags & ~O_APPEND) == -1) {
+        return IcsErr_Ok;
+    }
+
+#if defined(HAVE_COPY_FILE_RANGE)
+    while (inPos < inSize) {
+        loff_t inOff  = (loff_t)inPos;
+        loff_t outOff = (loff_t)outPos;
+
+        n = copy_file_range(inFd, &inOff, outFd, &outOff, inSize - inPos, 0);
+        if (n <= 0) break;
+        inPos += (size_t)n;
+        outPos += (size_t)n;
+    }
+#endif
+#if defined(HAVE_SENDFILE)
+        /* sendfile() writes at the current position of the output. */
+    if (inPos < inSize && lseek(outFd, (off_t)outPos, SEEK_SET) != -1) {
+        while (inPos < inSize) {
+            off_t inOff = (off_t)inPos;
+
+            n = sendfile(outFd, inFd, &inOff, inSize - inPos);
+            if (n <= 0) break;
+            inPos += (size_t)n;
+            outPos += (size_t)n;
+        }
+    }
+#endif
+
+        /* Put the streams where the kernel stopped. */
+    if (ICSFSEEK(in, (ptrdiff_t)inPos, SEEK_SET) != 0 ||
+        ICSFSEEK(out, 0, SEEK_END) != 0) {
+        return IcsErr_FCopyIds;
+    }
+    *done = inPos >= inSize;
+    return IcsErr_Ok;
+}
+#endif
+
+
 /* Append image data from infilename at inoffset to outfilename. If outfilename
    is a .ics file it must end with the END keyword. */
 Ics_Error IcsCopyIds(const char *infilename,
@@ -200,15 +698,17 @@ Ics_Error IcsCopyIds(const char *infilename,
                      const char *outfilename)
 {
     ICSINIT;
-    FILE   *in     = NULL;
-    FILE   *out    = NULL;
-    char   *buffer = NULL;
-    int     done   = 0;
-    size_t  n;
+    FILE         *in     = NULL;
+    FILE         *out    = NULL;
+    Ics_IoStream *inIo   = NULL;
+    Ics_IoStream *outIo  = NULL;
+    char         *buffer = NULL;
+    int           done   = 0;
+    size_t        n;
 
 
         /* Open files */
-    in = IcsFOpen(infilename, "rb");
+    in = IcsFOpenIo(infilename, "rb", &inIo);
     if (in == NULL) {
         error = IcsErr_FCopyIds;
         goto exit;
@@ -217,22 +717,28 @@ Ics_Error IcsCopyIds(const char *infilename,
         error = IcsErr_FCopyIds;
         goto exit;
     }
-    out = IcsFOpen(outfilename, "ab");
+    out = IcsFOpenIo(outfilename, "ab", &outIo);
     if (out == NULL) {
         error = IcsErr_FCopyIds;
         goto exit;
     }
-        /* Create an output buffer */
-    buffer = (char*)malloc(ICS_BUF_SIZE);
+#ifdef ICS_KERNEL_COPY
+    if (inIo == NULL && outIo == NULL) {
+        error = icsKernelCopy(in, inoffset, out, &done);
+        if (error || done) goto exit;
+    }
+#endif
+        /* Copy whatever is left through a buffer */
+    buffer = (char*)malloc(ICS_COPY_BUF_SIZE);
     if (buffer == NULL) {
         error = IcsErr_Alloc;
         goto exit;
     }
     while (!done) {
-        n = fread(buffer, 1, ICS_BUF_SIZE, in);
+        n = fread(buffer, 1, ICS_COPY_BUF_SIZE, in);
         if (feof (in)) {
             done = 1;
-        } else if (n != ICS_BUF_SIZE) {
+        } else if (n != ICS_COPY_BUF_SIZE) {
             error = IcsErr_FCopyIds;
             goto exit;
         }
@@ -245,117 +751,723 @@ Ics_Error IcsCopyIds(const char *infilename,
   exit:
     if (buffer) free(buffer);
     if (in) fclose(in);
-    if (out) fclose(out);
+    if (out) {
+        if (fclose(out) == EOF && !error) error = IcsErr_FCopyIds;
+    }
     return error;
 }
 
 
-/* Check if a file exist. */
-static int IcsExistFile(const char *filename)
+/* Get the size in bytes of the lines along the first dimension, which is the
+   unit to which the filter and predictor are applied. */
+static size_t icsLineSize(const Ics_Header *icsStruct)
 {
-    FILE *fp;
+    size_t size = IcsGetDataTypeSize(icsStruct->imel.dataType);
 
 
-    if ((fp = IcsFOpen(filename, "rb")) != NULL) {
-        fclose (fp);
-        return 1;
-    } else {
-        return 0;
-    }
+    if (icsStruct->dimensions > 0) size *= icsStruct->dim[0].size;
+    return size;
 }
 
 
-/* Find out if we are running on a little endian machine (Intel) or on a big
-   endian machine. On Intel CPUs the least significant byte is stored first in
-   memory. Returns: 1 if little endian; 0 big endian (e.g. MIPS). */
-static int IcsIsLittleEndianMachine(void)
+/* Prepare for writing the data described by icsStruct in blocks to fp, which
+   has been opened already. The state of the block writer is returned in
+   *bwPtr. */
+static Ics_Error icsStartBlockWrite(const Ics_Header  *icsStruct,
+                                    FILE              *fp,
+                                    Ics_BlockWrite   **bwPtr)
 {
-    int i = 1;
-    char *cptr = (char*)&i;
-    return (*cptr == 1);
-}
+    ICSINIT;
+    Ics_BlockWrite *bw;
 
 
-/* Fill the byte order array with the machine's byte order. */
-void IcsFillByteOrder(Ics_DataType dataType,
-                      int          bytes,
-                      int          machineByteOrder[ICS_MAX_IMEL_SIZE])
-{
-    if (IcsIsLittleEndianMachine()) {
-        IcsFillLittleEndianByteOrder(dataType, bytes, machineByteOrder);
-    } else {
-        IcsFillBigEndianByteOrder(dataType, bytes, machineByteOrder);
+    bw = (Ics_BlockWrite*)malloc(sizeof(Ics_BlockWrite));
+    if (bw == NULL) return IcsErr_Alloc;
+#ifdef ICS_ZLIB
+    bw->zlibStream = NULL;
+#endif
+#ifdef ICS_ZSTD
+    bw->zstdStream = NULL;
+#endif
+    bw->lineBuf = NULL;
+    bw->written = 0;
+    bw->bitByte = 0;
+    if (IcsGetActiveFilter(icsStruct) != IcsFilter_none ||
+        IcsGetActivePredictor(icsStruct) != IcsPredictor_none) {
+        bw->lineBuf = malloc(3 * icsLineSize(icsStruct));
+        if (bw->lineBuf == NULL) {
+            free(bw);
+            return IcsErr_Alloc;
+        }
+    }
+    bw->dataFilePtr = fp;
+
+    switch (icsStruct->compression) {
+        case IcsCompr_uncompressed:
+            break;
+#ifdef ICS_ZLIB
+        case IcsCompr_gzip:
+            error = IcsOpenZipWrite(icsStruct, bw);
+            break;
+#endif
+#ifdef ICS_ZSTD
+        case IcsCompr_zstd:
+            error = IcsOpenZstdWrite(icsStruct, bw);
+            break;
+#endif
+        default:
+                /* Chunks cannot be compressed until all their lines are
+                   there */
+            error = IcsErr_UnknownCompression;
     }
+    if (error) {
+        free(bw->lineBuf);
+        free(bw);
+        return error;
+    }
+
+    *bwPtr = bw;
+    return error;
 }
 
-/* Fill the byte order array with little endian byte order. */
-void IcsFillLittleEndianByteOrder(Ics_DataType dataType,
-                                  int          bytes,
-                                  int          byteOrder[ICS_MAX_IMEL_SIZE])
+
+/* Open the IDS file for writing the data in blocks. The ICS file must have
+   been written already. */
+Ics_Error IcsOpenIdsWrite(Ics_Header *icsStruct)
 {
-    int i;
-   (void) dataType; /* Not used, but kept as input for consistency. */
+    ICSINIT;
+    FILE           *fp;
+    Ics_BlockWrite *bw;
+    char            filename[ICS_MAXPATHLEN];
+    const char     *mode = "wb";
 
 
-    if (bytes > ICS_MAX_IMEL_SIZE) {
-            /* This will cause problems if undetected, */
-            /* but shouldn't happen anyway */
-        bytes = ICS_MAX_IMEL_SIZE;
+    if (icsStruct->version == 1) {
+        IcsGetIdsName(filename, icsStruct->filename);
+    } else {
+        IcsStrCpy(filename, icsStruct->filename, ICS_MAXPATHLEN);
+        mode = "ab";
     }
 
-    for (i = 0; i < bytes; i++) {
-        byteOrder[i] = 1 + i;
+    fp = IcsFOpen(filename, mode);
+    if (fp == NULL) return IcsErr_FOpenIds;
+    error = icsStartBlockWrite(icsStruct, fp, &bw);
+    if (error) {
+        fclose(fp);
+    } else {
+        icsStruct->blockWrite = bw;
     }
+
+    return error;
 }
 
-/* Fill the byte order array with big endian byte order. */
-void IcsFillBigEndianByteOrder(Ics_DataType dataType,
-                               int          bytes,
-                               int          byteOrder[ICS_MAX_IMEL_SIZE])
+
+/* Write a data block as it is to be stored in the file, compressing it if
+   needed. */
+static Ics_Error icsWriteBlock(const Ics_Header *icsStruct,
+                               Ics_BlockWrite   *bw,
+                               const void       *src,
+                               size_t            n)
 {
-    int i, hbytes;
+    ICSINIT;
 
 
-    if (bytes > ICS_MAX_IMEL_SIZE) {
-            /* This will cause problems if undetected, */
-            /* but shouldn't happen anyway */
-        bytes = ICS_MAX_IMEL_SIZE;
+    switch (icsStruct->compression) {
+        case IcsCompr_uncompressed:
+            if (fwrite(src, 1, n, bw->dataFilePtr) != n) {
+                error = IcsErr_FWriteIds;
+            }
+            break;
+#ifdef ICS_ZLIB
+        case IcsCompr_gzip:
+            error = IcsWriteZipBlock(bw, src, n);
+            break;
+#endif
+#ifdef ICS_ZSTD
+        case IcsCompr_zstd:
+            error = IcsWriteZstdBlock(bw, src, n);
+            break;
+#endif
+        default:
+            error = IcsErr_UnknownCompression;
     }
 
-    if (dataType == Ics_complex32 || dataType == Ics_complex64) {
-        hbytes = bytes/2;
-        for (i = 0; i < hbytes; i++) {
-            byteOrder[i]        = hbytes - i;
-            byteOrder[i+hbytes] = bytes - i;
+    return error;
+}
+
+
+/* Write a data block to filtered or predicted data. These are applied to each
+   line, so a line is gathered in bw->lineBuf until it is complete; whole lines
+   in src are encoded without copying them first. */
+static Ics_Error icsWriteLines(const Ics_Header *icsStruct,
+                               Ics_BlockWrite   *bw,
+                               const void       *src,
+                               size_t            n)
+{
+    ICSINIT;
+    Ics_Filter      filter    = IcsGetActiveFilter(icsStruct);
+    Ics_Predictor   predictor = IcsGetActivePredictor(icsStruct);
+    int             nBytes    = (int)IcsGetDataTypeSize(icsStruct->imel.dataType);
+    size_t          lineLen   = icsLineSize(icsStruct);
+    size_t          nImels    = lineLen / (size_t)nBytes;
+    char           *line      = (char*)bw->lineBuf;
+    char           *encoded   = line + lineLen;
+    const char     *p         = (const char*)src;
+    size_t          count;
+
+
+    while (n > 0) {
+        count = bw->written % lineLen;
+        if (count == 0 && n >= lineLen) {
+                /* A whole line */
+            IcsEncodeData(filter, predictor, p, encoded, nImels, nBytes);
+            count = lineLen;
+        } else {
+                /* Gather a partial line */
+            count = lineLen - count < n ? lineLen - count : n;
+            memcpy(line + bw->written % lineLen, p, count);
+            if ((bw->written + count) % lineLen == 0) {
+                IcsEncodeData(filter, predictor, line, encoded, nImels, nBytes);
+            }
         }
-    } else {
-        for (i = 0; i < bytes; i++) {
-            byteOrder[i] = bytes - i;
+        if ((bw->written + count) % lineLen == 0) {
+            error = icsWriteBlock(icsStruct, bw, encoded, lineLen);
+            if (error) return error;
         }
+        bw->written += count;
+        p += count;
+        n -= count;
     }
+
+    return error;
 }
 
 
-/* Reorder the bytes in the images as specified in the ByteOrder array. */
-static Ics_Error IcsReorderIds(char        *buf,
-                               size_t       length,
-                               Ics_DataType dataType,
-                               int          srcByteOrder[ICS_MAX_IMEL_SIZE],
-                               int          bytes)
+/* Write a data block to binary data, which is packed into bits. The imels
+   that do not fill a byte are kept in bw->bitByte until the byte is
+   complete. */
+static Ics_Error icsWriteBits(const Ics_Header *icsStruct,
+                              Ics_BlockWrite   *bw,
+                              const void       *src,
+                              size_t            n)
 {
     ICSINIT;
-    int  i;
-    size_t j, imels;
-    int  dstByteOrder[ICS_MAX_IMEL_SIZE];
-    char imel[ICS_MAX_IMEL_SIZE];
-    int  different = 0, empty = 0;
-
+    const unsigned char *p = (const unsigned char*)src;
+    unsigned char        packed[ICS_PACK_BUF_SIZE];
+    size_t               bit, count, i;
 
-    imels = length / (size_t)bytes;
-    if (length % (size_t)bytes != 0) return IcsErr_BitsVsSizeConfl;
 
-        /* Create destination byte order: */
-    IcsFillByteOrder(dataType, bytes, dstByteOrder);
+        /* The rest of the current byte */
+    bit = bw->written % 8;
+    if (bit != 0) {
+        count = 8 - bit < n ? 8 - bit : n;
+        for (i = 0; i < count; i++) {
+            if (p[i]) bw->bitByte |= (unsigned char)(1 << (bit + i));
+        }
+        p += count;
+        n -= count;
+        bw->written += count;
+        if (bw->written % 8 == 0) {
+            error = icsWriteBlock(icsStruct, bw, &bw->bitByte, 1);
+            if (error) return error;
+        }
+    }
+        /* Whole bytes */
+    while (n >= 8) {
+        count = n - n % 8;
+        if (count > 8 * ICS_PACK_BUF_SIZE) count = 8 * ICS_PACK_BUF_SIZE;
+        IcsPackBits(p, packed, count);
+        error = icsWriteBlock(icsStruct, bw, packed, count / 8);
+        if (error) return error;
+        p += count;
+        n -= count;
+        bw->written += count;
+    }
+        /* The start of the next byte */
+    if (n > 0) {
+        IcsPackBits(p, &bw->bitByte, n);
+        bw->written += n;
+    }
+
+    return error;
+}
+
+
+/* Append a data block to the data written with the block writer bw. */
+static Ics_Error icsAppendBlock(const Ics_Header *icsStruct,
+                                Ics_BlockWrite   *bw,
+                                const void       *src,
+                                size_t            n)
+{
+    ICSINIT;
+
+
+    if (bw->written + n > IcsGetDataSize(icsStruct)) return IcsErr_FSizeConflict;
+
+    if (icsStruct->imel.dataType == Ics_binary) {
+        return icsWriteBits(icsStruct, bw, src, n);
+    }
+    if (bw->lineBuf != NULL) {
+        return icsWriteLines(icsStruct, bw, src, n);
+    }
+
+    error = icsWriteBlock(icsStruct, bw, src, n);
+    if (!error) bw->written += n;
+
+    return error;
+}
+
+
+/* Append a data block to the IDS file opened with IcsOpenIdsWrite. */
+Ics_Error IcsWriteIdsBlock(Ics_Header *icsStruct,
+                           const void *src,
+                           size_t      n)
+{
+    return icsAppendBlock(icsStruct, (Ics_BlockWrite*)icsStruct->blockWrite,
+                          src, n);
+}
+
+
+/* Finish writing the data in blocks, flushing the compressed stream. The file
+   is not closed, nor is bw freed. */
+static Ics_Error icsEndBlockWrite(const Ics_Header *icsStruct,
+                                  Ics_BlockWrite   *bw)
+{
+    ICSINIT;
+
+
+    if ((icsStruct->imel.dataType == Ics_binary) && (bw->written % 8 != 0)) {
+            /* The last, partial byte of binary data */
+        error = icsWriteBlock(icsStruct, bw, &bw->bitByte, 1);
+    }
+    if (!error && (bw->written != IcsGetDataSize(icsStruct))) {
+        error = IcsErr_FSizeConflict;
+    }
+#ifdef ICS_ZLIB
+    if (bw->zlibStream != NULL) {
+        if (!error)
+            error = IcsCloseZipWrite(bw);
+        else
+            IcsCloseZipWrite(bw);
+    }
+#endif
+#ifdef ICS_ZSTD
+    if (bw->zstdStream != NULL) {
+        if (!error)
+            error = IcsCloseZstdWrite(bw);
+        else
+            IcsCloseZstdWrite(bw);
+    }
+#endif
+    free(bw->lineBuf);
+    bw->lineBuf = NULL;
+
+    return error;
+}
+
+
+/* Finish writing the IDS file opened with IcsOpenIdsWrite. The Ics_BlockWrite
+   structure is kept, with a NULL file pointer, so that IcsClose knows the data
+   has been written. */
+Ics_Error IcsCloseIdsWrite(Ics_Header *icsStruct)
+{
+    ICSINIT;
+    Ics_BlockWrite *bw = (Ics_BlockWrite*)icsStruct->blockWrite;
+
+
+    error = icsEndBlockWrite(icsStruct, bw);
+    if (fclose(bw->dataFilePtr) == EOF) {
+        if (!error) error = IcsErr_FCloseIds;
+    }
+    bw->dataFilePtr = NULL;
+
+    return error;
+}
+
+
+/* Write the data given with IcsSetDataAs, or binary data, to fp. The data is
+   gathered and converted to the type of the image a block at a time, into a
+   staging buffer that is passed on to the block writer, which packs binary
+   data into bits. The image is thus never held in memory in the file type.
+   Chunks can only be compressed once all their lines are there; for chunked
+   compression the data is converted as a whole. The state of the block writer
+   is kept here, so that icsStruct is not modified. */
+Ics_Error IcsWriteIdsConverted(const Ics_Header *icsStruct,
+                               FILE             *fp)
+{
+    ICSINIT;
+    Ics_BlockWrite *bw       = NULL;
+    Ics_DataType    destType = icsStruct->imel.dataType;
+    Ics_DataType    srcType  = icsStruct->dataType;
+    double          scale    = icsStruct->convScale;
+    double          offset   = icsStruct->convOffset;
+    size_t          srcSize, destSize;
+    size_t          count    = IcsGetImageSize(icsStruct);
+    size_t          dim[ICS_MAXDIM], curpos[ICS_MAXDIM];
+    ptrdiff_t       stride[ICS_MAXDIM];
+    size_t          bufImels, fill = 0, block, j;
+    int             nDims, i;
+    int             chunked  = 0;
+    const char     *src      = (const char*)icsStruct->data;
+    const char     *line, *p;
+    char           *buf, *gather = NULL;
+
+
+    if (srcType == Ics_unknown) {
+            /* Binary data given with IcsSetData */
+        srcType = destType;
+        scale = 1.0;
+        offset = 0.0;
+    }
+    srcSize = IcsGetDataTypeSize(srcType);
+    destSize = IcsGetDataTypeSize(destType);
+    if (srcSize == 0 || destSize == 0) return IcsErr_UnknownDataType;
+    if ((icsStruct->dataStrides == NULL) &&
+        (icsStruct->dataLength / srcSize < count))
+        return IcsErr_FSizeConflict;
+    if (icsStruct->compression == IcsCompr_chunked_gzip) {
+#ifdef ICS_ZLIB
+        if (destType == Ics_binary) return IcsErr_UnknownCompression;
+        chunked = 1;
+#else
+        return IcsErr_UnknownCompression;
+#endif
+    }
+
+    if (icsStruct->dataStrides != NULL) {
+        nDims = icsStruct->dimensions;
+        for (i = 0; i < nDims; i++) {
+            dim[i] = icsStruct->dim[i].size;
+            stride[i] = icsStruct->dataStrides[i];
+        }
+    } else {
+            /* A single line holding all the data */
+        nDims = 1;
+        dim[0] = count;
+        stride[0] = 1;
+    }
+    if (chunked) {
+        bufImels = count;
+    } else {
+        bufImels = ICS_CONVERT_BUF_SIZE /
+                   (srcSize > destSize ? srcSize : destSize);
+        if (bufImels == 0) bufImels = 1;
+    }
+    buf = (char*)malloc(bufImels * destSize);
+    if (buf == NULL) return IcsErr_Alloc;
+    if (stride[0] != 1) {
+        gather = (char*)malloc(bufImels * srcSize);
+        if (gather == NULL) {
+            free(buf);
+            return IcsErr_Alloc;
+        }
+    }
+    if (!chunked) {
+        error = icsStartBlockWrite(icsStruct, fp, &bw);
+        if (error) {
+            free(gather);
+            free(buf);
+            return error;
+        }
+    }
+
+    for (i = 0; i < nDims; i++) {
+        curpos[i] = 0;
+    }
+    while (!error) {
+        line = src;
+        for (i = 1; i < nDims; i++) {
+            line += (ptrdiff_t)curpos[i] * stride[i] * (ptrdiff_t)srcSize;
+        }
+        for (j = 0; !error && (j < dim[0]); j += block) {
+            block = dim[0] - j < bufImels - fill ? dim[0] - j : bufImels - fill;
+            p = line + (ptrdiff_t)j * stride[0] * (ptrdiff_t)srcSize;
+            if (gather != NULL) {
+                IcsGatherImels(p, stride[0] * (ptrdiff_t)srcSize, block,
+                               (int)srcSize, gather);
+                p = gather;
+            }
+            error = IcsConvertImels(p, srcType, buf + fill * destSize,
+                                    destType, block, scale, offset);
+            fill += block;
+            if (!error && !chunked && (fill == bufImels)) {
+                error = icsAppendBlock(icsStruct, bw, buf, fill * destSize);
+                fill = 0;
+            }
+        }
+        for (i = 1; i < nDims; i++) {
+            curpos[i]++;
+            if (curpos[i] < dim[i]) {
+                break;
+            }
+            curpos[i] = 0;
+        }
+        if (i == nDims) {
+            break;
+        }
+    }
+    if (chunked) {
+#ifdef ICS_ZLIB
+        if (!error) error = IcsWriteChunks(icsStruct, buf, NULL, fp);
+#endif
+    } else {
+        if (!error && (fill > 0)) {
+            error = icsAppendBlock(icsStruct, bw, buf, fill * destSize);
+        }
+        if (!error)
+            error = icsEndBlockWrite(icsStruct, bw);
+        else
+            icsEndBlockWrite(icsStruct, bw);
+        free(bw);
+    }
+    free(gather);
+    free(buf);
+
+    return error;
+}
+
+
+/* Check if a file exist. */
+static int IcsExistFile(const char *filename)
+{
+    FILE *fp;
+
+
+    if ((fp = IcsFOpen(filename, "rb")) != NULL) {
+        fclose (fp);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+
+/* Find out if we are running on a little endian machine (Intel) or on a big
+   endian machine. On Intel CPUs the least significant byte is stored first in
+   memory. Returns: 1 if little endian; 0 big endian (e.g. MIPS). */
+static int IcsIsLittleEndianMachine(void)
+{
+    int i = 1;
+    char *cptr = (char*)&i;
+    return (*cptr == 1);
+}
+
+
+/* Fill the byte order array with the machine's byte order. */
+void IcsFillByteOrder(Ics_DataType dataType,
+                      int          bytes,
+                      int          machineByteOrder[ICS_MAX_IMEL_SIZE])
+{
+    if (IcsIsLittleEndianMachine()) {
+        IcsFillLittleEndianByteOrder(dataType, bytes, machineByteOrder);
+    } else {
+        IcsFillBigEndianByteOrder(dataType, bytes, machineByteOrder);
+    }
+}
+
+/* Fill the byte order array with little endian byte order. */
+void IcsFillLittleEndianByteOrder(Ics_DataType dataType,
+                                  int          bytes,
+                                  int          byteOrder[ICS_MAX_IMEL_SIZE])
+{
+    int i;
+   (void) dataType; /* Not used, but kept as input for consistency. */
+
+
+    if (bytes > ICS_MAX_IMEL_SIZE) {
+            /* This will cause problems if undetected, */
+            /* but shouldn't happen anyway */
+        bytes = ICS_MAX_IMEL_SIZE;
+    }
+
+    for (i = 0; i < bytes; i++) {
+        byteOrder[i] = 1 + i;
+    }
+}
+
+/* Fill the byte order array with big endian byte order. */
+void IcsFillBigEndianByteOrder(Ics_DataType dataType,
+                               int          bytes,
+                               int          byteOrder[ICS_MAX_IMEL_SIZE])
+{
+    int i, hbytes;
+
+
+    if (bytes > ICS_MAX_IMEL_SIZE) {
+            /* This will cause problems if undetected, */
+            /* but shouldn't happen anyway */
+        bytes = ICS_MAX_IMEL_SIZE;
+    }
+
+    if (dataType == Ics_complex32 || dataType == Ics_complex64) {
+        hbytes = bytes/2;
+        for (i = 0; i < hbytes; i++) {
+            byteOrder[i]        = hbytes - i;
+            byteOrder[i+hbytes] = bytes - i;
+        }
+    } else {
+        for (i = 0; i < bytes; i++) {
+            byteOrder[i] = bytes - i;
+        }
+    }
+}
+
+
+/* Reverse the bytes in each group of width bytes, for width 2, 4 or 8. length
+   must be a multiple of width. */
+static void IcsSwapBytes(unsigned char *buf,
+                         size_t         length,
+                         int            width)
+{
+    size_t j;
+
+
+    switch (width) {
+        case 2:
+            for (j = 0; j < length; j += 2) {
+                ics_t_uint16 v;
+                memcpy(&v, buf + j, 2);
+                v = (ics_t_uint16)((v >> 8) | (v << 8));
+                memcpy(buf + j, &v, 2);
+            }
+            break;
+        case 4:
+            for (j = 0; j < length; j += 4) {
+                ics_t_uint32 v;
+                memcpy(&v, buf + j, 4);
+                v = ((v >> 24) & 0x000000FFu) | ((v >> 8) & 0x0000FF00u) |
+                    ((v << 8) & 0x00FF0000u) | ((v << 24) & 0xFF000000u);
+                memcpy(buf + j, &v, 4);
+            }
+            break;
+        case 8:
+            for (j = 0; j < length; j += 8) {
+                ics_t_uint64 v;
+                memcpy(&v, buf + j, 8);
+                v = ((v >> 56) & 0x00000000000000FFull) |
+                    ((v >> 40) & 0x000000000000FF00ull) |
+                    ((v >> 24) & 0x0000000000FF0000ull) |
+                    ((v >>  8) & 0x00000000FF000000ull) |
+                    ((v <<  8) & 0x000000FF00000000ull) |
+                    ((v << 24) & 0x0000FF0000000000ull) |
+                    ((v << 40) & 0x00FF000000000000ull) |
+                    ((v << 56) & 0xFF00000000000000ull);
+                memcpy(buf + j, &v, 8);
+            }
+            break;
+    }
+}
+
+
+#if defined(ICS_X86_SIMD)
+
+/* Fill a 16-byte shuffle mask that reverses each group of width bytes. */
+static void IcsFillSwapMask(unsigned char mask[16],
+                            int           width)
+{
+    int i;
+
+
+    for (i = 0; i < 16; i++) {
+        mask[i] = (unsigned char)(i - i % width + (width - 1 - i % width));
+    }
+}
+
+
+/* As IcsSwapBytes, using SSSE3 instructions. */
+__attribute__((target("ssse3")))
+static void IcsSwapBytesSSSE3(unsigned char *buf,
+                              size_t         length,
+                              int            width)
+{
+    unsigned char mask[16];
+    __m128i       m, v;
+
+
+    IcsFillSwapMask(mask, width);
+    m = _mm_loadu_si128((const __m128i*)mask);
+    for (; length >= 16; length -= 16, buf += 16) {
+        v = _mm_loadu_si128((const __m128i*)buf);
+        _mm_storeu_si128((__m128i*)buf, _mm_shuffle_epi8(v, m));
+    }
+    IcsSwapBytes(buf, length, width);
+}
+
+
+/* As IcsSwapBytes, using AVX2 instructions. */
+__attribute__((target("avx2")))
+static void IcsSwapBytesAVX2(unsigned char *buf,
+                             size_t         length,
+                             int            width)
+{
+    unsigned char mask[16];
+    __m256i       m, v;
+
+
+    IcsFillSwapMask(mask, width);
+    m = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)mask));
+    for (; length >= 32; length -= 32, buf += 32) {
+        v = _mm256_loadu_si256((const __m256i*)buf);
+        _mm256_storeu_si256((__m256i*)buf, _mm256_shuffle_epi8(v, m));
+    }
+    IcsSwapBytes(buf, length, width);
+}
+
+#elif defined(ICS_NEON_SIMD)
+
+/* As IcsSwapBytes, using NEON instructions. */
+static void IcsSwapBytesNEON(unsigned char *buf,
+                             size_t         length,
+                             int            width)
+{
+    uint8x16_t v;
+
+
+    for (; length >= 16; length -= 16, buf += 16) {
+        v = vld1q_u8(buf);
+        switch (width) {
+            case 2:
+                v = vrev16q_u8(v);
+                break;
+            case 4:
+                v = vrev32q_u8(v);
+                break;
+            default:
+                v = vrev64q_u8(v);
+                break;
+        }
+        vst1q_u8(buf, v);
+    }
+    IcsSwapBytes(buf, length, width);
+}
+
+#endif
+
+
+/* Reorder the bytes in the images as specified in the ByteOrder array. The
+   common cases, where the bytes of each sample (or of each half of a complex
+   sample) are reversed, are handled with vector instructions where
+   available. */
+Ics_Error IcsReorderIds(char        *buf,
+                        size_t       length,
+                        Ics_DataType dataType,
+                        int          srcByteOrder[ICS_MAX_IMEL_SIZE],
+                        int          bytes)
+{
+    ICSINIT;
+    int  i, width;
+    size_t j, imels;
+    int  dstByteOrder[ICS_MAX_IMEL_SIZE];
+    int  srcPos[ICS_MAX_IMEL_SIZE];
+    char imel[ICS_MAX_IMEL_SIZE];
+    int  different = 0, empty = 0;
+
+
+    imels = length / (size_t)bytes;
+    if (length % (size_t)bytes != 0) return IcsErr_BitsVsSizeConfl;
+
+        /* Create destination byte order: */
+    IcsFillByteOrder(dataType, bytes, dstByteOrder);
 
         /* Localize byte order array: */
     for (i = 0; i < bytes; i++){
@@ -364,6 +1476,40 @@ static Ics_Error IcsReorderIds(char        *buf,
     }
     if (!different || empty) return IcsErr_Ok;
 
+        /* Find out if the bytes are reversed in groups of 2, 4 or 8: */
+    for (i = 0; i < bytes; i++) {
+        srcPos[i] = -1;
+    }
+    for (i = 0; i < bytes; i++) {
+        if (srcByteOrder[i] < 1 || srcByteOrder[i] > bytes) break;
+        srcPos[srcByteOrder[i] - 1] = i;
+    }
+    for (width = (i == bytes) ? 8 : 0; width > 1; width /= 2) {
+        if (bytes % width != 0) continue;
+        for (i = 0; i < bytes; i++) {
+            if (srcPos[dstByteOrder[i] - 1] != i - i % width + (width - 1 - i % width))
+                break;
+        }
+        if (i == bytes) break;
+    }
+    if (width > 1) {
+#if defined(ICS_X86_SIMD)
+        if (__builtin_cpu_supports("avx2")) {
+            IcsSwapBytesAVX2((unsigned char*)buf, length, width);
+        } else if (__builtin_cpu_supports("ssse3")) {
+            IcsSwapBytesSSSE3((unsigned char*)buf, length, width);
+        } else {
+            IcsSwapBytes((unsigned char*)buf, length, width);
+        }
+#elif defined(ICS_NEON_SIMD)
+        IcsSwapBytesNEON((unsigned char*)buf, length, width);
+#else
+        IcsSwapBytes((unsigned char*)buf, length, width);
+#endif
+        return error;
+    }
+
+        /* Any other byte order: */
     for (j = 0; j < imels; j++){
         for (i = 0; i < bytes; i++){
             imel[srcByteOrder[i]-1] = buf[i];
@@ -378,19 +1524,14 @@ static Ics_Error IcsReorderIds(char        *buf,
 }
 
 
-/* Open an IDS file for reading. */
-Ics_Error IcsOpenIds(Ics_Header *icsStruct)
+/* Find the name of the file that contains the image data, and the offset of the
+   data within that file. For version 1.0 files, the compression method is
+   changed if the data is found in a compressed .ids.gz or .ids.Z file. */
+static Ics_Error IcsGetIdsFile(Ics_Header *icsStruct,
+                               char       *filename,
+                               size_t     *offset)
 {
-    ICSINIT;
-    Ics_BlockRead *br;
-    char           filename[ICS_MAXPATHLEN];
-    size_t         offset = 0;
-
-
-    if (icsStruct->blockRead != NULL) {
-        error = IcsCloseIds(icsStruct);
-        if (error) return error;
-    }
+    *offset = 0;
     if (icsStruct->version == 1) {          /* Version 1.0 */
         IcsGetIdsName(filename, icsStruct->filename);
 #ifdef ICS_DO_GZEXT
@@ -415,14 +1556,64 @@ Ics_Error IcsOpenIds(Ics_Header *icsStruct)
     } else {                                  /* Version 2.0 */
         if (icsStruct->srcFile[0] == '\0') return IcsErr_MissingData;
         IcsStrCpy(filename, icsStruct->srcFile, ICS_MAXPATHLEN);
+        *offset = icsStruct->srcOffset;
+    }
+
+    return IcsErr_Ok;
+}
+
+
+/* Return the ICS file in memory if the image data follows its header, or NULL
+   if the data is to be read from a file. */
+static const Ics_Memory *icsDataMemory(const Ics_Header *icsStruct)
+{
+    if ((icsStruct->memory == NULL) || (icsStruct->version == 1) ||
+        (icsStruct->srcFile[0] != '\0'))
+        return NULL;
+
+    return (const Ics_Memory*)icsStruct->memory;
+}
+
+
+/* Open an IDS file for reading. */
+Ics_Error IcsOpenIds(Ics_Header *icsStruct)
+{
+    ICSINIT;
+    Ics_BlockRead    *br;
+    char              filename[ICS_MAXPATHLEN];
+    size_t            offset;
+    const Ics_Memory *mem = icsDataMemory(icsStruct);
+
+
+    if (icsStruct->blockRead != NULL) {
+        error = IcsCloseIds(icsStruct);
+        if (error) return error;
+    }
+    if ((icsStruct->imel.dataType == Ics_binary) &&
+        ((icsStruct->compression == IcsCompr_compress) ||
+         (icsStruct->compression == IcsCompr_chunked_gzip)))
+            /* Packed bits are read in blocks that do not fill whole bytes */
+        return IcsErr_UnknownCompression;
+    if (mem != NULL) {
         offset = icsStruct->srcOffset;
+    } else {
+        error = IcsGetIdsFile(icsStruct, filename, &offset);
+        if (error) return error;
     }
 
     br = (Ics_BlockRead*)malloc(sizeof (Ics_BlockRead));
     if (br == NULL) return IcsErr_Alloc;
 
-    br->dataFilePtr = IcsFOpen(filename, "rb");
-    if (br->dataFilePtr == NULL) return IcsErr_FOpenIds;
+    br->io = NULL;
+    if (mem != NULL) {
+        br->dataFilePtr = IcsOpenMemoryStream(mem);
+    } else {
+        br->dataFilePtr = IcsFOpenIo(filename, "rb", &br->io);
+    }
+    if (br->dataFilePtr == NULL) {
+        free(br);
+        return IcsErr_FOpenIds;
+    }
     if (ICSFSEEK(br->dataFilePtr, (ptrdiff_t)offset, SEEK_SET) != 0) {
         fclose(br->dataFilePtr);
         free(br);
@@ -431,8 +1622,24 @@ Ics_Error IcsOpenIds(Ics_Header *icsStruct)
 #ifdef ICS_ZLIB
     br->zlibStream = NULL;
     br->zlibInputBuffer = NULL;
+#endif
+#ifdef ICS_ZSTD
+    br->zstdStream = NULL;
 #endif
     br->compressRead = 0;
+    br->dataOffset = offset;
+    br->lineBuf = NULL;
+    br->linePos = 0;
+    br->bitByte = 0;
+    if (IcsGetActiveFilter(icsStruct) != IcsFilter_none ||
+        IcsGetActivePredictor(icsStruct) != IcsPredictor_none) {
+        br->lineBuf = malloc(2 * icsLineSize(icsStruct));
+        if (br->lineBuf == NULL) {
+            fclose(br->dataFilePtr);
+            free(br);
+            return IcsErr_Alloc;
+        }
+    }
     icsStruct->blockRead = br;
 
 #ifdef ICS_ZLIB
@@ -440,6 +1647,19 @@ Ics_Error IcsOpenIds(Ics_Header *icsStruct)
         error = IcsOpenZip(icsStruct);
         if (error) {
             fclose (br->dataFilePtr);
+            free(br->lineBuf);
+            free(icsStruct->blockRead);
+            icsStruct->blockRead = NULL;
+            return error;
+        }
+    }
+#endif
+#ifdef ICS_ZSTD
+    if (icsStruct->compression == IcsCompr_zstd) {
+        error = IcsOpenZstd(icsStruct);
+        if (error) {
+            fclose (br->dataFilePtr);
+            free(br->lineBuf);
             free(icsStruct->blockRead);
             icsStruct->blockRead = NULL;
             return error;
@@ -469,6 +1689,15 @@ Ics_Error IcsCloseIds(Ics_Header *icsStruct)
             IcsCloseZip(icsStruct);
     }
 #endif
+#ifdef ICS_ZSTD
+    if (br->zstdStream != NULL) {
+        if (!error)
+            error = IcsCloseZstd(icsStruct);
+        else
+            IcsCloseZstd(icsStruct);
+    }
+#endif
+    free(br->lineBuf);
     free(br);
     icsStruct->blockRead = NULL;
 
@@ -476,10 +1705,10 @@ Ics_Error IcsCloseIds(Ics_Header *icsStruct)
 }
 
 
-/* Read a data block from an IDS file. */
-Ics_Error IcsReadIdsBlock(Ics_Header *icsStruct,
-                          void       *dest,
-                          size_t      n)
+/* Read a data block from an IDS file, as stored in the file. */
+static Ics_Error icsReadBlock(Ics_Header *icsStruct,
+                              void       *dest,
+                              size_t      n)
 {
     ICSINIT;
     Ics_BlockRead* br = (Ics_BlockRead*)icsStruct->blockRead;
@@ -499,6 +1728,11 @@ Ics_Error IcsReadIdsBlock(Ics_Header *icsStruct,
         case IcsCompr_gzip:
             error = IcsReadZipBlock(icsStruct, dest, n);
             break;
+#endif
+#ifdef ICS_ZSTD
+        case IcsCompr_zstd:
+            error = IcsReadZstdBlock(icsStruct, dest, n);
+            break;
 #endif
         case IcsCompr_compress:
             if (br->compressRead) {
@@ -508,10 +1742,164 @@ Ics_Error IcsReadIdsBlock(Ics_Header *icsStruct,
                 br->compressRead = 1;
             }
             break;
+        case IcsCompr_chunked_gzip:
+            error = IcsErr_BlockNotAllowed;
+            break;
         default:
             error = IcsErr_UnknownCompression;
     }
 
+    return error;
+}
+
+
+/* Decode a line as read from the file: undo the filter, put the bytes in
+   machine order and undo the predictor. scratch must hold a line. */
+static Ics_Error icsDecodeLine(Ics_Header *icsStruct,
+                               char       *line,
+                               char       *scratch)
+{
+    ICSINIT;
+    Ics_Filter     filter    = IcsGetActiveFilter(icsStruct);
+    Ics_Predictor  predictor = IcsGetActivePredictor(icsStruct);
+    int            nBytes    = (int)IcsGetDataTypeSize(icsStruct->imel.dataType);
+    size_t         lineLen   = icsLineSize(icsStruct);
+
+
+    if (filter != IcsFilter_none) {
+        memcpy(scratch, line, lineLen);
+        IcsUnfilterData(filter, scratch, line, lineLen / (size_t)nBytes,
+                        nBytes);
+    }
+    error = IcsReorderIds(line, lineLen, icsStruct->imel.dataType,
+                          icsStruct->byteOrder,
+                          IcsGetBytesPerSample(icsStruct));
+    if (error) return error;
+    IcsUnpredictData(predictor, line, lineLen / (size_t)nBytes, nBytes);
+
+    return error;
+}
+
+
+/* Read a data block from filtered or predicted data. These are applied to each
+   line, so the stream is always positioned at the start of a line. Whole lines
+   are read directly into dest and decoded there; a line that is only partially
+   read is decoded into br->lineBuf, from where the rest is taken by the next
+   read. */
+static Ics_Error icsReadLines(Ics_Header *icsStruct,
+                              void       *dest,
+                              size_t      n)
+{
+    ICSINIT;
+    Ics_BlockRead *br      = (Ics_BlockRead*)icsStruct->blockRead;
+    size_t         lineLen = icsLineSize(icsStruct);
+    char          *line    = (char*)br->lineBuf;
+    char          *scratch = line + lineLen;
+    char          *p       = (char*)dest;
+    size_t         count, i;
+
+
+        /* The rest of the current line */
+    count = br->linePos % lineLen;
+    if (count != 0) {
+        count = lineLen - count < n ? lineLen - count : n;
+        memcpy(p, line + br->linePos % lineLen, count);
+        p += count;
+        n -= count;
+        br->linePos += count;
+    }
+        /* Whole lines */
+    count = n - n % lineLen;
+    if (count > 0) {
+        error = icsReadBlock(icsStruct, p, count);
+        if (error) return error;
+        for (i = 0; i < count; i += lineLen) {
+            error = icsDecodeLine(icsStruct, p + i, scratch);
+            if (error) return error;
+        }
+        p += count;
+        n -= count;
+        br->linePos += count;
+    }
+        /* The start of the next line */
+    if (n > 0) {
+        error = icsReadBlock(icsStruct, line, lineLen);
+        if (error) return error;
+        error = icsDecodeLine(icsStruct, line, scratch);
+        if (error) return error;
+        memcpy(p, line, n);
+        br->linePos += n;
+    }
+
+    return error;
+}
+
+
+/* Read a data block from binary data, which is packed into bits. Whole bytes
+   are read into the end of dest and unpacked in place; a byte that is only
+   partially read is kept in br->bitByte, from where the rest is taken by the
+   next read. */
+static Ics_Error icsReadBits(Ics_Header *icsStruct,
+                             void       *dest,
+                             size_t      n)
+{
+    ICSINIT;
+    Ics_BlockRead *br = (Ics_BlockRead*)icsStruct->blockRead;
+    unsigned char *p  = (unsigned char*)dest;
+    size_t         bit, count, i;
+
+
+        /* The rest of the current byte */
+    bit = br->linePos % 8;
+    if (bit != 0) {
+        count = 8 - bit < n ? 8 - bit : n;
+        for (i = 0; i < count; i++) {
+            p[i] = (unsigned char)((br->bitByte >> (bit + i)) & 1);
+        }
+        p += count;
+        n -= count;
+        br->linePos += count;
+    }
+        /* Whole bytes */
+    count = n - n % 8;
+    if (count > 0) {
+        error = icsReadBlock(icsStruct, p + count - count / 8, count / 8);
+        if (error) return error;
+        IcsUnpackBits(p + count - count / 8, p, count);
+        p += count;
+        n -= count;
+        br->linePos += count;
+    }
+        /* The start of the next byte */
+    if (n > 0) {
+        error = icsReadBlock(icsStruct, &br->bitByte, 1);
+        if (error) return error;
+        IcsUnpackBits(&br->bitByte, p, n);
+        br->linePos += n;
+    }
+
+    return error;
+}
+
+
+/* Read a data block from an IDS file. */
+Ics_Error IcsReadIdsBlock(Ics_Header *icsStruct,
+                          void       *dest,
+                          size_t      n)
+{
+    ICSINIT;
+    Ics_BlockRead* br = (Ics_BlockRead*)icsStruct->blockRead;
+
+
+    if (icsStruct->imel.dataType == Ics_binary) {
+        return icsReadBits(icsStruct, dest, n);
+    }
+    if (br->lineBuf != NULL) {
+            /* The lines are put in machine order as they are decoded */
+        return icsReadLines(icsStruct, dest, n);
+    }
+
+    error = icsReadBlock(icsStruct, dest, n);
     if (!error) error = IcsReorderIds((char*)dest, n, icsStruct->imel.dataType,
                                       icsStruct->byteOrder,
                                       IcsGetBytesPerSample(icsStruct));
@@ -528,10 +1916,10 @@ Ics_Error IcsSkipIdsBlock(Ics_Header *icsStruct,
 }
 
 
-/* Sets the file pointer into the IDS file. */
-Ics_Error IcsSetIdsBlock(Ics_Header *icsStruct,
-                         ptrdiff_t   offset,
-                         int         whence)
+/* Sets the file pointer into the IDS file, as stored in the file. */
+static Ics_Error icsSetBlock(Ics_Header *icsStruct,
+                             ptrdiff_t   offset,
+                             int         whence)
 {
     ICSINIT;
     Ics_BlockRead* br = (Ics_BlockRead*)icsStruct->blockRead;
@@ -565,8 +1953,21 @@ Ics_Error IcsSetIdsBlock(Ics_Header *icsStruct,
                     error = IcsErr_IllParameter;
             }
             break;
+#endif
+#ifdef ICS_ZSTD
+        case IcsCompr_zstd:
+            switch (whence) {
+                case SEEK_SET:
+                case SEEK_CUR:
+                    error = IcsSetZstdBlock(icsStruct, offset, whence);
+                    break;
+                default:
+                    error = IcsErr_IllParameter;
+            }
+            break;
 #endif
         case IcsCompr_compress:
+        case IcsCompr_chunked_gzip:
             error = IcsErr_BlockNotAllowed;
             break;
         default:
@@ -577,6 +1978,129 @@ Ics_Error IcsSetIdsBlock(Ics_Header *icsStruct,
 }
 
 
+/* Sets the position in filtered or predicted data. The stream is moved to the
+   start of the line that contains the new position, and if that is not the
+   start of the line, the line is read and decoded. */
+static Ics_Error icsSetLines(Ics_Header *icsStruct,
+                             ptrdiff_t   offset,
+                             int         whence)
+{
+    ICSINIT;
+    Ics_BlockRead *br      = (Ics_BlockRead*)icsStruct->blockRead;
+    size_t         lineLen = icsLineSize(icsStruct);
+    size_t         current, target, start;
+
+
+    switch (whence) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += (ptrdiff_t)br->linePos;
+            break;
+        default:
+            return IcsErr_IllParameter;
+    }
+    if (offset < 0) return IcsErr_IllParameter;
+    target = (size_t)offset;
+    start = target - target % lineLen;
+        /* Position of the stream */
+    current = (br->linePos + lineLen - 1) / lineLen * lineLen;
+    if (target % lineLen != 0 && br->linePos % lineLen != 0 &&
+        start + lineLen == current) {
+            /* Within the line that is already decoded */
+        br->linePos = target;
+        return IcsErr_Ok;
+    }
+    if (start >= current) {
+        error = icsSetBlock(icsStruct, (ptrdiff_t)(start - current), SEEK_CUR);
+    } else {
+        error = icsSetBlock(icsStruct, (ptrdiff_t)start, SEEK_SET);
+    }
+    if (error) return error;
+        /* icsSetBlock might have reopened the file */
+    br = (Ics_BlockRead*)icsStruct->blockRead;
+    br->linePos = start;
+    if (target != start) {
+        char *line = (char*)br->lineBuf;
+        error = icsReadBlock(icsStruct, line, lineLen);
+        if (error) return error;
+        error = icsDecodeLine(icsStruct, line, line + lineLen);
+        if (error) return error;
+        br->linePos = target;
+    }
+
+    return error;
+}
+
+
+/* Sets the position in binary data, which is packed into bits. The stream is
+   moved to the byte that contains the new position, and if that is not the
+   first imel in the byte, the byte is read. */
+static Ics_Error icsSetBits(Ics_Header *icsStruct,
+                            ptrdiff_t   offset,
+                            int         whence)
+{
+    ICSINIT;
+    Ics_BlockRead *br = (Ics_BlockRead*)icsStruct->blockRead;
+    size_t         current, target, start;
+
+
+    switch (whence) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += (ptrdiff_t)br->linePos;
+            break;
+        default:
+            return IcsErr_IllParameter;
+    }
+    if (offset < 0) return IcsErr_IllParameter;
+    target = (size_t)offset;
+    start = target / 8;
+        /* Position of the stream, in bytes */
+    current = (br->linePos + 7) / 8;
+    if (target % 8 != 0 && br->linePos % 8 != 0 && start + 1 == current) {
+            /* Within the byte that is already read */
+        br->linePos = target;
+        return IcsErr_Ok;
+    }
+    if (start >= current) {
+        error = icsSetBlock(icsStruct, (ptrdiff_t)(start - current), SEEK_CUR);
+    } else {
+        error = icsSetBlock(icsStruct, (ptrdiff_t)start, SEEK_SET);
+    }
+    if (error) return error;
+        /* icsSetBlock might have reopened the file */
+    br = (Ics_BlockRead*)icsStruct->blockRead;
+    br->linePos = start * 8;
+    if (target % 8 != 0) {
+        error = icsReadBlock(icsStruct, &br->bitByte, 1);
+        if (error) return error;
+        br->linePos = target;
+    }
+
+    return error;
+}
+
+
+/* Sets the file pointer into the IDS file. */
+Ics_Error IcsSetIdsBlock(Ics_Header *icsStruct,
+                         ptrdiff_t   offset,
+                         int         whence)
+{
+    Ics_BlockRead* br = (Ics_BlockRead*)icsStruct->blockRead;
+
+
+    if (icsStruct->imel.dataType == Ics_binary) {
+        return icsSetBits(icsStruct, offset, whence);
+    }
+    if (br->lineBuf != NULL) {
+        return icsSetLines(icsStruct, offset, whence);
+    }
+    return icsSetBlock(icsStruct, offset, whence);
+}
+
+
 /* Read the data from an IDS file. */
 Ics_Error IcsReadIds(Ics_Header *icsStruct,
                      void       *dest,
@@ -586,7 +2110,19 @@ Ics_Error IcsReadIds(Ics_Header *icsStruct,
 
     error = IcsOpenIds(icsStruct);
     if (error) return error;
-    error = IcsReadIdsBlock(icsStruct, dest, n);
+    if (icsStruct->compression == IcsCompr_chunked_gzip) {
+            /* Chunked data can only be read as a whole */
+        if (n < IcsGetDataSize(icsStruct)) {
+            error = IcsErr_BlockNotAllowed;
+        } else {
+            error = IcsReadChunks(icsStruct, NULL, NULL, NULL, dest, NULL, 0);
+            if (!error && n > IcsGetDataSize(icsStruct)) {
+                error = IcsErr_OutputNotFilled;
+            }
+        }
+    } else {
+        error = IcsReadIdsBlock(icsStruct, dest, n);
+    }
     if (!error)
         error = IcsCloseIds(icsStruct);
     else
@@ -595,3 +2131,505 @@ Ics_Error IcsReadIds(Ics_Header *icsStruct,
     return error;
 }
 
+
+/* Read n bytes at offset bytes from the start of the data as stored in the
+   file, without using the file position. */
+static Ics_Error icsReadAt(const Ics_Header *icsStruct,
+                           size_t            offset,
+                           void             *dest,
+                           size_t            n)
+{
+    Ics_BlockRead    *br  = (Ics_BlockRead*)icsStruct->blockRead;
+    const Ics_Memory *mem = icsDataMemory(icsStruct);
+    char             *p   = (char*)dest;
+#if defined(_WIN32)
+    Ics_Error      error = IcsErr_Ok;
+    HANDLE         file;
+    OVERLAPPED     overlapped;
+    DWORD          nread;
+    unsigned __int64 pos;
+#elif defined(HAVE_PREAD)
+    int            fd;
+    ssize_t        nread;
+    off_t          pos;
+#endif
+
+
+    if (mem != NULL) {
+            /* The data is already in memory */
+        if ((br->dataOffset > mem->size) ||
+            (offset > mem->size - br->dataOffset) ||
+            (n > mem->size - br->dataOffset - offset))
+            return IcsErr_EndOfStream;
+        memcpy(dest, mem->data + br->dataOffset + offset, n);
+        return IcsErr_Ok;
+    }
+    if (br->io != NULL) {
+            /* The file was opened through custom callbacks */
+        return IcsReadIoAt(br->io, dest, n, br->dataOffset + offset);
+    }
+
+#if defined(_WIN32)
+        /* ReadFile with an offset moves the file pointer of a synchronous
+           handle, which the stream reads rely on. The file is therefore read
+           through a second handle, opened for overlapped I/O, which has no
+           file pointer. */
+    file = ReOpenFile((HANDLE)_get_osfhandle(_fileno(br->dataFilePtr)),
+                      GENERIC_READ,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      FILE_FLAG_OVERLAPPED);
+    if (file == INVALID_HANDLE_VALUE) return IcsErr_FReadIds;
+    pos = br->dataOffset + offset;
+    while (!error && (n > 0)) {
+        DWORD len = n > 0x40000000 ? 0x40000000 : (DWORD)n;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)(pos & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(pos >> 32);
+        if ((!ReadFile(file, p, len, NULL, &overlapped) &&
+             (GetLastError() != ERROR_IO_PENDING)) ||
+            !GetOverlappedResult(file, &overlapped, &nread, TRUE)) {
+            error = GetLastError() == ERROR_HANDLE_EOF ? IcsErr_EndOfStream
+                                                       : IcsErr_FReadIds;
+        } else if (nread == 0) {
+            error = IcsErr_EndOfStream;
+        } else {
+            p += nread;
+            pos += nread;
+            n -= nread;
+        }
+    }
+    CloseHandle(file);
+    if (error) return error;
+#elif defined(HAVE_PREAD)
+    fd = fileno(br->dataFilePtr);
+    pos = (off_t)(br->dataOffset + offset);
+    while (n > 0) {
+        nread = pread(fd, p, n, pos);
+        if (nread < 0) return IcsErr_FReadIds;
+        if (nread == 0) return IcsErr_EndOfStream;
+        p += nread;
+        pos += nread;
+        n -= (size_t)nread;
+    }
+#else
+    (void)p;
+    return IcsErr_NotValidAction;
+#endif
+
+    return IcsErr_Ok;
+}
+
+
+/* Read n bytes of image data starting at offset bytes from the start of the
+   data. The file position of the open IDS file is not used nor changed, so this
+   function can be called concurrently from multiple threads on the same
+   Ics_Header. Only for uncompressed data; IcsOpenIds must be called first. A
+   file opened through custom I/O is read with its readAt callback. Binary data
+   is read from the bytes that hold the imels asked for, and unpacked. */
+Ics_Error IcsReadIdsAt(Ics_Header *icsStruct,
+                       size_t      offset,
+                       void       *dest,
+                       size_t      n)
+{
+    ICSINIT;
+    Ics_BlockRead *br = (Ics_BlockRead*)icsStruct->blockRead;
+    size_t         bytes, size, start, count, head;
+    unsigned char *packed;
+
+
+    if (br == NULL) return IcsErr_NotValidAction;
+    if (icsStruct->compression != IcsCompr_uncompressed)
+        return IcsErr_BlockNotAllowed;
+    bytes = (size_t)IcsGetBytesPerSample(icsStruct);
+    if ((offset % bytes != 0) || (n % bytes != 0)) return IcsErr_IllParameter;
+    size = IcsGetDataSize(icsStruct);
+    if ((offset > size) || (n > size - offset)) return IcsErr_EndOfStream;
+
+    if (icsStruct->imel.dataType == Ics_binary) {
+        if (n == 0) return IcsErr_Ok;
+        start = offset / 8;
+        count = (offset + n + 7) / 8 - start;
+        packed = (unsigned char*)malloc(count);
+        if (packed == NULL) return IcsErr_Alloc;
+        error = icsReadAt(icsStruct, start, packed, count);
+        if (!error) {
+                /* The imels in the first byte that come before offset are
+                   unpacked along with it, into the start of dest */
+            head = offset % 8;
+            if (head != 0) {
+                unsigned char first[8];
+                IcsUnpackBits(packed, first, 8);
+                count = 8 - head < n ? 8 - head : n;
+                memcpy(dest, first + head, count);
+                IcsUnpackBits(packed + 1, (char*)dest + count, n - count);
+            } else {
+                IcsUnpackBits(packed, dest, n);
+            }
+        }
+        free(packed);
+        return error;
+    }
+
+    error = icsReadAt(icsStruct, offset, dest, n);
+    if (error) return error;
+    error = IcsReorderIds((char*)dest, n, icsStruct->imel.dataType,
+                          icsStruct->byteOrder, (int)bytes);
+
+    return error;
+}
+
+
+#if !defined(_WIN32) && defined(HAVE_PREADV)
+
+#if defined(IOV_MAX)
+#define ICS_MAX_IOV IOV_MAX
+#else
+#define ICS_MAX_IOV 1024
+#endif
+
+/* Read the extents first to last-1 with a single preadv call, or as few as
+   needed if it returns less than asked for. The gaps between the extents are
+   read into scratch, which is as large as the largest gap. */
+static Ics_Error icsReadExtentsV(const Ics_Header *icsStruct,
+                                 const Ics_Extent *extents,
+                                 size_t            first,
+                                 size_t            last,
+                                 char             *scratch)
+{
+    Ics_BlockRead *br = (Ics_BlockRead*)icsStruct->blockRead;
+    struct iovec   iov[ICS_MAX_IOV];
+    struct iovec  *v  = iov;
+    int            nIov = 0, fd = fileno(br->dataFilePtr);
+    size_t         i, end;
+    ssize_t        nread;
+    off_t          pos;
+
+
+    end = extents[first].offset;
+    for (i = first; i < last; i++) {
+        if (extents[i].offset > end) {
+            iov[nIov].iov_base = scratch;
+            iov[nIov].iov_len = extents[i].offset - end;
+            nIov++;
+        }
+        iov[nIov].iov_base = extents[i].dest;
+        iov[nIov].iov_len = extents[i].n;
+        nIov++;
+        end = extents[i].offset + extents[i].n;
+    }
+    pos = (off_t)(br->dataOffset + extents[first].offset);
+    while (nIov > 0) {
+        nread = preadv(fd, v, nIov, pos);
+        if (nread < 0) return IcsErr_FReadIds;
+        if (nread == 0) return IcsErr_EndOfStream;
+        pos += nread;
+            /* Continue after a short read where it stopped */
+        while (nIov > 0 && (size_t)nread >= v->iov_len) {
+            nread -= (ssize_t)v->iov_len;
+            v++;
+            nIov--;
+        }
+        if (nIov > 0) {
+            v->iov_base = (char*)v->iov_base + nread;
+            v->iov_len -= (size_t)nread;
+        }
+    }
+
+    return IcsErr_Ok;
+}
+
+#endif
+
+
+/* Read the extents of uncompressed image data, which must be in increasing
+   order and not overlap, without using the file position. Extents that are at
+   most ICS_ROI_GAP_SIZE bytes apart are read together, with the gaps between
+   them: with a single vectored read where the c library provides preadv, and
+   otherwise through a buffer of ICS_ROI_BUF_SIZE bytes. IcsOpenIds must be
+   called first. Returns IcsErr_NotValidAction without reading anything if the
+   file cannot be read at an offset. */
+Ics_Error IcsReadIdsExtents(Ics_Header       *icsStruct,
+                            const Ics_Extent *extents,
+                            size_t            count)
+{
+    ICSINIT;
+    Ics_BlockRead *br      = (Ics_BlockRead*)icsStruct->blockRead;
+    int            bytes;
+    size_t         first, last, span, maxGap, gap, i;
+    int            vectored = 0;
+    char          *buf     = NULL;
+
+
+    if (br == NULL) return IcsErr_NotValidAction;
+    if ((icsStruct->compression != IcsCompr_uncompressed) ||
+        (icsStruct->imel.dataType == Ics_binary))
+        return IcsErr_BlockNotAllowed;
+    if (icsDataMemory(icsStruct) == NULL) {
+        if (br->io != NULL) {
+            if (br->io->vtable.readAt == NULL) return IcsErr_NotValidAction;
+        } else {
+#if !defined(_WIN32) && defined(HAVE_PREADV)
+            vectored = 1;
+#elif !defined(_WIN32) && !defined(HAVE_PREAD)
+            return IcsErr_NotValidAction;
+#endif
+        }
+    }
+    bytes = IcsGetBytesPerSample(icsStruct);
+
+    for (first = 0; !error && (first < count); first = last) {
+            /* Find the extents that are read together */
+        span = extents[first].n;
+        maxGap = 0;
+        for (last = first + 1; last < count; last++) {
+            gap = extents[last].offset -
+                  (extents[last - 1].offset + extents[last - 1].n);
+            if (gap > ICS_ROI_GAP_SIZE) break;
+            if (vectored) {
+#if !defined(_WIN32) && defined(HAVE_PREADV)
+                if (2 * (last - first + 1) > ICS_MAX_IOV) break;
+#endif
+            } else if (span + gap + extents[last].n > ICS_ROI_BUF_SIZE) {
+                break;
+            }
+            if (gap > maxGap) maxGap = gap;
+            span += gap + extents[last].n;
+        }
+        if ((last - first == 1) || (icsDataMemory(icsStruct) != NULL)) {
+                /* Nothing to be gained by reading them together */
+            for (i = first; !error && (i < last); i++) {
+                error = icsReadAt(icsStruct, extents[i].offset,
+                                  extents[i].dest, extents[i].n);
+            }
+        } else if (vectored) {
+#if !defined(_WIN32) && defined(HAVE_PREADV)
+            if (maxGap > 0 && buf == NULL) {
+                buf = (char*)malloc(ICS_ROI_GAP_SIZE);
+                if (buf == NULL) return IcsErr_Alloc;
+            }
+            error = icsReadExtentsV(icsStruct, extents, first, last, buf);
+#endif
+        } else {
+            if (buf == NULL) {
+                buf = (char*)malloc(ICS_ROI_BUF_SIZE);
+                if (buf == NULL) return IcsErr_Alloc;
+            }
+            error = icsReadAt(icsStruct, extents[first].offset, buf, span);
+            for (i = first; !error && (i < last); i++) {
+                memcpy(extents[i].dest,
+                       buf + (extents[i].offset - extents[first].offset),
+                       extents[i].n);
+            }
+        }
+        for (i = first; !error && (i < last); i++) {
+            error = IcsReorderIds((char*)extents[i].dest, extents[i].n,
+                                  icsStruct->imel.dataType,
+                                  icsStruct->byteOrder, bytes);
+        }
+    }
+    free(buf);
+
+    return error;
+}
+
+
+/* Check if the byte order of the data in the file matches that of the
+   machine. */
+static int IcsIsMachineByteOrder(const Ics_Header *icsStruct)
+{
+    int i, bytes;
+    int dstByteOrder[ICS_MAX_IMEL_SIZE];
+
+
+    bytes = IcsGetBytesPerSample(icsStruct);
+    IcsFillByteOrder(icsStruct->imel.dataType, bytes, dstByteOrder);
+    for (i = 0; i < bytes; i++) {
+        if (icsStruct->byteOrder[i] == 0) return 1; /* Unknown: don't reorder */
+        if (icsStruct->byteOrder[i] != dstByteOrder[i]) return 0;
+    }
+
+    return 1;
+}
+
+
+/* Map n bytes at offset of a file into memory. If writable is set, the mapping
+   is private (copy-on-write) and can be modified. Returns zero on failure. */
+static int IcsMapFile(Ics_DataMap *dm,
+                      const char  *filename,
+                      size_t       offset,
+                      size_t       n,
+                      int          writable)
+{
+#if defined(_WIN32)
+    FILE             *fp;
+    HANDLE            file, mapping;
+    LARGE_INTEGER     fileSize;
+    SYSTEM_INFO       info;
+    unsigned __int64  start;
+    size_t            skip;
+    void             *base = NULL;
+
+
+    fp = IcsFOpen(filename, "rb");
+    if (fp == NULL) return 0;
+    file = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (!GetFileSizeEx(file, &fileSize) ||
+        (unsigned __int64)fileSize.QuadPart < offset + n) {
+        fclose(fp);
+        return 0;
+    }
+    GetSystemInfo(&info);
+    skip = offset % info.dwAllocationGranularity;
+    start = offset - skip;
+    mapping = CreateFileMapping(file, NULL,
+                                writable ? PAGE_WRITECOPY : PAGE_READONLY,
+                                0, 0, NULL);
+    if (mapping != NULL) {
+        base = MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ,
+                             (DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF),
+                             n + skip);
+        CloseHandle(mapping);
+    }
+    fclose(fp);
+    if (base == NULL) return 0;
+    dm->base = base;
+    dm->length = n + skip;
+    dm->data = (char*)base + skip;
+    dm->isMapped = 1;
+    return 1;
+#elif defined(HAVE_MMAP)
+    int          fd;
+    struct stat  st;
+    size_t       skip;
+    void        *base;
+
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < offset + n) {
+        close(fd);
+        return 0;
+    }
+    skip = offset % (size_t)sysconf(_SC_PAGESIZE);
+    base = mmap(NULL, n + skip, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                MAP_PRIVATE, fd, (off_t)(offset - skip));
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+    dm->base = base;
+    dm->length = n + skip;
+    dm->data = (char*)base + skip;
+    dm->isMapped = 1;
+    return 1;
+#else
+    (void)dm;
+    (void)filename;
+    (void)offset;
+    (void)writable;
+    return 0;
+#endif
+}
+
+
+/* Map the image data into memory. Uncompressed data is memory mapped; if it is
+   not stored in the machine's byte order, the mapping is private and reordered
+   in place. Uncompressed data in an ICS file held in memory is used where it
+   is, if it needs no reordering. When the file cannot be mapped, or the data is
+   compressed, the data is read into a newly allocated buffer instead. */
+Ics_Error IcsMapIds(Ics_Header  *icsStruct,
+                    const void **dest)
+{
+    ICSINIT;
+    Ics_DataMap      *dm;
+    char              filename[ICS_MAXPATHLEN];
+    size_t            offset, n;
+    int               swap;
+    const Ics_Memory *mem = icsDataMemory(icsStruct);
+
+
+    if (icsStruct->dataMap != NULL) {
+        *dest = ((Ics_DataMap*)icsStruct->dataMap)->data;
+        return IcsErr_Ok;
+    }
+    n = IcsGetDataSize(icsStruct);
+    if (n == 0) return IcsErr_MissingData;
+
+    dm = (Ics_DataMap*)malloc(sizeof(Ics_DataMap));
+    if (dm == NULL) return IcsErr_Alloc;
+    dm->base = NULL;
+    dm->length = 0;
+    dm->data = NULL;
+    dm->isMapped = 0;
+
+    if (mem != NULL) {
+        offset = icsStruct->srcOffset;
+    } else {
+        error = IcsGetIdsFile(icsStruct, filename, &offset);
+        if (error) {
+            free(dm);
+            return error;
+        }
+    }
+    if ((icsStruct->compression == IcsCompr_uncompressed) &&
+        (icsStruct->imel.dataType != Ics_binary)) {
+            /* Binary data is packed in the file, and must be unpacked */
+        swap = !IcsIsMachineByteOrder(icsStruct);
+        if (mem != NULL) {
+            if (!swap && offset + n <= mem->size) {
+                dm->data = (void*)(mem->data + offset);
+            }
+        } else if (!IcsCustomIo() &&
+                   IcsMapFile(dm, filename, offset, n, swap) && swap) {
+            error = IcsReorderIds((char*)dm->data, n,
+                                  icsStruct->imel.dataType,
+                                  icsStruct->byteOrder,
+                                  IcsGetBytesPerSample(icsStruct));
+#if !defined(_WIN32) && defined(HAVE_MMAP)
+            if (!error) mprotect(dm->base, dm->length, PROT_READ);
+#endif
+        }
+    }
+    if (!error && dm->data == NULL) {
+            /* Fall back to reading the data into a buffer */
+        dm->base = malloc(n);
+        if (dm->base == NULL) {
+            error = IcsErr_Alloc;
+        } else {
+            dm->length = n;
+            dm->data = dm->base;
+            error = IcsReadIds(icsStruct, dm->base, n);
+        }
+    }
+    if (error) {
+        icsStruct->dataMap = dm;
+        IcsUnmapIds(icsStruct);
+        return error;
+    }
+
+    icsStruct->dataMap = dm;
+    *dest = dm->data;
+    return error;
+}
+
+
+/* Release the image data mapped into memory. */
+Ics_Error IcsUnmapIds(Ics_Header *icsStruct)
+{
+    ICSINIT;
+    Ics_DataMap *dm = (Ics_DataMap*)icsStruct->dataMap;
+
+
+    if (dm == NULL) return IcsErr_NotValidAction;
+    if (dm->isMapped) {
+#if defined(_WIN32)
+        if (!UnmapViewOfFile(dm->base)) error = IcsErr_FCloseIds;
+#elif defined(HAVE_MMAP)
+        if (munmap(dm->base, dm->length) != 0) error = IcsErr_FCloseIds;
+#endif
+    } else {
+        free(dm->base);
+    }
+    free(dm);
+    icsStruct->dataMap = NULL;
+
+    return error;
+}
@@ -0,0 +1,665 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright 2025:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Contact: libics@svi.nl
+ *
+ * Copyright (C) 2000-2013 Cris Luengo and others
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_chunk.c
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsGetChunkShape()
+ *   IcsWriteChunks()
+ *   IcsReadChunks()
+ *
+ * With IcsCompr_chunked_gzip, the image is divided into chunks of equal size,
+ * clipped at the image edges, and numbered with the first dimension running
+ * fastest. The image data starts with a table that contains, for each chunk,
+ * its offset from the start of the image data and its length, both as 64-bit
+ * little-endian integers. The table is followed by the chunks, each of which is
+ * a separate gzip stream containing the imels of the chunk in the usual order.
+ * Chunks can thus be compressed and decompressed independently of each other.
+ * A predictor, if any, is applied to each line of a chunk along the first
+ * dimension, and a filter to each chunk as a whole.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "libics_intern.h"
+
+
+#define ICS_CHUNK_ENTRY 16 /* Bytes per chunk in the offset table */
+
+
+/* The division of the image into chunks. */
+typedef struct {
+    int        nDims;
+    size_t     nBytes;              /* Bytes per imel */
+    size_t     dim[ICS_MAXDIM];     /* Size of the image */
+    size_t     shape[ICS_MAXDIM];   /* Size of a chunk */
+    size_t     grid[ICS_MAXDIM];    /* Number of chunks along each dimension */
+    size_t     nChunks;             /* Total number of chunks */
+    size_t     maxBytes;            /* Bytes in a chunk that is not clipped */
+} Ics_ChunkGrid;
+
+
+/* One batch of chunks compressed in parallel by IcsWriteChunks. */
+typedef struct {
+    const Ics_ChunkGrid *grid;
+    const char          *src;                /* Image data */
+    ptrdiff_t            stride[ICS_MAXDIM]; /* Strides of src, in imels */
+    int                  level;              /* Compression level */
+    Ics_Filter           filter;             /* Filter applied to chunks */
+    Ics_Predictor        predictor;          /* Predictor applied to lines */
+    size_t               first;              /* First chunk in this batch */
+    char               **inBuf;              /* Uncompressed chunk data, with
+                                                room for the encoded data */
+    char               **outBuf;             /* Compressed chunk data */
+    size_t               outSize;            /* Size of each output buffer */
+    size_t              *outLen;             /* Compressed length of chunks */
+} Ics_ChunkWriteBatch;
+
+
+/* One batch of chunks decompressed in parallel by IcsReadChunks. */
+typedef struct {
+    Ics_Header          *icsStruct;
+    const Ics_ChunkGrid *grid;
+    const size_t        *chunks;             /* Chunks in this batch */
+    Ics_Filter           filter;             /* Filter applied to chunks */
+    Ics_Predictor        predictor;          /* Predictor applied to lines */
+    char               **inBuf;              /* Compressed chunk data */
+    size_t              *inLen;              /* Compressed length of chunks */
+    char               **outBuf;             /* Uncompressed chunk data, with
+                                                room for the filtered data */
+    const size_t        *offset;             /* First imel of the ROI */
+    const size_t        *sampling;           /* Sampling of the ROI */
+    size_t               outSize[ICS_MAXDIM];/* Size of the output */
+    char                *dest;               /* Output data */
+    ptrdiff_t            stride[ICS_MAXDIM]; /* Strides of dest, in imels */
+} Ics_ChunkReadBatch;
+
+
+/* Get the size of the chunks along each dimension, filling in defaults. */
+void IcsGetChunkShape(const Ics_Header *icsStruct,
+                      size_t           *shape)
+{
+    int    i;
+    size_t s;
+
+
+    for (i = 0; i < icsStruct->dimensions; i++) {
+        s = icsStruct->chunkSize[i];
+        if (s == 0) s = ICS_CHUNK_SIZE;
+        if (s > icsStruct->dim[i].size) s = icsStruct->dim[i].size;
+        if (s == 0) s = 1;
+        shape[i] = s;
+    }
+}
+
+
+static void icsInitChunkGrid(const Ics_Header *icsStruct,
+                             Ics_ChunkGrid    *grid)
+{
+    int i;
+
+
+    grid->nDims = icsStruct->dimensions;
+    grid->nBytes = IcsGetDataTypeSize(icsStruct->imel.dataType);
+    IcsGetChunkShape(icsStruct, grid->shape);
+    grid->nChunks = 1;
+    grid->maxBytes = grid->nBytes;
+    for (i = 0; i < grid->nDims; i++) {
+        grid->dim[i] = icsStruct->dim[i].size;
+        grid->grid[i] = (grid->dim[i] + grid->shape[i] - 1) / grid->shape[i];
+        grid->nChunks *= grid->grid[i];
+        grid->maxBytes *= grid->shape[i];
+    }
+}
+
+
+/* Get the position and size of a chunk. Returns the number of bytes in it. */
+static size_t icsGetChunk(const Ics_ChunkGrid *grid,
+                          size_t               chunk,
+                          size_t              *origin,
+                          size_t              *size)
+{
+    int    i;
+    size_t n = grid->nBytes;
+
+
+    for (i = 0; i < grid->nDims; i++) {
+        origin[i] = (chunk % grid->grid[i]) * grid->shape[i];
+        chunk /= grid->grid[i];
+        size[i] = grid->dim[i] - origin[i];
+        if (size[i] > grid->shape[i]) size[i] = grid->shape[i];
+        n *= size[i];
+    }
+    return n;
+}
+
+
+/* Copy an n-dimensional block of imels from src to dest. The strides of both
+   are given in imels. */
+static void icsCopyBlock(const char      *src,
+                         const ptrdiff_t *srcStride,
+                         char            *dest,
+                         const ptrdiff_t *destStride,
+                         const size_t    *size,
+                         int              nDims,
+                         size_t           nBytes)
+{
+    size_t      pos[ICS_MAXDIM];
+    const char *in;
+    char       *out;
+    size_t      j;
+    int         i;
+
+
+    for (i = 0; i < nDims; i++) {
+        pos[i] = 0;
+    }
+    while (1) {
+        in = src;
+        out = dest;
+        for (i = 1; i < nDims; i++) {
+            in += (ptrdiff_t)pos[i] * srcStride[i] * (ptrdiff_t)nBytes;
+            out += (ptrdiff_t)pos[i] * destStride[i] * (ptrdiff_t)nBytes;
+        }
+        if (srcStride[0] == 1 && destStride[0] == 1) {
+            memcpy(out, in, size[0] * nBytes);
+        } else {
+            for (j = 0; j < size[0]; j++) {
+                memcpy(out, in, nBytes);
+                in += srcStride[0] * (ptrdiff_t)nBytes;
+                out += destStride[0] * (ptrdiff_t)nBytes;
+            }
+        }
+        for (i = 1; i < nDims; i++) {
+            pos[i]++;
+            if (pos[i] < size[i]) {
+                break;
+            }
+            pos[i] = 0;
+        }
+        if (i >= nDims) {
+            break;
+        }
+    }
+}
+
+
+static void icsPutUInt64(unsigned char *buf,
+                         size_t         value)
+{
+    int i;
+
+
+    for (i = 0; i < 8; i++) {
+        buf[i] = (unsigned char)(value & 0xFF);
+        value = (size_t)(((unsigned long long)value) >> 8);
+    }
+}
+
+
+static unsigned long long icsGetUInt64(const unsigned char *buf)
+{
+    unsigned long long value = 0;
+    int                i;
+
+
+    for (i = 7; i >= 0; i--) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+
+/* Gather one chunk of the image into a buffer and compress it. */
+static Ics_Error icsCompressChunk(void   *arg,
+                                  size_t  task)
+{
+    Ics_ChunkWriteBatch *batch = (Ics_ChunkWriteBatch*)arg;
+    const Ics_ChunkGrid *grid  = batch->grid;
+    size_t               origin[ICS_MAXDIM];
+    size_t               size[ICS_MAXDIM];
+    ptrdiff_t            chunkStride[ICS_MAXDIM];
+    const char          *src   = batch->src;
+    char                *buf   = batch->inBuf[task];
+    size_t               n, lineLen, j;
+    int                  i;
+
+
+    n = icsGetChunk(grid, batch->first + task, origin, size);
+    chunkStride[0] = 1;
+    for (i = 0; i < grid->nDims; i++) {
+        if (i > 0) chunkStride[i] = chunkStride[i - 1] * (ptrdiff_t)size[i - 1];
+        src += (ptrdiff_t)origin[i] * batch->stride[i] * (ptrdiff_t)grid->nBytes;
+    }
+    icsCopyBlock(src, batch->stride, buf, chunkStride, size, grid->nDims,
+                 grid->nBytes);
+    src = buf;
+    if (batch->predictor != IcsPredictor_none) {
+        lineLen = size[0] * grid->nBytes;
+        for (j = 0; j < n; j += lineLen) {
+            IcsPredictData(batch->predictor, buf + j, buf + grid->maxBytes + j,
+                           size[0], (int)grid->nBytes);
+        }
+        src = buf + grid->maxBytes;
+    }
+    if (batch->filter != IcsFilter_none) {
+        char *dest = src == buf ? buf + grid->maxBytes : buf;
+        IcsFilterData(batch->filter, src, dest, n / grid->nBytes,
+                      (int)grid->nBytes);
+        src = dest;
+    }
+    batch->outLen[task] = batch->outSize;
+    return IcsZipChunk(src, n, batch->outBuf[task], &batch->outLen[task],
+                       batch->level);
+}
+
+
+/* Write the image data in src, of the type of the image, as independently
+   compressed chunks, preceded by the table of offsets. strides can be NULL for
+   contiguous data. The chunks are compressed in parallel, a batch at a time.
+   The file must be open for writing and reading, as the table is written after
+   all chunks. */
+Ics_Error IcsWriteChunks(const Ics_Header *icsStruct,
+                         const void       *src,
+                         const ptrdiff_t  *strides,
+                         FILE             *file)
+{
+    ICSINIT;
+    Ics_ChunkGrid        grid;
+    Ics_ChunkWriteBatch  batch;
+    unsigned char       *table   = NULL;
+    char                *inMem   = NULL;
+    char                *outMem  = NULL;
+    size_t               tableSize, pos, nSlots, slotSize, count, i;
+    ptrdiff_t            tableStart;
+    int                  nThreads;
+
+
+    icsInitChunkGrid(icsStruct, &grid);
+    nThreads = IcsGetCompressionThreads(icsStruct);
+    nSlots = (size_t)nThreads * 2;
+    if (nSlots > grid.nChunks) nSlots = grid.nChunks;
+
+    batch.grid = &grid;
+    batch.src = (const char*)src;
+    if (strides != NULL) {
+        for (i = 0; i < (size_t)grid.nDims; i++) {
+            batch.stride[i] = strides[i];
+        }
+    } else {
+        batch.stride[0] = 1;
+        for (i = 1; i < (size_t)grid.nDims; i++) {
+            batch.stride[i] = batch.stride[i - 1] * (ptrdiff_t)grid.dim[i - 1];
+        }
+    }
+    batch.level = icsStruct->compLevel;
+    batch.filter = IcsGetActiveFilter(icsStruct);
+    batch.predictor = IcsGetActivePredictor(icsStruct);
+    slotSize = grid.maxBytes * (batch.filter != IcsFilter_none ||
+                                batch.predictor != IcsPredictor_none ? 2 : 1);
+    batch.outSize = IcsZipChunkBound(grid.maxBytes);
+    batch.inBuf = (char**)malloc(nSlots * sizeof(char*));
+    batch.outBuf = (char**)malloc(nSlots * sizeof(char*));
+    batch.outLen = (size_t*)malloc(nSlots * sizeof(size_t));
+    tableSize = grid.nChunks * ICS_CHUNK_ENTRY;
+    table = (unsigned char*)calloc(grid.nChunks, ICS_CHUNK_ENTRY);
+    inMem = (char*)malloc(nSlots * slotSize);
+    outMem = (char*)malloc(nSlots * batch.outSize);
+    if (batch.inBuf == NULL || batch.outBuf == NULL || batch.outLen == NULL ||
+        table == NULL || inMem == NULL || outMem == NULL) {
+        error = IcsErr_Alloc;
+        goto exit;
+    }
+    for (i = 0; i < nSlots; i++) {
+        batch.inBuf[i] = inMem + i * slotSize;
+        batch.outBuf[i] = outMem + i * batch.outSize;
+    }
+
+        /* Reserve space for the table, it is filled in at the end */
+    if (ICSFSEEK(file, 0, SEEK_END) != 0 ||
+        (tableStart = (ptrdiff_t)ICSFTELL(file)) < 0 ||
+        fwrite(table, 1, tableSize, file) != tableSize) {
+        error = IcsErr_FWriteIds;
+        goto exit;
+    }
+    pos = tableSize;
+
+    for (batch.first = 0; batch.first < grid.nChunks; batch.first += count) {
+        count = grid.nChunks - batch.first;
+        if (count > nSlots) count = nSlots;
+        error = IcsParallelFor(nThreads, count, icsCompressChunk, &batch);
+        if (error) goto exit;
+            /* Write the chunks in order */
+        for (i = 0; i < count; i++) {
+            if (fwrite(batch.outBuf[i], 1, batch.outLen[i], file)
+                != batch.outLen[i]) {
+                error = IcsErr_FWriteIds;
+                goto exit;
+            }
+            icsPutUInt64(table + (batch.first + i) * ICS_CHUNK_ENTRY, pos);
+            icsPutUInt64(table + (batch.first + i) * ICS_CHUNK_ENTRY + 8,
+                         batch.outLen[i]);
+            pos += batch.outLen[i];
+        }
+    }
+
+        /* Fill in the table, and leave the file position at the end of the
+           data */
+    if (ICSFSEEK(file, tableStart, SEEK_SET) != 0 ||
+        fwrite(table, 1, tableSize, file) != tableSize ||
+        ICSFSEEK(file, tableStart + (ptrdiff_t)pos, SEEK_SET) != 0) {
+        error = IcsErr_FWriteIds;
+    }
+
+  exit:
+    free(batch.inBuf);
+    free(batch.outBuf);
+    free(batch.outLen);
+    free(table);
+    free(inMem);
+    free(outMem);
+    return error;
+}
+
+
+/* Get the range of output imels along dimension i that fall within the chunk
+   with the given origin and size. Returns 0 if there are none. */
+static int icsChunkOverlap(const Ics_ChunkReadBatch *batch,
+                           int                       i,
+                           size_t                    origin,
+                           size_t                    size,
+                           size_t                   *first,
+                           size_t                   *end)
+{
+    size_t o = batch->offset[i];
+    size_t s = batch->sampling[i];
+
+
+    if (origin + size <= o) return 0;
+    *first = origin <= o ? 0 : (origin - o + s - 1) / s;
+    *end = (origin + size - o + s - 1) / s;
+    if (*end > batch->outSize[i]) *end = batch->outSize[i];
+    return *first < *end;
+}
+
+
+/* Decompress one chunk and copy the imels within the ROI to the output. */
+static Ics_Error icsDecompressChunk(void   *arg,
+                                    size_t  task)
+{
+    ICSINIT;
+    Ics_ChunkReadBatch  *batch = (Ics_ChunkReadBatch*)arg;
+    const Ics_ChunkGrid *grid  = batch->grid;
+    size_t               origin[ICS_MAXDIM];
+    size_t               size[ICS_MAXDIM];
+    size_t               first[ICS_MAXDIM];
+    size_t               end[ICS_MAXDIM];
+    ptrdiff_t            srcStride[ICS_MAXDIM];
+    ptrdiff_t            chunkStride = 1;
+    const char          *src   = batch->outBuf[task];
+    char                *dest  = batch->dest;
+    size_t               n, lineLen, j;
+    int                  i;
+
+
+    n = icsGetChunk(grid, batch->chunks[task], origin, size);
+    if (batch->filter != IcsFilter_none) {
+        error = IcsUnzipChunk(batch->inBuf[task], batch->inLen[task],
+                              batch->outBuf[task] + grid->maxBytes, n);
+        if (!error) IcsUnfilterData(batch->filter,
+                                    batch->outBuf[task] + grid->maxBytes,
+                                    batch->outBuf[task], n / grid->nBytes,
+                                    (int)grid->nBytes);
+    } else {
+        error = IcsUnzipChunk(batch->inBuf[task], batch->inLen[task],
+                              batch->outBuf[task], n);
+    }
+    if (!error) error = IcsReorderIds(batch->outBuf[task], n,
+                                      batch->icsStruct->imel.dataType,
+                                      batch->icsStruct->byteOrder,
+                                      (int)grid->nBytes);
+    if (error) return error;
+    if (batch->predictor != IcsPredictor_none) {
+        lineLen = size[0] * grid->nBytes;
+        for (j = 0; j < n; j += lineLen) {
+            IcsUnpredictData(batch->predictor, batch->outBuf[task] + j,
+                             size[0], (int)grid->nBytes);
+        }
+    }
+
+    for (i = 0; i < grid->nDims; i++) {
+        icsChunkOverlap(batch, i, origin[i], size[i], &first[i], &end[i]);
+        src += (ptrdiff_t)(batch->offset[i] + first[i] * batch->sampling[i]
+                           - origin[i]) * chunkStride * (ptrdiff_t)grid->nBytes;
+        dest += (ptrdiff_t)first[i] * batch->stride[i]
+            * (ptrdiff_t)grid->nBytes;
+        srcStride[i] = chunkStride * (ptrdiff_t)batch->sampling[i];
+        end[i] -= first[i];
+        chunkStride *= (ptrdiff_t)size[i];
+    }
+    icsCopyBlock(src, srcStride, dest, batch->stride, end, grid->nDims,
+                 grid->nBytes);
+
+    return error;
+}
+
+
+/* Read a region of chunked image data, decompressing only the chunks that
+   contain imels within the region, using multiple threads. offset, size and
+   sampling describe the region as in IcsGetROIData, and can be NULL to read
+   the whole image. destStride gives the strides of dest in imels, and can be
+   NULL if the output is contiguous. nThreads is the number of threads to use,
+   or 0 to use the number set with IcsSetCompressionThreads. IcsOpenIds must be
+   called first. */
+Ics_Error IcsReadChunks(Ics_Header      *icsStruct,
+                        const size_t    *offset,
+                        const size_t    *size,
+                        const size_t    *sampling,
+                        void            *dest,
+                        const ptrdiff_t *destStride,
+                        int              nThreads)
+{
+    ICSINIT;
+    Ics_BlockRead       *br      = (Ics_BlockRead*)icsStruct->blockRead;
+    Ics_ChunkGrid        grid;
+    Ics_ChunkReadBatch   batch;
+    size_t               bOffset[ICS_MAXDIM];
+    size_t               bSampling[ICS_MAXDIM];
+    size_t               range[ICS_MAXDIM];
+    size_t               pos[ICS_MAXDIM];
+    size_t               origin, extent, first, end;
+    unsigned char       *table   = NULL;
+    size_t              *chunks  = NULL;
+    size_t              *inSize  = NULL;
+    char                *outMem  = NULL;
+    size_t               tableSize, nNeeded, done, count, chunk, i;
+    size_t               slotSize;
+    size_t               nSlots  = 0;
+    unsigned long long   chunkOffset, chunkLength;
+    int                  d;
+
+
+    if (br == NULL) return IcsErr_NotValidAction;
+    icsInitChunkGrid(icsStruct, &grid);
+    for (d = 0; d < grid.nDims; d++) {
+        bOffset[d] = offset != NULL ? offset[d] : 0;
+        bSampling[d] = sampling != NULL ? sampling[d] : 1;
+        batch.outSize[d] = size != NULL ? size[d] : grid.dim[d];
+        batch.outSize[d] = (batch.outSize[d] + bSampling[d] - 1) / bSampling[d];
+    }
+    batch.icsStruct = icsStruct;
+    batch.grid = &grid;
+    batch.filter = IcsGetActiveFilter(icsStruct);
+    batch.predictor = IcsGetActivePredictor(icsStruct);
+    batch.offset = bOffset;
+    batch.sampling = bSampling;
+    batch.dest = (char*)dest;
+    if (destStride != NULL) {
+        for (d = 0; d < grid.nDims; d++) {
+            batch.stride[d] = destStride[d];
+        }
+    } else {
+        batch.stride[0] = 1;
+        for (d = 1; d < grid.nDims; d++) {
+            batch.stride[d] = batch.stride[d - 1]
+                * (ptrdiff_t)batch.outSize[d - 1];
+        }
+    }
+    batch.inBuf = NULL;
+    batch.inLen = NULL;
+    batch.outBuf = NULL;
+
+        /* Read the offset table */
+    tableSize = grid.nChunks * ICS_CHUNK_ENTRY;
+    table = (unsigned char*)malloc(tableSize);
+    chunks = (size_t*)malloc(grid.nChunks * sizeof(size_t));
+    if (table == NULL || chunks == NULL) {
+        error = IcsErr_Alloc;
+        goto exit;
+    }
+    if (ICSFSEEK(br->dataFilePtr, (ptrdiff_t)br->dataOffset, SEEK_SET) != 0 ||
+        fread(table, 1, tableSize, br->dataFilePtr) != tableSize) {
+        error = ferror(br->dataFilePtr) ? IcsErr_FReadIds : IcsErr_EndOfStream;
+        goto exit;
+    }
+
+        /* Make a list of the chunks that contain imels within the ROI */
+    for (d = 0; d < grid.nDims; d++) {
+        if (batch.outSize[d] == 0) goto exit;
+        pos[d] = bOffset[d] / grid.shape[d];
+        range[d] = (bOffset[d] + (batch.outSize[d] - 1) * bSampling[d])
+            / grid.shape[d];
+    }
+    nNeeded = 0;
+    while (1) {
+        chunk = 0;
+        for (d = grid.nDims - 1; d >= 0; d--) {
+            origin = pos[d] * grid.shape[d];
+            extent = grid.dim[d] - origin;
+            if (extent > grid.shape[d]) extent = grid.shape[d];
+            if (!icsChunkOverlap(&batch, d, origin, extent, &first, &end)) {
+                break;
+            }
+            chunk = chunk * grid.grid[d] + pos[d];
+        }
+        if (d < 0) {
+            chunks[nNeeded++] = chunk;
+        }
+        for (d = 0; d < grid.nDims; d++) {
+            pos[d]++;
+            if (pos[d] <= range[d]) {
+                break;
+            }
+            pos[d] = bOffset[d] / grid.shape[d];
+        }
+        if (d == grid.nDims) {
+            break;
+        }
+    }
+
+    if (nThreads <= 0) nThreads = IcsGetCompressionThreads(icsStruct);
+    nSlots = (size_t)nThreads * 2;
+    if (nSlots > nNeeded) nSlots = nNeeded;
+    batch.inBuf = (char**)calloc(nSlots, sizeof(char*));
+    batch.inLen = (size_t*)malloc(nSlots * sizeof(size_t));
+    batch.outBuf = (char**)malloc(nSlots * sizeof(char*));
+    inSize = (size_t*)calloc(nSlots, sizeof(size_t));
+    slotSize = grid.maxBytes * (batch.filter != IcsFilter_none ? 2 : 1);
+    outMem = (char*)malloc(nSlots * slotSize);
+    if (batch.inBuf == NULL || batch.inLen == NULL || batch.outBuf == NULL ||
+        inSize == NULL || outMem == NULL) {
+        error = IcsErr_Alloc;
+        goto exit;
+    }
+    for (i = 0; i < nSlots; i++) {
+        batch.outBuf[i] = outMem + i * slotSize;
+    }
+
+    for (done = 0; done < nNeeded; done += count) {
+        count = nNeeded - done;
+        if (count > nSlots) count = nSlots;
+        batch.chunks = chunks + done;
+            /* Read the compressed chunks of this batch */
+        for (i = 0; i < count; i++) {
+            chunkOffset = icsGetUInt64(table + batch.chunks[i]
+                                       * ICS_CHUNK_ENTRY);
+            chunkLength = icsGetUInt64(table + batch.chunks[i]
+                                       * ICS_CHUNK_ENTRY + 8);
+            if (chunkOffset < tableSize || chunkLength == 0 ||
+                chunkOffset > (size_t)-1 - br->dataOffset ||
+                chunkLength > (size_t)-1 - br->dataOffset - chunkOffset) {
+                error = IcsErr_CorruptedStream;
+                goto exit;
+            }
+            batch.inLen[i] = (size_t)chunkLength;
+            if (batch.inLen[i] > inSize[i]) {
+                char *buf = (char*)realloc(batch.inBuf[i], batch.inLen[i]);
+                if (buf == NULL) {
+                    error = IcsErr_Alloc;
+                    goto exit;
+                }
+                batch.inBuf[i] = buf;
+                inSize[i] = batch.inLen[i];
+            }
+            if (ICSFSEEK(br->dataFilePtr,
+                         (ptrdiff_t)(br->dataOffset + chunkOffset),
+                         SEEK_SET) != 0 ||
+                fread(batch.inBuf[i], 1, batch.inLen[i], br->dataFilePtr)
+                != batch.inLen[i]) {
+                error = ferror(br->dataFilePtr) ? IcsErr_FReadIds
+                                                : IcsErr_EndOfStream;
+                goto exit;
+            }
+        }
+        error = IcsParallelFor(nThreads, count, icsDecompressChunk, &batch);
+        if (error) goto exit;
+    }
+
+  exit:
+    if (batch.inBuf != NULL) {
+        for (i = 0; i < nSlots; i++) {
+            free(batch.inBuf[i]);
+        }
+    }
+    free(batch.inBuf);
+    free(batch.inLen);
+    free(batch.outBuf);
+    free(inSize);
+    free(outMem);
+    free(table);
+    free(chunks);
+    return error;
+}
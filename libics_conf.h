@@ -0,0 +1,248 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright (C) 2000-2013, 2017, 2025 Cris Luengo and others
+ * Copyright 2015, 2017:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_conf.h
+ *
+ * This file allows you to configure libics. Only needed to build the
+ * library
+ *
+ */
+
+
+#ifndef LIBICS_CONF_H
+#define LIBICS_CONF_H
+
+
+/* These are used internally when the precise length of a variable is needed.
+   We also use size_t and ptrdiff_t for a variables that are as wide as a
+   pointer (i.e. can hold the size of any data block). */
+#include <stdint.h>
+typedef uint8_t  ics_t_uint8;
+typedef int8_t   ics_t_sint8;
+typedef uint16_t ics_t_uint16;
+typedef int16_t  ics_t_sint16;
+typedef uint32_t ics_t_uint32;
+typedef int32_t  ics_t_sint32;
+typedef uint64_t ics_t_uint64;
+typedef int64_t  ics_t_sint64;
+typedef float    ics_t_real32;
+typedef double   ics_t_real64;
+
+
+/* Doubles larger than ICS_MAX_DOUBLE or smaller than ICS_MIN_DOUBLE are written
+   in scientific notation. */
+#define ICS_MAX_DOUBLE 10000000
+#define ICS_MIN_DOUBLE 0.001
+
+
+/* ICS_HISTARRAY_INCREMENT sets the increment for the array allocated to contain
+   the history strings. */
+#define ICS_HISTARRAY_INCREMENT 1024
+
+
+/* ICS_BUF_SIZE is the size of the buffer allocated to:
+   - Do the compression. This is independent from the memory allocated by zlib
+     for the dictionary.
+   - Decompress stuff into when skipping a data block (IcsSetIdsBlock() for
+     compressed files). */
+#define ICS_BUF_SIZE 16384
+
+
+/* ICS_COPY_BUF_SIZE is the size of the buffer through which data is copied
+   from one IDS file to another when the ICS file is opened for updating. On
+   Linux the kernel copies the data, and this buffer is used only when it
+   cannot. */
+#define ICS_COPY_BUF_SIZE (1024 * 1024)
+
+
+/* ICS_HEADER_BUF_SIZE is the size of the blocks in which the ICS header is
+   read. Most headers are read with a single read from the file. It must be at
+   least ICS_LINE_LENGTH. */
+#define ICS_HEADER_BUF_SIZE 16384
+
+
+/* ICS_ZIP_INDEX_SPAN is the distance, in bytes of uncompressed data, between
+   the access points recorded while reading gzip-compressed data. Seeking in
+   such data starts decompressing from the nearest access point. Each access
+   point stores 32 kB of data. */
+#define ICS_ZIP_INDEX_SPAN (4 * 1024 * 1024)
+
+
+/* ICS_CHUNK_SIZE is the default size, in imels along each dimension, of the
+   chunks written with IcsCompr_chunked_gzip. Chunks are clipped to the size of
+   the image. */
+#define ICS_CHUNK_SIZE 64
+
+
+/* ICS_STRIDE_BUF_SIZE is the size of the buffer in which non-contiguous image
+   data is gathered before it is written to an uncompressed file. */
+#define ICS_STRIDE_BUF_SIZE (1024 * 1024)
+
+
+/* ICS_CONVERT_BUF_SIZE is the size of the buffer in which image data is read
+   before it is converted to the data type requested with IcsGetDataAs, and in
+   which image data given with IcsSetDataAs is converted before it is
+   written. It should fit in the level-2 cache. */
+#define ICS_CONVERT_BUF_SIZE (64 * 1024)
+
+
+/* ICS_ROI_GAP_SIZE is the largest gap, in bytes, between two lines of a region
+   read with IcsGetROIData that is read through rather than skipped. Lines
+   closer together than this are read from the file with a single request. */
+#define ICS_ROI_GAP_SIZE (64 * 1024)
+
+
+/* ICS_ROI_BUF_SIZE is the size of the buffer in which the lines of a region
+   are read when they cannot be read directly into the output, because they
+   are subsampled or converted, or because the output is not contiguous along
+   the lines. Lines read into a strided output are transposed from this buffer
+   one batch at a time. */
+#define ICS_ROI_BUF_SIZE (1024 * 1024)
+
+
+#undef ICS_USING_CONFIGURE
+#if !defined(ICS_USING_CONFIGURE)
+
+/*********************************************************************/
+/* If we are not using the configure script:                         */
+/*********************************************************************/
+
+
+/* If ICS_FORCE_C_LOCALE is set, the locale is set to "C" before each read or
+   write operation. This ensures that the ICS header file is formatted
+   properly. Where the C library provides uselocale(), or on Windows, only the
+   locale of the calling thread is changed. If your program does not modify
+   the locale, you can safely comment out is line: the "C" locale is the
+   default. If this constant is not defined and your program changes the
+   locale, the resulting ICS header file might not be readable by other
+   applications: it will only be readable if the reading application is set to
+   the same locale as the writing application.  The ICS standard calls for the
+   locale to be set to "C". */
+#define ICS_FORCE_C_LOCALE
+
+
+/* If ICS_DO_GZEXT is defined, the code will search for IDS files which have the
+   .ids.gz or .ids.Z filename extension. */
+#define ICS_DO_GZEXT
+
+
+/* If ICS_ZLIB is defined, the zlib dependency is included, and the library will
+   be able to read GZIP compressed files.  This variable is set by the makefile
+   -- enable ZLIB support there. */
+/*#define ICS_ZLIB*/
+
+
+/* If ICS_ZSTD is defined, the zstd dependency is included, and the library will
+   be able to read and write Zstandard compressed files.  This variable is set
+   by the makefile -- enable zstd support there. */
+/*#define ICS_ZSTD*/
+
+
+#else
+
+/******************************************************************************/
+/*  If we are using the configure script:                                     */
+/******************************************************************************/
+
+
+/* If we should force the c locale. */
+#undef ICS_FORCE_C_LOCALE
+
+
+/* Whether to search for IDS files with .ids.gz or .ids.Z extension. */
+#undef ICS_DO_GZEXT
+
+
+/* Whether to use zlib compression. */
+#undef ICS_ZLIB
+
+
+/* Whether to use zstd compression. */
+#undef ICS_ZSTD
+
+
+/* Whether to use the reentrant string tokenizer */
+#undef HAVE_STRTOK_R
+
+
+/* Whether the c library provides memory-mapped file access */
+#undef HAVE_MMAP
+
+
+/* Whether the c library provides positional file reading */
+#undef HAVE_PREAD
+
+
+/* Whether the c library provides vectored positional file reading */
+#undef HAVE_PREADV
+
+
+/* Whether the c library provides uselocale */
+#undef HAVE_USELOCALE
+
+
+/* Whether the c library provides copy_file_range */
+#undef HAVE_COPY_FILE_RANGE
+
+
+/* Whether the c library provides sendfile */
+#undef HAVE_SENDFILE
+
+
+/* Whether the c library provides fmemopen, to read ICS files in memory */
+#undef HAVE_FMEMOPEN
+
+
+/* Whether the c library provides open_memstream, to write ICS files in
+   memory */
+#undef HAVE_OPEN_MEMSTREAM
+
+
+/* Whether the c library provides fopencookie or funopen, to do file I/O
+   through custom callbacks */
+#undef HAVE_FOPENCOOKIE
+#undef HAVE_FUNOPEN
+
+
+/* Whether POSIX threads are available, for parallel compression */
+#undef HAVE_PTHREADS
+
+
+/* Whether the compiler supports _Float16 as a data type. */
+#undef HAVE_FLOAT16
+
+
+#endif
+#ifdef HAVE_FLOAT16
+typedef _Float16    ics_t_real16;
+#endif
+#endif
+
@@ -0,0 +1,451 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright 2025:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Contact: libics@svi.nl
+ *
+ * Copyright (C) 2000-2013 Cris Luengo and others
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_convert.c
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsConvertImels()
+ *   IcsPackBits()
+ *   IcsUnpackBits()
+ *
+ * Imels are converted in blocks small enough to stay in the level-1 cache:
+ * each block is widened into an array of doubles, scaled, and narrowed into
+ * the destination type. Each of these steps is a simple loop over one type,
+ * which the compiler vectorizes. Half-precision values are converted in
+ * software, as most compilers do not support _Float16.
+ *
+ * Binary imels take one byte in memory, and one bit in the file. Bit i%8 of
+ * byte i/8 holds imel i, as in the bit planes of IcsFilter_bitshuffle.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "libics_intern.h"
+
+
+/* Vector instructions for packing bits. On x86 the instruction set is selected
+   at run time. */
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define ICS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+/* Number of imels converted at a time. */
+#define ICS_CONVERT_BLOCK 512
+
+
+/* Convert a half-precision value, given by its bits, to single precision. */
+static float icsHalfToFloat(ics_t_uint16 h)
+{
+    ics_t_uint32 sign = (ics_t_uint32)(h & 0x8000) << 16;
+    ics_t_uint32 exp  = (h >> 10) & 0x1F;
+    ics_t_uint32 mant = h & 0x3FF;
+    ics_t_uint32 bits;
+    float        f;
+
+
+    if (exp == 0x1F) {
+            /* Infinity or NaN */
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else if (exp != 0) {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if (mant == 0) {
+        bits = sign;
+    } else {
+            /* Subnormal: normalize the mantissa */
+        exp = 113;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+    }
+    memcpy(&f, &bits, sizeof(f));
+
+    return f;
+}
+
+
+/* Convert a single-precision value to half precision, rounding to nearest
+   even. Values too large for half precision become infinity. */
+static ics_t_uint16 icsFloatToHalf(float f)
+{
+    ics_t_uint32 x, absx, sign, h, rem, half;
+    int          shift;
+
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (x >> 16) & 0x8000;
+    absx = x & 0x7FFFFFFF;
+    if (absx >= 0x7F800000) {
+            /* Infinity or NaN */
+        return (ics_t_uint16)(sign | 0x7C00 | (absx > 0x7F800000 ? 0x200 : 0));
+    }
+    if (absx >= 0x477FF000) {
+            /* Rounds to a value larger than 65504 */
+        return (ics_t_uint16)(sign | 0x7C00);
+    }
+    if (absx >= 0x38800000) {
+            /* Normal: rebias the exponent and round the mantissa; a carry
+               correctly moves into the exponent */
+        h = (absx - 0x38000000) >> 13;
+        rem = absx & 0x1FFF;
+        if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+        return (ics_t_uint16)(sign | h);
+    }
+    if (absx < 0x33000000) {
+            /* Rounds to zero */
+        return (ics_t_uint16)sign;
+    }
+        /* Subnormal */
+    shift = 126 - (int)(absx >> 23);
+    x = (absx & 0x7FFFFF) | 0x800000;
+    h = x >> shift;
+    rem = x & ((1u << shift) - 1);
+    half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) h++;
+
+    return (ics_t_uint16)(sign | h);
+}
+
+
+/* Widen n values of type `type` to doubles. */
+static void icsLoad(const void   *src,
+                    Ics_DataType  type,
+                    double       *tmp,
+                    size_t        n)
+{
+    size_t i;
+
+
+#define ICS_LOAD(T) {                                                         \
+        const T *in = (const T*)src;                                          \
+        for (i = 0; i < n; i++) tmp[i] = (double)in[i];                       \
+    }
+    switch (type) {
+        case Ics_binary:
+        case Ics_uint8:  ICS_LOAD(ics_t_uint8);  break;
+        case Ics_sint8:  ICS_LOAD(ics_t_sint8);  break;
+        case Ics_uint16: ICS_LOAD(ics_t_uint16); break;
+        case Ics_sint16: ICS_LOAD(ics_t_sint16); break;
+        case Ics_uint32: ICS_LOAD(ics_t_uint32); break;
+        case Ics_sint32: ICS_LOAD(ics_t_sint32); break;
+        case Ics_uint64: ICS_LOAD(ics_t_uint64); break;
+        case Ics_sint64: ICS_LOAD(ics_t_sint64); break;
+        case Ics_real32: ICS_LOAD(ics_t_real32); break;
+        case Ics_real64: ICS_LOAD(ics_t_real64); break;
+        case Ics_real16:
+        {
+            const ics_t_uint16 *in = (const ics_t_uint16*)src;
+            for (i = 0; i < n; i++) tmp[i] = (double)icsHalfToFloat(in[i]);
+        }
+        break;
+        default:
+            break;
+    }
+#undef ICS_LOAD
+}
+
+
+/* Narrow n doubles to type `type`. Integers are rounded to nearest, and values
+   out of range saturate; NaN becomes the smallest value of the type. For
+   binary data, any non-zero value is 1, as when it is packed. */
+static void icsStore(const double *tmp,
+                     void         *dest,
+                     Ics_DataType  type,
+                     size_t        n)
+{
+    size_t i;
+
+
+#define ICS_STORE_INT(T, lo, hi) {                                            \
+        T *out = (T*)dest;                                                    \
+        for (i = 0; i < n; i++) {                                             \
+            double v = tmp[i];                                                \
+            out[i] = v >= (double)(hi) ? (T)(hi) :                            \
+                     v > (double)(lo) ? (T)(v < 0 ? v - 0.5 : v + 0.5) :      \
+                     (T)(lo);                                                 \
+        }                                                                     \
+    }
+#define ICS_STORE_REAL(T) {                                                   \
+        T *out = (T*)dest;                                                    \
+        for (i = 0; i < n; i++) out[i] = (T)tmp[i];                           \
+    }
+    switch (type) {
+        case Ics_binary:
+        {
+            ics_t_uint8 *out = (ics_t_uint8*)dest;
+            for (i = 0; i < n; i++) out[i] = tmp[i] != 0.0;
+        }
+        break;
+        case Ics_uint8:  ICS_STORE_INT(ics_t_uint8, 0, UINT8_MAX);          break;
+        case Ics_sint8:  ICS_STORE_INT(ics_t_sint8, INT8_MIN, INT8_MAX);    break;
+        case Ics_uint16: ICS_STORE_INT(ics_t_uint16, 0, UINT16_MAX);        break;
+        case Ics_sint16: ICS_STORE_INT(ics_t_sint16, INT16_MIN, INT16_MAX); break;
+        case Ics_uint32: ICS_STORE_INT(ics_t_uint32, 0, UINT32_MAX);        break;
+        case Ics_sint32: ICS_STORE_INT(ics_t_sint32, INT32_MIN, INT32_MAX); break;
+        case Ics_uint64: ICS_STORE_INT(ics_t_uint64, 0, UINT64_MAX);        break;
+        case Ics_sint64: ICS_STORE_INT(ics_t_sint64, INT64_MIN, INT64_MAX); break;
+        case Ics_real32: ICS_STORE_REAL(ics_t_real32);                      break;
+        case Ics_real64: ICS_STORE_REAL(ics_t_real64);                      break;
+        case Ics_real16:
+        {
+            ics_t_uint16 *out = (ics_t_uint16*)dest;
+            for (i = 0; i < n; i++) out[i] = icsFloatToHalf((float)tmp[i]);
+        }
+        break;
+        default:
+            break;
+    }
+#undef ICS_STORE_INT
+#undef ICS_STORE_REAL
+}
+
+
+/* Convert n imels of type srcType at src to type destType at dest, computing
+   value * scale + offset. Integer results are rounded and saturated. Complex
+   imels can only be converted to complex imels; both components are scaled.
+   src and dest may be the same buffer, but must not otherwise overlap. */
+Ics_Error IcsConvertImels(const void   *src,
+                          Ics_DataType  srcType,
+                          void         *dest,
+                          Ics_DataType  destType,
+                          size_t        n,
+                          double        scale,
+                          double        offset)
+{
+    double      tmp[ICS_CONVERT_BLOCK];
+    size_t      srcSize  = IcsGetDataTypeSize(srcType);
+    size_t      destSize = IcsGetDataTypeSize(destType);
+    size_t      block, start, i, j;
+    int         srcComplex, destComplex, backwards;
+    const char *in;
+    char       *out;
+
+
+    if (srcSize == 0 || destSize == 0) return IcsErr_UnknownDataType;
+    srcComplex = srcType == Ics_complex32 || srcType == Ics_complex64;
+    destComplex = destType == Ics_complex32 || destType == Ics_complex64;
+    if (srcComplex != destComplex) return IcsErr_IllParameter;
+    if (srcType == destType && scale == 1.0 && offset == 0.0) {
+        if (src != dest) memcpy(dest, src, n * srcSize);
+        return IcsErr_Ok;
+    }
+    if (srcComplex) {
+            /* Convert the real and imaginary components separately */
+        srcType = srcType == Ics_complex32 ? Ics_real32 : Ics_real64;
+        destType = destType == Ics_complex32 ? Ics_real32 : Ics_real64;
+        srcSize /= 2;
+        destSize /= 2;
+        n *= 2;
+    }
+
+        /* When converting in place to a larger type, the blocks are processed
+           from the end, so that no imel is overwritten before it is read */
+    backwards = src == dest && destSize > srcSize;
+    for (i = 0; i < n; i += block) {
+        block = n - i < ICS_CONVERT_BLOCK ? n - i : ICS_CONVERT_BLOCK;
+        start = backwards ? n - i - block : i;
+        in = (const char*)src + start * srcSize;
+        out = (char*)dest + start * destSize;
+        icsLoad(in, srcType, tmp, block);
+        if (scale != 1.0 || offset != 0.0) {
+            for (j = 0; j < block; j++) {
+                tmp[j] = tmp[j] * scale + offset;
+            }
+        }
+        icsStore(tmp, out, destType, block);
+    }
+
+    return IcsErr_Ok;
+}
+
+
+/* Pack imels start to n-1, n a multiple of 8. */
+static void icsPackBits(const unsigned char *src,
+                        unsigned char       *dest,
+                        size_t               n,
+                        size_t               start)
+{
+    size_t        i;
+    unsigned char byte;
+    int           j;
+
+
+    for (i = start; i < n; i += 8) {
+        byte = 0;
+        for (j = 0; j < 8; j++) {
+            byte |= (unsigned char)((src[i + (size_t)j] != 0) << j);
+        }
+        dest[i / 8] = byte;
+    }
+}
+
+
+/* Unpack imels start to n-1, n a multiple of 8. */
+static void icsUnpackBits(const unsigned char *src,
+                          unsigned char       *dest,
+                          size_t               n,
+                          size_t               start)
+{
+    size_t        i;
+    unsigned char byte;
+    int           j;
+
+
+    for (i = start; i < n; i += 8) {
+        byte = src[i / 8];
+        for (j = 0; j < 8; j++) {
+            dest[i + (size_t)j] = (byte >> j) & 1;
+        }
+    }
+}
+
+
+#if defined(ICS_X86_SIMD)
+
+/* As icsPackBits, using SSE2 instructions. movemask collects the most
+   significant bit of 16 bytes, which is set for the bytes that are zero. */
+__attribute__((target("sse2")))
+static void icsPackBitsSSE2(const unsigned char *src,
+                            unsigned char       *dest,
+                            size_t               n)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t  i;
+    int     bits;
+
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        bits = ~_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(src + i)), zero));
+        dest[i / 8] = (unsigned char)bits;
+        dest[i / 8 + 1] = (unsigned char)(bits >> 8);
+    }
+    icsPackBits(src, dest, n, i);
+}
+
+
+/* As icsUnpackBits, using SSE2 instructions. Two bytes are each repeated
+   eight times, and each copy is masked to one of its bits. */
+__attribute__((target("sse2")))
+static void icsUnpackBitsSSE2(const unsigned char *src,
+                              unsigned char       *dest,
+                              size_t               n)
+{
+    __m128i mask = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+                                (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    __m128i one  = _mm_set1_epi8(1);
+    __m128i v;
+    size_t  i;
+
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = _mm_cvtsi32_si128(src[i / 8] | (src[i / 8 + 1] << 8));
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_and_si128(v, one));
+    }
+    icsUnpackBits(src, dest, n, i);
+}
+
+#endif
+
+
+/* Pack n binary imels, one per byte in src, into (n+7)/8 bytes at dest. Any
+   non-zero byte is a 1. Unused bits of the last byte are set to 0. */
+void IcsPackBits(const void *src,
+                 void       *dest,
+                 size_t      n)
+{
+    const unsigned char *s = (const unsigned char*)src;
+    unsigned char       *d = (unsigned char*)dest;
+    size_t               m = n - n % 8;
+    size_t               i;
+
+
+#if defined(ICS_X86_SIMD)
+    if (__builtin_cpu_supports("sse2")) {
+        icsPackBitsSSE2(s, d, m);
+    } else {
+        icsPackBits(s, d, m, 0);
+    }
+#else
+    icsPackBits(s, d, m, 0);
+#endif
+    if (m < n) {
+        d[m / 8] = 0;
+        for (i = m; i < n; i++) {
+            d[m / 8] |= (unsigned char)((s[i] != 0) << (i - m));
+        }
+    }
+}
+
+
+/* Unpack n binary imels from (n+7)/8 bytes at src into n bytes at dest, each 0
+   or 1. The bytes are unpacked in order, each one before its imels are
+   written, so src may be the last (n+7)/8 bytes of dest. */
+void IcsUnpackBits(const void *src,
+                   void       *dest,
+                   size_t      n)
+{
+    const unsigned char *s = (const unsigned char*)src;
+    unsigned char       *d = (unsigned char*)dest;
+    size_t               m = n - n % 8;
+    unsigned char        byte;
+    size_t               i;
+
+
+#if defined(ICS_X86_SIMD)
+    if (__builtin_cpu_supports("sse2")) {
+        icsUnpackBitsSSE2(s, d, m);
+    } else {
+        icsUnpackBits(s, d, m, 0);
+    }
+#else
+    icsUnpackBits(s, d, m, 0);
+#endif
+    if (m < n) {
+        byte = s[m / 8];
+        for (i = m; i < n; i++) {
+            d[i] = (byte >> (i - m)) & 1;
+        }
+    }
+}
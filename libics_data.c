@@ -36,9 +36,16 @@
  *
  * This file declares some data structures used when reading and
  * writing the ICS headers.
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsSymbolHash()
+ *   IcsGetSymbolToken()
  */
 
 
+#include <stdlib.h>
+#include <string.h>
 #include "libics_intern.h"
 
 
@@ -75,7 +82,10 @@ Ics_Symbol G_SubCatSymbols[] =
     {"type",               ICSTOK_TYPE},
     {"model",              ICSTOK_MODEL},
     {"s_params",           ICSTOK_SPARAMS},
-    {"s_states",           ICSTOK_SSTATES}
+    {"s_states",           ICSTOK_SSTATES},
+    {"chunks",             ICSTOK_CHUNKS},
+    {"filter",             ICSTOK_FILTER},
+    {"predictor",          ICSTOK_PREDICTOR}
 };
 
 
@@ -137,10 +147,14 @@ Ics_Symbol G_ValueSymbols[] =
     {"uncompressed",      ICSTOK_COMPR_UNCOMPRESSED},
     {"compress",          ICSTOK_COMPR_COMPRESS},
     {"gzip",              ICSTOK_COMPR_GZIP},
+    {"chunked_gzip",      ICSTOK_COMPR_CHUNKED_GZIP},
+    {"zstd",              ICSTOK_COMPR_ZSTD},
+    {"shuffle",           ICSTOK_FILTER_SHUFFLE},
+    {"bitshuffle",        ICSTOK_FILTER_BITSHUFFLE},
+    {"horizontal",        ICSTOK_PREDICTOR_HORIZONTAL},
     {"integer",           ICSTOK_FORMAT_INTEGER},
     {"real",              ICSTOK_FORMAT_REAL},
-    {"float",             ICSTOK_FORMAT_REAL}, /* CAUTION: this makes this list
-                                                  one longer than expected */
+    {"float",             ICSTOK_FORMAT_REAL}, /* Synonym of "real" */
     {"complex",           ICSTOK_FORMAT_COMPLEX},
     {"signed",            ICSTOK_SIGN_SIGNED},
     {"unsigned",          ICSTOK_SIGN_UNSIGNED},
@@ -153,31 +167,136 @@ Ics_Symbol G_ValueSymbols[] =
 };
 
 
+/* Case-insensitive FNV-1a hash. Only ASCII letters are folded, such that the
+   result does not depend on the locale. */
+ics_t_uint32 IcsSymbolHash(const char   *name,
+                           ics_t_uint32  seed)
+{
+    ics_t_uint32 h = 2166136261u ^ seed;
+    unsigned int c;
+
+
+    while ((c = (unsigned char)*name++) != 0) {
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        h = (h ^ c) * 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+
+Ics_Token IcsGetSymbolToken(const char           *name,
+                            const Ics_SymbolList *listSpec)
+{
+    ics_t_uint32 mask = ((ics_t_uint32)1 << listSpec->hashBits) - 1;
+    int          i;
+
+
+    if (name == NULL) return ICSTOK_NONE;
+    i = listSpec->hash[IcsSymbolHash(name, listSpec->hashSeed) & mask];
+        /* Because some older ics versions have uncapitalized subsubcat
+           symbols (e.g. "channels" instead of the current "Channels"), do a
+           case-insensitive string comparison for backward compatibility. */
+    if (i < 0 || ICSSTRCASECMP(listSpec->list[i].name, name) != 0) {
+        return ICSTOK_NONE;
+    }
+    return listSpec->list[i].token;
+}
+
+
+/* Perfect hash tables for the symbol lists above, generated by
+   support/symbol_hash.c. Regenerate them when changing the lists; the checks
+   below fail to compile when the number of symbols changes, and test_symbols
+   fails when a symbol is not found. */
+#ifndef ICS_SYMBOL_HASH_GENERATOR
+
+
+static const signed char G_CatHash[8] =
+{
+      2,   0,   1,   3,   4,   6,  -1,   5
+};
+
+
+typedef char icsCheckCatHash[
+    sizeof(G_CatSymbols) / sizeof(Ics_Symbol) == 7 ? 1 : -1];
+
+
 Ics_SymbolList G_Categories =
 {
-    ICSTOK_LASTMAIN,
-    G_CatSymbols
+    sizeof(G_CatSymbols) / sizeof(Ics_Symbol),
+    G_CatSymbols,
+    0x00000049u,
+    3,
+    G_CatHash
 };
 
 
+static const signed char G_SubCatHash[32] =
+{
+      5,  20,  18,   9,  -1,  -1,  13,   6,  22,   2,  -1,  -1,  21,   7,  11,  19,
+      4,   8,   1,  -1,  10,  17,  16,  12,  -1,  -1,  14,   0,   3,  -1,  -1,  15
+};
+
+
+typedef char icsCheckSubCatHash[
+    sizeof(G_SubCatSymbols) / sizeof(Ics_Symbol) == 23 ? 1 : -1];
+
+
 Ics_SymbolList G_SubCategories =
 {
-    ICSTOK_LASTSUB - ICSTOK_FIRSTSUB - 1,
-    G_SubCatSymbols
+    sizeof(G_SubCatSymbols) / sizeof(Ics_Symbol),
+    G_SubCatSymbols,
+    0x00024ebdu,
+    5,
+    G_SubCatHash
+};
+
+
+static const signed char G_SubSubCatHash[128] =
+{
+     16,   0,  -1,  -1,  -1,  34,  -1,  -1,   8,  -1,  22,  10,  -1,  23,  -1,  -1,
+     -1,  -1,  -1,  -1,  31,   3,  46,   2,  30,  -1,  -1,  18,  -1,  -1,  -1,  -1,
+     -1,  -1,  20,  32,  -1,  -1,  42,  17,  19,  -1,  -1,  38,  41,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  21,  -1,  -1,  36,  -1,  -1,  -1,  14,  -1,  -1,
+     -1,  45,  43,  -1,  -1,  -1,  -1,  -1,  12,  -1,  -1,  -1,  -1,  33,  -1,  -1,
+     13,  40,  -1,  -1,  47,  -1,   4,  -1,   1,  44,  -1,  11,  -1,  -1,   5,  27,
+     35,   7,  -1,  -1,  -1,  -1,  28,  -1,  -1,  -1,  -1,  -1,  24,  -1,  37,  -1,
+     -1,  -1,  -1,  39,  -1,  25,   6,  -1,  29,  -1,  -1,  26,  -1,  15,  -1,   9
 };
 
 
+typedef char icsCheckSubSubCatHash[
+    sizeof(G_SubSubCatSymbols) / sizeof(Ics_Symbol) == 48 ? 1 : -1];
+
+
 Ics_SymbolList G_SubSubCategories =
 {
-    ICSTOK_LASTSUBSUB - ICSTOK_FIRSTSUBSUB - 1,
-    G_SubSubCatSymbols
+    sizeof(G_SubSubCatSymbols) / sizeof(Ics_Symbol),
+    G_SubSubCatSymbols,
+    0x00003315u,
+    7,
+    G_SubSubCatHash
 };
 
 
+static const signed char G_ValueHash[32] =
+{
+      5,   0,   3,  -1,  12,   7,  -1,  -1,  -1,  16,  13,  -1,   8,  14,   4,  -1,
+     -1,  -1,   9,   2,  10,  -1,  -1,  17,  -1,  -1,  15,  11,   6,  -1,   1,  -1
+};
+
+
+typedef char icsCheckValueHash[
+    sizeof(G_ValueSymbols) / sizeof(Ics_Symbol) == 18 ? 1 : -1];
+
+
 Ics_SymbolList G_Values =
 {
-    ICSTOK_LASTVALUE - ICSTOK_FIRSTVALUE - 1 + 1, /* See above: this list is one
-                                                     longer than expected. */
-    G_ValueSymbols
+    sizeof(G_ValueSymbols) / sizeof(Ics_Symbol),
+    G_ValueSymbols,
+    0x0000009au,
+    5,
+    G_ValueHash
 };
 
+
+#endif
@@ -0,0 +1,819 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright 2015-2017:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Contact: libics@svi.nl
+ *
+ * Copyright (C) 2000-2013 Cris Luengo and others
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_filter.c
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsGetActiveFilter()
+ *   IcsFilterData()
+ *   IcsUnfilterData()
+ *   IcsGetActivePredictor()
+ *   IcsPredictData()
+ *   IcsUnpredictData()
+ *
+ * The filters rearrange a run of n imels of nBytes bytes each, as stored in the
+ * file. IcsFilter_shuffle stores byte j of all imels together, for j = 0 to
+ * nBytes-1, such that the output consists of nBytes planes of n bytes.
+ * IcsFilter_bitshuffle stores bit k (0 being the least significant) of byte j
+ * of all imels together, in bit plane 8*j+k. Each bit plane holds n/8 bytes,
+ * bit i%8 of byte i/8 coming from imel i; the last n%8 imels are not
+ * transposed but copied after the bit planes.
+ *
+ * The predictor is applied before the filter, to integer imels in the machine's
+ * byte order. IcsPredictor_horizontal replaces imel i by the difference between
+ * imels i and i-1, modulo 2^(8*nBytes); the first imel of a run is kept.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "libics_intern.h"
+
+
+/* Vector instructions for shuffling. On x86 the instruction set is selected at
+   run time. */
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define ICS_X86_SIMD
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define ICS_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+
+/* Get the filter that is applied to the data. Uncompressed data and binary
+   data, which is packed into bits, are never filtered. */
+Ics_Filter IcsGetActiveFilter(const Ics_Header *icsStruct)
+{
+    if (icsStruct->compression == IcsCompr_uncompressed) return IcsFilter_none;
+    if (icsStruct->imel.dataType == Ics_binary) return IcsFilter_none;
+    return icsStruct->filter;
+}
+
+
+/* Shuffle the bytes of imels start to n-1. */
+static void icsShuffle(const unsigned char *src,
+                       unsigned char       *dest,
+                       size_t               n,
+                       size_t               nBytes,
+                       size_t               start)
+{
+    size_t i, j;
+
+
+    for (j = 0; j < nBytes; j++) {
+        for (i = start; i < n; i++) {
+            dest[j * n + i] = src[i * nBytes + j];
+        }
+    }
+}
+
+
+/* Undo icsShuffle for imels start to n-1. */
+static void icsUnshuffle(const unsigned char *src,
+                         unsigned char       *dest,
+                         size_t               n,
+                         size_t               nBytes,
+                         size_t               start)
+{
+    size_t i, j;
+
+
+    for (j = 0; j < nBytes; j++) {
+        for (i = start; i < n; i++) {
+            dest[i * nBytes + j] = src[j * n + i];
+        }
+    }
+}
+
+
+/* Transpose an 8x8 bit matrix stored in the 8 bytes of x: bit k of byte i
+   becomes bit i of byte k. */
+static ics_t_uint64 icsTranspose8x8(ics_t_uint64 x)
+{
+    ics_t_uint64 t;
+
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+
+/* Bit-shuffle groups of 8 imels, starting at imel start, up to imel m (a
+   multiple of 8). */
+static void icsBitShuffle(const unsigned char *src,
+                          unsigned char       *dest,
+                          size_t               m,
+                          size_t               nBytes,
+                          size_t               start)
+{
+    size_t       i, j, k, planeSize = m / 8;
+    ics_t_uint64 x;
+
+
+    for (j = 0; j < nBytes; j++) {
+        for (i = start; i < m; i += 8) {
+            x = 0;
+            for (k = 0; k < 8; k++) {
+                x |= (ics_t_uint64)src[(i + k) * nBytes + j] << (8 * k);
+            }
+            x = icsTranspose8x8(x);
+            for (k = 0; k < 8; k++) {
+                dest[(8 * j + k) * planeSize + i / 8] =
+                    (unsigned char)(x >> (8 * k));
+            }
+        }
+    }
+}
+
+
+/* Undo icsBitShuffle. */
+static void icsBitUnshuffle(const unsigned char *src,
+                            unsigned char       *dest,
+                            size_t               m,
+                            size_t               nBytes)
+{
+    size_t       i, j, k, planeSize = m / 8;
+    ics_t_uint64 x;
+
+
+    for (j = 0; j < nBytes; j++) {
+        for (i = 0; i < m; i += 8) {
+            x = 0;
+            for (k = 0; k < 8; k++) {
+                x |= (ics_t_uint64)src[(8 * j + k) * planeSize + i / 8]
+                    << (8 * k);
+            }
+            x = icsTranspose8x8(x);
+            for (k = 0; k < 8; k++) {
+                dest[(i + k) * nBytes + j] = (unsigned char)(x >> (8 * k));
+            }
+        }
+    }
+}
+
+
+#if defined(ICS_X86_SIMD)
+
+/* Split the bytes of a and b into the even ones (a first) and the odd ones. */
+#define ICS_DEINTERLEAVE(a, b, even, odd) {                                  \
+    even = _mm_packus_epi16(_mm_and_si128(a, _mm_set1_epi16(0xFF)),           \
+                            _mm_and_si128(b, _mm_set1_epi16(0xFF)));          \
+    odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));       \
+}
+
+/* The inverse of ICS_DEINTERLEAVE. */
+#define ICS_INTERLEAVE(even, odd, a, b) {                                    \
+    a = _mm_unpacklo_epi8(even, odd);                                         \
+    b = _mm_unpackhi_epi8(even, odd);                                         \
+}
+
+
+/* Load 16 imels of nBytes = 1, 2, 4 or 8 bytes, and split them into nBytes
+   vectors holding byte j of each imel. */
+__attribute__((target("sse2")))
+static void icsLoadPlanesSSE2(const unsigned char *src,
+                              __m128i             *p,
+                              size_t               nBytes)
+{
+    __m128i x[8], e[4], o[4];
+
+
+    switch (nBytes) {
+        case 1:
+            p[0] = _mm_loadu_si128((const __m128i*)src);
+            break;
+        case 2:
+            x[0] = _mm_loadu_si128((const __m128i*)src);
+            x[1] = _mm_loadu_si128((const __m128i*)(src + 16));
+            ICS_DEINTERLEAVE(x[0], x[1], p[0], p[1]);
+            break;
+        case 4:
+            x[0] = _mm_loadu_si128((const __m128i*)src);
+            x[1] = _mm_loadu_si128((const __m128i*)(src + 16));
+            x[2] = _mm_loadu_si128((const __m128i*)(src + 32));
+            x[3] = _mm_loadu_si128((const __m128i*)(src + 48));
+            ICS_DEINTERLEAVE(x[0], x[1], e[0], o[0]);
+            ICS_DEINTERLEAVE(x[2], x[3], e[1], o[1]);
+            ICS_DEINTERLEAVE(e[0], e[1], p[0], p[2]);
+            ICS_DEINTERLEAVE(o[0], o[1], p[1], p[3]);
+            break;
+        default: /* 8 */
+            x[0] = _mm_loadu_si128((const __m128i*)src);
+            x[1] = _mm_loadu_si128((const __m128i*)(src + 16));
+            x[2] = _mm_loadu_si128((const __m128i*)(src + 32));
+            x[3] = _mm_loadu_si128((const __m128i*)(src + 48));
+            x[4] = _mm_loadu_si128((const __m128i*)(src + 64));
+            x[5] = _mm_loadu_si128((const __m128i*)(src + 80));
+            x[6] = _mm_loadu_si128((const __m128i*)(src + 96));
+            x[7] = _mm_loadu_si128((const __m128i*)(src + 112));
+                /* Bytes 0,2,4,6 and 1,3,5,7 */
+            ICS_DEINTERLEAVE(x[0], x[1], e[0], o[0]);
+            ICS_DEINTERLEAVE(x[2], x[3], e[1], o[1]);
+            ICS_DEINTERLEAVE(x[4], x[5], e[2], o[2]);
+            ICS_DEINTERLEAVE(x[6], x[7], e[3], o[3]);
+                /* Bytes 0,4 / 2,6 / 1,5 / 3,7 */
+            ICS_DEINTERLEAVE(e[0], e[1], x[0], x[1]);
+            ICS_DEINTERLEAVE(e[2], e[3], x[2], x[3]);
+            ICS_DEINTERLEAVE(o[0], o[1], x[4], x[5]);
+            ICS_DEINTERLEAVE(o[2], o[3], x[6], x[7]);
+            ICS_DEINTERLEAVE(x[0], x[2], p[0], p[4]);
+            ICS_DEINTERLEAVE(x[1], x[3], p[2], p[6]);
+            ICS_DEINTERLEAVE(x[4], x[6], p[1], p[5]);
+            ICS_DEINTERLEAVE(x[5], x[7], p[3], p[7]);
+            break;
+    }
+}
+
+
+/* The inverse of icsLoadPlanesSSE2. */
+__attribute__((target("sse2")))
+static void icsStorePlanesSSE2(const __m128i *p,
+                               unsigned char *dest,
+                               size_t         nBytes)
+{
+    __m128i x[8], e[4], o[4];
+    size_t  i;
+
+
+    switch (nBytes) {
+        case 1:
+            _mm_storeu_si128((__m128i*)dest, p[0]);
+            return;
+        case 2:
+            ICS_INTERLEAVE(p[0], p[1], x[0], x[1]);
+            break;
+        case 4:
+            ICS_INTERLEAVE(p[0], p[2], e[0], e[1]);
+            ICS_INTERLEAVE(p[1], p[3], o[0], o[1]);
+            ICS_INTERLEAVE(e[0], o[0], x[0], x[1]);
+            ICS_INTERLEAVE(e[1], o[1], x[2], x[3]);
+            break;
+        default: /* 8 */
+            ICS_INTERLEAVE(p[0], p[4], x[0], x[2]);
+            ICS_INTERLEAVE(p[2], p[6], x[1], x[3]);
+            ICS_INTERLEAVE(p[1], p[5], x[4], x[6]);
+            ICS_INTERLEAVE(p[3], p[7], x[5], x[7]);
+            ICS_INTERLEAVE(x[0], x[1], e[0], e[1]);
+            ICS_INTERLEAVE(x[2], x[3], e[2], e[3]);
+            ICS_INTERLEAVE(x[4], x[5], o[0], o[1]);
+            ICS_INTERLEAVE(x[6], x[7], o[2], o[3]);
+            ICS_INTERLEAVE(e[0], o[0], x[0], x[1]);
+            ICS_INTERLEAVE(e[1], o[1], x[2], x[3]);
+            ICS_INTERLEAVE(e[2], o[2], x[4], x[5]);
+            ICS_INTERLEAVE(e[3], o[3], x[6], x[7]);
+            break;
+    }
+    for (i = 0; i < nBytes; i++) {
+        _mm_storeu_si128((__m128i*)(dest + 16 * i), x[i]);
+    }
+}
+
+
+/* As icsShuffle, using SSE2 instructions, for nBytes = 2, 4 or 8. */
+__attribute__((target("sse2")))
+static void icsShuffleSSE2(const unsigned char *src,
+                           unsigned char       *dest,
+                           size_t               n,
+                           size_t               nBytes)
+{
+    __m128i p[8];
+    size_t  i, j;
+
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        icsLoadPlanesSSE2(src + i * nBytes, p, nBytes);
+        for (j = 0; j < nBytes; j++) {
+            _mm_storeu_si128((__m128i*)(dest + j * n + i), p[j]);
+        }
+    }
+    icsShuffle(src, dest, n, nBytes, i);
+}
+
+
+/* As icsUnshuffle, using SSE2 instructions, for nBytes = 2, 4 or 8. */
+__attribute__((target("sse2")))
+static void icsUnshuffleSSE2(const unsigned char *src,
+                             unsigned char       *dest,
+                             size_t               n,
+                             size_t               nBytes)
+{
+    __m128i p[8];
+    size_t  i, j;
+
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        for (j = 0; j < nBytes; j++) {
+            p[j] = _mm_loadu_si128((const __m128i*)(src + j * n + i));
+        }
+        icsStorePlanesSSE2(p, dest + i * nBytes, nBytes);
+    }
+    icsUnshuffle(src, dest, n, nBytes, i);
+}
+
+
+/* As icsBitShuffle, using SSE2 instructions, for nBytes = 1, 2, 4 or 8. Each
+   byte plane of 16 imels is split into bits with movemask, which collects the
+   most significant bit of each byte. */
+__attribute__((target("sse2")))
+static void icsBitShuffleSSE2(const unsigned char *src,
+                              unsigned char       *dest,
+                              size_t               m,
+                              size_t               nBytes)
+{
+    __m128i      p[8], v;
+    size_t       i, j, planeSize = m / 8;
+    int          k, bits;
+
+
+    for (i = 0; i + 16 <= m; i += 16) {
+        icsLoadPlanesSSE2(src + i * nBytes, p, nBytes);
+        for (j = 0; j < nBytes; j++) {
+            v = p[j];
+            for (k = 7; k >= 0; k--) {
+                bits = _mm_movemask_epi8(v);
+                dest[(8 * j + (size_t)k) * planeSize + i / 8] =
+                    (unsigned char)bits;
+                dest[(8 * j + (size_t)k) * planeSize + i / 8 + 1] =
+                    (unsigned char)(bits >> 8);
+                v = _mm_add_epi8(v, v);
+            }
+        }
+    }
+    icsBitShuffle(src, dest, m, nBytes, i);
+}
+
+#elif defined(ICS_NEON_SIMD)
+
+/* As icsShuffle, using NEON instructions, for nBytes = 2 or 4. */
+static void icsShuffleNEON(const unsigned char *src,
+                           unsigned char       *dest,
+                           size_t               n,
+                           size_t               nBytes)
+{
+    size_t i = 0;
+
+
+    if (nBytes == 2) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x2_t v = vld2q_u8(src + i * 2);
+            vst1q_u8(dest + i, v.val[0]);
+            vst1q_u8(dest + n + i, v.val[1]);
+        }
+    } else if (nBytes == 4) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x4_t v = vld4q_u8(src + i * 4);
+            vst1q_u8(dest + i, v.val[0]);
+            vst1q_u8(dest + n + i, v.val[1]);
+            vst1q_u8(dest + 2 * n + i, v.val[2]);
+            vst1q_u8(dest + 3 * n + i, v.val[3]);
+        }
+    }
+    icsShuffle(src, dest, n, nBytes, i);
+}
+
+
+/* As icsUnshuffle, using NEON instructions, for nBytes = 2 or 4. */
+static void icsUnshuffleNEON(const unsigned char *src,
+                             unsigned char       *dest,
+                             size_t               n,
+                             size_t               nBytes)
+{
+    size_t i = 0;
+
+
+    if (nBytes == 2) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x2_t v;
+            v.val[0] = vld1q_u8(src + i);
+            v.val[1] = vld1q_u8(src + n + i);
+            vst2q_u8(dest + i * 2, v);
+        }
+    } else if (nBytes == 4) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x4_t v;
+            v.val[0] = vld1q_u8(src + i);
+            v.val[1] = vld1q_u8(src + n + i);
+            v.val[2] = vld1q_u8(src + 2 * n + i);
+            v.val[3] = vld1q_u8(src + 3 * n + i);
+            vst4q_u8(dest + i * 4, v);
+        }
+    }
+    icsUnshuffle(src, dest, n, nBytes, i);
+}
+
+#endif
+
+
+/* Apply filter to n imels of nBytes bytes each, from src to dest. The buffers
+   must not overlap. */
+void IcsFilterData(Ics_Filter  filter,
+                   const void *src,
+                   void       *dest,
+                   size_t      n,
+                   int         nBytes)
+{
+    const unsigned char *s    = (const unsigned char*)src;
+    unsigned char       *d    = (unsigned char*)dest;
+    size_t               size = (size_t)nBytes;
+    size_t               m    = n - n % 8;
+
+
+    switch (filter) {
+        case IcsFilter_shuffle:
+#if defined(ICS_X86_SIMD)
+            if ((size == 2 || size == 4 || size == 8) &&
+                __builtin_cpu_supports("sse2")) {
+                icsShuffleSSE2(s, d, n, size);
+                return;
+            }
+#elif defined(ICS_NEON_SIMD)
+            if (size == 2 || size == 4) {
+                icsShuffleNEON(s, d, n, size);
+                return;
+            }
+#endif
+            icsShuffle(s, d, n, size, 0);
+            break;
+        case IcsFilter_bitshuffle:
+#if defined(ICS_X86_SIMD)
+            if ((size == 1 || size == 2 || size == 4 || size == 8) &&
+                __builtin_cpu_supports("sse2")) {
+                icsBitShuffleSSE2(s, d, m, size);
+            } else {
+                icsBitShuffle(s, d, m, size, 0);
+            }
+#else
+            icsBitShuffle(s, d, m, size, 0);
+#endif
+            memcpy(d + m * size, s + m * size, (n - m) * size);
+            break;
+        default:
+            memcpy(d, s, n * size);
+    }
+}
+
+
+/* Undo IcsFilterData. */
+void IcsUnfilterData(Ics_Filter  filter,
+                     const void *src,
+                     void       *dest,
+                     size_t      n,
+                     int         nBytes)
+{
+    const unsigned char *s    = (const unsigned char*)src;
+    unsigned char       *d    = (unsigned char*)dest;
+    size_t               size = (size_t)nBytes;
+    size_t               m    = n - n % 8;
+
+
+    switch (filter) {
+        case IcsFilter_shuffle:
+#if defined(ICS_X86_SIMD)
+            if ((size == 2 || size == 4 || size == 8) &&
+                __builtin_cpu_supports("sse2")) {
+                icsUnshuffleSSE2(s, d, n, size);
+                return;
+            }
+#elif defined(ICS_NEON_SIMD)
+            if (size == 2 || size == 4) {
+                icsUnshuffleNEON(s, d, n, size);
+                return;
+            }
+#endif
+            icsUnshuffle(s, d, n, size, 0);
+            break;
+        case IcsFilter_bitshuffle:
+            icsBitUnshuffle(s, d, m, size);
+            memcpy(d + m * size, s + m * size, (n - m) * size);
+            break;
+        default:
+            memcpy(d, s, n * size);
+    }
+}
+
+
+/* Get the predictor that is applied to the data. Uncompressed data and data
+   types other than integers of at least a byte are never predicted. */
+Ics_Predictor IcsGetActivePredictor(const Ics_Header *icsStruct)
+{
+    Ics_Format format;
+    int        sign;
+    size_t     bits;
+
+
+    if (icsStruct->compression == IcsCompr_uncompressed) {
+        return IcsPredictor_none;
+    }
+    IcsGetPropsDataType(icsStruct->imel.dataType, &format, &sign, &bits);
+    if (format != IcsForm_integer || bits < 8) return IcsPredictor_none;
+    return icsStruct->predictor;
+}
+
+
+/* Replace imels start to n-1 by their difference with the previous imel. */
+static void icsPredict(const unsigned char *src,
+                       unsigned char       *dest,
+                       size_t               n,
+                       size_t               nBytes,
+                       size_t               start)
+{
+    size_t i;
+
+
+    if (start == 0 && n > 0) {
+        memcpy(dest, src, nBytes);
+        start = 1;
+    }
+    switch (nBytes) {
+        case 1:
+            for (i = start; i < n; i++) {
+                dest[i] = (unsigned char)(src[i] - src[i - 1]);
+            }
+            break;
+        case 2:
+            for (i = start; i < n; i++) {
+                ics_t_uint16 a, b;
+                memcpy(&a, src + 2 * i, 2);
+                memcpy(&b, src + 2 * (i - 1), 2);
+                a = (ics_t_uint16)(a - b);
+                memcpy(dest + 2 * i, &a, 2);
+            }
+            break;
+        case 4:
+            for (i = start; i < n; i++) {
+                ics_t_uint32 a, b;
+                memcpy(&a, src + 4 * i, 4);
+                memcpy(&b, src + 4 * (i - 1), 4);
+                a -= b;
+                memcpy(dest + 4 * i, &a, 4);
+            }
+            break;
+        case 8:
+            for (i = start; i < n; i++) {
+                ics_t_uint64 a, b;
+                memcpy(&a, src + 8 * i, 8);
+                memcpy(&b, src + 8 * (i - 1), 8);
+                a -= b;
+                memcpy(dest + 8 * i, &a, 8);
+            }
+            break;
+    }
+}
+
+
+/* Undo icsPredict in place for imels start to n-1, imel start-1 having been
+   restored already. */
+static void icsUnpredict(unsigned char *buf,
+                         size_t         n,
+                         size_t         nBytes,
+                         size_t         start)
+{
+    size_t i;
+
+
+    if (start == 0) start = 1;
+    switch (nBytes) {
+        case 1:
+            for (i = start; i < n; i++) {
+                buf[i] = (unsigned char)(buf[i] + buf[i - 1]);
+            }
+            break;
+        case 2:
+            for (i = start; i < n; i++) {
+                ics_t_uint16 a, b;
+                memcpy(&a, buf + 2 * i, 2);
+                memcpy(&b, buf + 2 * (i - 1), 2);
+                a = (ics_t_uint16)(a + b);
+                memcpy(buf + 2 * i, &a, 2);
+            }
+            break;
+        case 4:
+            for (i = start; i < n; i++) {
+                ics_t_uint32 a, b;
+                memcpy(&a, buf + 4 * i, 4);
+                memcpy(&b, buf + 4 * (i - 1), 4);
+                a += b;
+                memcpy(buf + 4 * i, &a, 4);
+            }
+            break;
+        case 8:
+            for (i = start; i < n; i++) {
+                ics_t_uint64 a, b;
+                memcpy(&a, buf + 8 * i, 8);
+                memcpy(&b, buf + 8 * (i - 1), 8);
+                a += b;
+                memcpy(buf + 8 * i, &a, 8);
+            }
+            break;
+    }
+}
+
+
+#if defined(ICS_X86_SIMD)
+
+/* As icsPredict, using SSE2 instructions. Each vector is combined with the last
+   imel of the previous one. Returns the number of imels done. */
+__attribute__((target("sse2")))
+static size_t icsPredictSSE2(const unsigned char *src,
+                             unsigned char       *dest,
+                             size_t               n,
+                             size_t               nBytes)
+{
+    __m128i prev = _mm_setzero_si128();
+    __m128i v, d;
+    size_t  i, len = n * nBytes - (n * nBytes) % 16;
+
+
+    for (i = 0; i < len; i += 16) {
+        v = _mm_loadu_si128((const __m128i*)(src + i));
+        switch (nBytes) {
+            case 1:
+                d = _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(prev, 15));
+                d = _mm_sub_epi8(v, d);
+                break;
+            case 2:
+                d = _mm_or_si128(_mm_slli_si128(v, 2), _mm_srli_si128(prev, 14));
+                d = _mm_sub_epi16(v, d);
+                break;
+            case 4:
+                d = _mm_or_si128(_mm_slli_si128(v, 4), _mm_srli_si128(prev, 12));
+                d = _mm_sub_epi32(v, d);
+                break;
+            default: /* 8 */
+                d = _mm_or_si128(_mm_slli_si128(v, 8), _mm_srli_si128(prev, 8));
+                d = _mm_sub_epi64(v, d);
+                break;
+        }
+        _mm_storeu_si128((__m128i*)(dest + i), d);
+        prev = v;
+    }
+    return len / nBytes;
+}
+
+
+/* As icsUnpredict, using SSE2 instructions: a prefix sum within each vector,
+   to which the last imel of the previous vector is added. Returns the number
+   of imels done. */
+__attribute__((target("sse2")))
+static size_t icsUnpredictSSE2(unsigned char *buf,
+                               size_t         n,
+                               size_t         nBytes)
+{
+    __m128i carry = _mm_setzero_si128();
+    __m128i v;
+    size_t  i, len = n * nBytes - (n * nBytes) % 16;
+
+
+    for (i = 0; i < len; i += 16) {
+        v = _mm_loadu_si128((const __m128i*)(buf + i));
+        switch (nBytes) {
+            case 1:
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+                v = _mm_add_epi8(v, carry);
+                carry = _mm_unpackhi_epi8(v, v);
+                carry = _mm_shufflehi_epi16(carry, 0xFF);
+                carry = _mm_shuffle_epi32(carry, 0xFF);
+                break;
+            case 2:
+                v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+                v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+                v = _mm_add_epi16(v, carry);
+                carry = _mm_shufflehi_epi16(v, 0xFF);
+                carry = _mm_shuffle_epi32(carry, 0xFF);
+                break;
+            case 4:
+                v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+                v = _mm_add_epi32(v, carry);
+                carry = _mm_shuffle_epi32(v, 0xFF);
+                break;
+            default: /* 8 */
+                v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+                v = _mm_add_epi64(v, carry);
+                carry = _mm_unpackhi_epi64(v, v);
+                break;
+        }
+        _mm_storeu_si128((__m128i*)(buf + i), v);
+    }
+    return len / nBytes;
+}
+
+#endif
+
+
+/* Apply predictor to n integer imels of nBytes bytes each, from src to dest.
+   The buffers must not overlap. */
+void IcsPredictData(Ics_Predictor  predictor,
+                    const void    *src,
+                    void          *dest,
+                    size_t         n,
+                    int            nBytes)
+{
+    const unsigned char *s     = (const unsigned char*)src;
+    unsigned char       *d     = (unsigned char*)dest;
+    size_t               size  = (size_t)nBytes;
+    size_t               start = 0;
+
+
+    if (predictor != IcsPredictor_horizontal ||
+        (size != 1 && size != 2 && size != 4 && size != 8)) {
+        memcpy(d, s, n * size);
+        return;
+    }
+#if defined(ICS_X86_SIMD)
+    if (__builtin_cpu_supports("sse2")) {
+        start = icsPredictSSE2(s, d, n, size);
+    }
+#endif
+    icsPredict(s, d, n, size, start);
+}
+
+
+/* Undo IcsPredictData, in place. */
+void IcsUnpredictData(Ics_Predictor  predictor,
+                      void          *buf,
+                      size_t         n,
+                      int            nBytes)
+{
+    unsigned char *b     = (unsigned char*)buf;
+    size_t         size  = (size_t)nBytes;
+    size_t         start = 0;
+
+
+    if (predictor != IcsPredictor_horizontal ||
+        (size != 1 && size != 2 && size != 4 && size != 8)) {
+        return;
+    }
+#if defined(ICS_X86_SIMD)
+    if (__builtin_cpu_supports("sse2")) {
+        start = icsUnpredictSSE2(b, n, size);
+    }
+#endif
+    icsUnpredict(b, n, size, start);
+}
+
+
+/* Apply predictor and filter to n imels from src. The result is written to the
+   first n imels of buf, which must have room for 2*n imels. */
+void IcsEncodeData(Ics_Filter     filter,
+                   Ics_Predictor  predictor,
+                   const void    *src,
+                   void          *buf,
+                   size_t         n,
+                   int            nBytes)
+{
+    unsigned char *b = (unsigned char*)buf;
+
+
+    if (predictor != IcsPredictor_none && filter != IcsFilter_none) {
+        IcsPredictData(predictor, src, b + n * (size_t)nBytes, n, nBytes);
+        IcsFilterData(filter, b + n * (size_t)nBytes, b, n, nBytes);
+    } else if (predictor != IcsPredictor_none) {
+        IcsPredictData(predictor, src, b, n, nBytes);
+    } else {
+        IcsFilterData(filter, src, b, n, nBytes);
+    }
+}
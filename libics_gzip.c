@@ -38,10 +38,18 @@
  *
  *   IcsWriteZip()
  *   IcsWriteZipWithStrides()
+ *   IcsWriteZipParallel()
+ *   IcsOpenZipWrite()
+ *   IcsWriteZipBlock()
+ *   IcsCloseZipWrite()
  *   IcsOpenZip()
  *   IcsCloseZip()
  *   IcsReadZipBlock()
  *   IcsSetZipBlock()
+ *   IcsFreeZipIndex()
+ *   IcsZipChunkBound()
+ *   IcsZipChunk()
+ *   IcsUnzipChunk()
  *
  * This is the only file that contains any zlib dependancies.
  *
@@ -58,6 +66,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "libics_intern.h"
 
 // Include zlib.h only when available
@@ -67,6 +76,14 @@
 
 #define DEF_MEM_LEVEL 8 /* Default value defined in zutil.h */
 
+/* inflateGetDictionary, needed to build the index, was added in zlib 1.2.7.1 */
+#if defined(ICS_ZLIB) && ZLIB_VERNUM >= 0x1271
+#define ICS_ZIP_INDEX
+#endif
+
+#define ICS_ZIP_BLOCK_SIZE (256 * 1024) /* Block size for parallel compression */
+#define ICS_ZIP_DICT_SIZE  32768        /* Size of the deflate window */
+
 
 /* GZIP stuff */
 #ifdef ICS_ZLIB
@@ -216,12 +233,15 @@ Ics_Error IcsWriteZip(const void *inBuf,
 }
 
 
-/* Write ZIP compressed data, with strides. */
+/* Write ZIP compressed data, with strides. The predictor and filter, if any,
+   are applied to each line along the first dimension. */
 Ics_Error IcsWriteZipWithStrides(const void      *src,
                                  const size_t    *dim,
                                  const ptrdiff_t *stride,
                                  int              nDims,
                                  int              nBytes,
+                                 Ics_Filter       filter,
+                                 Ics_Predictor    predictor,
                                  FILE            *file,
                                  int              level)
 {
@@ -230,6 +250,7 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
     z_stream     stream;
     Byte        *inBuf              = 0; /* input buffer */
     Byte        *inBuf_ptr;
+    Byte        *filterBuf          = 0; /* encoded input */
     Byte        *outBuf             = 0; /* output buffer */
     size_t       curPos[ICS_MAXDIM];
     char const  *data;
@@ -238,6 +259,8 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
     size_t       count, totalCount = 0;
     uLong        crc;
     const int    contiguousLine    = stride[0]==1;
+    const int    encode            = filter != IcsFilter_none ||
+                                     predictor != IcsPredictor_none;
 
 
         /* Create an output buffer */
@@ -251,6 +274,14 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
             return IcsErr_Alloc;
         }
     }
+    if (encode) {
+        filterBuf = (Byte*)malloc(2 * dim[0] * (size_t)nBytes);
+        if (filterBuf == Z_NULL) {
+            free(outBuf);
+            if (!contiguousLine) free(inBuf);
+            return IcsErr_Alloc;
+        }
+    }
 
         /* Initialize the stream for output */
     stream.zalloc = (alloc_func)0;
@@ -266,6 +297,7 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
     if (err != Z_OK) {
         free(outBuf);
         if (!contiguousLine) free(inBuf);
+        free(filterBuf);
         if (err == Z_VERSION_ERROR) {
             return IcsErr_WrongZlibVersion;
         } else {
@@ -299,9 +331,15 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
                 data += stride[0] * nBytes;
                 inBuf_ptr += nBytes;
             }
+        }
+        if (encode) {
+            IcsEncodeData(filter, predictor, inBuf, filterBuf, dim[0], nBytes);
+            inBuf_ptr = filterBuf;
+        } else {
+            inBuf_ptr = inBuf;
         }
             /* Write the compressed data */
-        stream.next_in = (Bytef*)inBuf;
+        stream.next_in = (Bytef*)inBuf_ptr;
         stream.avail_in = (uInt)(dim[0] * (size_t)nBytes);
         totalCount += stream.avail_in;
         while (stream.avail_in != 0) {
@@ -323,7 +361,7 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
             error = IcsErr_CompressionProblem;
             goto error_exit;
         }
-        crc = crc32(crc, (Bytef*)inBuf, (uInt)(dim[0] * (size_t)nBytes));
+        crc = crc32(crc, (Bytef*)inBuf_ptr, (uInt)(dim[0] * (size_t)nBytes));
             /* This is part of the N-D loop */
         for (i = 1; i < nDims; i++) {
             curPos[i]++;
@@ -368,6 +406,7 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
     err = deflateEnd(&stream);
     free(outBuf);
     if (!contiguousLine) free(inBuf);
+    free(filterBuf);
 
     if (error) {
         return error;
@@ -380,8 +419,422 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
     (void)stride;
     (void)nDims;
     (void)nBytes;
+    (void)filter;
+    (void)predictor;
+    (void)file;
+    (void)level;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+#ifdef ICS_ZLIB
+
+/* One batch of blocks compressed in parallel by IcsWriteZipParallel. */
+typedef struct {
+    const Bytef  *input;     /* Input data for this batch */
+    size_t        length;    /* Length of the input data */
+    size_t        history;   /* Bytes available before input, used as
+                                dictionary for the first block */
+    int           last;      /* Set if the batch ends the stream */
+    int           level;     /* Compression level */
+    Bytef       **outBuf;    /* Output buffer for each block */
+    size_t        outSize;   /* Size of each output buffer */
+    size_t       *outLen;    /* Compressed length of each block */
+    uLong        *crc;       /* CRC of each block */
+} Ics_ZipBatch;
+
+
+/* Compress one block of a batch into a raw deflate stream that ends on a byte
+   boundary, using the preceding 32 kB of data as dictionary, such that the
+   blocks can be concatenated into a single stream. */
+static Ics_Error icsDeflateBlock(void   *arg,
+                                 size_t  task)
+{
+    Ics_ZipBatch *batch = (Ics_ZipBatch*)arg;
+    z_stream      stream;
+    const Bytef  *in    = batch->input + task * ICS_ZIP_BLOCK_SIZE;
+    size_t        len   = batch->length - task * ICS_ZIP_BLOCK_SIZE;
+    size_t        dict  = batch->history + task * ICS_ZIP_BLOCK_SIZE;
+    int           last, err;
+
+
+    if (len > ICS_ZIP_BLOCK_SIZE) len = ICS_ZIP_BLOCK_SIZE;
+    if (dict > ICS_ZIP_DICT_SIZE) dict = ICS_ZIP_DICT_SIZE;
+    last = batch->last && (task + 1) * ICS_ZIP_BLOCK_SIZE >= batch->length;
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    err = deflateInit2(&stream, batch->level, Z_DEFLATED, -MAX_WBITS,
+                       DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        return err == Z_VERSION_ERROR ? IcsErr_WrongZlibVersion
+                                      : IcsErr_CompressionProblem;
+    }
+    if (dict > 0) {
+        deflateSetDictionary(&stream, in - dict, (uInt)dict);
+    }
+    stream.next_in = (Bytef*)in;
+    stream.avail_in = (uInt)len;
+    stream.next_out = batch->outBuf[task];
+    stream.avail_out = (uInt)batch->outSize;
+    err = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    batch->outLen[task] = batch->outSize - stream.avail_out;
+    deflateEnd(&stream);
+    if (err != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0 ||
+        stream.avail_out == 0) {
+        return IcsErr_CompressionProblem;
+    }
+    batch->crc[task] = crc32(0L, in, (uInt)len);
+
+    return IcsErr_Ok;
+}
+
+
+/* Copy the next n bytes of the strided data into dest. curPos keeps track of
+   the position in the data between calls. If a filter or predictor is given,
+   each line is gathered into lineBuf and encoded into filterBuf when the first
+   of its bytes is needed; lineBuf holds one line and filterBuf two, and
+   filterBuf must be preserved between calls. */
+static void icsGatherStrided(const void      *src,
+                             const size_t    *dim,
+                             const ptrdiff_t *stride,
+                             int              nDims,
+                             int              nBytes,
+                             Ics_Filter       filter,
+                             Ics_Predictor    predictor,
+                             Bytef           *lineBuf,
+                             Bytef           *filterBuf,
+                             size_t          *curPos,
+                             Bytef           *dest,
+                             size_t           n)
+{
+    char const *data;
+    size_t      count, j;
+    int         i;
+
+
+    while (n > 0) {
+        data = (char const*)src;
+        for (i = 0; i < nDims; i++) {
+            data += (ptrdiff_t)curPos[i] * stride[i] * nBytes;
+        }
+        if (filter != IcsFilter_none || predictor != IcsPredictor_none) {
+            if (curPos[0] == 0) {
+                for (j = 0; j < dim[0]; j++) {
+                    memcpy(lineBuf + j * (size_t)nBytes, data, (size_t)nBytes);
+                    data += stride[0] * nBytes;
+                }
+                IcsEncodeData(filter, predictor, lineBuf, filterBuf, dim[0],
+                              nBytes);
+            }
+            count = dim[0] - curPos[0];
+            if (count * (size_t)nBytes > n) count = n / (size_t)nBytes;
+            memcpy(dest, filterBuf + curPos[0] * (size_t)nBytes,
+                   count * (size_t)nBytes);
+        } else if (stride[0] == 1) {
+            count = dim[0] - curPos[0];
+            if (count * (size_t)nBytes > n) count = n / (size_t)nBytes;
+            memcpy(dest, data, count * (size_t)nBytes);
+        } else {
+            memcpy(dest, data, (size_t)nBytes);
+            count = 1;
+        }
+        dest += count * (size_t)nBytes;
+        n -= count * (size_t)nBytes;
+        curPos[0] += count;
+        for (i = 0; i < nDims - 1 && curPos[i] == dim[i]; i++) {
+            curPos[i] = 0;
+            curPos[i + 1]++;
+        }
+    }
+}
+
+#endif
+
+
+/* Write ZIP compressed data using multiple threads, in the manner of pigz. The
+   data is split into blocks that are compressed independently, each using the
+   32 kB of data that precede it as dictionary. The compressed blocks together
+   form a single standard gzip stream, with a CRC combined from those of the
+   blocks. If stride is NULL the data is contiguous, otherwise it is gathered
+   into a buffer one batch at a time. A filter or predictor requires stride to
+   be given. */
+Ics_Error IcsWriteZipParallel(const void      *src,
+                              size_t           n,
+                              const size_t    *dim,
+                              const ptrdiff_t *stride,
+                              int              nDims,
+                              int              nBytes,
+                              Ics_Filter       filter,
+                              Ics_Predictor    predictor,
+                              FILE            *file,
+                              int              level,
+                              int              nThreads)
+{
+#ifdef ICS_ZLIB
+    ICSINIT;
+    Ics_ZipBatch  batch;
+    Bytef        *gather  = NULL;
+    Bytef        *lineBuf = NULL;
+    Bytef        *outMem  = NULL;
+    size_t        curPos[ICS_MAXDIM];
+    size_t        nBlocks, batchSize, done, i, keep;
+    uLong         crc;
+    const int     encode  = filter != IcsFilter_none ||
+                            predictor != IcsPredictor_none;
+
+
+    nBlocks = (size_t)nThreads * 4;
+    batchSize = nBlocks * ICS_ZIP_BLOCK_SIZE;
+    batch.level = level;
+    batch.outSize = compressBound(ICS_ZIP_BLOCK_SIZE) + 64;
+    batch.outBuf = (Bytef**)malloc(nBlocks * sizeof(Bytef*));
+    batch.outLen = (size_t*)malloc(nBlocks * sizeof(size_t));
+    batch.crc = (uLong*)malloc(nBlocks * sizeof(uLong));
+    outMem = (Bytef*)malloc(nBlocks * batch.outSize);
+    if (stride != NULL) {
+        gather = (Bytef*)malloc(ICS_ZIP_DICT_SIZE + batchSize);
+    }
+    if (encode) {
+        lineBuf = (Bytef*)malloc(3 * dim[0] * (size_t)nBytes);
+    }
+    if (batch.outBuf == NULL || batch.outLen == NULL || batch.crc == NULL ||
+        outMem == NULL || (stride != NULL && gather == NULL) ||
+        (encode && lineBuf == NULL)) {
+        error = IcsErr_Alloc;
+        goto exit;
+    }
+    for (i = 0; i < nBlocks; i++) {
+        batch.outBuf[i] = outMem + i * batch.outSize;
+    }
+    for (i = 0; i < ICS_MAXDIM; i++) {
+        curPos[i] = 0;
+    }
+    crc = crc32(0L, Z_NULL, 0);
+
+        /* Write a very simple GZIP header: */
+    fprintf(file, "%c%c%c%c%c%c%c%c%c%c", gz_magic[0], gz_magic[1], Z_DEFLATED,
+            0,0,0,0,0,0, OS_CODE);
+
+    done = 0;
+    do {
+        batch.length = n - done < batchSize ? n - done : batchSize;
+        batch.history = done;
+        batch.last = done + batch.length >= n;
+        if (stride == NULL) {
+            batch.input = (const Bytef*)src + done;
+        } else {
+                /* Keep the end of the previous batch as dictionary */
+            keep = done < ICS_ZIP_DICT_SIZE ? done : ICS_ZIP_DICT_SIZE;
+            if (keep > 0) {
+                memmove(gather + ICS_ZIP_DICT_SIZE - keep,
+                        gather + ICS_ZIP_DICT_SIZE + batchSize - keep, keep);
+            }
+            icsGatherStrided(src, dim, stride, nDims, nBytes, filter,
+                             predictor, lineBuf,
+                             lineBuf + dim[0] * (size_t)nBytes, curPos,
+                             gather + ICS_ZIP_DICT_SIZE, batch.length);
+            batch.input = gather + ICS_ZIP_DICT_SIZE;
+        }
+        error = IcsParallelFor(nThreads,
+                               (batch.length + ICS_ZIP_BLOCK_SIZE - 1)
+                               / ICS_ZIP_BLOCK_SIZE,
+                               icsDeflateBlock, &batch);
+        if (error) goto exit;
+            /* Write the blocks in order */
+        for (i = 0; i * ICS_ZIP_BLOCK_SIZE < batch.length; i++) {
+            size_t len = batch.length - i * ICS_ZIP_BLOCK_SIZE;
+            if (len > ICS_ZIP_BLOCK_SIZE) len = ICS_ZIP_BLOCK_SIZE;
+            if (fwrite(batch.outBuf[i], 1, batch.outLen[i], file)
+                != batch.outLen[i]) {
+                error = IcsErr_FWriteIds;
+                goto exit;
+            }
+            crc = crc32_combine(crc, batch.crc[i], (z_off_t)len);
+        }
+        done += batch.length;
+    } while (done < n);
+
+        /* Write the CRC and original data length */
+    icsPutLong(file, crc);
+    icsPutLong(file, n & 0xFFFFFFFF);
+
+  exit:
+    free(batch.outBuf);
+    free(batch.outLen);
+    free(batch.crc);
+    free(outMem);
+    free(gather);
+    free(lineBuf);
+    return error;
+#else
+    (void)src;
+    (void)n;
+    (void)dim;
+    (void)stride;
+    (void)nDims;
+    (void)nBytes;
+    (void)filter;
+    (void)predictor;
     (void)file;
     (void)level;
+    (void)nThreads;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+#ifdef ICS_ZLIB
+
+/* This is the struct behind the "void* zlibStream" in Ics_BlockWrite. */
+typedef struct {
+    z_stream  stream;
+    Byte     *outBuf;     /* Output buffer */
+    uLong     crc;        /* Running CRC of the uncompressed data */
+    size_t    totalCount; /* Number of bytes compressed so far */
+} Ics_ZipWrite;
+
+
+/* Compress the input of the stream, writing the output to file. */
+static Ics_Error icsZipWriteDeflate(Ics_ZipWrite *zw,
+                                    int           flush,
+                                    FILE         *file)
+{
+    unsigned int have;
+    int          err;
+
+
+    do {
+        zw->stream.avail_out = ICS_BUF_SIZE;
+        zw->stream.next_out = zw->outBuf;
+        err = deflate(&zw->stream, flush);
+        if (err == Z_STREAM_ERROR) return IcsErr_CompressionProblem;
+        have = ICS_BUF_SIZE - zw->stream.avail_out;
+        if (fwrite(zw->outBuf, 1, have, file) != have || ferror(file)) {
+            return IcsErr_FWriteIds;
+        }
+    } while (zw->stream.avail_out == 0);
+    if (zw->stream.avail_in != 0) return IcsErr_CompressionProblem;
+    return IcsErr_Ok;
+}
+
+#endif
+
+
+/* Start writing ZIP compressed data in blocks with the block writer bw, as
+   IcsWriteZip does in one go. */
+Ics_Error IcsOpenZipWrite(const Ics_Header *icsStruct,
+                          Ics_BlockWrite   *bw)
+{
+#ifdef ICS_ZLIB
+    Ics_ZipWrite *zw;
+    int           err;
+
+
+    zw = (Ics_ZipWrite*)malloc(sizeof(Ics_ZipWrite));
+    if (zw == NULL) return IcsErr_Alloc;
+    zw->outBuf = (Byte*)malloc(ICS_BUF_SIZE);
+    if (zw->outBuf == Z_NULL) {
+        free(zw);
+        return IcsErr_Alloc;
+    }
+    zw->stream.zalloc = (alloc_func)0;
+    zw->stream.zfree = (free_func)0;
+    zw->stream.opaque = (voidpf)0;
+    zw->stream.avail_in = 0;
+    zw->stream.next_in = NULL;
+    zw->stream.next_out = Z_NULL;
+    zw->stream.avail_out = 0;
+    zw->crc = crc32(0L, Z_NULL, 0);
+    zw->totalCount = 0;
+
+    err = deflateInit2(&zw->stream, icsStruct->compLevel, Z_DEFLATED,
+                       -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        free(zw->outBuf);
+        free(zw);
+        if (err == Z_VERSION_ERROR) {
+            return IcsErr_WrongZlibVersion;
+        } else {
+            return IcsErr_CompressionProblem;
+        }
+    }
+
+        /* Write a very simple GZIP header: */
+    fprintf(bw->dataFilePtr, "%c%c%c%c%c%c%c%c%c%c", gz_magic[0], gz_magic[1],
+            Z_DEFLATED, 0,0,0,0,0,0, OS_CODE);
+
+    bw->zlibStream = zw;
+    return IcsErr_Ok;
+#else
+    (void)icsStruct;
+    (void)bw;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Compress a block of data into the stream opened with IcsOpenZipWrite. */
+Ics_Error IcsWriteZipBlock(Ics_BlockWrite *bw,
+                           const void     *src,
+                           size_t          n)
+{
+#ifdef ICS_ZLIB
+    ICSINIT;
+    Ics_ZipWrite *zw = (Ics_ZipWrite*)bw->zlibStream;
+    const Bytef  *p  = (const Bytef*)src;
+    uInt          len;
+
+
+    while (!error && n > 0) {
+        len = n < ICS_BUF_SIZE ? (uInt)n : ICS_BUF_SIZE;
+        zw->stream.next_in = (Bytef*)p;
+        zw->stream.avail_in = len;
+        zw->crc = crc32(zw->crc, p, len);
+        zw->totalCount += len;
+        error = icsZipWriteDeflate(zw, Z_NO_FLUSH, bw->dataFilePtr);
+        p += len;
+        n -= len;
+    }
+
+    return error;
+#else
+    (void)bw;
+    (void)src;
+    (void)n;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Finish the stream opened with IcsOpenZipWrite, writing the GZIP trailer. */
+Ics_Error IcsCloseZipWrite(Ics_BlockWrite *bw)
+{
+#ifdef ICS_ZLIB
+    ICSINIT;
+    Ics_ZipWrite *zw = (Ics_ZipWrite*)bw->zlibStream;
+
+
+    zw->stream.next_in = NULL;
+    zw->stream.avail_in = 0;
+    error = icsZipWriteDeflate(zw, Z_FINISH, bw->dataFilePtr);
+    if (!error) {
+            /* Write the CRC and original data length */
+        icsPutLong(bw->dataFilePtr, zw->crc);
+        icsPutLong(bw->dataFilePtr, zw->totalCount & 0xFFFFFFFF);
+    }
+    if (deflateEnd(&zw->stream) != Z_OK && !error) {
+        error = IcsErr_CompressionProblem;
+    }
+    free(zw->outBuf);
+    free(zw);
+    bw->zlibStream = NULL;
+
+    return error;
+#else
+    (void)bw;
     return IcsErr_UnknownCompression;
 #endif
 }
@@ -498,50 +951,196 @@ Ics_Error IcsCloseZip(Ics_Header *icsStruct)
 }
 
 
+#ifdef ICS_ZIP_INDEX
+
+/* Add an access point to the index at the current position of the stream, if
+   the previous one is far enough behind. inPos is the offset in the file of the
+   next input byte. */
+static Ics_Error icsZipIndexAdd(Ics_Header *icsStruct,
+                                z_stream   *stream,
+                                size_t      inPos,
+                                uLong       crc)
+{
+    Ics_ZipIndex *index = (Ics_ZipIndex*)icsStruct->zipIndex;
+    Ics_ZipPoint *point;
+    size_t        prev  = 0;
+    uInt          len   = ICS_ZIP_DICT_SIZE;
+
+
+    if (index == NULL) {
+        index = (Ics_ZipIndex*)malloc(sizeof(Ics_ZipIndex));
+        if (index == NULL) return IcsErr_Alloc;
+        index->points = NULL;
+        index->nPoints = 0;
+        index->size = 0;
+        icsStruct->zipIndex = index;
+    }
+    if (index->nPoints > 0) prev = index->points[index->nPoints - 1].out;
+    if (stream->total_out < prev + ICS_ZIP_INDEX_SPAN) return IcsErr_Ok;
+
+    if (index->nPoints == index->size) {
+        size_t        size   = index->size + 64;
+        Ics_ZipPoint *points = (Ics_ZipPoint*)realloc(index->points,
+                                                      size * sizeof(Ics_ZipPoint));
+        if (points == NULL) return IcsErr_Alloc;
+        index->points = points;
+        index->size = size;
+    }
+    point = &index->points[index->nPoints];
+    point->window = (unsigned char*)malloc(ICS_ZIP_DICT_SIZE);
+    if (point->window == NULL) return IcsErr_Alloc;
+    if (inflateGetDictionary(stream, point->window, &len) != Z_OK) {
+        free(point->window);
+        return IcsErr_DecompressionProblem;
+    }
+    point->windowLen = len;
+    point->out = stream->total_out;
+    point->in = inPos;
+    point->bits = stream->data_type & 7;
+    point->crc = crc;
+    index->nPoints++;
+
+    return IcsErr_Ok;
+}
+
+
+/* Find the last access point at or before uncompressed offset pos. */
+static Ics_ZipPoint *icsZipIndexFind(Ics_Header *icsStruct,
+                                     size_t      pos)
+{
+    Ics_ZipIndex *index = (Ics_ZipIndex*)icsStruct->zipIndex;
+    size_t        lo, hi, mid;
+
+
+    if (index == NULL || index->nPoints == 0 || index->points[0].out > pos) {
+        return NULL;
+    }
+    lo = 0;
+    hi = index->nPoints;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (index->points[mid].out <= pos) lo = mid; else hi = mid;
+    }
+
+    return &index->points[lo];
+}
+
+
+/* Restart decompression at an access point. */
+static Ics_Error icsZipJump(Ics_Header         *icsStruct,
+                            const Ics_ZipPoint *point)
+{
+    Ics_BlockRead *br     = (Ics_BlockRead*)icsStruct->blockRead;
+    FILE          *file   = br->dataFilePtr;
+    z_stream      *stream = (z_stream*)br->zlibStream;
+    int            ch;
+
+
+    if (ICSFSEEK(file, (ptrdiff_t)point->in - (point->bits ? 1 : 0),
+                 SEEK_SET) != 0) {
+        return IcsErr_FReadIds;
+    }
+    if (inflateReset2(stream, -MAX_WBITS) != Z_OK) {
+        return IcsErr_DecompressionProblem;
+    }
+    if (point->bits) {
+        ch = getc(file);
+        if (ch == EOF) return IcsErr_FReadIds;
+        inflatePrime(stream, point->bits, ch >> (8 - point->bits));
+    }
+    if (inflateSetDictionary(stream, point->window, point->windowLen) != Z_OK) {
+        return IcsErr_DecompressionProblem;
+    }
+    stream->avail_in = 0;
+    stream->total_out = (uLong)point->out;
+    br->zlibCRC = point->crc;
+
+    return IcsErr_Ok;
+}
+
+#endif
+
+
+/* Free the index into the ZIP compressed data. */
+void IcsFreeZipIndex(Ics_Header *icsStruct)
+{
+    Ics_ZipIndex *index = (Ics_ZipIndex*)icsStruct->zipIndex;
+    size_t        i;
+
+
+    if (index == NULL) return;
+    for (i = 0; i < index->nPoints; i++) {
+        free(index->points[i].window);
+    }
+    free(index->points);
+    free(index);
+    icsStruct->zipIndex = NULL;
+}
+
+
 /* Read ZIP compressed data block. This function mostly does:
-     gzread((gzFile)br->ZlibStream, outBuf, len); */
+     gzread((gzFile)br->ZlibStream, outBuf, len);
+   While reading, access points are added to the index at the end of deflate
+   blocks every ICS_ZIP_INDEX_SPAN bytes, so that IcsSetZipBlock can later
+   resume decompression close to any position. */
 Ics_Error IcsReadZipBlock(Ics_Header *icsStruct,
                           void       *outBuf,
                           size_t      len)
 {
 #ifdef ICS_ZLIB
+    ICSINIT;
     Ics_BlockRead *br      = (Ics_BlockRead*)icsStruct->blockRead;
     FILE          *file    = br->dataFilePtr;
     z_stream*      stream  = (z_stream*)br->zlibStream;
     void          *inBuf   = br->zlibInputBuffer;
-    int            err;
+    int            err     = Z_OK;
     size_t         prevout = stream->total_out, todo = len;
+    size_t         inPos   = 0;
     unsigned int   bufsize, done;
     Bytef         *prevbuf;
+#ifdef ICS_ZIP_INDEX
+    const int      flush   = Z_BLOCK;
+#else
+    const int      flush   = Z_NO_FLUSH;
+#endif
 
         /* Read the compressed data */
-    do {
-        stream->avail_in = (uInt)fread(inBuf, 1, ICS_BUF_SIZE, file);
-        if (ferror(file)) {
+    stream->avail_in = 0;
+    while (todo > 0 && err != Z_STREAM_END) {
+        if (stream->avail_in == 0) {
+            inPos = (size_t)ICSFTELL(file);
+            stream->avail_in = (uInt)fread(inBuf, 1, ICS_BUF_SIZE, file);
+            if (ferror(file)) {
+                return IcsErr_FReadIds;
+            }
+            if (stream->avail_in == 0) {
+                err = Z_STREAM_ERROR;
+                break;
+            }
+            stream->next_in = inBuf;
+        }
+        bufsize = (unsigned int)(todo < ICS_BUF_SIZE ? todo : ICS_BUF_SIZE);
+        stream->avail_out = bufsize;
+        prevbuf = stream->next_out = (Bytef*)outBuf + len - todo;
+        err = inflate(stream, flush);
+        if (!(err == Z_OK || err == Z_STREAM_END || err == Z_BUF_ERROR)) {
             return IcsErr_FReadIds;
         }
-        if (stream->avail_in == 0 && todo > 0) {
-            err = Z_STREAM_ERROR;
-            break;
+        done = bufsize - stream->avail_out;
+        todo -= done;
+        br->zlibCRC = crc32(br->zlibCRC, prevbuf, done);
+#ifdef ICS_ZIP_INDEX
+            /* At the end of a deflate block (but not the last one)? */
+        if (err == Z_OK && (stream->data_type & 128) &&
+            !(stream->data_type & 64)) {
+            error = icsZipIndexAdd(icsStruct, stream,
+                                   inPos + (size_t)(stream->next_in
+                                                    - (Bytef*)inBuf),
+                                   br->zlibCRC);
+            if (error) return error;
         }
-        stream->next_in = inBuf;
-        do {
-            if (todo == 0) {
-                err = Z_OK;
-                break;
-            }
-            bufsize = (unsigned int)(todo < ICS_BUF_SIZE ? todo : ICS_BUF_SIZE);
-            stream->avail_out = bufsize;
-            prevbuf = stream->next_out = (Bytef*)outBuf + len - todo;;
-            err = inflate(stream, Z_NO_FLUSH);
-            if (!(err == Z_OK || err == Z_STREAM_END || err == Z_BUF_ERROR)) {
-                return IcsErr_FReadIds;
-            }
-            done = bufsize - stream->avail_out;
-            todo -= done;
-            br->zlibCRC = crc32(br->zlibCRC, prevbuf, done);
-        } while (stream->avail_out == 0);
-    } while (err != Z_STREAM_END && todo > 0);
+#endif
+    }
 
         /* Set the file pointer back so that unused input can be read again. */
     ICSFSEEK(file, -(ptrdiff_t)stream->avail_in, SEEK_CUR);
@@ -552,7 +1151,7 @@ Ics_Error IcsReadZipBlock(Ics_Header *icsStruct,
         if (icsGetLong(file) != br->zlibCRC) {
             err = Z_STREAM_ERROR;
         } else {
-            if (icsGetLong(file) != stream->total_out) {
+            if (icsGetLong(file) != (stream->total_out & 0xFFFFFFFF)) {
                 err = Z_STREAM_ERROR;
             }
         }
@@ -564,7 +1163,7 @@ Ics_Error IcsReadZipBlock(Ics_Header *icsStruct,
         if (len != stream->total_out - prevout) return IcsErr_EndOfStream;
         return IcsErr_Ok;
     }
-    if (err == Z_OK) return IcsErr_Ok;
+    if (err == Z_OK || err == Z_BUF_ERROR) return IcsErr_Ok;
     return IcsErr_DecompressionProblem;
 #else
     (void)icsStruct;
@@ -576,40 +1175,63 @@ Ics_Error IcsReadZipBlock(Ics_Header *icsStruct,
 
 
 /* Skip ZIP compressed data block. This function mostly does:
-     gzseek((gzFile)br->ZlibStream, (z_off_t)offset, whence); */
+     gzseek((gzFile)br->ZlibStream, (z_off_t)offset, whence);
+   If the index has an access point between the current position and the
+   target, or before the target when seeking backwards, decompression resumes
+   from there. Otherwise the stream is decompressed from the current position,
+   or from the start. */
 Ics_Error IcsSetZipBlock(Ics_Header *icsStruct,
                          ptrdiff_t   offset,
                          int         whence)
 {
 #ifdef ICS_ZLIB
     ICSINIT;
-    size_t         n, bufsize;
-    void          *buf;
+    size_t         n;
+    unsigned char  buf[ICS_BUF_SIZE]; /* Skipped data is decompressed here */
     Ics_BlockRead *br     = (Ics_BlockRead*)icsStruct->blockRead;
     z_stream*      stream = (z_stream*)br->zlibStream;
+#ifdef ICS_ZIP_INDEX
+    Ics_ZipPoint  *point;
+#endif
 
     if ((whence == SEEK_CUR) && (offset<0)) {
         offset += (ptrdiff_t)stream->total_out;
         whence = SEEK_SET;
     }
+#ifdef ICS_ZIP_INDEX
+    if (whence == SEEK_CUR) {
+        offset += (ptrdiff_t)stream->total_out;
+        whence = SEEK_SET;
+    }
+    if (offset < 0) return IcsErr_IllParameter;
+    point = icsZipIndexFind(icsStruct, (size_t)offset);
+    if ((size_t)offset >= stream->total_out &&
+        (point == NULL || point->out <= stream->total_out)) {
+            /* Read forward from the current position */
+        offset -= (ptrdiff_t)stream->total_out;
+        whence = SEEK_CUR;
+    } else if (point != NULL) {
+            /* Read forward from the access point */
+        error = icsZipJump(icsStruct, point);
+        if (error) return error;
+        offset -= (ptrdiff_t)point->out;
+        whence = SEEK_CUR;
+    }
+#endif
     if (whence == SEEK_SET) {
         if (offset < 0) return IcsErr_IllParameter;
         error = IcsCloseIds(icsStruct);
         if (error) return error;
         error = IcsOpenIds(icsStruct);
         if (error) return error;
-        if (offset==0) return IcsErr_Ok;
     }
-
-    bufsize = (size_t)(offset < ICS_BUF_SIZE ? offset : ICS_BUF_SIZE);
-    buf = malloc(bufsize);
-    if (buf == NULL) return IcsErr_Alloc;
+    if (offset == 0) return IcsErr_Ok;
 
     n = (size_t)offset;
     while (n > 0) {
-        if (n > bufsize) {
-            error = IcsReadZipBlock(icsStruct, buf, bufsize);
-            n -= bufsize;
+        if (n > ICS_BUF_SIZE) {
+            error = IcsReadZipBlock(icsStruct, buf, ICS_BUF_SIZE);
+            n -= ICS_BUF_SIZE;
         } else {
             error = IcsReadZipBlock(icsStruct, buf, n);
             break;
@@ -619,8 +1241,6 @@ Ics_Error IcsSetZipBlock(Ics_Header *icsStruct,
         }
     }
 
-    free(buf);
-
     return error;
 #else
     (void)icsStruct;
@@ -630,3 +1250,101 @@ Ics_Error IcsSetZipBlock(Ics_Header *icsStruct,
 #endif
 }
 
+
+
+/* Get the size of the buffer needed to hold n bytes compressed by
+   IcsZipChunk. */
+size_t IcsZipChunkBound(size_t n)
+{
+#ifdef ICS_ZLIB
+        /* compressBound() includes a 6-byte zlib wrapper, gzip uses 18 */
+    return (size_t)compressBound((uLong)n) + 12;
+#else
+    return n;
+#endif
+}
+
+
+/* Compress n bytes from src into a single gzip stream at dest, which has room
+   for *destLen bytes. On return, *destLen is the length of the stream. */
+Ics_Error IcsZipChunk(const void *src,
+                      size_t      n,
+                      void       *dest,
+                      size_t     *destLen,
+                      int         level)
+{
+#ifdef ICS_ZLIB
+    z_stream stream;
+    int      err;
+
+
+    if (n > UINT_MAX || *destLen > UINT_MAX) return IcsErr_CompressionProblem;
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    err = deflateInit2(&stream, level, Z_DEFLATED, MAX_WBITS + 16,
+                       DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        return err == Z_VERSION_ERROR ? IcsErr_WrongZlibVersion
+                                      : IcsErr_CompressionProblem;
+    }
+    stream.next_in = (Bytef*)src;
+    stream.avail_in = (uInt)n;
+    stream.next_out = (Bytef*)dest;
+    stream.avail_out = (uInt)*destLen;
+    err = deflate(&stream, Z_FINISH);
+    *destLen -= stream.avail_out;
+    deflateEnd(&stream);
+
+    return err == Z_STREAM_END ? IcsErr_Ok : IcsErr_CompressionProblem;
+#else
+    (void)src;
+    (void)n;
+    (void)dest;
+    (void)destLen;
+    (void)level;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Decompress the gzip stream of srcLen bytes at src, which must expand to
+   exactly n bytes, into dest. */
+Ics_Error IcsUnzipChunk(const void *src,
+                        size_t      srcLen,
+                        void       *dest,
+                        size_t      n)
+{
+#ifdef ICS_ZLIB
+    z_stream stream;
+    int      err;
+
+
+    if (n > UINT_MAX || srcLen > UINT_MAX) return IcsErr_CorruptedStream;
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    stream.next_in = (Bytef*)src;
+    stream.avail_in = (uInt)srcLen;
+    err = inflateInit2(&stream, MAX_WBITS + 16);
+    if (err != Z_OK) {
+        return err == Z_VERSION_ERROR ? IcsErr_WrongZlibVersion
+                                      : IcsErr_DecompressionProblem;
+    }
+    stream.next_out = (Bytef*)dest;
+    stream.avail_out = (uInt)n;
+    err = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (err == Z_DATA_ERROR) return IcsErr_CorruptedStream;
+    if (err != Z_STREAM_END) return IcsErr_DecompressionProblem;
+    if (stream.avail_out != 0) return IcsErr_OutputNotFilled;
+
+    return IcsErr_Ok;
+#else
+    (void)src;
+    (void)srcLen;
+    (void)dest;
+    (void)n;
+    return IcsErr_UnknownCompression;
+#endif
+}
@@ -47,16 +47,80 @@
 /* Declare and initialize the error variable. */
 #define ICSINIT Ics_Error error = IcsErr_Ok
 
-/* Forcing the proper locale. */
-#ifdef ICS_FORCE_C_LOCALE
+/* Forcing the proper locale. Where possible only the locale of the calling
+   thread is changed, such that other threads can read and write files, or do
+   anything else, at the same time. */
+#if defined(ICS_FORCE_C_LOCALE) && defined(HAVE_USELOCALE)
 #include <locale.h>
-#define ICS_INIT_LOCALE \
-    char* Ics_CurrentLocale = 0
-#define ICS_SET_LOCALE                           \
-    Ics_CurrentLocale = setlocale(LC_ALL, NULL); \
-    setlocale (LC_ALL, "C")
-#define ICS_REVERT_LOCALE \
-    setlocale(LC_ALL, Ics_CurrentLocale)
+#if defined(__APPLE__)
+#include <xlocale.h>
+#endif
+/* The "C" locale is created once, see IcsGetCLocale(). Should that fail, the
+   global locale is changed instead. */
+locale_t IcsGetCLocale(void);
+#define ICS_INIT_LOCALE                                               \
+    locale_t Ics_CurrentLocale = (locale_t)0;                         \
+    char     Ics_CurrentLocaleName[ICS_LINE_LENGTH] = ""
+#define ICS_SET_LOCALE                                                \
+do {                                                                  \
+    locale_t Ics_CLocale = IcsGetCLocale();                           \
+    if (Ics_CLocale) {                                                \
+        Ics_CurrentLocale = uselocale(Ics_CLocale);                   \
+    } else {                                                          \
+        IcsStrCpy(Ics_CurrentLocaleName, setlocale(LC_ALL, NULL),     \
+                  ICS_LINE_LENGTH);                                   \
+        setlocale(LC_ALL, "C");                                       \
+    }                                                                 \
+} while (0)
+#define ICS_REVERT_LOCALE                                             \
+do {                                                                  \
+    if (Ics_CurrentLocale) {                                          \
+        uselocale(Ics_CurrentLocale);                                 \
+        Ics_CurrentLocale = (locale_t)0;                              \
+    } else if (Ics_CurrentLocaleName[0] != '\0') {                    \
+        setlocale(LC_ALL, Ics_CurrentLocaleName);                     \
+        Ics_CurrentLocaleName[0] = '\0';                              \
+    }                                                                 \
+} while (0)
+#elif defined(ICS_FORCE_C_LOCALE) && defined(_WIN32)
+#include <locale.h>
+#define ICS_INIT_LOCALE                                               \
+    int   Ics_ThreadLocale = -1;                                      \
+    char  Ics_CurrentLocale[ICS_LINE_LENGTH] = ""
+#define ICS_SET_LOCALE                                                \
+do {                                                                  \
+    Ics_ThreadLocale = _configthreadlocale(_ENABLE_PER_THREAD_LOCALE);\
+    IcsStrCpy(Ics_CurrentLocale, setlocale(LC_ALL, NULL),             \
+              ICS_LINE_LENGTH);                                       \
+    setlocale(LC_ALL, "C");                                           \
+} while (0)
+#define ICS_REVERT_LOCALE                                             \
+do {                                                                  \
+    if (Ics_ThreadLocale != -1) {                                     \
+        setlocale(LC_ALL, Ics_CurrentLocale);                         \
+        _configthreadlocale(Ics_ThreadLocale);                        \
+        Ics_ThreadLocale = -1;                                        \
+    }                                                                 \
+} while (0)
+#elif defined(ICS_FORCE_C_LOCALE)
+#include <locale.h>
+/* setlocale() returns a pointer to static storage, which the next call
+   overwrites, so the name of the current locale must be copied. */
+#define ICS_INIT_LOCALE                                               \
+    char Ics_CurrentLocale[ICS_LINE_LENGTH] = ""
+#define ICS_SET_LOCALE                                                \
+do {                                                                  \
+    IcsStrCpy(Ics_CurrentLocale, setlocale(LC_ALL, NULL),             \
+              ICS_LINE_LENGTH);                                       \
+    setlocale(LC_ALL, "C");                                           \
+} while (0)
+#define ICS_REVERT_LOCALE                                             \
+do {                                                                  \
+    if (Ics_CurrentLocale[0] != '\0') {                               \
+        setlocale(LC_ALL, Ics_CurrentLocale);                         \
+        Ics_CurrentLocale[0] = '\0';                                  \
+    }                                                                 \
+} while (0)
 #else
 #define ICS_INIT_LOCALE
 #define ICS_SET_LOCALE
@@ -102,6 +166,9 @@ typedef enum {
     ICSTOK_MODEL,
     ICSTOK_SPARAMS,
     ICSTOK_SSTATES,
+    ICSTOK_CHUNKS,
+    ICSTOK_FILTER,
+    ICSTOK_PREDICTOR,
     ICSTOK_LASTSUB,
 
         /* SubsubCategory tokens: */
@@ -161,6 +228,11 @@ typedef enum {
     ICSTOK_COMPR_UNCOMPRESSED,
     ICSTOK_COMPR_COMPRESS,
     ICSTOK_COMPR_GZIP,
+    ICSTOK_COMPR_CHUNKED_GZIP,
+    ICSTOK_COMPR_ZSTD,
+    ICSTOK_FILTER_SHUFFLE,
+    ICSTOK_FILTER_BITSHUFFLE,
+    ICSTOK_PREDICTOR_HORIZONTAL,
     ICSTOK_FORMAT_INTEGER,
     ICSTOK_FORMAT_REAL,
     ICSTOK_FORMAT_COMPLEX,
@@ -197,9 +269,16 @@ typedef struct {
 } Ics_Symbol;
 
 
+/* The symbols in a list are found through a perfect hash: the hash of each
+   name, computed with IcsSymbolHash() and hashSeed, is reduced to hashBits
+   bits, and used to index hash[], which holds the index of the symbol in list
+   (or -1). The tables are generated by support/symbol_hash.c. */
 typedef struct {
-    int         entries;
-    Ics_Symbol *list;
+    int                entries;
+    Ics_Symbol        *list;
+    ics_t_uint32       hashSeed;
+    int                hashBits;
+    const signed char *hash;
 } Ics_SymbolList;
 
 
@@ -213,6 +292,15 @@ extern Ics_SymbolList G_SubSubCategories;
 extern Ics_SymbolList G_Values;
 
 
+/* Case-insensitive hash of a symbol name. */
+ics_t_uint32 IcsSymbolHash(const char   *name,
+                           ics_t_uint32  seed);
+
+/* Find a symbol by name, ignoring case. Returns ICSTOK_NONE if not found. */
+Ics_Token IcsGetSymbolToken(const char           *name,
+                            const Ics_SymbolList *listSpec);
+
+
 /* This is the struct behind the "void* History" in the ICS structure: */
 typedef struct {
     char   **strings; /* History strings */
@@ -222,6 +310,14 @@ typedef struct {
                          elements might be NULL */
 } Ics_History;
 
+/* The cookie of a stream opened through the callbacks set with
+   IcsSetIoVTable: */
+typedef struct {
+    Ics_IoVTable   vtable;          /* Callbacks the file was opened with */
+    void          *handle;          /* Handle returned by vtable.open */
+} Ics_IoStream;
+
+
 /* This is the struct behind the "void* BlockRead" in the ICS structure: */
 typedef struct {
     FILE*          dataFilePtr;     /* Input data file */
@@ -229,16 +325,108 @@ typedef struct {
     void          *zlibStream;      /* z_stream* (or gzFile) for zlib */
     void          *zlibInputBuffer; /* Input buffer for compressed data */
     unsigned long  zlibCRC;         /* running CRC */
+#endif
+#ifdef ICS_ZSTD
+    void          *zstdStream;      /* Decompression state for zstd */
 #endif
     int            compressRead;    /* set to non-zero when IcsReadCompress has
                                       been called */
+    size_t         dataOffset;      /* Offset of the image data in the file */
+    void          *lineBuf;         /* Two lines: the decoded current line,
+                                       and scratch space; NULL if the data is
+                                       neither filtered nor predicted */
+    size_t         linePos;         /* Position in the decoded data */
+    unsigned char  bitByte;         /* For binary data, the packed byte that
+                                       holds the imel at linePos */
+    Ics_IoStream  *io;              /* Cookie of dataFilePtr if it was opened
+                                       through custom callbacks, or NULL */
 } Ics_BlockRead;
 
 
+/* This is the struct behind the "void* blockWrite" in the ICS structure: */
+typedef struct {
+    FILE*          dataFilePtr;     /* Output data file; NULL once finished */
+#ifdef ICS_ZLIB
+    void          *zlibStream;      /* Compression state for zlib */
+#endif
+#ifdef ICS_ZSTD
+    void          *zstdStream;      /* Compression state for zstd */
+#endif
+    void          *lineBuf;         /* Three lines: the line being gathered,
+                                       and room for the encoded line; NULL if
+                                       the data is neither filtered nor
+                                       predicted */
+    size_t         written;         /* Number of bytes written so far */
+    unsigned char  bitByte;         /* For binary data, the imels written
+                                       since the last whole byte, packed */
+} Ics_BlockWrite;
+
+
+/* This is the struct behind the "void* dataMap" in the ICS structure: */
+typedef struct {
+    void          *base;            /* Start of the mapped or allocated region */
+    size_t         length;          /* Length of the region */
+    void          *data;            /* Start of the image data in the region */
+    int            isMapped;        /* set to zero if base was malloc'd */
+} Ics_DataMap;
+
+
+/* An access point into gzip-compressed data, from where decompression can be
+   resumed: */
+typedef struct {
+    size_t         out;             /* Offset in the uncompressed data */
+    size_t         in;              /* Offset in the file of the first complete
+                                       byte of compressed data */
+    int            bits;            /* Number of bits of the byte before that
+                                       one still to be used, or 0 */
+    unsigned long  crc;             /* CRC of the uncompressed data up to here */
+    unsigned int   windowLen;       /* Length of window */
+    unsigned char *window;          /* Uncompressed data preceding this point */
+} Ics_ZipPoint;
+
+/* This is the struct behind the "void* zipIndex" in the ICS structure: */
+typedef struct {
+    Ics_ZipPoint  *points;          /* Access points, in increasing order */
+    size_t         nPoints;         /* Number of access points */
+    size_t         size;            /* Size of the points array */
+} Ics_ZipIndex;
+
+
+/* A run of bytes of the image data, read with IcsReadIdsExtents: */
+typedef struct {
+    size_t         offset;          /* Offset from the start of the data */
+    size_t         n;               /* Number of bytes */
+    void          *dest;            /* Where the bytes are read to */
+} Ics_Extent;
+
+
+/* This is the struct behind the "void* memory" in the ICS structure: */
+typedef struct {
+    const char    *data;            /* The ICS file; NULL when writing */
+    size_t         size;            /* Length of the ICS file */
+} Ics_Memory;
+
+
 /* Assorted support functions */
 FILE *IcsFOpen(const char *path,
                const char *mode);
 
+FILE *IcsFOpenIo(const char    *path,
+                 const char    *mode,
+                 Ics_IoStream **io);
+
+int IcsCustomIo(void);
+
+Ics_Error IcsReadIoAt(Ics_IoStream *io,
+                      void         *dest,
+                      size_t        n,
+                      size_t        offset);
+
+int IcsRemove(const char *path);
+
+int IcsRename(const char *from,
+              const char *to);
+
 size_t IcsStrToSize(const char *str);
 
 void IcsStrCpy(char       *dest,
@@ -257,6 +445,16 @@ Ics_Error IcsOpenIcs(FILE **fpp,
                      char  *filename,
                      int    forceName);
 
+FILE *IcsOpenMemoryStream(const Ics_Memory *mem);
+
+Ics_Error IcsReadIcsMemory(Ics_Header *icsStruct,
+                           Ics_Memory *mem,
+                           int         forceLocale);
+
+Ics_Error IcsWriteIcsMemory(Ics_Header  *icsStruct,
+                            void       **buf,
+                            size_t      *len);
+
 Ics_Error IcsInternAddHistory(Ics_Header *ics,
                               const char *key,
                               const char *stuff,
@@ -280,10 +478,77 @@ Ics_Error IcsWritePlainWithStrides(const void      *src,
                                    int              nBytes,
                                    FILE            *file);
 
+Ics_Error IcsConvertImels(const void   *src,
+                          Ics_DataType  srcType,
+                          void         *dest,
+                          Ics_DataType  destType,
+                          size_t        n,
+                          double        scale,
+                          double        offset);
+
+void IcsPackBits(const void *src,
+                 void       *dest,
+                 size_t      n);
+
+void IcsUnpackBits(const void *src,
+                   void       *dest,
+                   size_t      n);
+
+void IcsGatherImels(const char *src,
+                    ptrdiff_t   stride,
+                    size_t      n,
+                    int         nBytes,
+                    char       *dest);
+
+void IcsTransposeImels(const char *src,
+                       ptrdiff_t   srcStride,
+                       ptrdiff_t   srcLineStride,
+                       char       *dest,
+                       ptrdiff_t   destStride,
+                       ptrdiff_t   destLineStride,
+                       size_t      n,
+                       size_t      nLines,
+                       int         nBytes);
+
+Ics_Error IcsUpdateIcs(Ics_Header *icsStruct,
+                       size_t      size,
+                       int        *done);
+
 Ics_Error IcsCopyIds(const char *infilename,
                      size_t      inoffset,
                      const char *outfilename);
 
+Ics_Error IcsWriteIdsStream(const Ics_Header *icsStruct,
+                            FILE             *fp);
+
+Ics_Error IcsWriteIdsConverted(const Ics_Header *icsStruct,
+                               FILE             *fp);
+
+Ics_Error IcsReadIdsExtents(Ics_Header       *icsStruct,
+                            const Ics_Extent *extents,
+                            size_t            count);
+
+Ics_Error IcsOpenIdsWrite(Ics_Header *icsStruct);
+
+Ics_Error IcsWriteIdsBlock(Ics_Header *icsStruct,
+                           const void *src,
+                           size_t      n);
+
+Ics_Error IcsCloseIdsWrite(Ics_Header *icsStruct);
+
+/* Thread support functions */
+typedef Ics_Error (*Ics_TaskFunc)(void   *arg,
+                                  size_t  task);
+
+int IcsGetNumberOfProcessors(void);
+
+Ics_Error IcsParallelFor(int           nThreads,
+                         size_t        nTasks,
+                         Ics_TaskFunc  func,
+                         void         *arg);
+
+int IcsGetCompressionThreads(const Ics_Header *icsStruct);
+
 /* zlib interface functions */
 Ics_Error IcsWriteZip(const void *src,
                       size_t      n,
@@ -295,9 +560,23 @@ Ics_Error IcsWriteZipWithStrides(const void      *src,
                                  const ptrdiff_t *stride,
                                  int              nDims,
                                  int              nBytes,
+                                 Ics_Filter       filter,
+                                 Ics_Predictor    predictor,
                                  FILE            *file,
                                  int              level);
 
+Ics_Error IcsWriteZipParallel(const void      *src,
+                              size_t           n,
+                              const size_t    *dim,
+                              const ptrdiff_t *stride,
+                              int              nDims,
+                              int              nBytes,
+                              Ics_Filter       filter,
+                              Ics_Predictor    predictor,
+                              FILE            *file,
+                              int              level,
+                              int              nThreads);
+
 Ics_Error IcsOpenZip(Ics_Header *IcsStruct);
 
 Ics_Error IcsCloseZip(Ics_Header *IcsStruct);
@@ -310,6 +589,121 @@ Ics_Error IcsSetZipBlock(Ics_Header *IcsStruct,
                          ptrdiff_t   offset,
                          int         whence);
 
+void IcsFreeZipIndex(Ics_Header *IcsStruct);
+
+Ics_Error IcsOpenZipWrite(const Ics_Header *icsStruct,
+                          Ics_BlockWrite   *bw);
+
+Ics_Error IcsWriteZipBlock(Ics_BlockWrite *bw,
+                           const void     *src,
+                           size_t          n);
+
+Ics_Error IcsCloseZipWrite(Ics_BlockWrite *bw);
+
+size_t IcsZipChunkBound(size_t n);
+
+Ics_Error IcsZipChunk(const void *src,
+                      size_t      n,
+                      void       *dest,
+                      size_t     *destLen,
+                      int         level);
+
+Ics_Error IcsUnzipChunk(const void *src,
+                        size_t      srcLen,
+                        void       *dest,
+                        size_t      n);
+
+/* zstd interface functions */
+Ics_Error IcsWriteZstd(const void *src,
+                       size_t      n,
+                       FILE       *file,
+                       int         level,
+                       int         nThreads);
+
+Ics_Error IcsWriteZstdWithStrides(const void      *src,
+                                  const size_t    *dim,
+                                  const ptrdiff_t *stride,
+                                  int              nDims,
+                                  int              nBytes,
+                                  Ics_Filter       filter,
+                                  Ics_Predictor    predictor,
+                                  FILE            *file,
+                                  int              level,
+                                  int              nThreads);
+
+Ics_Error IcsOpenZstd(Ics_Header *icsStruct);
+
+Ics_Error IcsCloseZstd(Ics_Header *icsStruct);
+
+Ics_Error IcsReadZstdBlock(Ics_Header *icsStruct,
+                           void       *outBuf,
+                           size_t      len);
+
+Ics_Error IcsSetZstdBlock(Ics_Header *icsStruct,
+                          ptrdiff_t   offset,
+                          int         whence);
+
+Ics_Error IcsOpenZstdWrite(const Ics_Header *icsStruct,
+                           Ics_BlockWrite   *bw);
+
+Ics_Error IcsWriteZstdBlock(Ics_BlockWrite *bw,
+                            const void     *src,
+                            size_t          n);
+
+Ics_Error IcsCloseZstdWrite(Ics_BlockWrite *bw);
+
+/* Filters applied before compression */
+Ics_Filter IcsGetActiveFilter(const Ics_Header *icsStruct);
+
+void IcsFilterData(Ics_Filter  filter,
+                   const void *src,
+                   void       *dest,
+                   size_t      n,
+                   int         nBytes);
+
+void IcsUnfilterData(Ics_Filter  filter,
+                     const void *src,
+                     void       *dest,
+                     size_t      n,
+                     int         nBytes);
+
+Ics_Predictor IcsGetActivePredictor(const Ics_Header *icsStruct);
+
+void IcsPredictData(Ics_Predictor  predictor,
+                    const void    *src,
+                    void          *dest,
+                    size_t         n,
+                    int            nBytes);
+
+void IcsUnpredictData(Ics_Predictor  predictor,
+                      void          *buf,
+                      size_t         n,
+                      int            nBytes);
+
+void IcsEncodeData(Ics_Filter     filter,
+                   Ics_Predictor  predictor,
+                   const void    *src,
+                   void          *buf,
+                   size_t         n,
+                   int            nBytes);
+
+/* Chunked compression functions */
+void IcsGetChunkShape(const Ics_Header *icsStruct,
+                      size_t           *shape);
+
+Ics_Error IcsWriteChunks(const Ics_Header *icsStruct,
+                         const void       *src,
+                         const ptrdiff_t  *strides,
+                         FILE             *file);
+
+Ics_Error IcsReadChunks(Ics_Header      *icsStruct,
+                        const size_t    *offset,
+                        const size_t    *size,
+                        const size_t    *sampling,
+                        void            *dest,
+                        const ptrdiff_t *destStride,
+                        int              nThreads);
+
 /* Reading COMPRESS-compressed data */
 Ics_Error IcsReadCompress(Ics_Header *IcsStruct,
                           void       *outBuf,
@@ -0,0 +1,403 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright 2025:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Contact: libics@svi.nl
+ *
+ * Copyright (C) 2000-2013 Cris Luengo and others
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_io.c
+ *
+ * The following library functions are contained in this file:
+ *
+ *   IcsSetIoVTable()
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsFOpen()
+ *   IcsFOpenIo()
+ *   IcsCustomIo()
+ *   IcsReadIoAt()
+ *   IcsRemove()
+ *   IcsRename()
+ *
+ * All files are opened as stdio streams, so that the rest of the library does
+ * not need to know where the bytes come from. With custom I/O, the stream is
+ * created with fopencookie (glibc) or funopen (BSD, macOS) on top of the
+ * callbacks set with IcsSetIoVTable.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* glibc declares fopencookie() only for GNU sources. This
+                       can't depend on HAVE_FOPENCOOKIE: with configure, that
+                       is defined in libics_conf.h, which is included later */
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics_intern.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+#define ICS_CUSTOM_IO
+#endif
+
+#if defined(ICS_CUSTOM_IO) && defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
+
+#ifdef ICS_CUSTOM_IO
+/* The callbacks set with IcsSetIoVTable, used when icsIoActive is set. They
+   are shared by the whole process; they are only accessed through
+   icsSetIo and icsGetIo, which hold icsIoLock where threads are available. */
+static Ics_IoVTable icsIo;
+static int          icsIoActive = 0;
+#ifdef HAVE_PTHREADS
+static pthread_mutex_t icsIoLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/* Set the callbacks, or return to the c library if vtable is NULL. */
+static void icsSetIo(const Ics_IoVTable *vtable)
+{
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&icsIoLock);
+#endif
+    if (vtable == NULL) {
+        icsIoActive = 0;
+    } else {
+        icsIo = *vtable;
+        icsIoActive = 1;
+    }
+#ifdef HAVE_PTHREADS
+    pthread_mutex_unlock(&icsIoLock);
+#endif
+}
+
+
+/* Copy the callbacks to vtable if they are set. Returns non-zero if they
+   are. */
+static int icsGetIo(Ics_IoVTable *vtable)
+{
+    int active;
+
+
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&icsIoLock);
+#endif
+    active = icsIoActive;
+    if (active && vtable != NULL) *vtable = icsIo;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_unlock(&icsIoLock);
+#endif
+
+    return active;
+}
+#endif
+
+
+/* Open a file through the c library. On Windows it uses _wfopen to support
+   UTF-8 filenames. */
+static FILE *icsFOpenStdio(const char *path,
+                           const char *mode)
+{
+#ifdef _WIN32
+    wchar_t *wpath  = NULL, wmode[8];
+    int      n      = MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, 0);
+    FILE    *result = NULL;
+
+    wpath =(wchar_t*)malloc(n * sizeof(wchar_t));
+    if (!wpath) return NULL;
+
+    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, n)) goto exit;
+    if (!MultiByteToWideChar(CP_UTF8, 0, mode, -1, wmode, 8)) goto exit;
+
+    result = _wfopen(wpath, wmode);
+
+  exit:
+    if (wpath) {
+        free(wpath);
+    }
+    return result;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+
+#ifdef ICS_CUSTOM_IO
+/* The stream functions, which forward to the callbacks in the cookie. */
+#if defined(HAVE_FOPENCOOKIE)
+static ssize_t icsCookieRead(void   *cookie,
+                             char   *buf,
+                             size_t  n)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    return (ssize_t)io->vtable.read(io->handle, buf, n);
+}
+
+
+static ssize_t icsCookieWrite(void       *cookie,
+                              const char *buf,
+                              size_t      n)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    ptrdiff_t     res;
+
+
+    if (io->vtable.write == NULL) return 0;
+    res = io->vtable.write(io->handle, buf, n);
+        /* glibc takes 0 to mean an error */
+    return res < 0 ? 0 : (ssize_t)res;
+}
+
+
+static int icsCookieSeek(void    *cookie,
+                         off64_t *offset,
+                         int      whence)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    ptrdiff_t     pos;
+
+
+    pos = io->vtable.seek(io->handle, (ptrdiff_t)*offset, whence);
+    if (pos < 0) return -1;
+    *offset = (off64_t)pos;
+    return 0;
+}
+#else
+static int icsCookieRead(void *cookie,
+                         char *buf,
+                         int   n)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    return (int)io->vtable.read(io->handle, buf, (size_t)n);
+}
+
+
+static int icsCookieWrite(void       *cookie,
+                          const char *buf,
+                          int         n)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    return (int)io->vtable.write(io->handle, buf, (size_t)n);
+}
+
+
+static fpos_t icsCookieSeek(void   *cookie,
+                            fpos_t  offset,
+                            int     whence)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    return (fpos_t)io->vtable.seek(io->handle, (ptrdiff_t)offset, whence);
+}
+#endif
+
+
+static int icsCookieClose(void *cookie)
+{
+    Ics_IoStream *io = (Ics_IoStream*)cookie;
+    int           res;
+
+
+    res = io->vtable.close(io->handle);
+    free(io);
+    return res == 0 ? 0 : EOF;
+}
+
+
+/* Open a file through the callbacks in vtable, which are copied into the
+   cookie of the stream. */
+static FILE *icsFOpenCustom(const char         *path,
+                            const char         *mode,
+                            const Ics_IoVTable *vtable,
+                            Ics_IoStream      **ioPtr)
+{
+    Ics_IoStream *io;
+    FILE         *fp;
+
+
+    if (vtable->write == NULL && strchr(mode, 'r') == NULL) return NULL;
+    if (vtable->write == NULL && strchr(mode, '+') != NULL) return NULL;
+    io = (Ics_IoStream*)malloc(sizeof(Ics_IoStream));
+    if (io == NULL) return NULL;
+    io->vtable = *vtable;
+    io->handle = io->vtable.open(io->vtable.userData, path, mode);
+    if (io->handle == NULL) {
+        free(io);
+        return NULL;
+    }
+#if defined(HAVE_FOPENCOOKIE)
+    {
+        cookie_io_functions_t funcs;
+        funcs.read = icsCookieRead;
+        funcs.write = icsCookieWrite;
+        funcs.seek = icsCookieSeek;
+        funcs.close = icsCookieClose;
+        fp = fopencookie(io, mode, funcs);
+    }
+#else
+    fp = funopen(io, icsCookieRead,
+                 io->vtable.write != NULL ? icsCookieWrite : NULL,
+                 icsCookieSeek, icsCookieClose);
+#endif
+    if (fp == NULL) {
+        io->vtable.close(io->handle);
+        free(io);
+        return NULL;
+    }
+    if (ioPtr != NULL) *ioPtr = io;
+    return fp;
+}
+#endif
+
+
+/* Do all file I/O through the callbacks in vtable, or through the c library if
+   vtable is NULL. */
+Ics_Error IcsSetIoVTable(const Ics_IoVTable *vtable)
+{
+    ICSINIT;
+
+
+    if (vtable != NULL &&
+        (vtable->open == NULL || vtable->read == NULL ||
+         vtable->seek == NULL || vtable->close == NULL))
+        return IcsErr_IllParameter;
+#ifdef ICS_CUSTOM_IO
+    icsSetIo(vtable);
+#else
+    if (vtable != NULL) error = IcsErr_NotValidAction;
+#endif
+
+    return error;
+}
+
+
+/* Open a file with the I/O set with IcsSetIoVTable. If the file was opened
+   through the callbacks and io is not NULL, *io is set to the cookie of the
+   stream, which lives until the stream is closed; otherwise *io is set to
+   NULL. */
+FILE *IcsFOpenIo(const char    *path,
+                 const char    *mode,
+                 Ics_IoStream **io)
+{
+#ifdef ICS_CUSTOM_IO
+    Ics_IoVTable vtable;
+#endif
+
+
+    if (io != NULL) *io = NULL;
+#ifdef ICS_CUSTOM_IO
+    if (icsGetIo(&vtable)) return icsFOpenCustom(path, mode, &vtable, io);
+#endif
+    return icsFOpenStdio(path, mode);
+}
+
+
+/* This is a wrapper for the fopen function: it opens the file with the I/O set
+   with IcsSetIoVTable. */
+FILE *IcsFOpen(const char *path,
+               const char *mode)
+{
+    return IcsFOpenIo(path, mode, NULL);
+}
+
+
+/* Returns non-zero if files are opened through custom callbacks, in which case
+   the library cannot memory map them or hand them to the kernel. */
+int IcsCustomIo(void)
+{
+#ifdef ICS_CUSTOM_IO
+    return icsGetIo(NULL);
+#else
+    return 0;
+#endif
+}
+
+
+/* Read n bytes at offset of a file opened through custom callbacks, without
+   using its position. */
+Ics_Error IcsReadIoAt(Ics_IoStream *io,
+                      void         *dest,
+                      size_t        n,
+                      size_t        offset)
+{
+    char      *p = (char*)dest;
+    ptrdiff_t  nread;
+
+
+    if (io->vtable.readAt == NULL) return IcsErr_NotValidAction;
+    while (n > 0) {
+        nread = io->vtable.readAt(io->handle, p, n, offset);
+        if (nread < 0) return IcsErr_FReadIds;
+        if (nread == 0) return IcsErr_EndOfStream;
+        p += nread;
+        offset += (size_t)nread;
+        n -= (size_t)nread;
+    }
+
+    return IcsErr_Ok;
+}
+
+
+/* Delete a file with the I/O set with IcsSetIoVTable. */
+int IcsRemove(const char *path)
+{
+#ifdef ICS_CUSTOM_IO
+    Ics_IoVTable vtable;
+
+
+    if (icsGetIo(&vtable) && vtable.remove != NULL) {
+        return vtable.remove(vtable.userData, path);
+    }
+#endif
+    return remove(path);
+}
+
+
+/* Rename a file with the I/O set with IcsSetIoVTable. */
+int IcsRename(const char *from,
+              const char *to)
+{
+#ifdef ICS_CUSTOM_IO
+    Ics_IoVTable vtable;
+
+
+    if (icsGetIo(&vtable) && vtable.rename != NULL) {
+        return vtable.rename(vtable.userData, from, to);
+    }
+#endif
+    return rename(from, to);
+}
@@ -103,6 +103,28 @@ ICSEXPORT Ics_Error IcsReadIds(Ics_Header *icsStruct,
                                void       *dest,
                                size_t      n);
 
+/* Reads image data at an offset from the start of the data. Does not use the
+   file position, and can be called concurrently from multiple threads. */
+ICSEXPORT Ics_Error IcsReadIdsAt(Ics_Header *icsStruct,
+                                 size_t      offset,
+                                 void       *dest,
+                                 size_t      n);
+
+/* Reorders the bytes of image data in memory from the given byte order to the
+   machine's byte order. */
+ICSEXPORT Ics_Error IcsReorderIds(char         *buf,
+                                  size_t        length,
+                                  Ics_DataType  dataType,
+                                  int           srcByteOrder[ICS_MAX_IMEL_SIZE],
+                                  int           bytes);
+
+/* Maps image data into memory. */
+ICSEXPORT Ics_Error IcsMapIds(Ics_Header  *icsStruct,
+                              const void **dest);
+
+/* Releases image data mapped into memory. */
+ICSEXPORT Ics_Error IcsUnmapIds(Ics_Header *icsStruct);
+
 /* Writes image data to disk. */
 ICSEXPORT Ics_Error IcsWriteIds(const Ics_Header *icsStruct);
 
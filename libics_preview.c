@@ -140,6 +140,7 @@ Ics_Error IcsGetPreviewData(ICS    *ics,
         return error;
     }
     switch (ics->imel.dataType) {
+        case Ics_binary:
         case Ics_uint8:
         {
             ics_t_uint8 *in  = buf;
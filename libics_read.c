@@ -36,6 +36,10 @@
  *
  *   IcsReadIcs()
  *   IcsVersion()
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsReadIcsMemory()
  */
 
 
@@ -44,13 +48,24 @@
 #include <string.h>
 #include "libics_intern.h"
 
-/* Use thread safe string tokenization if available */
-#ifdef HAVE_STRTOK_R
-#define STRTOK(str, seps) strtok_r(str, seps, &saveptr)
-#else
-#define STRTOK(str, seps) strtok(str, seps)
+#if ICS_HEADER_BUF_SIZE < ICS_LINE_LENGTH
+#error ICS_HEADER_BUF_SIZE must be at least ICS_LINE_LENGTH
 #endif
 
+
+/* The header is read in large blocks, and the lines are returned as pointers
+   into the buffer. */
+typedef struct {
+    FILE   *fp;
+    char   *buf;    /* ICS_HEADER_BUF_SIZE bytes, plus one for a null byte */
+    size_t  size;   /* Number of valid bytes in buf */
+    size_t  pos;    /* Position in buf of the next byte to return */
+    size_t  offset; /* Position in the file of buf[0] */
+    int     skip;   /* The previous line was truncated, skip the rest of it */
+    int     eof;
+} Ics_HeaderReader;
+
+
 /* Find the index for "bits", which should be the first parameter. */
 static int icsGetBitsParam(char order[ICS_MAXDIM+1][ICS_STRLEN_TOKEN],
                            int  parameters)
@@ -68,49 +83,162 @@ static int icsGetBitsParam(char order[ICS_MAXDIM+1][ICS_STRLEN_TOKEN],
 }
 
 
-/* Like fgets(), gets a string from a stream. However, does not stop at newline
-   character, but at 'sep'. It retains the 'sep' character at the end of the
-   string; a null byte is appended. Also, it implements the solution to the
-   CR/LF pair problem caused by some windows applications. If 'sep' is LF, it
-   might be prepended by a CR. */
-static char *icsFGetStr(char *line,
-                        int   n,
-                        FILE *fi,
-                        char  sep)
+/* Prepare to read the header from fp, which must not have been read from. The
+   stream is made unbuffered, such that each block is read with a single read
+   from the file. */
+static Ics_Error icsOpenHeaderReader(Ics_HeaderReader *hr,
+                                     FILE             *fp)
 {
-        /* n == ICS_LINE_LENGTH */
-    int i = 0;
-    int ch;
+    hr->fp = fp;
+    hr->size = 0;
+    hr->pos = 0;
+    hr->offset = 0;
+    hr->skip = 0;
+    hr->eof = 0;
+    hr->buf = (char*)malloc(ICS_HEADER_BUF_SIZE + 1);
+    if (hr->buf == NULL) return IcsErr_Alloc;
+    setvbuf(fp, NULL, _IONBF, 0);
+    return IcsErr_Ok;
+}
 
 
-        /* Imitate fgets() */
-    while (i < n - 1) {
-        ch = getc(fi);
-        if (ch == EOF)
-            break;
+static void icsCloseHeaderReader(Ics_HeaderReader *hr)
+{
+    free(hr->buf);
+    hr->buf = NULL;
+}
 
-            /* Skip CR if next char is LF and sep is LF. */
-        if (ch == '\r' && sep == '\n') {
-            ch = getc(fi);
-            if (ch != sep && ch != EOF) {
-                ungetc(ch, fi);
-                ch = '\r';
-            }
+
+/* Move the unread bytes to the start of the buffer and read the next block
+   after them. Sets hr->eof if no more bytes could be read. */
+static Ics_Error icsFillHeaderReader(Ics_HeaderReader *hr)
+{
+    size_t n;
+
+
+    if (hr->pos > 0) {
+        memmove(hr->buf, hr->buf + hr->pos, hr->size - hr->pos);
+        hr->offset += hr->pos;
+        hr->size -= hr->pos;
+        hr->pos = 0;
+    }
+    n = fread(hr->buf + hr->size, 1, ICS_HEADER_BUF_SIZE - hr->size, hr->fp);
+    if (n == 0) {
+        if (ferror(hr->fp)) return IcsErr_FReadIcs;
+        hr->eof = 1;
+    }
+    hr->size += n;
+    return IcsErr_Ok;
+}
+
+
+/* Like fgetc(), returns EOF on end of file or read error. */
+static int icsHeaderGetc(Ics_HeaderReader *hr)
+{
+    if (hr->pos == hr->size) {
+        if (hr->eof || icsFillHeaderReader(hr) != IcsErr_Ok) return EOF;
+        if (hr->pos == hr->size) return EOF;
+    }
+    return (unsigned char)hr->buf[hr->pos++];
+}
+
+
+/* Get the next line, up to the 'sep' character. The line is null-terminated in
+   place and stays valid until the next call. Lines longer than
+   ICS_LINE_LENGTH-1 characters are truncated. Also, it implements the solution
+   to the CR/LF pair problem caused by some windows applications: if 'sep' is LF,
+   it might be prepended by a CR, which is removed. Returns NULL at the end of
+   the file. */
+static char *icsHeaderGetLine(Ics_HeaderReader *hr,
+                              char              sep)
+{
+    char   *line;
+    char   *end;
+    size_t  n;
+
+
+        /* Skip what is left of a truncated line */
+    while (hr->skip) {
+        end = (char*)memchr(hr->buf + hr->pos, sep, hr->size - hr->pos);
+        if (end != NULL) {
+            hr->pos = (size_t)(end - hr->buf) + 1;
+            hr->skip = 0;
+        } else {
+            hr->pos = hr->size;
+            if (hr->eof || icsFillHeaderReader(hr) != IcsErr_Ok) return NULL;
         }
+    }
 
-        line[i] =(char)ch;
-        i++;
-        if ((char)ch == sep)
-            break;
+        /* Make sure a whole line is in the buffer */
+    for (;;) {
+        n = hr->size - hr->pos;
+        end = (char*)memchr(hr->buf + hr->pos, sep,
+                            n < ICS_LINE_LENGTH ? n : ICS_LINE_LENGTH);
+        if (end != NULL || n >= ICS_LINE_LENGTH || hr->eof) break;
+        if (icsFillHeaderReader(hr) != IcsErr_Ok) return NULL;
     }
-    line[i] = '\0';
-    if (i != 0) {
-            /* Read at least a 'sep' character */
-        return line;
+    if (n == 0) return NULL;
+
+    line = hr->buf + hr->pos;
+    if (end != NULL) {
+        hr->pos = (size_t)(end - hr->buf) + 1;
+    } else if (n >= ICS_LINE_LENGTH) {
+        end = line + ICS_LINE_LENGTH - 1;
+        hr->pos = (size_t)(end - hr->buf) + 1;
+        hr->skip = 1;
     } else {
-            /* EOF at first getc() call */
-        return NULL;
+        end = line + n; /* Last line lacks its separator */
+        hr->pos = hr->size;
+    }
+    if (sep == '\n' && end > line && end[-1] == '\r') {
+        end--;
+    }
+    *end = '\0';
+    return line;
+}
+
+
+/* Split a line into its fields, like repeated calls to strtok() would. The
+   fields are null-terminated in place. Returns the number of fields. */
+static int icsSplitLine(char       *line,
+                        const char *seps,
+                        char      **fields,
+                        int         maxFields)
+{
+    int n = 0;
+
+
+    for (;;) {
+        while (*line == seps[0] || *line == seps[1]) line++;
+        if (*line == '\0' || n == maxFields) break;
+        fields[n++] = line;
+        while (*line != '\0' && *line != seps[0] && *line != seps[1]) line++;
+        if (*line == '\0') break;
+        *line++ = '\0';
     }
+    return n;
+}
+
+
+/* Join fields[first] to fields[nFields-1] in place, separated by 'sep'. Returns
+   the joined string. */
+static char *icsJoinFields(char **fields,
+                           int    first,
+                           int    nFields,
+                           char   sep)
+{
+    char   *dest = fields[first] + strlen(fields[first]);
+    size_t  len;
+    int     i;
+
+
+    for (i = first + 1; i < nFields; i++) {
+        len = strlen(fields[i]);
+        *dest++ = sep;
+        memmove(dest, fields[i], len + 1);
+        dest += len;
+    }
+    return fields[first];
 }
 
 
@@ -121,34 +249,34 @@ static char *icsFGetStr(char *line,
    newline then peek at the third character to see if it is a newline.  If so
    then use newline as the second separator. Return IcsErr_FReadIcs on read
    errors and IcsErr_NotIcsFile on premature end-of-file. */
-static Ics_Error getIcsSeparators(FILE *fi,
-                                  char *seps)
+static Ics_Error getIcsSeparators(Ics_HeaderReader *hr,
+                                  char             *seps)
 {
     int sep1;
     int sep2;
     int sep3;
 
 
-    sep1 = fgetc(fi);
+    sep1 = icsHeaderGetc(hr);
     if (sep1 == EOF) {
-        return (ferror(fi)) ? IcsErr_FReadIcs : IcsErr_NotIcsFile;
+        return (ferror(hr->fp)) ? IcsErr_FReadIcs : IcsErr_NotIcsFile;
     }
-    sep2 = fgetc(fi);
+    sep2 = icsHeaderGetc(hr);
     if (sep2 == EOF) {
-        return (ferror(fi)) ? IcsErr_FReadIcs : IcsErr_NotIcsFile;
+        return (ferror(hr->fp)) ? IcsErr_FReadIcs : IcsErr_NotIcsFile;
     }
     if (sep1 == sep2) {
         return IcsErr_NotIcsFile;
     }
     if (sep2 == '\r' && sep1 != '\n') {
-        sep3 = fgetc(fi);
+        sep3 = icsHeaderGetc(hr);
         if (sep3 == EOF) {
-            return (ferror(fi)) ? IcsErr_FReadIcs : IcsErr_NotIcsFile;
+            return (ferror(hr->fp)) ? IcsErr_FReadIcs : IcsErr_NotIcsFile;
         } else {
             if (sep3 == '\n') {
                 sep2 = '\n';
             } else {
-                ungetc(sep3, fi);
+                hr->pos--;
             }
         }
     }
@@ -160,28 +288,25 @@ static Ics_Error getIcsSeparators(FILE *fi,
 }
 
 
-static Ics_Error getIcsVersion(FILE       *fi,
-                               const char *seps,
-                               int        *ver)
+static Ics_Error getIcsVersion(Ics_HeaderReader *hr,
+                               const char       *seps,
+                               int              *ver)
 {
     ICSINIT;
-    char *word;
-    char  line[ICS_LINE_LENGTH];
-#ifdef HAVE_STRTOK_R
-    char *saveptr;
-#endif
-
-
-    if (icsFGetStr(line, ICS_LINE_LENGTH, fi, seps[1]) == NULL)
-        return IcsErr_FReadIcs;
-    word = STRTOK(line, seps);
-    if (word == NULL) return IcsErr_NotIcsFile;
-    if (strcmp(word, ICS_VERSION) != 0) return IcsErr_NotIcsFile;
-    word = STRTOK(NULL, seps);
-    if (word == NULL) return IcsErr_NotIcsFile;
-    if (strcmp(word, "1.0") == 0) {
+    char *line;
+    char *fields[3];
+    int   n;
+
+
+    line = icsHeaderGetLine(hr, seps[1]);
+    if (line == NULL) return IcsErr_FReadIcs;
+    n = icsSplitLine(line, seps, fields, 3);
+    if (n < 1) return IcsErr_NotIcsFile;
+    if (strcmp(fields[0], ICS_VERSION) != 0) return IcsErr_NotIcsFile;
+    if (n < 2) return IcsErr_NotIcsFile;
+    if (strcmp(fields[1], "1.0") == 0) {
         *ver = 1;
-    } else if (strcmp(word, "2.0") == 0) {
+    } else if (strcmp(fields[1], "2.0") == 0) {
         *ver = 2;
     } else {
         error = IcsErr_NotIcsFile;
@@ -191,84 +316,57 @@ static Ics_Error getIcsVersion(FILE       *fi,
 }
 
 
-static Ics_Error getIcsFileName(FILE       *fi,
-                                const char *seps)
+static Ics_Error getIcsFileName(Ics_HeaderReader *hr,
+                                const char       *seps)
 {
     ICSINIT;
-    char *word;
-    char  line[ICS_LINE_LENGTH];
-#ifdef HAVE_STRTOK_R
-    char *saveptr;
-#endif
+    char *line;
+    char *fields[1];
 
 
-    if (icsFGetStr(line, ICS_LINE_LENGTH, fi, seps[1]) == NULL)
-        return IcsErr_FReadIcs;
-    word = STRTOK(line, seps);
-    if (word == NULL) return IcsErr_NotIcsFile;
-    if (strcmp(word, ICS_FILENAME) != 0) return IcsErr_NotIcsFile;
+    line = icsHeaderGetLine(hr, seps[1]);
+    if (line == NULL) return IcsErr_FReadIcs;
+    if (icsSplitLine(line, seps, fields, 1) < 1) return IcsErr_NotIcsFile;
+    if (strcmp(fields[0], ICS_FILENAME) != 0) return IcsErr_NotIcsFile;
 
     return error;
 }
 
 
-static Ics_Token getIcsToken(char           *str,
-                             Ics_SymbolList *listSpec)
-{
-    int       i;
-    Ics_Token token = ICSTOK_NONE;
-
-        /* Because some older ics versions have uncapitalized subsubcat
-           symbols (e.g. "channels" instead of the current "Channels"), do a
-           case-insensitive string comparison for backward compatibility. */
-    if (str != NULL) {
-        for (i = 0; i < listSpec->entries; i++) {
-            if (ICSSTRCASECMP(listSpec->list[i].name, str) == 0) {
-                token = listSpec->list[i].token;
-            }
-        }
-    }
-
-    return token;
-}
-
-
-static Ics_Error getIcsCat(char        *str,
-                           const char  *seps,
-                           Ics_Token   *cat,
-                           Ics_Token   *subCat,
-                           Ics_Token   *subSubCat,
-                           const char **index1,
-                           const char **index2)
+/* Identify the category, sub-category and sub-sub-category of a line split into
+   fields. *first is set to the index of the first field after these. */
+static Ics_Error getIcsCat(char        **fields,
+                           int           nFields,
+                           int          *first,
+                           Ics_Token    *cat,
+                           Ics_Token    *subCat,
+                           Ics_Token    *subSubCat,
+                           const char  **index1,
+                           const char  **index2)
 {
     ICSINIT;
-    char *token, buffer[ICS_LINE_LENGTH], *idx1, *idx2;
-#ifdef HAVE_STRTOK_R
-    char *saveptr;
-#endif
+    char *token, *idx1, *idx2;
+    int   i = 0;
 
 
     *subCat = *subSubCat = ICSTOK_NONE;
     *index1 = NULL;
     *index2 = NULL;
 
-    IcsStrCpy(buffer, str, ICS_LINE_LENGTH);
-    token = STRTOK(buffer, seps);
-    *cat = getIcsToken(token, &G_Categories);
+    token = i < nFields ? fields[i++] : NULL;
+    *cat = IcsGetSymbolToken(token, &G_Categories);
     if (*cat == ICSTOK_NONE) return IcsErr_MissCat;
     if ((*cat != ICSTOK_HISTORY) &&(*cat != ICSTOK_END)) {
-        token = STRTOK(NULL, seps);
-        *subCat = getIcsToken(token, &G_SubCategories);
+        token = i < nFields ? fields[i++] : NULL;
+        *subCat = IcsGetSymbolToken(token, &G_SubCategories);
         if (*subCat == ICSTOK_NONE) return IcsErr_MissSubCat;
         if (*subCat == ICSTOK_SPARAMS || *subCat == ICSTOK_SSTATES) {
-            token = STRTOK(NULL, seps);
+            token = i < nFields ? fields[i++] : NULL;
+            if (token == NULL) return IcsErr_MissSensorSubSubCat;
             if (token[strlen(token) - 1] == ']') {
                 idx1 = strchr(token, '[');
                 if (idx1) {
                     idx2 = strchr(idx1 + 1, '[');
-                        /* Todo: Check that this line is indeed not
-                                 necessary. */
-                        /* token[strlen(token) - 1] = '\0'; */
                     *idx1 = '\0';
                     *index1 = idx1 + 1;
                     if (idx2) {
@@ -276,19 +374,11 @@ static Ics_Error getIcsCat(char        *str,
                     }
                 }
             }
-            *subSubCat = getIcsToken(token, &G_SubSubCategories);
+            *subSubCat = IcsGetSymbolToken(token, &G_SubSubCategories);
             if (*subSubCat == ICSTOK_NONE) return IcsErr_MissSensorSubSubCat;
         }
     }
-
-        /* Copy the remaining stuff into 'str' */
-    if ((token = STRTOK(NULL, seps)) != NULL) {
-        strcpy(str, token);
-    }
-    while ((token = STRTOK(NULL, seps)) != NULL) {
-        IcsAppendChar(str, seps[0]);
-        strcat(str, token);
-    }
+    *first = i;
 
     return error;
 }
@@ -300,7 +390,7 @@ static Ics_Error getIcsSensorState(char            *str,
     ICSINIT;
 
 
-    switch (getIcsToken(str, &G_Values)) {
+    switch (IcsGetSymbolToken(str, &G_Values)) {
         case ICSTOK_STATE_DEFAULT:
             *state = IcsSensorState_default;
             break;
@@ -321,12 +411,16 @@ static Ics_Error getIcsSensorState(char            *str,
 }
 
 
+/* Get the next field of the current line, or NULL if there are no more. */
+#define NEXT_FIELD (++field < nFields ? fields[field] : NULL)
+
+
 #define ICS_SET_SENSOR_STRING(FIELD)            \
 do {                                            \
     while (ptr != NULL && i < ICS_MAX_LAMBDA) { \
         IcsStrCpy(icsStruct->FIELD[i++],        \
                   ptr, ICS_STRLEN_TOKEN);       \
-        ptr = STRTOK(NULL, seps);               \
+        ptr = NEXT_FIELD;                       \
     }                                           \
 } while (0)
 
@@ -343,7 +437,7 @@ do {                                            \
 do {                                            \
     while (ptr != NULL && i < ICS_MAX_LAMBDA) { \
         icsStruct->FIELD[i++] = atoi(ptr);      \
-        ptr = STRTOK(NULL, seps);               \
+        ptr = NEXT_FIELD;                       \
     }                                           \
 } while (0)
 
@@ -352,7 +446,7 @@ do {                                            \
 do {                                            \
     while (ptr != NULL && i < ICS_MAX_LAMBDA) { \
         icsStruct->FIELD[i++] = atof(ptr);      \
-        ptr = STRTOK(NULL, seps);               \
+        ptr = NEXT_FIELD;                       \
     }                                           \
 } while (0)
 
@@ -362,7 +456,7 @@ do {                                            \
     while (ptr != NULL && i < ICS_MAX_LAMBDA) { \
         error = getIcsSensorState(ptr, &state); \
         icsStruct->FIELD ## State[i++] = state; \
-        ptr = STRTOK(NULL, seps);               \
+        ptr = NEXT_FIELD;                       \
     }                                           \
 } while(0)
 
@@ -376,18 +470,19 @@ do {                                            \
 } while(0)
 
 
-Ics_Error IcsReadIcs(Ics_Header *icsStruct,
-                     const char *filename,
-                     int         forceName,
-                     int         forceLocale)
+/* Parse the header read from fp into icsStruct, which has been initialized. */
+static Ics_Error icsReadHeader(Ics_Header *icsStruct,
+                               FILE       *fp,
+                               int         forceLocale)
 {
     ICSINIT;
     ICS_INIT_LOCALE;
-    FILE            *fp;
+    Ics_HeaderReader hr;
     int              end        = 0, si, sj;
     size_t           i, j;
-    char             seps[3], *ptr, *data;
-    char             line[ICS_LINE_LENGTH];
+    char             seps[3], *ptr, *data, *line;
+    char            *fields[ICS_LINE_LENGTH / 2 + 1];
+    int              nFields, field;
     Ics_Token        cat, subCat, subSubCat;
     int              detID;
     const char      *idx1;
@@ -406,9 +501,6 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
     char             label[ICS_MAXDIM+1][ICS_STRLEN_TOKEN];
     char             unit[ICS_MAXDIM+1][ICS_STRLEN_TOKEN];
     Ics_SensorState  state      = IcsSensorState_default;
-#ifdef HAVE_STRTOK_R
-    char *saveptr;
-#endif
 
 
     for (i = 0; i < ICS_MAXDIM+1; i++) {
@@ -420,34 +512,32 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
         unit[i][0] = '\0';
     }
 
-    IcsInit(icsStruct);
-    icsStruct->fileMode = IcsFileMode_read;
-
-    IcsStrCpy(icsStruct->filename, filename, ICS_MAXPATHLEN);
-    error = IcsOpenIcs(&fp, icsStruct->filename, forceName);
+    error = icsOpenHeaderReader(&hr, fp);
     if (error) return error;
 
     if (forceLocale) {
         ICS_SET_LOCALE;
     }
 
-    if (!error) error = getIcsSeparators(fp, seps);
+    if (!error) error = getIcsSeparators(&hr, seps);
+
+    if (!error) error = getIcsVersion(&hr, seps, &(icsStruct->version));
+    if (!error) error = getIcsFileName(&hr, seps);
 
-    if (!error) error = getIcsVersion(fp, seps, &(icsStruct->version));
-    if (!error) error = getIcsFileName(fp, seps);
-    
     while (!end && !error
-           && (icsFGetStr(line, ICS_LINE_LENGTH, fp, seps[1]) != NULL)) {
-        if (getIcsCat(line, seps, &cat, &subCat, &subSubCat, &idx1, &idx2) !=
-            IcsErr_Ok)
+           && (line = icsHeaderGetLine(&hr, seps[1])) != NULL) {
+        nFields = icsSplitLine(line, seps, fields,
+                               sizeof(fields) / sizeof(fields[0]));
+        if (getIcsCat(fields, nFields, &field, &cat, &subCat, &subSubCat,
+                      &idx1, &idx2) != IcsErr_Ok)
             continue;
-        ptr = STRTOK(line, seps);
+        ptr = field < nFields ? fields[field] : NULL;
         i = 0;
         switch (cat) {
             case ICSTOK_END:
                 end = 1;
                 if (icsStruct->srcFile[0] == '\0') {
-                    icsStruct->srcOffset =(size_t) ftell(fp);
+                    icsStruct->srcOffset = hr.offset + hr.pos;
                     IcsStrCpy(icsStruct->srcFile, icsStruct->filename,
                               ICS_MAXPATHLEN);
                 }
@@ -481,13 +571,13 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                     case ICSTOK_ORDER:
                         while (ptr!= NULL && i < ICS_MAXDIM+1) {
                             IcsStrCpy(order[i++], ptr, ICS_STRLEN_TOKEN);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     case ICSTOK_SIZES:
                         while (ptr!= NULL && i < ICS_MAXDIM+1) {
                             sizes[i++] = IcsStrToSize(ptr);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     case ICSTOK_COORD:
@@ -507,7 +597,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
             case ICSTOK_REPRES:
                 switch (subCat) {
                     case ICSTOK_FORMAT:
-                        switch (getIcsToken(ptr, &G_Values)) {
+                        switch (IcsGetSymbolToken(ptr, &G_Values)) {
                             case ICSTOK_FORMAT_INTEGER:
                                 format = IcsForm_integer;
                                 break;
@@ -523,7 +613,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                         break;
                     case ICSTOK_SIGN:
                     {
-                        Ics_Token tok = getIcsToken(ptr, &G_Values);
+                        Ics_Token tok = IcsGetSymbolToken(ptr, &G_Values);
                         if (tok == ICSTOK_SIGN_UNSIGNED) {
                             sign = 0;
                         } else {
@@ -538,7 +628,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                         }
                         break;
                     case ICSTOK_COMPR:
-                        switch (getIcsToken(ptr, &G_Values)) {
+                        switch (IcsGetSymbolToken(ptr, &G_Values)) {
                             case ICSTOK_COMPR_UNCOMPRESSED:
                                 icsStruct->compression = IcsCompr_uncompressed;
                                 break;
@@ -553,6 +643,12 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                             case ICSTOK_COMPR_GZIP:
                                 icsStruct->compression = IcsCompr_gzip;
                                 break;
+                            case ICSTOK_COMPR_CHUNKED_GZIP:
+                                icsStruct->compression = IcsCompr_chunked_gzip;
+                                break;
+                            case ICSTOK_COMPR_ZSTD:
+                                icsStruct->compression = IcsCompr_zstd;
+                                break;
                             default:
                                 error = IcsErr_UnknownCompression;
                         }
@@ -560,7 +656,33 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                     case ICSTOK_BYTEO:
                         while (ptr!= NULL && i < ICS_MAX_IMEL_SIZE) {
                             icsStruct->byteOrder[i++] = atoi(ptr);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
+                        }
+                        break;
+                    case ICSTOK_CHUNKS:
+                        while (ptr!= NULL && i < ICS_MAXDIM) {
+                            icsStruct->chunkSize[i++] = IcsStrToSize(ptr);
+                            ptr = NEXT_FIELD;
+                        }
+                        break;
+                    case ICSTOK_FILTER:
+                        switch (IcsGetSymbolToken(ptr, &G_Values)) {
+                            case ICSTOK_FILTER_SHUFFLE:
+                                icsStruct->filter = IcsFilter_shuffle;
+                                break;
+                            case ICSTOK_FILTER_BITSHUFFLE:
+                                icsStruct->filter = IcsFilter_bitshuffle;
+                                break;
+                            default:
+                                error = IcsErr_UnknownCompression;
+                        }
+                        break;
+                    case ICSTOK_PREDICTOR:
+                        if (IcsGetSymbolToken(ptr, &G_Values)
+                            == ICSTOK_PREDICTOR_HORIZONTAL) {
+                            icsStruct->predictor = IcsPredictor_horizontal;
+                        } else {
+                            error = IcsErr_UnknownCompression;
                         }
                         break;
                     default:
@@ -573,25 +695,25 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                     case ICSTOK_ORIGIN:
                         while (ptr!= NULL && i < ICS_MAXDIM+1) {
                             origin[i++] = atof(ptr);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     case ICSTOK_SCALE:
                         while (ptr!= NULL && i < ICS_MAXDIM+1) {
                             scale[i++] = atof(ptr);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     case ICSTOK_UNITS:
                         while (ptr!= NULL && i < ICS_MAXDIM+1) {
                             IcsStrCpy(unit[i++], ptr, ICS_STRLEN_TOKEN);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     case ICSTOK_LABELS:
                         while (ptr!= NULL && i < ICS_MAXDIM+1) {
                             IcsStrCpy(label[i++], ptr, ICS_STRLEN_TOKEN);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     default:
@@ -600,8 +722,11 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                 break;
             case ICSTOK_HISTORY:
                 if (ptr != NULL) {
-                    data = STRTOK(NULL, seps+1); /* This will get the rest of
-                                                    the line */
+                    data = NULL;
+                    if (field + 1 < nFields) { /* Get the rest of the line */
+                        data = icsJoinFields(fields, field + 1, nFields,
+                                             seps[0]);
+                    }
                     if (data == NULL) { /* data is not allowed to be "", but ptr
                                            is */
                         data = ptr;
@@ -627,7 +752,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                         while (ptr != NULL && i < ICS_MAX_LAMBDA) {
                             IcsStrCpy(icsStruct->type[i++], ptr,
                                       ICS_STRLEN_TOKEN);
-                            ptr = STRTOK(NULL, seps);
+                            ptr = NEXT_FIELD;
                         }
                         break;
                     case ICSTOK_MODEL:
@@ -738,7 +863,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                                             default:
                                                 break;
                                         }
-                                        ptr = STRTOK(NULL, seps);
+                                        ptr = NEXT_FIELD;
                                     } else {
                                         error = IcsErr_MissSensorSubSubCatIndex;
                                         break;
@@ -751,7 +876,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                                         detID = atoi(idx1);
                                         icsStruct->detectorSensitivity[i++][detID]
                                             = atof(ptr);
-                                        ptr = STRTOK(NULL, seps);
+                                        ptr = NEXT_FIELD;
                                     } else {
                                         error = IcsErr_MissSensorSubSubCatIndex;
                                         break;
@@ -766,7 +891,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                                         detID = atoi(idx1);
                                         icsStruct->detectorRadius[i++][detID]
                                             = atof(ptr);
-                                        ptr = STRTOK(NULL, seps);
+                                        ptr = NEXT_FIELD;
                                     }
                                 } else {
                                     printf("Using non-vector detRadius.\n");
@@ -848,7 +973,7 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
                                             default:
                                                 break;
                                         }
-                                        ptr = STRTOK(NULL, seps);
+                                        ptr = NEXT_FIELD;
                                     } else {
                                         error = IcsErr_MissSensorSubSubCatIndex;
                                         break;
@@ -1076,6 +1201,56 @@ Ics_Error IcsReadIcs(Ics_Header *icsStruct,
         ICS_REVERT_LOCALE;
     }
 
+    icsCloseHeaderReader(&hr);
+    return error;
+}
+
+
+Ics_Error IcsReadIcs(Ics_Header *icsStruct,
+                     const char *filename,
+                     int         forceName,
+                     int         forceLocale)
+{
+    ICSINIT;
+    FILE *fp;
+
+
+    IcsInit(icsStruct);
+    icsStruct->fileMode = IcsFileMode_read;
+
+    IcsStrCpy(icsStruct->filename, filename, ICS_MAXPATHLEN);
+    error = IcsOpenIcs(&fp, icsStruct->filename, forceName);
+    if (error) return error;
+
+    error = icsReadHeader(icsStruct, fp, forceLocale);
+
+    if (fclose(fp) == EOF) {
+        if (!error) error = IcsErr_FCloseIcs; /* Don't overwrite any previous
+                                                 error. */
+    }
+    return error;
+}
+
+
+/* Read the header of an ICS file held in memory. The image data that follows
+   the header is read from the same memory, icsStruct keeps a pointer to mem. */
+Ics_Error IcsReadIcsMemory(Ics_Header *icsStruct,
+                           Ics_Memory *mem,
+                           int         forceLocale)
+{
+    ICSINIT;
+    FILE *fp;
+
+
+    IcsInit(icsStruct);
+    icsStruct->fileMode = IcsFileMode_read;
+    icsStruct->memory = mem;
+
+    fp = IcsOpenMemoryStream(mem);
+    if (fp == NULL) return IcsErr_FOpenIcs;
+
+    error = icsReadHeader(icsStruct, fp, forceLocale);
+
     if (fclose(fp) == EOF) {
         if (!error) error = IcsErr_FCloseIcs; /* Don't overwrite any previous
                                                  error. */
@@ -1091,21 +1266,28 @@ int IcsVersion(const char *filename,
 {
     ICSINIT;
     ICS_INIT_LOCALE;
-    int   version;
-    FILE *fp;
-    char  FileName[ICS_MAXPATHLEN];
-    char  seps[3];
+    int              version;
+    FILE            *fp;
+    Ics_HeaderReader hr;
+    char             FileName[ICS_MAXPATHLEN];
+    char             seps[3];
 
 
     IcsStrCpy(FileName, filename, ICS_MAXPATHLEN);
     error = IcsOpenIcs(&fp, FileName, forceName);
     if (error) return 0;
+    error = icsOpenHeaderReader(&hr, fp);
+    if (error) {
+        fclose(fp);
+        return 0;
+    }
     version = 0;
     ICS_SET_LOCALE;
-    if (!error) error = getIcsSeparators(fp, seps);
-    if (!error) error = getIcsVersion(fp, seps, &version);
-    if (!error) error = getIcsFileName(fp, seps);
+    if (!error) error = getIcsSeparators(&hr, seps);
+    if (!error) error = getIcsVersion(&hr, seps, &version);
+    if (!error) error = getIcsFileName(&hr, seps);
     ICS_REVERT_LOCALE;
+    icsCloseHeaderReader(&hr);
     if (fclose(fp) == EOF) {
         return 0;
     }
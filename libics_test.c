@@ -109,10 +109,41 @@ void IcsPrintIcs (ICS const* ics)
       case IcsCompr_gzip:
          s = "gzip";
          break;
+      case IcsCompr_chunked_gzip:
+         s = "chunked_gzip";
+         break;
+      case IcsCompr_zstd:
+         s = "zstd";
+         break;
       default:
          s = "unknown";
    }
    printf ("Compression: %s (level %d)\n", s, ics->compLevel);
+   switch (ics->filter) {
+      case IcsFilter_none:
+         s = "none";
+         break;
+      case IcsFilter_shuffle:
+         s = "shuffle";
+         break;
+      case IcsFilter_bitshuffle:
+         s = "bitshuffle";
+         break;
+      default:
+         s = "unknown";
+   }
+   printf ("Filter: %s\n", s);
+   switch (ics->predictor) {
+      case IcsPredictor_none:
+         s = "none";
+         break;
+      case IcsPredictor_horizontal:
+         s = "horizontal";
+         break;
+      default:
+         s = "unknown";
+   }
+   printf ("Predictor: %s\n", s);
    printf ("Byteorder: ");
    for (ii=0; ii<ICS_MAX_IMEL_SIZE; ii++)
       if (ics->byteOrder[ii] != 0)
@@ -128,6 +159,15 @@ void IcsPrintIcs (ICS const* ics)
       printf ("   ZlibStream: %p\n", br->zlibStream);
       printf ("   ZlibInputBuffer: %p\n", br->zlibInputBuffer);
 #endif
+#ifdef ICS_ZSTD
+      printf ("   ZstdStream: %p\n", br->zstdStream);
+#endif
+   }
+   printf ("BlockWrite: %p\n", ics->blockWrite);
+   if (ics->blockWrite != NULL) {
+      Ics_BlockWrite* bw = (Ics_BlockWrite*)ics->blockWrite;
+      printf ("   DataFilePtr: %p\n", (void*)bw->dataFilePtr);
+      printf ("   Written: %lu\n", (unsigned long)bw->written);
    }
    printf ("Sensor data: \n");
    printf ("   Sensor type:");
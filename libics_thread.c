@@ -0,0 +1,228 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright 2025:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Contact: libics@svi.nl
+ *
+ * Copyright (C) 2000-2013 Cris Luengo and others
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_thread.c
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsGetNumberOfProcessors()
+ *   IcsGetCompressionThreads()
+ *   IcsParallelFor()
+ *
+ * Threads are created with the Windows API or with POSIX threads. If neither
+ * is available, the tasks are run one after the other by the calling thread.
+ */
+
+
+#include <stdlib.h>
+#include "libics_intern.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(HAVE_PTHREADS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+/* State shared by all threads running the tasks of one IcsParallelFor call. */
+typedef struct {
+    Ics_TaskFunc      func;
+    void             *arg;
+    size_t            nTasks;
+    size_t            next;   /* Next task to be picked up */
+    Ics_Error         error;  /* First error produced by a task */
+#if defined(_WIN32)
+    CRITICAL_SECTION  lock;
+#elif defined(HAVE_PTHREADS)
+    pthread_mutex_t   lock;
+#endif
+} Ics_TaskQueue;
+
+
+#if defined(_WIN32)
+#define ICS_LOCK(q)   EnterCriticalSection(&(q)->lock)
+#define ICS_UNLOCK(q) LeaveCriticalSection(&(q)->lock)
+#elif defined(HAVE_PTHREADS)
+#define ICS_LOCK(q)   pthread_mutex_lock(&(q)->lock)
+#define ICS_UNLOCK(q) pthread_mutex_unlock(&(q)->lock)
+#else
+#define ICS_LOCK(q)
+#define ICS_UNLOCK(q)
+#endif
+
+
+/* Run tasks from the queue until there are none left, or one failed. */
+static void IcsRunTasks(Ics_TaskQueue *queue)
+{
+    Ics_Error error;
+    size_t    task;
+
+
+    while (1) {
+        ICS_LOCK(queue);
+        if (queue->error != IcsErr_Ok || queue->next >= queue->nTasks) {
+            ICS_UNLOCK(queue);
+            break;
+        }
+        task = queue->next++;
+        ICS_UNLOCK(queue);
+        error = queue->func(queue->arg, task);
+        if (error) {
+            ICS_LOCK(queue);
+            if (queue->error == IcsErr_Ok) queue->error = error;
+            ICS_UNLOCK(queue);
+        }
+    }
+}
+
+
+#if defined(_WIN32)
+static DWORD WINAPI IcsThreadMain(LPVOID queue)
+{
+    IcsRunTasks((Ics_TaskQueue*)queue);
+    return 0;
+}
+#elif defined(HAVE_PTHREADS)
+static void *IcsThreadMain(void *queue)
+{
+    IcsRunTasks((Ics_TaskQueue*)queue);
+    return NULL;
+}
+#endif
+
+
+/* Get the number of processors available to this process. */
+int IcsGetNumberOfProcessors(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#elif defined(HAVE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+
+/* Get the number of threads to use for compressing the data. */
+int IcsGetCompressionThreads(const Ics_Header *icsStruct)
+{
+    if (icsStruct->compThreads > 0) return icsStruct->compThreads;
+    return IcsGetNumberOfProcessors();
+}
+
+
+/* Call func(arg, task) for task = 0 .. nTasks-1, using up to nThreads threads
+   (including the calling thread). Tasks are handed out in order, but can
+   finish in any order. After the first task that returns an error no new tasks
+   are started, and that error is returned. If threads cannot be created, the
+   remaining tasks are run by the calling thread. */
+Ics_Error IcsParallelFor(int           nThreads,
+                         size_t        nTasks,
+                         Ics_TaskFunc  func,
+                         void         *arg)
+{
+    Ics_TaskQueue  queue;
+#if defined(_WIN32)
+    HANDLE        *threads = NULL;
+#elif defined(HAVE_PTHREADS)
+    pthread_t     *threads = NULL;
+#endif
+    int            i, started = 0;
+
+
+    queue.func = func;
+    queue.arg = arg;
+    queue.nTasks = nTasks;
+    queue.next = 0;
+    queue.error = IcsErr_Ok;
+
+    if ((size_t)nThreads > nTasks) nThreads = (int)nTasks;
+#if defined(_WIN32)
+    InitializeCriticalSection(&queue.lock);
+#elif defined(HAVE_PTHREADS)
+    pthread_mutex_init(&queue.lock, NULL);
+#endif
+#if defined(_WIN32) || defined(HAVE_PTHREADS)
+    if (nThreads > 1) {
+        threads = malloc((size_t)(nThreads - 1) * sizeof(*threads));
+    }
+    if (threads != NULL) {
+#if defined(_WIN32)
+        for (i = 0; i < nThreads - 1; i++) {
+            threads[started] = CreateThread(NULL, 0, IcsThreadMain, &queue, 0,
+                                            NULL);
+            if (threads[started] == NULL) break;
+            started++;
+        }
+#else
+        for (i = 0; i < nThreads - 1; i++) {
+            if (pthread_create(&threads[started], NULL, IcsThreadMain,
+                               &queue) != 0) break;
+            started++;
+        }
+#endif
+    }
+#else
+    (void)i;
+    (void)started;
+#endif
+
+    IcsRunTasks(&queue);
+
+#if defined(_WIN32) || defined(HAVE_PTHREADS)
+    if (threads != NULL) {
+        for (i = 0; i < started; i++) {
+#if defined(_WIN32)
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+#else
+            pthread_join(threads[i], NULL);
+#endif
+        }
+        free(threads);
+    }
+#endif
+#if defined(_WIN32)
+    DeleteCriticalSection(&queue.lock);
+#elif defined(HAVE_PTHREADS)
+    pthread_mutex_destroy(&queue.lock);
+#endif
+
+    return queue.error;
+}
@@ -36,20 +36,39 @@
  *
  *   IcsOpen()
  *   IcsClose()
+ *   IcsOpenMemory()
+ *   IcsWriteMemory()
  *   IcsGetLayout()
  *   IcsSetLayout()
  *   IcsGetDataSize()
  *   IcsGetImelSize()
  *   IcsGetImageSize()
  *   IcsGetData()
+ *   IcsMapData()
+ *   IcsUnmapData()
  *   IcsGetDataBlock()
  *   IcsSkipDataBlock()
  *   IcsGetROIData()
+ *   IcsGetROIDataWithStrides()
+ *   IcsGetROIDataParallel()
  *   IcsGetDataWithStrides()
+ *   IcsGetDataAs()
+ *   IcsGetROIDataAs()
+ *   IcsGetROIDataWithStridesAs()
+ *   IcsGetDataWithStridesAs()
+ *   IcsSetConversionScale()
  *   IcsSetData()
  *   IcsSetDataWithStrides()
+ *   IcsSetDataAs()
+ *   IcsOpenWriteStream()
+ *   IcsWriteDataBlock()
+ *   IcsFinishWrite()
  *   IcsSetSource()
+ *   IcsSetHeaderPadding()
  *   IcsSetCompression()
+ *   IcsSetCompressionThreads()
+ *   IcsSetChunkSize()
+ *   IcsGetChunkSize()
  *   IcsGetPosition()
  *   IcsGetPositionF()
  *   IcsSetPosition()
@@ -82,50 +101,76 @@ const char * ICSKEY_LABEL[] = {"x-position", "y-position", "z-position",
 #define ICSKEY_ORDER_LENGTH 5 /* Number of elements in ICSKEY_ORDER and
                                  ICSKEY_LABEL arrays. */
 
+/* Number of lines of a region that IcsGetROIData reads at a time. */
+#define ICS_ROI_MAX_LINES 256
 
-/* Create an ICS structure, and read the stuff from file if reading. */
-Ics_Error IcsOpen(ICS        **ics,
-                  const char  *filename,
-                  const char  *mode)
+
+/* Parse the mode string given to IcsOpen and IcsOpenMemory. */
+static Ics_Error icsParseMode(const char *mode,
+                              int        *reading,
+                              int        *writing,
+                              int        *version,
+                              int        *forceName,
+                              int        *forceLocale)
 {
-    ICSINIT;
-    int    version = 0, forceName = 0, forceLocale = 1, reading = 0;
-    int    writing = 0;
     size_t i;
 
 
+    *reading = 0;
+    *writing = 0;
+    *version = 0;
+    *forceName = 0;
+    *forceLocale = 1;
+
         /* the mode string is one of: "r", "w", "rw", with "f" and/or "l"
            appended for reading and "1" or "2" appended for writing */
     for (i = 0; i<strlen(mode); i++) {
         switch (mode[i]) {
             case 'r':
-                if (reading) return IcsErr_IllParameter;
-                reading = 1;
+                if (*reading) return IcsErr_IllParameter;
+                *reading = 1;
                 break;
             case 'w':
-                if (writing) return IcsErr_IllParameter;
-                writing = 1;
+                if (*writing) return IcsErr_IllParameter;
+                *writing = 1;
                 break;
             case 'f':
-                if (forceName) return IcsErr_IllParameter;
-                forceName = 1;
+                if (*forceName) return IcsErr_IllParameter;
+                *forceName = 1;
                 break;
             case 'l':
-                if (forceLocale) return IcsErr_IllParameter;
-                forceLocale = 0;
+                if (!*forceLocale) return IcsErr_IllParameter;
+                *forceLocale = 0;
                 break;
             case '1':
-                if (version!=0) return IcsErr_IllParameter;
-                version = 1;
+                if (*version!=0) return IcsErr_IllParameter;
+                *version = 1;
                 break;
             case '2':
-                if (version!=0) return IcsErr_IllParameter;
-                version = 2;
+                if (*version!=0) return IcsErr_IllParameter;
+                *version = 2;
                 break;
             default:
                 return IcsErr_IllParameter;
         }
     }
+
+    return IcsErr_Ok;
+}
+
+
+/* Create an ICS structure, and read the stuff from file if reading. */
+Ics_Error IcsOpen(ICS        **ics,
+                  const char  *filename,
+                  const char  *mode)
+{
+    ICSINIT;
+    int version, forceName, forceLocale, reading, writing;
+
+
+    error = icsParseMode(mode, &reading, &writing, &version, &forceName,
+                         &forceLocale);
+    if (error) return error;
     *ics =(ICS*)malloc(sizeof(ICS));
     if (*ics == NULL) return IcsErr_Alloc;
     if (reading) {
@@ -168,55 +213,145 @@ Ics_Error IcsClose(ICS *ics)
 
 
     if (ics == NULL) return IcsErr_NotValidAction;
+    if (ics->dataMap != NULL) {
+        error = IcsUnmapIds(ics);
+    }
     if (ics->fileMode == IcsFileMode_read) {
             /* We're reading */
         if (ics->blockRead != NULL) {
-            error = IcsCloseIds(ics);
+            if (error) IcsCloseIds(ics); else error = IcsCloseIds(ics);
         }
     } else if (ics->fileMode == IcsFileMode_write) {
             /* We're writing */
-        error = IcsWriteIcs(ics, NULL);
-        if (!error) error = IcsWriteIds(ics);
+        Ics_BlockWrite *bw = (Ics_BlockWrite*)ics->blockWrite;
+        if (ics->memory != NULL) {
+                /* Nothing to write: the file was obtained with IcsWriteMemory */
+        } else if (bw == NULL) {
+            error = IcsWriteIcs(ics, NULL);
+            if (!error) error = IcsWriteIds(ics);
+        } else {
+                /* The data was written with IcsWriteDataBlock */
+            if (bw->dataFilePtr != NULL) error = IcsCloseIdsWrite(ics);
+            free(bw);
+        }
     } else {
             /* We're updating */
-        int needcopy = 0;
+        int needcopy = 0, done = 0;
         if (ics->blockRead != NULL) {
-            error = IcsCloseIds(ics);
+            if (error) IcsCloseIds(ics); else error = IcsCloseIds(ics);
         }
         if (ics->version == 2 && !strcmp(ics->srcFile, ics->filename)) {
                 /* The ICS file contains the data */
-            needcopy = 1;
             ics->srcFile[0] = '\0'; /* needed to get the END keyword in the
                                        header */
-                /* Rename the original file */
-            strcpy(filename, ics->filename);
-            strcat(filename, ".tmp");
-            if (rename(ics->filename, filename)) {
-                error = IcsErr_FTempMoveIcs;
+                /* Rewrite the header in place if it fits before the data */
+            if (!error) error = IcsUpdateIcs(ics, ics->srcOffset, &done);
+            if (!error && !done) {
+                    /* Rename the original file */
+                strcpy(filename, ics->filename);
+                strcat(filename, ".tmp");
+                if (IcsRename(ics->filename, filename)) {
+                    error = IcsErr_FTempMoveIcs;
+                } else {
+                    needcopy = 1;
+                }
             }
         }
-        if (!error) error = IcsWriteIcs(ics, NULL);
+        if (!error && !done) error = IcsWriteIcs(ics, NULL);
         if (!error && needcopy) {
                 /* Copy the data over from the original file */
             error = IcsCopyIds(filename, ics->srcOffset, ics->filename);
                 /* Delete original file */
             if (!error) {
-                remove(filename);
+                IcsRemove(filename);
             }
         }
-        if (error) {
+        if (error && needcopy) {
                 /* Let's try copying the old file back */
-            remove(ics->filename);
-            rename(filename, ics->filename);
+            IcsRemove(ics->filename);
+            IcsRename(filename, ics->filename);
         }
     }
+    IcsFreeZipIndex(ics);
     IcsFreeHistory(ics);
+    free(ics->memory);
     free(ics);
 
     return error;
 }
 
 
+/* Create an ICS structure for an ICS file held in memory, and read the header
+   from the buffer if reading. */
+Ics_Error IcsOpenMemory(ICS        **ics,
+                        const void  *buf,
+                        size_t       len,
+                        const char  *mode)
+{
+    ICSINIT;
+    int         version, forceName, forceLocale, reading, writing;
+    Ics_Memory *mem;
+
+
+    error = icsParseMode(mode, &reading, &writing, &version, &forceName,
+                         &forceLocale);
+    if (error) return error;
+        /* Only version 2.0 files can hold their data, and a buffer can't be
+           updated */
+    if (forceName || version == 1 || (reading && writing))
+        return IcsErr_IllParameter;
+    if (reading && ((buf == NULL) || (len == 0))) return IcsErr_IllParameter;
+    if (writing && ((buf != NULL) || (len != 0))) return IcsErr_IllParameter;
+    if (!reading && !writing) return IcsErr_IllParameter;
+
+    mem = (Ics_Memory*)malloc(sizeof(Ics_Memory));
+    if (mem == NULL) return IcsErr_Alloc;
+    mem->data = (const char*)buf;
+    mem->size = len;
+    *ics = (ICS*)malloc(sizeof(ICS));
+    if (*ics == NULL) {
+        free(mem);
+        return IcsErr_Alloc;
+    }
+    if (reading) {
+            /* We're reading */
+        error = IcsReadIcsMemory(*ics, mem, forceLocale);
+        if (error) {
+            IcsFreeHistory(*ics);
+            free(mem);
+            free(*ics);
+            *ics = NULL;
+        }
+    } else {
+            /* We're writing */
+        IcsInit(*ics);
+        (*ics)->fileMode = IcsFileMode_write;
+        (*ics)->memory = mem;
+    }
+
+    return error;
+}
+
+
+/* Write the ICS file into a newly allocated buffer. */
+Ics_Error IcsWriteMemory(ICS    *ics,
+                         void  **buf,
+                         size_t *len)
+{
+    ICSINIT;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+    if ((buf == NULL) || (len == NULL)) return IcsErr_IllParameter;
+    if (ics->blockWrite != NULL) return IcsErr_NotValidAction;
+
+    error = IcsWriteIcsMemory(ics, buf, len);
+
+    return error;
+}
+
+
 /* Get the layout parameters from the ICS structure. */
 Ics_Error IcsGetLayout(const ICS    *ics,
                        Ics_DataType *dt,
@@ -270,6 +405,8 @@ Ics_Error IcsSetLayout(ICS          *ics,
         }
     }
     ics->dimensions = nDims;
+    if ((dt == Ics_binary) && (ics->compression == IcsCompr_chunked_gzip))
+        ics->compression = IcsCompr_gzip; /* bits are not split into chunks */
 
     return error;
 }
@@ -331,6 +468,42 @@ Ics_Error IcsGetData(ICS    *ics,
 }
 
 
+/* Map the image data into memory, avoiding a copy where possible. The data is
+   valid until IcsUnmapData or IcsClose is called. */
+Ics_Error IcsMapData(ICS         *ics,
+                     const void **data,
+                     ptrdiff_t   *strides)
+{
+    ICSINIT;
+    int i;
+
+
+    if ((ics == NULL) || (ics->fileMode == IcsFileMode_write))
+        return IcsErr_NotValidAction;
+    if (data == NULL) return IcsErr_IllParameter;
+
+    error = IcsMapIds(ics, data);
+    if (!error && strides != NULL) {
+        strides[0] = 1;
+        for (i = 1; i < ics->dimensions; i++) {
+            strides[i] = strides[i - 1] * (ptrdiff_t)ics->dim[i - 1].size;
+        }
+    }
+
+    return error;
+}
+
+
+/* Release the memory obtained through IcsMapData. */
+Ics_Error IcsUnmapData(ICS *ics)
+{
+    if ((ics == NULL) || (ics->fileMode == IcsFileMode_write))
+        return IcsErr_NotValidAction;
+
+    return IcsUnmapIds(ics);
+}
+
+
 /* Read a portion of the image data from an ICS file. */
 Ics_Error IcsGetDataBlock(ICS    *ics,
                           void   *dest,
@@ -374,267 +547,672 @@ Ics_Error IcsSkipDataBlock(ICS    *ics,
 }
 
 
-/* Read a square region of the image from an ICS file. */
-Ics_Error IcsGetROIData(ICS          *ics,
-                        const size_t *offsetPtr,
-                        const size_t *sizePtr,
-                        const size_t *samplingPtr,
-                        void         *destPtr,
-                        size_t        n)
+/* Returns the size of the imels returned when reading as type, or 0 if type is
+   not valid. *convert is set if the imels need to be converted; type is
+   Ics_unknown to read the imels as they are stored. */
+static size_t icsOutputImelSize(const ICS    *ics,
+                                Ics_DataType  type,
+                                int          *convert)
+{
+    *convert = (type != Ics_unknown) &&
+               ((type != ics->imel.dataType) || (ics->convScale != 1.0) ||
+                (ics->convOffset != 0.0));
+    if (!*convert) return (size_t)IcsGetBytesPerSample(ics);
+
+    return IcsGetDataTypeSize(type);
+}
+
+
+/* Read the extents of the image data from the open IDS file, in order, through
+   the file position. *curLoc is the position in the data, in bytes. Gaps in
+   uncompressed data of up to ICS_ROI_GAP_SIZE bytes are read through, into
+   *gapBuf, which is allocated when first needed, rather than skipped: seeking
+   discards the buffer of the stream. */
+static Ics_Error icsReadExtentsStream(ICS              *ics,
+                                      const Ics_Extent *extents,
+                                      size_t            count,
+                                      size_t           *curLoc,
+                                      char            **gapBuf)
 {
     ICSINIT;
-    int           i, sizeConflict = 0, p;
-    size_t        j;
-    size_t        imelSize, roiSize, curLoc, newLoc, bufSize;
-    size_t        curPos[ICS_MAXDIM];
-    size_t        stride[ICS_MAXDIM];
-    size_t        bOffset[ICS_MAXDIM];
-    size_t        bSize[ICS_MAXDIM];
-    size_t        bSampling[ICS_MAXDIM];
-    const size_t *offset, *size, *sampling;
-    char         *buf;
-    char         *dest            = (char*)destPtr;
+    size_t i, gap;
+
+
+    for (i = 0; !error && (i < count); i++) {
+        gap = extents[i].offset - *curLoc;
+        if ((gap > 0) && (ics->compression == IcsCompr_uncompressed) &&
+            (gap <= ICS_ROI_GAP_SIZE)) {
+            if (*gapBuf == NULL) {
+                *gapBuf = (char*)malloc(ICS_ROI_GAP_SIZE);
+                if (*gapBuf == NULL) return IcsErr_Alloc;
+            }
+            error = IcsReadIdsBlock(ics, *gapBuf, gap);
+        } else if (gap > 0) {
+            error = IcsSkipIdsBlock(ics, gap);
+        }
+        if (!error) error = IcsReadIdsBlock(ics, extents[i].dest, extents[i].n);
+        *curLoc = extents[i].offset + extents[i].n;
+    }
+
+    return error;
+}
+
+
+/* Read the image data, converting it to another data type. The data is read
+   in pieces that fit in the cache, each of which is converted into dest. */
+Ics_Error IcsGetDataAs(ICS          *ics,
+                       Ics_DataType  type,
+                       void         *dest,
+                       size_t        n)
+{
+    ICSINIT;
+    int     convert;
+    size_t  imelSize, outSize, count, bufImels, block, i;
+    char   *buf;
+    char   *out = (char*)dest;
 
 
     if ((ics == NULL) || (ics->fileMode == IcsFileMode_write))
         return IcsErr_NotValidAction;
+    outSize = icsOutputImelSize(ics, type, &convert);
+    if (outSize == 0) return IcsErr_UnknownDataType;
+    if ((n == 0) || (dest == NULL)) return IcsErr_Ok;
+    if (!convert) return IcsGetData(ics, dest, n);
 
-    if ((n == 0) ||(dest == NULL)) return IcsErr_Ok;
-    p = ics->dimensions;
-    if (offsetPtr != NULL) {
-        offset = offsetPtr;
-    } else {
-        for (i = 0; i < p; i++) {
-            bOffset[i] = 0;
+    imelSize = (size_t)IcsGetBytesPerSample(ics);
+    count = IcsGetImageSize(ics);
+    if (n < count * outSize) count = n / outSize;
+    if ((ics->compression == IcsCompr_chunked_gzip) ||
+        (ics->compression == IcsCompr_compress)) {
+            /* The data can only be read as a whole: it is read into dest if it
+               fits, and converted in place */
+        if (IcsGetDataSize(ics) <= n) {
+            buf = (char*)dest;
+        } else {
+            buf = (char*)malloc(IcsGetDataSize(ics));
+            if (buf == NULL) return IcsErr_Alloc;
         }
-        offset = bOffset;
-    }
-    if (sizePtr != NULL) {
-        size = sizePtr;
-    } else {
-        for (i = 0; i < p; i++) {
-            bSize[i] = ics->dim[i].size - offset[i];
+        error = IcsReadIds(ics, buf, IcsGetDataSize(ics));
+        if (!error) {
+            error = IcsConvertImels(buf, ics->imel.dataType, dest, type, count,
+                                    ics->convScale, ics->convOffset);
         }
-        size = bSize;
-    }
-    if (samplingPtr != NULL) {
-        sampling = samplingPtr;
+        if (buf != dest) free(buf);
     } else {
-        for (i = 0; i < p; i++) {
-            bSampling[i] = 1;
+        bufImels = ICS_CONVERT_BUF_SIZE / imelSize;
+        if (bufImels == 0) bufImels = 1;
+        buf = (char*)malloc(bufImels * imelSize);
+        if (buf == NULL) return IcsErr_Alloc;
+        error = IcsOpenIds(ics);
+        if (error) {
+            free(buf);
+            return error;
         }
-        sampling = bSampling;
-    }
-    for (i = 0; i < p; i++) {
-        if (sampling[i] < 1 || offset[i] + size[i] > ics->dim[i].size)
-            return IcsErr_IllegalROI;
-    }
-    imelSize = (size_t)IcsGetBytesPerSample(ics);
-    roiSize = imelSize;
-    for (i = 0; i < p; i++) {
-        roiSize *= (size[i] + sampling[i] - 1) / sampling[i];
+        for (i = 0; !error && (i < count); i += block) {
+            block = count - i < bufImels ? count - i : bufImels;
+            error = IcsReadIdsBlock(ics, buf, block * imelSize);
+            if (!error) {
+                error = IcsConvertImels(buf, ics->imel.dataType, out, type,
+                                        block, ics->convScale,
+                                        ics->convOffset);
+            }
+            out += block * outSize;
+        }
+        free(buf);
+        if (error)
+            IcsCloseIds(ics);
+        else
+            error = IcsCloseIds(ics);
     }
-    if (n != roiSize) {
-        sizeConflict = 1;
-        if (n < roiSize) return IcsErr_BufferTooSmall;
+    if ((error == IcsErr_Ok) && (n > IcsGetImageSize(ics) * outSize)) {
+        error = IcsErr_OutputNotFilled;
     }
-        /* The stride array tells us how many imels to skip to go the next pixel
-           in each dimension */
-    stride[0] = 1;
-    for (i = 1; i < p; i++) {
-        stride[i] = stride[i - 1] * ics->dim[i - 1].size;
+
+    return error;
+}
+
+
+/* The layout of a region read by icsGetROIDataWithStrides: where each of its
+   lines is found in the file, and where its imels go in dest. */
+typedef struct {
+    ICS          *ics;
+    Ics_DataType  type;
+    int           nDims;
+    int           convert;                /* Imels are converted to type */
+    int           direct;                 /* Lines are read into dest */
+    size_t        imelSize;               /* Size of the imels in the file */
+    size_t        outSize;                /* Size of the imels in dest */
+    size_t        lineSize;               /* Bytes read for each line */
+    size_t        lineImels;              /* Imels of each line in dest */
+    size_t        slotSize;               /* Bytes of buffer for each line */
+    size_t        nLines;                 /* Lines in the region */
+    size_t        batchLines;             /* Lines read at a time */
+    ptrdiff_t     step;                   /* Bytes between the imels of a
+                                             line in the buffer */
+    ptrdiff_t     lineStep;               /* Bytes between lines in dest */
+    size_t        offset[ICS_MAXDIM];     /* First imel of the region */
+    size_t        sampling[ICS_MAXDIM];   /* Sampling of the region */
+    size_t        outDim[ICS_MAXDIM];     /* Size of the output */
+    size_t        fileStride[ICS_MAXDIM]; /* Strides of the file, in imels */
+    ptrdiff_t     stride[ICS_MAXDIM];     /* Strides of dest, in imels */
+    char         *dest;
+} Ics_RoiPlan;
+
+
+/* Find the lines first to first+count-1 of the region: set the extents to
+   read them from the file into buf, or into dest if they are read directly,
+   and out to where they go in dest. */
+static void icsPlanROILines(const Ics_RoiPlan *plan,
+                            size_t             first,
+                            size_t             count,
+                            char              *buf,
+                            Ics_Extent        *extents,
+                            char             **out)
+{
+    int    i;
+    size_t k, loc;
+    size_t pos[ICS_MAXDIM];
+
+
+        /* pos is the position of the line in the output */
+    pos[0] = 0;
+    for (i = 1; i < plan->nDims; i++) {
+        pos[i] = first % plan->outDim[i];
+        first /= plan->outDim[i];
     }
-    error = IcsOpenIds(ics);
-    if (error) return error;
-    bufSize = imelSize*size[0];
-    if (sampling[0] > 1) {
-            /* We read a line in a buffer, and then copy the needed imels to
-               dest */
-        buf =(char*)malloc(bufSize);
-        if (buf == NULL) return IcsErr_Alloc;
-        curLoc = 0;
-        for (i = 0; i < p; i++) {
-            curPos[i] = offset[i];
+    for (k = 0; k < count; k++) {
+        loc = plan->offset[0];
+        out[k] = plan->dest;
+        for (i = 1; i < plan->nDims; i++) {
+            loc += (plan->offset[i] + pos[i] * plan->sampling[i]) *
+                   plan->fileStride[i];
+            out[k] += (ptrdiff_t)pos[i] * plan->stride[i] *
+                      (ptrdiff_t)plan->outSize;
         }
-        while (1) {
-            newLoc = 0;
-            for (i = 0; i < p; i++) {
-                newLoc += curPos[i] * stride[i];
-            }
-            newLoc *= imelSize;
-            if (curLoc < newLoc) {
-                error = IcsSkipIdsBlock(ics, newLoc - curLoc);
-                curLoc = newLoc;
-            }
-            if (!error) error = IcsReadIdsBlock(ics, buf, bufSize);
-            if (error != IcsErr_Ok) {
-                break; /* stop reading on error */
-            }
-            curLoc += bufSize;
-            for (j=0; j < size[0]; j += sampling[0]) {
-                memcpy(dest, buf + (unsigned)i * imelSize, imelSize);
-                dest += imelSize;
-            }
-            for (i = 1; i < p; i++) {
-                curPos[i] += sampling[i];
-                if (curPos[i] < offset[i] + size[i]) {
-                    break;
-                }
-                curPos[i] = offset[i];
+        extents[k].offset = loc * plan->imelSize;
+        extents[k].n = plan->lineSize;
+        extents[k].dest = plan->direct ? out[k] : buf + k * plan->slotSize;
+        for (i = 1; i < plan->nDims; i++) {
+            pos[i]++;
+            if (pos[i] < plan->outDim[i]) {
+                break;
             }
-            if (i==p) {
-                break; /* we're done reading */
+            pos[i] = 0;
+        }
+    }
+}
+
+
+/* Copy the count lines in buf to where they go in dest, as set by
+   icsPlanROILines, sampling and converting their imels. gathered holds the
+   sampled imels of a line when they are converted. */
+static Ics_Error icsStoreROILines(const Ics_RoiPlan *plan,
+                                  char              *buf,
+                                  size_t             count,
+                                  char             **out,
+                                  char              *gathered)
+{
+    ICSINIT;
+    ICS    *ics      = plan->ics;
+    size_t  sampling = plan->sampling[0];
+    size_t  k, r;
+    char   *line;
+
+
+    if (plan->direct) return IcsErr_Ok;
+    if (plan->convert) {
+            /* Gather the needed imels, and convert them into dest if it is
+               contiguous along the lines, or otherwise in place */
+        for (k = 0; !error && (k < count); k++) {
+            line = buf + k * plan->slotSize;
+            if (sampling > 1) {
+                IcsGatherImels(line, (ptrdiff_t)(sampling * plan->imelSize),
+                               plan->lineImels, (int)plan->imelSize, gathered);
             }
+            error = IcsConvertImels(sampling > 1 ? gathered : line,
+                                    ics->imel.dataType,
+                                    plan->stride[0] == 1 ? out[k] : line,
+                                    plan->type, plan->lineImels,
+                                    ics->convScale, ics->convOffset);
         }
-        free(buf);
-    } else {
-            /* No subsampling in dim[0] required: read directly into dest */
-        curLoc = 0;
-        for (i = 0; i < p; i++) {
-            curPos[i] = offset[i];
+        if (error || (plan->stride[0] == 1)) return error;
+    }
+    if (plan->stride[0] == 1) {
+        for (k = 0; k < count; k++) {
+            IcsGatherImels(buf + k * plan->slotSize, plan->step,
+                           plan->lineImels, (int)plan->outSize, out[k]);
         }
-        while (1) {
-            newLoc = 0;
-            for (i = 0; i < p; i++) {
-                newLoc += curPos[i] * stride[i];
-            }
-            newLoc *= imelSize;
-            if (curLoc < newLoc) {
-                error = IcsSkipIdsBlock(ics, newLoc - curLoc);
-                curLoc = newLoc;
-            }
-            if (!error) error = IcsReadIdsBlock(ics, dest, bufSize);
-            if (error != IcsErr_Ok) {
-                break; /* stop reading on error */
-            }
-            curLoc += bufSize;
-            dest += bufSize;
-            for (i = 1; i < p; i++) {
-                curPos[i] += sampling[i];
-                if (curPos[i] < offset[i] + size[i]) {
-                    break;
-                }
-                curPos[i] = offset[i];
-            }
-            if (i==p) {
-                break; /* we're done reading */
-            }
+        return IcsErr_Ok;
+    }
+        /* Lines that are evenly spaced in dest, as are all the lines of a
+           batch along the second dimension, are copied together, so that a
+           transposed destination is written one tile at a time */
+    for (k = 0; k < count; k += r) {
+        r = 1;
+        while ((k + r < count) &&
+               (out[k + r] == out[k] + (ptrdiff_t)r * plan->lineStep)) {
+            r++;
         }
+        IcsTransposeImels(buf + k * plan->slotSize, plan->step,
+                          (ptrdiff_t)plan->slotSize, out[k],
+                          plan->stride[0] * (ptrdiff_t)plan->outSize,
+                          plan->lineStep, plan->lineImels, r,
+                          (int)plan->outSize);
     }
-    if (error)
-        IcsCloseIds(ics);
-    else
-        error = IcsCloseIds(ics);
 
-    if ((error == IcsErr_Ok) && sizeConflict) {
-        error = IcsErr_OutputNotFilled;
+    return IcsErr_Ok;
+}
+
+
+/* Read one batch of lines of the region at their offsets in the file, for
+   IcsParallelFor. Each batch has its own buffer. */
+static Ics_Error icsReadROITask(void   *arg,
+                                size_t  task)
+{
+    ICSINIT;
+    const Ics_RoiPlan *plan     = (const Ics_RoiPlan*)arg;
+    size_t             first, count;
+    Ics_Extent         extents[ICS_ROI_MAX_LINES];
+    char              *out[ICS_ROI_MAX_LINES];
+    char              *buf      = NULL;
+    char              *gathered = NULL;
+
+
+    first = task * plan->batchLines;
+    count = plan->nLines - first;
+    if (count > plan->batchLines) count = plan->batchLines;
+    if (!plan->direct) {
+        buf = (char*)malloc(count * plan->slotSize);
+        if (buf == NULL) return IcsErr_Alloc;
+        if (plan->convert && (plan->sampling[0] > 1)) {
+            gathered = (char*)malloc(plan->lineImels * plan->imelSize);
+            if (gathered == NULL) {
+                free(buf);
+                return IcsErr_Alloc;
+            }
+        }
     }
+    icsPlanROILines(plan, first, count, buf, extents, out);
+    error = IcsReadIdsExtents(plan->ics, extents, count);
+    if (!error) error = icsStoreROILines(plan, buf, count, out, gathered);
+    free(gathered);
+    free(buf);
+
     return error;
 }
 
 
-/* Read the image data into a region of your buffer. */
-Ics_Error IcsGetDataWithStrides(ICS             *ics,
-                                void            *destPtr,
-                                size_t           n, /* ignored */
-                                const ptrdiff_t *stridePtr,
-                                int              nDims)
+/* Read a square region of the image into a region of dest, converting the
+   imels to type if it is not Ics_unknown. The lines of the region are read in
+   file order, in batches; each line is read directly into dest when it can be,
+   otherwise into a buffer from which its imels are sampled, converted and
+   scattered to dest. stride gives the strides of dest in imels; if it is NULL,
+   dest is contiguous and must be n bytes large. If nThreads is larger than 1
+   and the data is uncompressed, the batches are read at their offsets in the
+   file by nThreads threads; chunked data is decompressed by nThreads threads,
+   or by the number set with IcsSetCompressionThreads if nThreads is 0. */
+static Ics_Error icsGetROIDataWithStrides(ICS             *ics,
+                                          const size_t    *offsetPtr,
+                                          const size_t    *sizePtr,
+                                          const size_t    *samplingPtr,
+                                          Ics_DataType     type,
+                                          void            *destPtr,
+                                          size_t           n,
+                                          const ptrdiff_t *stridePtr,
+                                          int              nDims,
+                                          int              nThreads)
 {
     ICSINIT;
-    int              i, p;
-    size_t           j;
-    size_t           imelSize, bufSize;
-    size_t           curPos[ICS_MAXDIM];
-    ptrdiff_t        b_stride[ICS_MAXDIM];
-    ptrdiff_t const *stride;
-    char            *buf;
-    char            *dest = (char*)destPtr;
-    char            *out;
-    (void)n; /* we're not using this parameter */
+    int              i, sizeConflict = 0, p, convert, positional;
+    size_t           first, count, nTasks;
+    size_t           imelSize, outSize, bufImelSize, roiImels, curLoc;
+    size_t           size[ICS_MAXDIM];
+    ptrdiff_t        bStride[ICS_MAXDIM];
+    const ptrdiff_t *stride;
+    Ics_RoiPlan      plan;
+    Ics_Extent       extents[ICS_ROI_MAX_LINES];
+    char            *out[ICS_ROI_MAX_LINES];
+    char            *buf      = NULL;
+    char            *gapBuf   = NULL;
+    char            *whole    = NULL;
+    char            *gathered = NULL;
+    char            *dest     = (char*)destPtr;
+
 
     if ((ics == NULL) || (ics->fileMode == IcsFileMode_write))
         return IcsErr_NotValidAction;
 
+    outSize = icsOutputImelSize(ics, type, &convert);
+    if (outSize == 0) return IcsErr_UnknownDataType;
     if (dest == NULL) return IcsErr_Ok;
+    if ((stridePtr == NULL) && (n == 0)) return IcsErr_Ok;
     p = ics->dimensions;
-    if (nDims != p) return IcsErr_IllParameter;
+    if ((stridePtr != NULL) && (nDims != p)) return IcsErr_IllParameter;
+    for (i = 0; i < p; i++) {
+        plan.offset[i] = offsetPtr != NULL ? offsetPtr[i] : 0;
+        plan.sampling[i] = samplingPtr != NULL ? samplingPtr[i] : 1;
+        size[i] = sizePtr != NULL ? sizePtr[i]
+                                  : ics->dim[i].size - plan.offset[i];
+        if (plan.sampling[i] < 1 ||
+            plan.offset[i] + size[i] > ics->dim[i].size)
+            return IcsErr_IllegalROI;
+        plan.outDim[i] = (size[i] + plan.sampling[i] - 1) / plan.sampling[i];
+    }
+    imelSize = (size_t)IcsGetBytesPerSample(ics);
+        /* Imels are converted in place in the buffer */
+    bufImelSize = imelSize > outSize ? imelSize : outSize;
+    roiImels = 1;
+    for (i = 0; i < p; i++) {
+        roiImels *= plan.outDim[i];
+    }
     if (stridePtr != NULL) {
         stride = stridePtr;
     } else {
-        b_stride[0] = 1;
+        if (n != roiImels * outSize) {
+            sizeConflict = 1;
+            if (n < roiImels * outSize) return IcsErr_BufferTooSmall;
+        }
+        bStride[0] = 1;
         for (i = 1; i < p; i++) {
-            b_stride[i] = b_stride[i - 1] * (ptrdiff_t)ics->dim[i - 1].size;
+            bStride[i] = bStride[i - 1] * (ptrdiff_t)plan.outDim[i - 1];
         }
-        stride = b_stride;
+        stride = bStride;
+    }
+    if (roiImels == 0) {
+        return sizeConflict ? IcsErr_OutputNotFilled : IcsErr_Ok;
     }
-    imelSize = (size_t)IcsGetBytesPerSample(ics);
 
     error = IcsOpenIds(ics);
     if (error) return error;
-    bufSize = imelSize * ics->dim[0].size;
-    if (stride[0] != 1) {
-            /* We read a line in a buffer, and then copy the imels to dest */
-        buf = (char*)malloc(bufSize);
-        if (buf == NULL) return IcsErr_Alloc;
-        for (i = 0; i < p; i++) {
-            curPos[i] = 0;
-        }
-        while (1) {
-            out = dest;
-            for (i = 1; i < p; i++) {
-                out += (ptrdiff_t)curPos[i] * stride[i] * (ptrdiff_t)imelSize;
+    if (ics->compression == IcsCompr_chunked_gzip) {
+            /* Decompress only the chunks that overlap the ROI, directly into
+               dest if the imels are not converted. Otherwise they are
+               decompressed into dest if the imels fit, and converted in place,
+               or into a buffer that is converted in place and from which the
+               lines are copied to dest as below */
+        if (!convert) {
+            error = IcsReadChunks(ics, plan.offset, size, plan.sampling, dest,
+                                  stride, nThreads);
+        } else if (stridePtr == NULL) {
+            if (roiImels * imelSize <= n) {
+                buf = dest;
+            } else {
+                buf = (char*)malloc(roiImels * imelSize);
+                if (buf == NULL) {
+                    IcsCloseIds(ics);
+                    return IcsErr_Alloc;
+                }
             }
-            if (!error) error = IcsReadIdsBlock(ics, buf, bufSize);
-            if (error != IcsErr_Ok) {
-                break; /* stop reading on error */
+            error = IcsReadChunks(ics, plan.offset, size, plan.sampling, buf,
+                                  NULL, nThreads);
+            if (!error) {
+                error = IcsConvertImels(buf, ics->imel.dataType, dest, type,
+                                        roiImels, ics->convScale,
+                                        ics->convOffset);
             }
-            for (j = 0; j < ics->dim[0].size; j++) {
-                memcpy(out, buf + j * imelSize, imelSize);
-                out += stride[0] * (ptrdiff_t)imelSize;
+            if (buf != dest) free(buf);
+            buf = NULL;
+        } else {
+            whole = (char*)malloc(roiImels * bufImelSize);
+            if (whole == NULL) {
+                IcsCloseIds(ics);
+                return IcsErr_Alloc;
             }
-            for (i = 1; i < p; i++) {
-                curPos[i]++;
-                if (curPos[i] < ics->dim[i].size) {
-                    break;
-                }
-                curPos[i] = 0;
+            error = IcsReadChunks(ics, plan.offset, size, plan.sampling, whole,
+                                  NULL, nThreads);
+            if (!error) {
+                error = IcsConvertImels(whole, ics->imel.dataType, whole, type,
+                                        roiImels, ics->convScale,
+                                        ics->convOffset);
             }
-            if (i==p) {
-                break; /* we're done reading */
+        }
+        if (error || (whole == NULL)) {
+            free(whole);
+            if (error)
+                IcsCloseIds(ics);
+            else
+                error = IcsCloseIds(ics);
+            if ((error == IcsErr_Ok) && sizeConflict) {
+                error = IcsErr_OutputNotFilled;
             }
+            return error;
         }
-        free(buf);
+    }
+
+    plan.ics = ics;
+    plan.type = type;
+    plan.nDims = p;
+    plan.convert = convert && (whole == NULL);
+    plan.imelSize = imelSize;
+    plan.outSize = outSize;
+    plan.lineSize = imelSize * size[0];
+    plan.lineImels = plan.outDim[0];
+    plan.nLines = roiImels / plan.lineImels;
+    plan.lineStep = p > 1 ? stride[1] * (ptrdiff_t)outSize : 0;
+    plan.dest = dest;
+        /* The file stride array tells us how many imels to skip to go the next
+           pixel in each dimension of the file */
+    plan.fileStride[0] = 1;
+    plan.stride[0] = stride[0];
+    for (i = 1; i < p; i++) {
+        plan.fileStride[i] = plan.fileStride[i - 1] * ics->dim[i - 1].size;
+        plan.stride[i] = stride[i];
+    }
+    plan.direct = (whole == NULL) && (plan.sampling[0] == 1) && !convert &&
+                  (stride[0] == 1);
+    if (whole != NULL) {
+            /* The lines were read and converted already */
+        plan.slotSize = plan.lineImels * outSize;
+        plan.step = (ptrdiff_t)outSize;
     } else {
-            /* No subsampling in dim[0] required: read directly into dest */
-        for (i = 0; i < p; i++) {
-            curPos[i] = 0;
-        }
-        while (1) {
-            out = dest;
-            for (i = 1; i < p; i++) {
-                out += (ptrdiff_t)curPos[i] * stride[i] * (ptrdiff_t)imelSize;
+        plan.slotSize = size[0] * bufImelSize;
+        plan.step = convert ? (ptrdiff_t)outSize
+                            : (ptrdiff_t)(plan.sampling[0] * imelSize);
+    }
+    plan.batchLines = ICS_ROI_MAX_LINES;
+    if (!plan.direct && (plan.slotSize * plan.batchLines > ICS_ROI_BUF_SIZE)) {
+        plan.batchLines = ICS_ROI_BUF_SIZE / plan.slotSize;
+        if (plan.batchLines == 0) plan.batchLines = 1;
+    }
+    positional = (ics->compression == IcsCompr_uncompressed) &&
+                 (ics->imel.dataType != Ics_binary) &&
+                 (IcsReadIdsExtents(ics, NULL, 0) == IcsErr_Ok);
+
+    if ((nThreads > 1) && positional && (plan.nLines > 1)) {
+            /* Batches are made small enough that each thread gets several of
+               them, and are handed out to the threads as they finish */
+        count = (plan.nLines + 4 * (size_t)nThreads - 1) /
+                (4 * (size_t)nThreads);
+        if (count < plan.batchLines) plan.batchLines = count;
+        nTasks = (plan.nLines + plan.batchLines - 1) / plan.batchLines;
+        error = IcsParallelFor(nThreads, nTasks, icsReadROITask, &plan);
+    } else {
+        if ((whole == NULL) && !plan.direct) {
+                /* We read lines in a buffer, and then copy or convert the
+                   needed imels to dest. Otherwise the lines are read directly
+                   into dest */
+            buf = (char*)malloc(plan.batchLines * plan.slotSize);
+            if (convert && (plan.sampling[0] > 1)) {
+                gathered = (char*)malloc(plan.lineImels * imelSize);
             }
-            if (!error) error = IcsReadIdsBlock(ics, out, bufSize);
-            if (error != IcsErr_Ok) {
-                break; /* stop reading on error */
+            if ((buf == NULL) || (convert && (plan.sampling[0] > 1) &&
+                                  (gathered == NULL))) {
+                free(buf);
+                free(gathered);
+                IcsCloseIds(ics);
+                return IcsErr_Alloc;
             }
-            for (i = 1; i < p; i++) {
-                curPos[i]++;
-                if (curPos[i] < ics->dim[i].size) {
-                    break;
+        }
+        curLoc = 0;
+        for (first = 0; first < plan.nLines; first += count) {
+                /* The next lines to read, in file order, and where they go */
+            count = plan.nLines - first;
+            if (count > plan.batchLines) count = plan.batchLines;
+            if (whole != NULL) {
+                buf = whole + first * plan.slotSize;
+                icsPlanROILines(&plan, first, count, buf, extents, out);
+                error = icsStoreROILines(&plan, buf, count, out, NULL);
+                buf = NULL;
+            } else {
+                icsPlanROILines(&plan, first, count, buf, extents, out);
+                    /* Uncompressed lines are read at their offsets, several at
+                       once, if the file allows it; otherwise they are read in
+                       sequence */
+                if (positional) {
+                    error = IcsReadIdsExtents(ics, extents, count);
+                } else {
+                    error = icsReadExtentsStream(ics, extents, count, &curLoc,
+                                                 &gapBuf);
+                }
+                if (!error) {
+                    error = icsStoreROILines(&plan, buf, count, out, gathered);
                 }
-                curPos[i] = 0;
             }
-            if (i==p) {
-                break; /* we're done reading */
+            if (error != IcsErr_Ok) {
+                break; /* stop reading on error */
             }
         }
     }
+    free(gapBuf);
+    free(gathered);
+    free(buf);
+    free(whole);
     if (error)
         IcsCloseIds(ics);
     else
         error = IcsCloseIds(ics);
 
+    if ((error == IcsErr_Ok) && sizeConflict) {
+        error = IcsErr_OutputNotFilled;
+    }
+    return error;
+}
+
+
+/* Read a square region of the image from an ICS file. */
+Ics_Error IcsGetROIData(ICS          *ics,
+                        const size_t *offset,
+                        const size_t *size,
+                        const size_t *sampling,
+                        void         *dest,
+                        size_t        n)
+{
+    return icsGetROIDataWithStrides(ics, offset, size, sampling, Ics_unknown,
+                                    dest, n, NULL, 0, 0);
+}
+
+
+/* Read a square region of the image, converting it to another data type. */
+Ics_Error IcsGetROIDataAs(ICS          *ics,
+                          const size_t *offset,
+                          const size_t *size,
+                          const size_t *sampling,
+                          Ics_DataType  type,
+                          void         *dest,
+                          size_t        n)
+{
+    if (type == Ics_unknown) return IcsErr_UnknownDataType;
+
+    return icsGetROIDataWithStrides(ics, offset, size, sampling, type, dest, n,
+                                    NULL, 0, 0);
+}
+
+
+/* Read a square region of the image into a region of your buffer. */
+Ics_Error IcsGetROIDataWithStrides(ICS             *ics,
+                                   const size_t    *offset,
+                                   const size_t    *size,
+                                   const size_t    *sampling,
+                                   void            *dest,
+                                   size_t           n,
+                                   const ptrdiff_t *stride,
+                                   int              nDims)
+{
+    return icsGetROIDataWithStrides(ics, offset, size, sampling, Ics_unknown,
+                                    dest, n, stride, nDims, 0);
+}
+
+
+/* Read a square region of the image into a region of your buffer, converting
+   it to another data type. */
+Ics_Error IcsGetROIDataWithStridesAs(ICS             *ics,
+                                     const size_t    *offset,
+                                     const size_t    *size,
+                                     const size_t    *sampling,
+                                     Ics_DataType     type,
+                                     void            *dest,
+                                     size_t           n,
+                                     const ptrdiff_t *stride,
+                                     int              nDims)
+{
+    if (type == Ics_unknown) return IcsErr_UnknownDataType;
+
+    return icsGetROIDataWithStrides(ics, offset, size, sampling, type, dest, n,
+                                    stride, nDims, 0);
+}
+
+
+/* Read a square region of the image using multiple threads. */
+Ics_Error IcsGetROIDataParallel(ICS          *ics,
+                                const size_t *offset,
+                                const size_t *size,
+                                const size_t *sampling,
+                                void         *dest,
+                                size_t        n,
+                                int           nThreads)
+{
+    if (nThreads <= 0) nThreads = IcsGetNumberOfProcessors();
+
+    return icsGetROIDataWithStrides(ics, offset, size, sampling, Ics_unknown,
+                                    dest, n, NULL, 0, nThreads);
+}
+
+
+/* Read the image data into a region of your buffer. */
+Ics_Error IcsGetDataWithStrides(ICS             *ics,
+                                void            *dest,
+                                size_t           n, /* ignored */
+                                const ptrdiff_t *stride,
+                                int              nDims)
+{
+    (void)n; /* we're not using this parameter */
+    return icsGetROIDataWithStrides(ics, NULL, NULL, NULL, Ics_unknown, dest,
+                                    IcsGetDataSize(ics), stride, nDims, 0);
+}
+
+
+/* Read the image data into a region of your buffer, converting it to another
+   data type. */
+Ics_Error IcsGetDataWithStridesAs(ICS             *ics,
+                                  Ics_DataType     type,
+                                  void            *dest,
+                                  size_t           n, /* ignored */
+                                  const ptrdiff_t *stride,
+                                  int              nDims)
+{
+    (void)n; /* we're not using this parameter */
+    if (type == Ics_unknown) return IcsErr_UnknownDataType;
+
+    return icsGetROIDataWithStrides(ics, NULL, NULL, NULL, type, dest,
+                                    IcsGetImageSize(ics) *
+                                    IcsGetDataTypeSize(type), stride, nDims,
+                                    0);
+}
+
+
+/* Set the scale and offset applied to imels converted to another data type. */
+Ics_Error IcsSetConversionScale(ICS    *ics,
+                                double  scale,
+                                double  offset)
+{
+    ICSINIT;
+
+
+    if (ics == NULL) return IcsErr_NotValidAction;
+
+    ics->convScale = scale;
+    ics->convOffset = offset;
+
     return error;
 }
 
@@ -693,6 +1271,109 @@ Ics_Error IcsSetDataWithStrides(ICS             *ics,
 }
 
 
+/* Set the image data, in imels of the given type, which are converted to the
+   type of the image when it is written. The pointer must be valid until
+   IcsClose() is called. */
+Ics_Error IcsSetDataAs(ICS          *ics,
+                       Ics_DataType  type,
+                       const void   *src,
+                       size_t        n)
+{
+    ICSINIT;
+    size_t size = IcsGetDataTypeSize(type);
+    int    srcComplex, destComplex;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+
+    if (ics->srcFile[0] != '\0') return IcsErr_DuplicateData;
+    if (ics->data != NULL) return IcsErr_DuplicateData;
+    if (ics->dimensions == 0) return IcsErr_NoLayout;
+    if (size == 0) return IcsErr_UnknownDataType;
+    srcComplex = type == Ics_complex32 || type == Ics_complex64;
+    destComplex = ics->imel.dataType == Ics_complex32 ||
+                  ics->imel.dataType == Ics_complex64;
+    if (srcComplex != destComplex) return IcsErr_IllParameter;
+    if (n != IcsGetImageSize(ics) * size) {
+        error = IcsErr_FSizeConflict;
+    }
+    ics->data = src;
+    ics->dataLength = n;
+    ics->dataStrides = NULL;
+    ics->dataType = type;
+
+    return error;
+}
+
+
+/* Write the header and open the data file, so that the image data can be
+   written in blocks with IcsWriteDataBlock. */
+Ics_Error IcsOpenWriteStream(ICS *ics)
+{
+    ICSINIT;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+    if (ics->memory != NULL) return IcsErr_NotValidAction;
+
+    if (ics->srcFile[0] != '\0') return IcsErr_DuplicateData;
+    if (ics->data != NULL) return IcsErr_DuplicateData;
+    if (ics->blockWrite != NULL) return IcsErr_DuplicateData;
+    if (ics->dimensions == 0) return IcsErr_NoLayout;
+    if (ics->compression == IcsCompr_chunked_gzip)
+        return IcsErr_UnknownCompression;
+
+    error = IcsWriteIcs(ics, NULL);
+    if (!error) error = IcsOpenIdsWrite(ics);
+
+    return error;
+}
+
+
+/* Append a block of image data to the file opened with IcsOpenWriteStream. */
+Ics_Error IcsWriteDataBlock(ICS        *ics,
+                            const void *src,
+                            size_t      n)
+{
+    ICSINIT;
+    Ics_BlockWrite *bw;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+
+    bw = (Ics_BlockWrite*)ics->blockWrite;
+    if ((bw == NULL) || (bw->dataFilePtr == NULL))
+        return IcsErr_NotValidAction;
+
+    error = IcsWriteIdsBlock(ics, src, n);
+
+    return error;
+}
+
+
+/* Finish writing the image data started with IcsOpenWriteStream. */
+Ics_Error IcsFinishWrite(ICS *ics)
+{
+    ICSINIT;
+    Ics_BlockWrite *bw;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+
+    bw = (Ics_BlockWrite*)ics->blockWrite;
+    if ((bw == NULL) || (bw->dataFilePtr == NULL))
+        return IcsErr_NotValidAction;
+
+    error = IcsCloseIdsWrite(ics);
+
+    return error;
+}
+
+
 /* Set the image data source file. */
 Ics_Error IcsSetSource(ICS        *ics,
                        const char *fname,
@@ -744,6 +1425,23 @@ Ics_Error IcsSetByteOrder(ICS           *ics,
 }
 
 
+/* Reserve padding after the header, for updating it in place. */
+Ics_Error IcsSetHeaderPadding(ICS    *ics,
+                              size_t  n)
+{
+    ICSINIT;
+
+
+    if ((ics == NULL) || ((ics->fileMode != IcsFileMode_write) &&
+                          (ics->fileMode != IcsFileMode_update)))
+        return IcsErr_NotValidAction;
+
+    ics->headerPadding = n;
+
+    return error;
+}
+
+
 /* Set the compression method and compression parameter. */
 Ics_Error IcsSetCompression(ICS             *ics,
                             Ics_Compression  compression,
@@ -758,6 +1456,9 @@ Ics_Error IcsSetCompression(ICS             *ics,
     if (compression == IcsCompr_compress)
         compression = IcsCompr_gzip; /* don't try writing 'compress' compressed
                                         data. */
+    if ((compression == IcsCompr_chunked_gzip) &&
+        (ics->imel.dataType == Ics_binary))
+        compression = IcsCompr_gzip; /* bits are not split into chunks */
     ics->compression = compression;
     ics->compLevel = level;
 
@@ -765,6 +1466,131 @@ Ics_Error IcsSetCompression(ICS             *ics,
 }
 
 
+/* Set the number of threads used for compression. */
+Ics_Error IcsSetCompressionThreads(ICS *ics,
+                                   int  nThreads)
+{
+    ICSINIT;
+
+
+    if ((ics == NULL) || (ics->fileMode == IcsFileMode_update))
+        return IcsErr_NotValidAction;
+    if (nThreads < 0) return IcsErr_IllParameter;
+
+    ics->compThreads = nThreads;
+
+    return error;
+}
+
+
+/* Set the size of the chunks for chunked compression. */
+Ics_Error IcsSetChunkSize(ICS          *ics,
+                          const size_t *chunkSize)
+{
+    ICSINIT;
+    int i;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+    if (chunkSize == NULL) return IcsErr_IllParameter;
+    if (ics->dimensions < 1) return IcsErr_NoLayout;
+
+    for (i = 0; i < ics->dimensions; i++) {
+        ics->chunkSize[i] = chunkSize[i];
+    }
+
+    return error;
+}
+
+
+/* Get the size of the chunks for chunked compression. */
+Ics_Error IcsGetChunkSize(const ICS *ics,
+                          size_t    *chunkSize)
+{
+    ICSINIT;
+
+
+    if (ics == NULL) return IcsErr_NotValidAction;
+    if (chunkSize == NULL) return IcsErr_IllParameter;
+    if (ics->dimensions < 1) return IcsErr_NoLayout;
+
+    IcsGetChunkShape(ics, chunkSize);
+
+    return error;
+}
+
+
+/* Set the filter applied before compression. */
+Ics_Error IcsSetFilter(ICS        *ics,
+                       Ics_Filter  filter)
+{
+    ICSINIT;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+    if (filter != IcsFilter_none && filter != IcsFilter_shuffle &&
+        filter != IcsFilter_bitshuffle)
+        return IcsErr_IllParameter;
+
+    ics->filter = filter;
+
+    return error;
+}
+
+
+/* Get the filter applied before compression. */
+Ics_Error IcsGetFilter(const ICS  *ics,
+                       Ics_Filter *filter)
+{
+    ICSINIT;
+
+
+    if (ics == NULL) return IcsErr_NotValidAction;
+    if (filter == NULL) return IcsErr_IllParameter;
+
+    *filter = ics->filter;
+
+    return error;
+}
+
+
+/* Set the predictor applied before compression. */
+Ics_Error IcsSetPredictor(ICS           *ics,
+                          Ics_Predictor  predictor)
+{
+    ICSINIT;
+
+
+    if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
+        return IcsErr_NotValidAction;
+    if (predictor != IcsPredictor_none &&
+        predictor != IcsPredictor_horizontal)
+        return IcsErr_IllParameter;
+
+    ics->predictor = predictor;
+
+    return error;
+}
+
+
+/* Get the predictor applied before compression. */
+Ics_Error IcsGetPredictor(const ICS     *ics,
+                          Ics_Predictor *predictor)
+{
+    ICSINIT;
+
+
+    if (ics == NULL) return IcsErr_NotValidAction;
+    if (predictor == NULL) return IcsErr_IllParameter;
+
+    *predictor = ics->predictor;
+
+    return error;
+}
+
+
 /* Get the position of the image in the real world: the origin of the first
    pixel, the distances between pixels and the units in which to measure. If you
    are not interested in one of the parameters, set the pointer to
@@ -996,12 +1822,15 @@ Ics_Error IcsSetSignificantBits(ICS    *ics,
                                 size_t  nbits)
 {
     ICSINIT;
-    size_t maxbits = IcsGetDataTypeSize(ics->imel.dataType) * 8;
+    Ics_Format format;
+    int        sign;
+    size_t     maxbits;
 
     if ((ics == NULL) || (ics->fileMode != IcsFileMode_write))
         return IcsErr_NotValidAction;
 
     if (ics->dimensions == 0) return IcsErr_NoLayout;
+    IcsGetPropsDataType(ics->imel.dataType, &format, &sign, &maxbits);
     if (nbits > maxbits) {
         nbits = maxbits;
     }
@@ -1133,6 +1962,7 @@ Ics_Error IcsGuessScilType(ICS *ics)
         return IcsErr_NotValidAction;
 
     switch (ics->imel.dataType) {
+        case Ics_binary:
         case Ics_uint8:
         case Ics_sint8:
         case Ics_uint16:
@@ -50,14 +50,20 @@
  *   IcsExtensionFind()
  *   IcsGetBytesPerSample()
  *   IcsOpenIcs()
+ *   IcsOpenMemoryStream()
+ *   IcsGetCLocale()
  */
 
 #include <stdlib.h>
 #include <string.h>
 #include "libics_intern.h"
 
+#if defined(ICS_FORCE_C_LOCALE) && defined(HAVE_USELOCALE) && \
+    defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
 #ifdef _WIN32
-#include <windows.h>
 #define strcasecmp _stricmp
 #else
 #include <strings.h>
@@ -69,35 +75,6 @@ const char IDSEXT_Z[] = ".ids.Z";
 const char IDSEXT_GZ[] = ".ids.gz";
 
 
-/* This is a wrapper for the fopen function, on UNIX it calls fopen, on Windows
-   it uses _wfopen to support UTF-8 filenames. */
-FILE* IcsFOpen(const char *path,
-               const char *mode)
-{
-#ifdef _WIN32
-    wchar_t *wpath  = NULL, wmode[8];
-    int      n      = MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, 0);
-    FILE    *result = NULL;
-
-    wpath =(wchar_t*)malloc(n * sizeof(wchar_t));
-    if (!wpath) return NULL;
-
-    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, n)) goto exit;
-    if (!MultiByteToWideChar(CP_UTF8, 0, mode, -1, wmode, 8)) goto exit;
-
-    result = _wfopen(wpath, wmode);
-
-  exit:
-    if (wpath) {
-        free(wpath);
-    }
-    return result;
-#else
-    return fopen(path, mode);
-#endif
-}
-
-
 /* This function can be used to check for the correct library version: if
   (strcmp (ICSLIB_VERSION, IcsGetLibVersion ()) != 0) return ERRORCODE; */
 const char *IcsGetLibVersion(void)
@@ -318,6 +295,65 @@ Ics_Error IcsOpenIcs(FILE **fpp,
 }
 
 
+/* Open a stream to read an ICS file held in memory. Where the c library
+   provides fmemopen, the stream reads straight from the buffer; elsewhere the
+   buffer is copied into a temporary file. */
+FILE *IcsOpenMemoryStream(const Ics_Memory *mem)
+{
+    FILE *fp;
+
+
+#ifdef HAVE_FMEMOPEN
+    fp = fmemopen((void*)mem->data, mem->size, "r");
+#else
+    fp = tmpfile();
+    if (fp != NULL) {
+        if (fwrite(mem->data, 1, mem->size, fp) != mem->size ||
+            fflush(fp) != 0) {
+            fclose(fp);
+            return NULL;
+        }
+        rewind(fp);
+    }
+#endif
+
+    return fp;
+}
+
+
+#if defined(ICS_FORCE_C_LOCALE) && defined(HAVE_USELOCALE)
+static locale_t G_CLocale = (locale_t)0;
+
+
+static void icsCreateCLocale(void)
+{
+    G_CLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+
+/* Return the "C" locale used by ICS_SET_LOCALE, or 0 if it could not be
+   created. It is created on first use and kept until the program ends. */
+locale_t IcsGetCLocale(void)
+{
+#ifdef HAVE_PTHREADS
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+
+    pthread_once(&once, icsCreateCLocale);
+#else
+    static int created = 0;
+
+
+    if (!created) {
+        icsCreateCLocale();
+        created = 1;
+    }
+#endif
+    return G_CLocale;
+}
+#endif
+
+
 /* Initialize the Ics_Header structure. */
 void IcsInit(Ics_Header *icsStruct)
 {
@@ -328,6 +364,7 @@ void IcsInit(Ics_Header *icsStruct)
     icsStruct->data = NULL;
     icsStruct->dataLength = 0;
     icsStruct->dataStrides = NULL;
+    icsStruct->dataType = Ics_unknown;
     icsStruct->filename[0] = '\0';
     icsStruct->dimensions = 0;
     for (i = 0; i < ICS_MAXDIM; i++) {
@@ -346,10 +383,23 @@ void IcsInit(Ics_Header *icsStruct)
     icsStruct->coord[0] = '\0';
     icsStruct->compression = IcsCompr_uncompressed;
     icsStruct->compLevel = 0;
+    icsStruct->compThreads = 1;
+    icsStruct->filter = IcsFilter_none;
+    icsStruct->predictor = IcsPredictor_none;
+    icsStruct->convScale = 1.0;
+    icsStruct->convOffset = 0.0;
+    for (i = 0; i < ICS_MAXDIM; i++) {
+        icsStruct->chunkSize[i] = 0;
+    }
     icsStruct->history = NULL;
     icsStruct->blockRead = NULL;
+    icsStruct->blockWrite = NULL;
+    icsStruct->dataMap = NULL;
+    icsStruct->zipIndex = NULL;
+    icsStruct->memory = NULL;
     icsStruct->srcFile[0] = '\0';
     icsStruct->srcOffset = 0;
+    icsStruct->headerPadding = 0;
     for (i = 0; i < ICS_MAX_IMEL_SIZE; i++) {
         icsStruct->byteOrder[i] = 0;
     }
@@ -483,6 +533,7 @@ size_t IcsGetDataTypeSize(Ics_DataType dataType)
 
 
     switch (dataType) {
+        case Ics_binary: /* One byte in memory, packed in the file */
         case Ics_uint8:
         case Ics_sint8:
             bytes = 1;
@@ -523,6 +574,9 @@ void IcsGetPropsDataType(Ics_DataType  dataType,
     *bits = IcsGetDataTypeSize(dataType) * 8;
     *sign = 1;
     switch (dataType) {
+        case Ics_binary:
+            *bits = 1;
+            /* fallthrough */
         case Ics_uint8:
         case Ics_uint16:
         case Ics_uint32:
@@ -559,6 +613,9 @@ void IcsGetDataTypeProps(Ics_DataType* dataType,
     switch (format) {
         case IcsForm_integer:
             switch (bits) {
+                case 1:
+                    *dataType = Ics_binary;
+                    break;
                 case 8:
                     *dataType = sign ? Ics_sint8 : Ics_uint8;
                     break;
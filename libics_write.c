@@ -35,8 +35,11 @@
  * The following library functions are contained in this file:
  *
  *   IcsWriteIcs()
+ *   IcsUpdateIcs()
+ *   IcsWriteIcsMemory()
  */
 
+#include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
@@ -410,9 +413,11 @@ static Ics_Error writeIcsLayout(Ics_Header *icsStruct,
 {
     ICSINIT;
     unsigned int    problem;
-    int    i;
-    char   line[ICS_LINE_LENGTH];
-    size_t size;
+    int        i;
+    char       line[ICS_LINE_LENGTH];
+    Ics_Format format;
+    int        sign;
+    size_t     bits;
 
 
         /* Write the number of parameters to the buffer: */
@@ -442,8 +447,8 @@ static Ics_Error writeIcsLayout(Ics_Header *icsStruct,
         /* Write the sizes: */
     problem = icsFirstToken(line, ICSTOK_LAYOUT);
     problem |= icsAddToken(line, ICSTOK_SIZES);
-    size = IcsGetDataTypeSize(icsStruct->imel.dataType);
-    problem |= icsAddInt(line,(long int)size * 8);
+    IcsGetPropsDataType(icsStruct->imel.dataType, &format, &sign, &bits);
+    problem |= icsAddInt(line,(long int)bits);
     for (i = 0; i < icsStruct->dimensions-1; i++) {
         if (icsStruct->dim[i].size == 0) return IcsErr_NoLayout;
         problem |= icsAddInt(line,(long int) icsStruct->dim[i].size);
@@ -468,7 +473,7 @@ static Ics_Error writeIcsLayout(Ics_Header *icsStruct,
 
         /* Number of significant bits, default is the number of bits/sample: */
     if (icsStruct->imel.sigBits == 0) {
-        icsStruct->imel.sigBits = size * 8;
+        icsStruct->imel.sigBits = bits;
     }
     problem = icsFirstToken(line, ICSTOK_LAYOUT);
     problem |= icsAddToken(line, ICSTOK_SIGBIT);
@@ -543,6 +548,12 @@ static Ics_Error writeIcsRep(Ics_Header *icsStruct,
         case IcsCompr_gzip:
             problem |= icsAddLastToken(line, ICSTOK_COMPR_GZIP);
             break;
+        case IcsCompr_chunked_gzip:
+            problem |= icsAddLastToken(line, ICSTOK_COMPR_CHUNKED_GZIP);
+            break;
+        case IcsCompr_zstd:
+            problem |= icsAddLastToken(line, ICSTOK_COMPR_ZSTD);
+            break;
         default:
             return IcsErr_UnknownCompression;
     }
@@ -550,6 +561,45 @@ static Ics_Error writeIcsRep(Ics_Header *icsStruct,
     error = icsAddLine(line, fp);
     if (error) return error;
 
+        /* For chunked compression, the size of the chunks in each dimension.
+           Any default sizes are filled in here. */
+    if (icsStruct->compression == IcsCompr_chunked_gzip) {
+        IcsGetChunkShape(icsStruct, icsStruct->chunkSize);
+        problem = icsFirstToken(line, ICSTOK_REPRES);
+        problem |= icsAddToken(line, ICSTOK_CHUNKS);
+        for (i = 0; i < icsStruct->dimensions - 1; i++) {
+            problem |= icsAddInt(line, (long int)icsStruct->chunkSize[i]);
+        }
+        problem |= icsAddLastInt(line, (long int)icsStruct->chunkSize[i]);
+        if (problem) return IcsErr_FailWriteLine;
+        error = icsAddLine(line, fp);
+        if (error) return error;
+    }
+
+        /* The filter applied before compression, if any. */
+    if (IcsGetActiveFilter(icsStruct) != IcsFilter_none) {
+        problem = icsFirstToken(line, ICSTOK_REPRES);
+        problem |= icsAddToken(line, ICSTOK_FILTER);
+        if (icsStruct->filter == IcsFilter_shuffle) {
+            problem |= icsAddLastToken(line, ICSTOK_FILTER_SHUFFLE);
+        } else {
+            problem |= icsAddLastToken(line, ICSTOK_FILTER_BITSHUFFLE);
+        }
+        if (problem) return IcsErr_FailWriteLine;
+        error = icsAddLine(line, fp);
+        if (error) return error;
+    }
+
+        /* The predictor applied before the filter, if any. */
+    if (IcsGetActivePredictor(icsStruct) != IcsPredictor_none) {
+        problem = icsFirstToken(line, ICSTOK_REPRES);
+        problem |= icsAddToken(line, ICSTOK_PREDICTOR);
+        problem |= icsAddLastToken(line, ICSTOK_PREDICTOR_HORIZONTAL);
+        if (problem) return IcsErr_FailWriteLine;
+        error = icsAddLine(line, fp);
+        if (error) return error;
+    }
+
         /* Define the byteorder. This is supposed to resolve little/big endian
            problems. If the calling function put something here, we'll keep
            it. Otherwise we fill in the machine's byte order. */
@@ -1021,6 +1071,30 @@ static Ics_Error writeIcsHistory(Ics_Header *icsStruct,
 }
 
 
+/* Write n bytes of lines containing only spaces, which readers skip. This
+   reserves space after the header, so that it can later be rewritten in
+   place. */
+static Ics_Error writeIcsPadding(size_t  n,
+                                 FILE   *fp)
+{
+    ICSINIT;
+    char   line[ICS_LINE_LENGTH];
+    size_t len;
+
+
+    while (!error && n > 0) {
+        len = n < ICS_LINE_LENGTH - 1 ? n : ICS_LINE_LENGTH - 1;
+        memset(line, ' ', len - 1);
+        line[len - 1] = ICS_EOL;
+        line[len] = '\0';
+        error = icsAddLine(line, fp);
+        n -= len;
+    }
+
+    return error;
+}
+
+
 static Ics_Error markEndOfFile(Ics_Header *icsStruct,
                                FILE       *fp)
 {
@@ -1040,30 +1114,15 @@ static Ics_Error markEndOfFile(Ics_Header *icsStruct,
 }
 
 
-Ics_Error IcsWriteIcs(Ics_Header *icsStruct,
-                      const char *filename)
+/* Write all of the header except the padding and the END keyword. */
+static Ics_Error writeIcsHeader(Ics_Header *icsStruct,
+                                FILE       *fp)
 {
     ICSINIT;
-    ICS_INIT_LOCALE;
     char  line[ICS_LINE_LENGTH];
     char  buf[ICS_MAXPATHLEN];
-    FILE *fp;
 
 
-    if ((filename != NULL) &&(filename[0] != '\0')) {
-        IcsGetIcsName(icsStruct->filename, filename, 0);
-    } else if (icsStruct->filename[0] != '\0') {
-        IcsStrCpy(buf, icsStruct->filename, ICS_MAXPATHLEN);
-        IcsGetIcsName(icsStruct->filename, buf, 0);
-    } else {
-        return IcsErr_FOpenIcs;
-    }
-
-    fp = IcsFOpen(icsStruct->filename, "wb");
-    if (fp == NULL) return IcsErr_FOpenIcs;
-
-    ICS_SET_LOCALE;
-
     line[0] = ICS_FIELD_SEP;
     line[1] = ICS_EOL;
     line[2] = '\0';
@@ -1084,7 +1143,12 @@ Ics_Error IcsWriteIcs(Ics_Header *icsStruct,
     if (!error) {
         IcsGetFileName(buf, icsStruct->filename);
         icsFirstText(line, ICS_FILENAME);
-        icsAddLastText(line, buf);
+        if (buf[0] != '\0') {
+            icsAddLastText(line, buf);
+        } else {
+                /* A file written to memory has no name */
+            line[strlen(line) - 1] = ICS_EOL;
+        }
         if (!error) error = icsAddLine(line, fp);
     }
 
@@ -1096,6 +1160,39 @@ Ics_Error IcsWriteIcs(Ics_Header *icsStruct,
     if (!error) error = writeIcsSensorData(icsStruct, fp);
     if (!error) error = writeIcsSensorStates(icsStruct, fp);
     if (!error) error = writeIcsHistory(icsStruct, fp);
+
+    return error;
+}
+
+
+Ics_Error IcsWriteIcs(Ics_Header *icsStruct,
+                      const char *filename)
+{
+    ICSINIT;
+    ICS_INIT_LOCALE;
+    char  buf[ICS_MAXPATHLEN];
+    FILE *fp;
+
+
+    if ((filename != NULL) &&(filename[0] != '\0')) {
+        IcsGetIcsName(icsStruct->filename, filename, 0);
+    } else if (icsStruct->filename[0] != '\0') {
+        IcsStrCpy(buf, icsStruct->filename, ICS_MAXPATHLEN);
+        IcsGetIcsName(icsStruct->filename, buf, 0);
+    } else {
+        return IcsErr_FOpenIcs;
+    }
+
+    fp = IcsFOpen(icsStruct->filename, "wb");
+    if (fp == NULL) return IcsErr_FOpenIcs;
+
+    ICS_SET_LOCALE;
+
+    error = writeIcsHeader(icsStruct, fp);
+    if (!error && icsStruct->version != 1 && icsStruct->srcFile[0] == '\0') {
+            /* Room to update the header without moving the data */
+        error = writeIcsPadding(icsStruct->headerPadding, fp);
+    }
     if (!error) error = markEndOfFile(icsStruct, fp);
 
     ICS_REVERT_LOCALE;
@@ -1107,3 +1204,143 @@ Ics_Error IcsWriteIcs(Ics_Header *icsStruct,
     return error;
 }
 
+
+/* Rewrite the header of an ICS version 2.0 file that contains the data, in the
+   size bytes that the old header occupies, so that the data need not be
+   copied. The new header is padded to the same size. *done is set to 0 if the
+   new header does not fit. */
+Ics_Error IcsUpdateIcs(Ics_Header *icsStruct,
+                       size_t      size,
+                       int        *done)
+{
+    ICSINIT;
+    ICS_INIT_LOCALE;
+    char  line[ICS_LINE_LENGTH];
+    char *buf;
+    FILE *tmp, *fp;
+    long  n;
+    size_t count;
+
+
+    *done = 0;
+
+        /* Write the new header to a temporary file to find its size */
+    tmp = tmpfile();
+    if (tmp == NULL) return IcsErr_Ok;
+
+    ICS_SET_LOCALE;
+    error = writeIcsHeader(icsStruct, tmp);
+    ICS_REVERT_LOCALE;
+
+    if (!error) error = icsFirstToken(line, ICSTOK_END);
+    if (!error) {
+        IcsAppendChar(line, ICS_EOL);
+        n = ftell(tmp);
+        if (n < 0 || (size_t)n + strlen(line) > size) {
+            fclose(tmp);
+            return IcsErr_Ok;
+        }
+        error = writeIcsPadding(size - (size_t)n - strlen(line), tmp);
+    }
+    if (!error) error = icsAddLine(line, tmp);
+    if (error) {
+        fclose(tmp);
+        return error;
+    }
+
+        /* Copy it over the old header */
+    buf = (char*)malloc(ICS_BUF_SIZE);
+    if (buf == NULL) {
+        fclose(tmp);
+        return IcsErr_Alloc;
+    }
+    fp = IcsFOpen(icsStruct->filename, "r+b");
+    if (fp == NULL) {
+        free(buf);
+        fclose(tmp);
+        return IcsErr_FOpenIcs;
+    }
+    rewind(tmp);
+    while (!error && (count = fread(buf, 1, ICS_BUF_SIZE, tmp)) > 0) {
+        if (fwrite(buf, 1, count, fp) != count) {
+            error = IcsErr_FWriteIcs;
+        }
+    }
+    if (!error && ferror(tmp)) error = IcsErr_FWriteIcs;
+    if (fclose(fp) == EOF) {
+        if (!error) error = IcsErr_FCloseIcs;
+    }
+    free(buf);
+    fclose(tmp);
+    if (!error) *done = 1;
+
+    return error;
+}
+
+
+/* Write the header and the image data into a newly allocated buffer. Where the
+   c library provides open_memstream, the buffer grows as the file is written;
+   elsewhere the file is written to a temporary file and read back. */
+Ics_Error IcsWriteIcsMemory(Ics_Header  *icsStruct,
+                            void       **buf,
+                            size_t      *len)
+{
+    ICSINIT;
+    ICS_INIT_LOCALE;
+    FILE   *fp;
+    char   *ptr  = NULL;
+    size_t  size = 0;
+#ifndef HAVE_OPEN_MEMSTREAM
+    long    n;
+#endif
+
+
+    *buf = NULL;
+    *len = 0;
+    if (icsStruct->version == 1) return IcsErr_NotValidAction;
+    if ((icsStruct->srcFile[0] == '\0') &&
+        ((icsStruct->data == NULL) || (icsStruct->dataLength == 0)))
+        return IcsErr_MissingData;
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    fp = open_memstream(&ptr, &size);
+#else
+    fp = tmpfile();
+#endif
+    if (fp == NULL) return IcsErr_FOpenIcs;
+
+    ICS_SET_LOCALE;
+    error = writeIcsHeader(icsStruct, fp);
+    if (!error) error = markEndOfFile(icsStruct, fp);
+    ICS_REVERT_LOCALE;
+
+    if (!error && icsStruct->srcFile[0] == '\0') {
+        error = IcsWriteIdsStream(icsStruct, fp);
+    }
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    if (fclose(fp) == EOF) {
+        if (!error) error = IcsErr_FCloseIds;
+    }
+#else
+    if (!error && (n = ftell(fp)) < 0) error = IcsErr_FWriteIds;
+    if (!error) {
+        size = (size_t)n;
+        ptr = (char*)malloc(size > 0 ? size : 1);
+        if (ptr == NULL) error = IcsErr_Alloc;
+    }
+    if (!error) {
+        rewind(fp);
+        if (fread(ptr, 1, size, fp) != size) error = IcsErr_FReadIds;
+    }
+    fclose(fp);
+#endif
+    if (error) {
+        free(ptr);
+        return error;
+    }
+
+    *buf = ptr;
+    *len = size;
+    return error;
+}
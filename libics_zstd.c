@@ -0,0 +1,571 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright 2015-2017:
+ *   Scientific Volume Imaging Holding B.V.
+ *   Hilversum, The Netherlands.
+ *   https://www.svi.nl
+ *
+ * Contact: libics@svi.nl
+ *
+ * Copyright (C) 2000-2013 Cris Luengo and others
+ *
+ * Large chunks of this library written by
+ *    Bert Gijsbers
+ *    Dr. Hans T.M. van der Voort
+ * And also Damir Sudar, Geert van Kempen, Jan Jitze Krol,
+ * Chiel Baarslag and Fons Laan.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : libics_zstd.c
+ *
+ * The following internal functions are contained in this file:
+ *
+ *   IcsWriteZstd()
+ *   IcsWriteZstdWithStrides()
+ *   IcsOpenZstdWrite()
+ *   IcsWriteZstdBlock()
+ *   IcsCloseZstdWrite()
+ *   IcsOpenZstd()
+ *   IcsCloseZstd()
+ *   IcsReadZstdBlock()
+ *   IcsSetZstdBlock()
+ *
+ * This is the only file that contains any libzstd dependencies.
+ *
+ * The data is written as a single Zstandard frame, with the content size and
+ * a checksum in the frame header. A compression level of 0 selects the zstd
+ * default level. If more than one compression thread is requested, libzstd
+ * compresses in parallel; if libzstd was built without thread support, the
+ * data is compressed in a single thread.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics_intern.h"
+
+#ifdef ICS_ZSTD
+    #include <zstd.h>
+#endif
+
+
+#ifdef ICS_ZSTD
+
+/* This is the struct behind the "void* zstdStream" in Ics_BlockRead. */
+typedef struct {
+    ZSTD_DStream  *stream;   /* Decompression context */
+    ZSTD_inBuffer  in;       /* Compressed data read but not yet consumed */
+    void          *inBuf;    /* Buffer for in.src */
+    size_t         inSize;   /* Size of inBuf */
+    size_t         totalOut; /* Number of bytes decompressed so far */
+    size_t         hint;     /* Last return value of ZSTD_decompressStream, 0
+                                at the end of a frame */
+} Ics_ZstdStream;
+
+
+/* Create a compression context for n bytes of input. */
+static Ics_Error icsZstdCreate(ZSTD_CCtx **cctx,
+                               size_t      n,
+                               int         level,
+                               int         nThreads)
+{
+    *cctx = ZSTD_createCCtx();
+    if (*cctx == NULL) return IcsErr_Alloc;
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(*cctx, ZSTD_c_compressionLevel,
+                                            level)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(*cctx, ZSTD_c_checksumFlag, 1)) ||
+        ZSTD_isError(ZSTD_CCtx_setPledgedSrcSize(*cctx,
+                                                 (unsigned long long)n))) {
+        ZSTD_freeCCtx(*cctx);
+        *cctx = NULL;
+        return IcsErr_CompressionProblem;
+    }
+    if (nThreads > 1) {
+            /* Fails if libzstd was built without multithreading support, in
+               which case we just compress in this thread. */
+        ZSTD_CCtx_setParameter(*cctx, ZSTD_c_nbWorkers, nThreads);
+    }
+    return IcsErr_Ok;
+}
+
+
+/* Compress n bytes from src, writing the output buffer to file whenever it
+   fills up. With ZSTD_e_end, the frame is finished and the output buffer
+   emptied. */
+static Ics_Error icsZstdCompress(ZSTD_CCtx         *cctx,
+                                 ZSTD_outBuffer    *out,
+                                 const void        *src,
+                                 size_t             n,
+                                 ZSTD_EndDirective  mode,
+                                 FILE              *file)
+{
+    ZSTD_inBuffer in;
+    size_t        remaining;
+
+
+    in.src = src;
+    in.size = n;
+    in.pos = 0;
+    do {
+        if (out->pos == out->size) {
+            if (fwrite(out->dst, 1, out->pos, file) != out->pos) {
+                return IcsErr_FWriteIds;
+            }
+            out->pos = 0;
+        }
+        remaining = ZSTD_compressStream2(cctx, out, &in, mode);
+        if (ZSTD_isError(remaining)) return IcsErr_CompressionProblem;
+    } while (mode == ZSTD_e_end ? remaining != 0 : in.pos != in.size);
+
+    if (mode == ZSTD_e_end && out->pos > 0) {
+        if (fwrite(out->dst, 1, out->pos, file) != out->pos) {
+            return IcsErr_FWriteIds;
+        }
+        out->pos = 0;
+    }
+    return IcsErr_Ok;
+}
+
+#endif
+
+
+/* Write zstd compressed data. */
+Ics_Error IcsWriteZstd(const void *src,
+                       size_t      n,
+                       FILE       *file,
+                       int         level,
+                       int         nThreads)
+{
+#ifdef ICS_ZSTD
+    ICSINIT;
+    ZSTD_CCtx      *cctx;
+    ZSTD_outBuffer  out;
+
+
+    out.size = ZSTD_CStreamOutSize();
+    out.pos = 0;
+    out.dst = malloc(out.size);
+    if (out.dst == NULL) return IcsErr_Alloc;
+
+    error = icsZstdCreate(&cctx, n, level, nThreads);
+    if (!error) {
+        error = icsZstdCompress(cctx, &out, src, n, ZSTD_e_end, file);
+        ZSTD_freeCCtx(cctx);
+    }
+    free(out.dst);
+
+    return error;
+#else
+    (void)src;
+    (void)n;
+    (void)file;
+    (void)level;
+    (void)nThreads;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Write zstd compressed data, with strides. The predictor and filter, if any,
+   are applied to each line along the first dimension. */
+Ics_Error IcsWriteZstdWithStrides(const void      *src,
+                                  const size_t    *dim,
+                                  const ptrdiff_t *stride,
+                                  int              nDims,
+                                  int              nBytes,
+                                  Ics_Filter       filter,
+                                  Ics_Predictor    predictor,
+                                  FILE            *file,
+                                  int              level,
+                                  int              nThreads)
+{
+#ifdef ICS_ZSTD
+    ICSINIT;
+    ZSTD_CCtx      *cctx;
+    ZSTD_outBuffer  out;
+    char           *lineBuf        = NULL;
+    char           *filterBuf      = NULL;
+    char           *linePtr;
+    size_t          curPos[ICS_MAXDIM];
+    char const     *data;
+    int             i;
+    size_t          j;
+    size_t          total          = (size_t)nBytes;
+    const size_t    lineSize       = dim[0] * (size_t)nBytes;
+    const int       contiguousLine = stride[0] == 1;
+    const int       encode         = filter != IcsFilter_none ||
+                                     predictor != IcsPredictor_none;
+
+
+    for (i = 0; i < nDims; i++) {
+        total *= dim[i];
+    }
+
+    out.size = ZSTD_CStreamOutSize();
+    out.pos = 0;
+    out.dst = malloc(out.size);
+    if (out.dst == NULL) return IcsErr_Alloc;
+    if (!contiguousLine) {
+        lineBuf = (char*)malloc(lineSize);
+        if (lineBuf == NULL) {
+            free(out.dst);
+            return IcsErr_Alloc;
+        }
+    }
+    if (encode) {
+        filterBuf = (char*)malloc(2 * lineSize);
+        if (filterBuf == NULL) {
+            free(out.dst);
+            free(lineBuf);
+            return IcsErr_Alloc;
+        }
+    }
+    error = icsZstdCreate(&cctx, total, level, nThreads);
+    if (error) {
+        free(out.dst);
+        free(lineBuf);
+        free(filterBuf);
+        return error;
+    }
+
+        /* Walk over each line in the 1st dimension */
+    for (i = 0; i < nDims; i++) {
+        curPos[i] = 0;
+    }
+    while (1) {
+        data = (char const*)src;
+        for (i = 1; i < nDims; i++) { /* curPos[0]==0 here */
+            data += (ptrdiff_t)curPos[i] * stride[i] * nBytes;
+        }
+            /* Get data line */
+        if (!contiguousLine) {
+            linePtr = lineBuf;
+            for (j = 0; j < dim[0]; j++) {
+                memcpy(linePtr, data, (size_t)nBytes);
+                data += stride[0] * nBytes;
+                linePtr += nBytes;
+            }
+            data = lineBuf;
+        }
+        if (encode) {
+            IcsEncodeData(filter, predictor, data, filterBuf, dim[0], nBytes);
+            data = filterBuf;
+        }
+        error = icsZstdCompress(cctx, &out, data, lineSize, ZSTD_e_continue,
+                                file);
+        if (error) break;
+            /* This is part of the N-D loop */
+        for (i = 1; i < nDims; i++) {
+            curPos[i]++;
+            if (curPos[i] < dim[i]) {
+                break;
+            }
+            curPos[i] = 0;
+        }
+        if (i == nDims) {
+            break; /* we're done writing */
+        }
+    }
+
+        /* Finish the frame */
+    if (!error) {
+        error = icsZstdCompress(cctx, &out, NULL, 0, ZSTD_e_end, file);
+    }
+
+    ZSTD_freeCCtx(cctx);
+    free(out.dst);
+    free(lineBuf);
+    free(filterBuf);
+
+    return error;
+#else
+    (void)src;
+    (void)dim;
+    (void)stride;
+    (void)nDims;
+    (void)nBytes;
+    (void)filter;
+    (void)predictor;
+    (void)file;
+    (void)level;
+    (void)nThreads;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+#ifdef ICS_ZSTD
+
+/* This is the struct behind the "void* zstdStream" in Ics_BlockWrite. */
+typedef struct {
+    ZSTD_CCtx      *cctx; /* Compression context */
+    ZSTD_outBuffer  out;  /* Compressed data not yet written */
+} Ics_ZstdWrite;
+
+#endif
+
+
+/* Start writing zstd compressed data in blocks. The size of the image is
+   pledged in the frame header, so finishing the frame fails if less data was
+   written. The stream is kept in the block writer bw. */
+Ics_Error IcsOpenZstdWrite(const Ics_Header *icsStruct,
+                           Ics_BlockWrite   *bw)
+{
+#ifdef ICS_ZSTD
+    ICSINIT;
+    Ics_ZstdWrite *zw;
+
+
+    zw = (Ics_ZstdWrite*)malloc(sizeof(Ics_ZstdWrite));
+    if (zw == NULL) return IcsErr_Alloc;
+    zw->out.size = ZSTD_CStreamOutSize();
+    zw->out.pos = 0;
+    zw->out.dst = malloc(zw->out.size);
+    if (zw->out.dst == NULL) {
+        free(zw);
+        return IcsErr_Alloc;
+    }
+    error = icsZstdCreate(&zw->cctx, IcsGetDataSize(icsStruct),
+                          icsStruct->compLevel,
+                          IcsGetCompressionThreads(icsStruct));
+    if (error) {
+        free(zw->out.dst);
+        free(zw);
+        return error;
+    }
+
+    bw->zstdStream = zw;
+    return IcsErr_Ok;
+#else
+    (void)icsStruct;
+    (void)bw;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Compress a block of data into the stream opened with IcsOpenZstdWrite. */
+Ics_Error IcsWriteZstdBlock(Ics_BlockWrite *bw,
+                            const void     *src,
+                            size_t          n)
+{
+#ifdef ICS_ZSTD
+    Ics_ZstdWrite *zw = (Ics_ZstdWrite*)bw->zstdStream;
+
+
+    return icsZstdCompress(zw->cctx, &zw->out, src, n, ZSTD_e_continue,
+                           bw->dataFilePtr);
+#else
+    (void)bw;
+    (void)src;
+    (void)n;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Finish the frame started with IcsOpenZstdWrite. */
+Ics_Error IcsCloseZstdWrite(Ics_BlockWrite *bw)
+{
+#ifdef ICS_ZSTD
+    ICSINIT;
+    Ics_ZstdWrite *zw = (Ics_ZstdWrite*)bw->zstdStream;
+
+
+    error = icsZstdCompress(zw->cctx, &zw->out, NULL, 0, ZSTD_e_end,
+                            bw->dataFilePtr);
+    ZSTD_freeCCtx(zw->cctx);
+    free(zw->out.dst);
+    free(zw);
+    bw->zstdStream = NULL;
+
+    return error;
+#else
+    (void)bw;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Start reading zstd compressed data. */
+Ics_Error IcsOpenZstd(Ics_Header *icsStruct)
+{
+#ifdef ICS_ZSTD
+    Ics_BlockRead  *br = (Ics_BlockRead*)icsStruct->blockRead;
+    Ics_ZstdStream *zs;
+
+
+    zs = (Ics_ZstdStream*)malloc(sizeof(Ics_ZstdStream));
+    if (zs == NULL) return IcsErr_Alloc;
+    zs->inSize = ZSTD_DStreamInSize();
+    zs->inBuf = malloc(zs->inSize);
+    if (zs->inBuf == NULL) {
+        free(zs);
+        return IcsErr_Alloc;
+    }
+    zs->stream = ZSTD_createDStream();
+    if (zs->stream == NULL) {
+        free(zs->inBuf);
+        free(zs);
+        return IcsErr_Alloc;
+    }
+    if (ZSTD_isError(ZSTD_initDStream(zs->stream))) {
+        ZSTD_freeDStream(zs->stream);
+        free(zs->inBuf);
+        free(zs);
+        return IcsErr_DecompressionProblem;
+    }
+    zs->in.src = zs->inBuf;
+    zs->in.size = 0;
+    zs->in.pos = 0;
+    zs->totalOut = 0;
+    zs->hint = 1;
+
+    br->zstdStream = zs;
+    return IcsErr_Ok;
+#else
+    (void)icsStruct;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Close zstd compressed data stream. */
+Ics_Error IcsCloseZstd(Ics_Header *icsStruct)
+{
+#ifdef ICS_ZSTD
+    Ics_BlockRead  *br = (Ics_BlockRead*)icsStruct->blockRead;
+    Ics_ZstdStream *zs = (Ics_ZstdStream*)br->zstdStream;
+
+
+    ZSTD_freeDStream(zs->stream);
+    free(zs->inBuf);
+    free(zs);
+    br->zstdStream = NULL;
+    return IcsErr_Ok;
+#else
+    (void)icsStruct;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Read zstd compressed data block. */
+Ics_Error IcsReadZstdBlock(Ics_Header *icsStruct,
+                           void       *outBuf,
+                           size_t      len)
+{
+#ifdef ICS_ZSTD
+    Ics_BlockRead  *br   = (Ics_BlockRead*)icsStruct->blockRead;
+    Ics_ZstdStream *zs   = (Ics_ZstdStream*)br->zstdStream;
+    FILE           *file = br->dataFilePtr;
+    ZSTD_outBuffer  out;
+    size_t          done, hint;
+    int             eof  = 0;
+
+
+    out.dst = outBuf;
+    out.size = len;
+    out.pos = 0;
+    while (out.pos < out.size) {
+        if (zs->in.pos == zs->in.size && !eof) {
+            zs->in.size = fread(zs->inBuf, 1, zs->inSize, file);
+            zs->in.pos = 0;
+            if (ferror(file)) return IcsErr_FReadIds;
+            eof = zs->in.size == 0;
+        }
+        done = out.pos;
+        hint = ZSTD_decompressStream(zs->stream, &out, &zs->in);
+        if (ZSTD_isError(hint)) return IcsErr_DecompressionProblem;
+        zs->totalOut += out.pos - done;
+        if (eof && out.pos == done) {
+                /* No more input, and the decoder has no more output. If the
+                   last frame was complete, we're at the end of the data. */
+            return zs->hint == 0 ? IcsErr_EndOfStream : IcsErr_CorruptedStream;
+        }
+        zs->hint = hint;
+    }
+
+    return IcsErr_Ok;
+#else
+    (void)icsStruct;
+    (void)outBuf;
+    (void)len;
+    return IcsErr_UnknownCompression;
+#endif
+}
+
+
+/* Skip zstd compressed data block. Seeking backwards restarts decompression
+   at the beginning of the data. */
+Ics_Error IcsSetZstdBlock(Ics_Header *icsStruct,
+                          ptrdiff_t   offset,
+                          int         whence)
+{
+#ifdef ICS_ZSTD
+    ICSINIT;
+    Ics_BlockRead  *br = (Ics_BlockRead*)icsStruct->blockRead;
+    Ics_ZstdStream *zs = (Ics_ZstdStream*)br->zstdStream;
+    size_t          n, bufSize;
+    void           *buf;
+
+
+    if (whence == SEEK_CUR) {
+        offset += (ptrdiff_t)zs->totalOut;
+    }
+    if (offset < 0) return IcsErr_IllParameter;
+    if ((size_t)offset < zs->totalOut) {
+            /* Start over */
+        if (ICSFSEEK(br->dataFilePtr, (ptrdiff_t)br->dataOffset,
+                     SEEK_SET) != 0) {
+            return IcsErr_FReadIds;
+        }
+        if (ZSTD_isError(ZSTD_initDStream(zs->stream))) {
+            return IcsErr_DecompressionProblem;
+        }
+        zs->in.size = 0;
+        zs->in.pos = 0;
+        zs->totalOut = 0;
+        zs->hint = 1;
+    }
+    n = (size_t)offset - zs->totalOut;
+    if (n == 0) return IcsErr_Ok;
+
+    bufSize = ZSTD_DStreamOutSize();
+    if (n < bufSize) bufSize = n;
+    buf = malloc(bufSize);
+    if (buf == NULL) return IcsErr_Alloc;
+
+    while (n > 0 && !error) {
+        size_t count = n < bufSize ? n : bufSize;
+        error = IcsReadZstdBlock(icsStruct, buf, count);
+        n -= count;
+    }
+
+    free(buf);
+
+    return error;
+#else
+    (void)icsStruct;
+    (void)offset;
+    (void)whence;
+    return IcsErr_UnknownCompression;
+#endif
+}
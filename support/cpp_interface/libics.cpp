@@ -29,6 +29,7 @@
 
 
 #include <stdexcept>
+#include <cstdlib>
 #include <cstring>
 
 #include "libics.hpp"
@@ -48,6 +49,16 @@ void ICS::Open(std::string const& filename, std::string const& mode) {
    }
 }
 
+void ICS::OpenMemory(void const* buf, std::size_t len, std::string const& mode) {
+   if (ics) {
+      Close(); // Let's close the file first!
+   }
+   Ics_Error err = IcsOpenMemory(&ics, buf, len, mode.c_str());
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
 void ICS::Close() {
    Ics_Error err = IcsClose(ics);
    ics = nullptr;
@@ -114,11 +125,15 @@ ICS::Layout ICS::GetLayout() const {
       case Ics_complex64:
          dt = DataType::Complex64;
          break;
+      case Ics_binary:
+         dt = DataType::Binary;
+         break;
    }
    return {dt, std::move(dims)};
 }
 
-void ICS::SetLayout(DataType dt, std::vector<std::size_t> const& dims) {
+// Convert the C++ data type enumerator to the C one.
+static Ics_DataType ToIcsDataType(DataType dt) {
    Ics_DataType type;
    switch( dt ) {
       default:
@@ -164,8 +179,15 @@ void ICS::SetLayout(DataType dt, std::vector<std::size_t> const& dims) {
       case DataType::Complex64:
          type = Ics_complex64;
          break;
+      case DataType::Binary:
+         type = Ics_binary;
+         break;
    }
-   IcsSetLayout(ics, type, static_cast<int>(dims.size()), dims.data());
+   return type;
+}
+
+void ICS::SetLayout(DataType dt, std::vector<std::size_t> const& dims) {
+   IcsSetLayout(ics, ToIcsDataType(dt), static_cast<int>(dims.size()), dims.data());
 }
 
 std::size_t ICS::GetDataSize() const {
@@ -201,6 +223,48 @@ void ICS::GetROIData(std::vector<std::size_t> const& offset,
    }
 }
 
+// Read a square region of the image from an ICS file using multiple threads.
+// To use the defaults in one of the parameters, pass an empty vector. Only
+// valid if reading.
+void ICS::GetROIDataParallel(std::vector<std::size_t> const& offset,
+                             std::vector<std::size_t> const& size,
+                             std::vector<std::size_t> const& sampling,
+                             void* dest,
+                             std::size_t n,
+                             int nThreads) {
+   Ics_Error err = IcsGetROIDataParallel(
+         ics,
+         offset.empty()   ? nullptr : offset.data(),
+         size.empty()     ? nullptr : size.data(),
+         sampling.empty() ? nullptr : sampling.data(),
+         dest, n, nThreads);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+// Read a square region of the image from an ICS file into a sub-block of a
+// memory block. To use the defaults in one of the parameters, pass an empty
+// vector. Only valid if reading.
+void ICS::GetROIDataWithStrides(std::vector<std::size_t> const& offset,
+                                std::vector<std::size_t> const& size,
+                                std::vector<std::size_t> const& sampling,
+                                void* dest,
+                                std::size_t n,
+                                std::vector<std::ptrdiff_t> const& stride) {
+   Ics_Error err = IcsGetROIDataWithStrides(
+         ics,
+         offset.empty()   ? nullptr : offset.data(),
+         size.empty()     ? nullptr : size.data(),
+         sampling.empty() ? nullptr : sampling.data(),
+         dest, n,
+         stride.empty() ? nullptr : stride.data(),
+         stride.empty() ? (ics ? ics->dimensions : 0) : static_cast<int>(stride.size()));
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
 // Read the image from an ICS file into a sub-block of a memory block. To use
 // the defaults strides, pass an empty vector. Only valid if reading.
 void ICS::GetDataWithStrides(void* dest, std::vector<std::ptrdiff_t> const& stride) {
@@ -213,6 +277,80 @@ void ICS::GetDataWithStrides(void* dest, std::vector<std::ptrdiff_t> const& stri
    }
 }
 
+// Read the image data from an ICS file, converted to the given type. Only
+// valid if reading.
+void ICS::GetDataAs(DataType dt, void* dest, std::size_t n) {
+   Ics_Error err = IcsGetDataAs(ics, ToIcsDataType(dt), dest, n);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+// Read a square region of the image from an ICS file, converted to the given
+// type. To use the defaults in one of the parameters, pass an empty vector.
+// Only valid if reading.
+void ICS::GetROIDataAs(std::vector<std::size_t> const& offset,
+                       std::vector<std::size_t> const& size,
+                       std::vector<std::size_t> const& sampling,
+                       DataType dt,
+                       void* dest,
+                       std::size_t n) {
+   Ics_Error err = IcsGetROIDataAs(
+         ics,
+         offset.empty()   ? nullptr : offset.data(),
+         size.empty()     ? nullptr : size.data(),
+         sampling.empty() ? nullptr : sampling.data(),
+         ToIcsDataType(dt), dest, n);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+// Read a square region of the image from an ICS file into a sub-block of a
+// memory block, converted to the given type. To use the defaults in one of the
+// parameters, pass an empty vector. Only valid if reading.
+void ICS::GetROIDataWithStridesAs(std::vector<std::size_t> const& offset,
+                                  std::vector<std::size_t> const& size,
+                                  std::vector<std::size_t> const& sampling,
+                                  DataType dt,
+                                  void* dest,
+                                  std::size_t n,
+                                  std::vector<std::ptrdiff_t> const& stride) {
+   Ics_Error err = IcsGetROIDataWithStridesAs(
+         ics,
+         offset.empty()   ? nullptr : offset.data(),
+         size.empty()     ? nullptr : size.data(),
+         sampling.empty() ? nullptr : sampling.data(),
+         ToIcsDataType(dt), dest, n,
+         stride.empty() ? nullptr : stride.data(),
+         stride.empty() ? (ics ? ics->dimensions : 0) : static_cast<int>(stride.size()));
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+// Read the image from an ICS file into a sub-block of a memory block, converted
+// to the given type. To use the defaults strides, pass an empty vector. Only
+// valid if reading.
+void ICS::GetDataWithStridesAs(DataType dt, void* dest, std::vector<std::ptrdiff_t> const& stride) {
+   Ics_Error err = IcsGetDataWithStridesAs(
+         ics, ToIcsDataType(dt), dest, 0,
+         stride.empty() ? nullptr : stride.data(),
+         stride.empty() ? (ics ? ics->dimensions : 0) : static_cast<int>(stride.size()));
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+// Set the scale and offset applied to the imels when they are converted to
+// another type.
+void ICS::SetConversionScale(double scale, double offset) {
+   Ics_Error err = IcsSetConversionScale(ics, scale, offset);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
 
 // Read a portion of the image data from an ICS file. Only valid if reading.
 void ICS::GetDataBlock(void *dest, std::size_t n) {
@@ -254,6 +392,47 @@ void ICS::SetDataWithStrides(void const* src,
    }
 }
 
+void ICS::SetDataAs(DataType dt, void const* src, std::size_t n) {
+   Ics_Error err = IcsSetDataAs(ics, ToIcsDataType(dt), src, n);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+void ICS::OpenWriteStream() {
+   Ics_Error err = IcsOpenWriteStream(ics);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+void ICS::WriteDataBlock(void const* src, std::size_t n) {
+   Ics_Error err = IcsWriteDataBlock(ics, src, n);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+void ICS::FinishWrite() {
+   Ics_Error err = IcsFinishWrite(ics);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+std::vector<unsigned char> ICS::WriteMemory() {
+   void* buf;
+   std::size_t len;
+   Ics_Error err = IcsWriteMemory(ics, &buf, &len);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+   std::vector<unsigned char> out(static_cast<unsigned char*>(buf),
+                                  static_cast<unsigned char*>(buf) + len);
+   std::free(buf);
+   return out;
+}
+
 void ICS::SetSource(std::string const& fname, std::size_t offset) {
    Ics_Error err = IcsSetSource(ics, fname.c_str(), offset);
    if (err != IcsErr_Ok) {
@@ -271,17 +450,129 @@ void ICS::SetByteOrder(ByteOrder order) {
    }
 }
 
+void ICS::SetHeaderPadding(std::size_t n) {
+   Ics_Error err = IcsSetHeaderPadding(ics, n);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
 void ICS::SetCompression(Compression compression, int level) {
-   Ics_Error err = IcsSetCompression(
-         ics,
-         compression == Compression::GZip ? IcsCompr_gzip
-                                          : IcsCompr_uncompressed,
-         level );
+   Ics_Compression type;
+   switch( compression ) {
+      default:
+      //case Compression::Uncompressed:
+         type = IcsCompr_uncompressed;
+         break;
+      case Compression::GZip:
+         type = IcsCompr_gzip;
+         break;
+      case Compression::ChunkedGZip:
+         type = IcsCompr_chunked_gzip;
+         break;
+      case Compression::Zstd:
+         type = IcsCompr_zstd;
+         break;
+   }
+   Ics_Error err = IcsSetCompression(ics, type, level);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+void ICS::SetCompressionThreads(int nThreads) {
+   Ics_Error err = IcsSetCompressionThreads(ics, nThreads);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+void ICS::SetChunkSize(std::vector<std::size_t> const& chunkSize) {
+   Ics_Error err = IcsSetChunkSize(ics, chunkSize.data());
    if (err != IcsErr_Ok) {
       throw std::runtime_error(IcsGetErrorText(err));
    }
 }
 
+std::vector<std::size_t> ICS::GetChunkSize() const {
+   std::vector<std::size_t> chunkSize(ICS_MAXDIM);
+   Ics_Error err = IcsGetChunkSize(ics, chunkSize.data());
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+   chunkSize.resize(static_cast<std::size_t>(ics->dimensions));
+   return chunkSize;
+}
+
+void ICS::SetFilter(Filter filter) {
+   Ics_Filter type;
+   switch( filter ) {
+      default:
+      //case Filter::None:
+         type = IcsFilter_none;
+         break;
+      case Filter::Shuffle:
+         type = IcsFilter_shuffle;
+         break;
+      case Filter::BitShuffle:
+         type = IcsFilter_bitshuffle;
+         break;
+   }
+   Ics_Error err = IcsSetFilter(ics, type);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+Filter ICS::GetFilter() const {
+   Ics_Filter type;
+   Ics_Error err = IcsGetFilter(ics, &type);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+   switch( type ) {
+      default:
+      //case IcsFilter_none:
+         return Filter::None;
+      case IcsFilter_shuffle:
+         return Filter::Shuffle;
+      case IcsFilter_bitshuffle:
+         return Filter::BitShuffle;
+   }
+}
+
+void ICS::SetPredictor(Predictor predictor) {
+   Ics_Predictor type;
+   switch( predictor ) {
+      default:
+      //case Predictor::None:
+         type = IcsPredictor_none;
+         break;
+      case Predictor::Horizontal:
+         type = IcsPredictor_horizontal;
+         break;
+   }
+   Ics_Error err = IcsSetPredictor(ics, type);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+}
+
+Predictor ICS::GetPredictor() const {
+   Ics_Predictor type;
+   Ics_Error err = IcsGetPredictor(ics, &type);
+   if (err != IcsErr_Ok) {
+      throw std::runtime_error(IcsGetErrorText(err));
+   }
+   switch( type ) {
+      default:
+      //case IcsPredictor_none:
+         return Predictor::None;
+      case IcsPredictor_horizontal:
+         return Predictor::Horizontal;
+   }
+}
+
 Units ICS::GetPosition(int dimension) const {
    char const* str;
    Units units;
@@ -85,12 +85,26 @@ enum class DataType {
    Real32,    // real,    signed,   32 bpp
    Real64,    // real,    signed,   64 bpp
    Complex32, // complex, signed, 2*32 bpp
-   Complex64  // complex, signed, 2*64 bpp
+   Complex64, // complex, signed, 2*64 bpp
+   Binary     // integer, unsigned,  1 bpp, one byte per imel in memory
 };
 
 enum class Compression {
    Uncompressed, // No compression
-   GZip          // Using zlib (ICS_ZLIB must be defined)
+   GZip,         // Using zlib (ICS_ZLIB must be defined)
+   ChunkedGZip,  // Independently gzipped chunks (ICS_ZLIB must be defined)
+   Zstd          // Using zstd (ICS_ZSTD must be defined)
+};
+
+enum class Filter {
+   None,      // No filter
+   Shuffle,   // Group the n-th byte of all imels in a line
+   BitShuffle // Group the n-th bit of all imels in a line
+};
+
+enum class Predictor {
+   None,      // No predictor
+   Horizontal // Store the difference with the previous imel in a line
 };
 
 enum class ByteOrder {
@@ -204,6 +218,12 @@ public:
    // other locale, set the locale properly then open the file with "rl").
    ICSCPPEXPORT void Open(std::string const& filename, std::string const& mode);
 
+   // Open an ICS version 2.0 file held in memory. For reading (mode = "r"),
+   // `buf` points to `len` bytes that must remain valid until Close is called.
+   // For writing (mode = "w"), `buf` must be null and `len` 0; nothing is
+   // written to disk, use WriteMemory to obtain the file.
+   ICSCPPEXPORT void OpenMemory(void const* buf, std::size_t len, std::string const& mode);
+
    // Close the ICS file. The ICS object is no longer associated to a file after
    // calling this function.  No files are actually written until this function is
    // called. Note that the destructor calls this function before exiting.
@@ -236,11 +256,68 @@ public:
                                 void* dest,
                                 std::size_t n);
 
+   // Read a square region of the image from an ICS file using nThreads
+   // threads, or one per processor if nThreads is 0. To use the defaults in one
+   // of the parameters, pass an empty vector. Only valid if reading.
+   ICSCPPEXPORT void GetROIDataParallel(std::vector<std::size_t> const& offset,
+                                        std::vector<std::size_t> const& size,
+                                        std::vector<std::size_t> const& sampling,
+                                        void* dest,
+                                        std::size_t n,
+                                        int nThreads = 0);
+
+   // Read a square region of the image from an ICS file into a sub-block of a
+   // memory block. To use the defaults in one of the parameters, pass an empty
+   // vector; n is used only if the strides are the default ones. Only valid if
+   // reading.
+   ICSCPPEXPORT void GetROIDataWithStrides(std::vector<std::size_t> const& offset,
+                                           std::vector<std::size_t> const& size,
+                                           std::vector<std::size_t> const& sampling,
+                                           void* dest,
+                                           std::size_t n,
+                                           std::vector<std::ptrdiff_t> const& stride);
+
    // Read the image from an ICS file into a sub-block of a memory block. To use
    // the defaults strides, pass an empty vector. Only valid if reading.
    ICSCPPEXPORT void GetDataWithStrides(void* dest,
                                         std::vector<std::ptrdiff_t> const& stride);
 
+   // Read the image data from an ICS file, converted to the given type. Only
+   // valid if reading.
+   ICSCPPEXPORT void GetDataAs(DataType dt, void* dest, std::size_t n);
+
+   // Read a square region of the image from an ICS file, converted to the
+   // given type. To use the defaults in one of the parameters, pass an empty
+   // vector. Only valid if reading.
+   ICSCPPEXPORT void GetROIDataAs(std::vector<std::size_t> const& offset,
+                                  std::vector<std::size_t> const& size,
+                                  std::vector<std::size_t> const& sampling,
+                                  DataType dt,
+                                  void* dest,
+                                  std::size_t n);
+
+   // Read a square region of the image from an ICS file into a sub-block of a
+   // memory block, converted to the given type. To use the defaults in one of
+   // the parameters, pass an empty vector. Only valid if reading.
+   ICSCPPEXPORT void GetROIDataWithStridesAs(std::vector<std::size_t> const& offset,
+                                             std::vector<std::size_t> const& size,
+                                             std::vector<std::size_t> const& sampling,
+                                             DataType dt,
+                                             void* dest,
+                                             std::size_t n,
+                                             std::vector<std::ptrdiff_t> const& stride);
+
+   // Read the image from an ICS file into a sub-block of a memory block,
+   // converted to the given type. To use the defaults strides, pass an empty
+   // vector. Only valid if reading.
+   ICSCPPEXPORT void GetDataWithStridesAs(DataType dt,
+                                          void* dest,
+                                          std::vector<std::ptrdiff_t> const& stride);
+
+   // Set the scale and offset applied to the imels when they are converted to
+   // another type: value * scale + offset.
+   ICSCPPEXPORT void SetConversionScale(double scale, double offset);
+
    // Read a portion of the image data from an ICS file. Only valid if reading.
    ICSCPPEXPORT void GetDataBlock(void *dest, std::size_t n);
 
@@ -263,6 +340,29 @@ public:
                                         std::size_t n,
                                         std::vector<ptrdiff_t> const& strides);
 
+   // Set the image data for an ICS image, given in another data type. The data
+   // is converted to the type set with SetLayout when it is written. The
+   // pointer to this data must be accessible until Close has been called. Only
+   // valid if writing.
+   ICSCPPEXPORT void SetDataAs(DataType dt, void const* src, std::size_t n);
+
+   // Write the header and prepare for writing the image data in blocks with
+   // WriteDataBlock, instead of giving all data with SetData. All other
+   // parameters must have been set before this call. Only valid if writing.
+   ICSCPPEXPORT void OpenWriteStream();
+
+   // Append a block of image data, in the order in which it is stored in the
+   // file. Only valid after OpenWriteStream.
+   ICSCPPEXPORT void WriteDataBlock(void const* src, std::size_t n);
+
+   // Finish writing the image data started with OpenWriteStream. Called by
+   // Close if needed.
+   ICSCPPEXPORT void FinishWrite();
+
+   // Write the header and image data of an ICS version 2.0 file into a buffer.
+   // Only valid if writing.
+   ICSCPPEXPORT std::vector<unsigned char> WriteMemory();
+
    // Set the image source parameter for an ICS version 2.0 file. Only valid if
    // writing.
    ICSCPPEXPORT void SetSource(std::string const& fname, std::size_t offset);
@@ -273,10 +373,41 @@ public:
    // not be correct.
    ICSCPPEXPORT void SetByteOrder(ByteOrder order);
 
+   // Reserve `n` bytes of padding between the header and the image data of an
+   // ICS version 2.0 file, so that the header can later be updated in place.
+   // Only valid if writing or updating.
+   ICSCPPEXPORT void SetHeaderPadding(std::size_t n);
+
    // Set the compression method and compression parameter. Only valid if
    // writing.
    ICSCPPEXPORT void SetCompression(Compression compression, int level = 9);
 
+   // Set the number of threads used to compress the data, or to decompress
+   // chunked data when reading. 0 means one thread per processor.
+   ICSCPPEXPORT void SetCompressionThreads(int nThreads);
+
+   // Set the size of the chunks for Compression::ChunkedGZip, one element per
+   // dimension. 0 selects the default size. Only valid if writing, after
+   // calling SetLayout.
+   ICSCPPEXPORT void SetChunkSize(std::vector<std::size_t> const& chunkSize);
+
+   // Get the size of the chunks in which the data is stored.
+   ICSCPPEXPORT std::vector<std::size_t> GetChunkSize() const;
+
+   // Set the filter applied to the data before compression. Only valid if
+   // writing.
+   ICSCPPEXPORT void SetFilter(Filter filter);
+
+   // Get the filter applied to the data before compression.
+   ICSCPPEXPORT Filter GetFilter() const;
+
+   // Set the predictor applied to integer data before compression. Only valid
+   // if writing.
+   ICSCPPEXPORT void SetPredictor(Predictor predictor);
+
+   // Get the predictor applied to the data before compression.
+   ICSCPPEXPORT Predictor GetPredictor() const;
+
    // Get the position of the image in the real world: the origin of the first
    // pixel, the distances between pixels and the units in which to measure.
    // Dimensions start at 0. Only valid if reading.
@@ -87,6 +87,7 @@ void mexFunction (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
          class = mxINT8_CLASS;
          elemsize = 1;
          break;
+      case Ics_binary:
       case Ics_uint8:
          class = mxUINT8_CLASS;
          elemsize = 1;
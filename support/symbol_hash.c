@@ -0,0 +1,125 @@
+/*
+ * libics: Image Cytometry Standard file reading and writing.
+ *
+ * Copyright (C) 2025 Cris Luengo and others
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * FILE : support/symbol_hash.c
+ *
+ * Generates the perfect hash tables for the symbol lists in libics_data.c.
+ * Whenever symbols are added, removed or renamed, build and run this program
+ * from the libics root directory:
+ *
+ *    cc -I. -o symbol_hash support/symbol_hash.c && ./symbol_hash
+ *
+ * and replace the generated block at the end of libics_data.c with its output.
+ */
+
+
+#define ICS_SYMBOL_HASH_GENERATOR
+#include "../libics_data.c"
+
+
+#define MAX_BITS  10
+#define MAX_SEEDS (1u << 24)
+
+
+/* Find the smallest table, and for that the first seed, for which the hash of
+   no two names collide. */
+static int findHash(const Ics_Symbol *list,
+                    int               entries,
+                    int              *bits,
+                    ics_t_uint32     *seed,
+                    signed char      *table)
+{
+    ics_t_uint32 mask;
+    int          i;
+
+
+    for (*bits = 1; (1 << *bits) < entries; (*bits)++);
+    for (; *bits <= MAX_BITS; (*bits)++) {
+        mask = ((ics_t_uint32)1 << *bits) - 1;
+        for (*seed = 0; *seed < MAX_SEEDS; (*seed)++) {
+            memset(table, -1, (size_t)1 << *bits);
+            for (i = 0; i < entries; i++) {
+                ics_t_uint32 h = IcsSymbolHash(list[i].name, *seed) & mask;
+                if (table[h] >= 0) break;
+                table[h] = (signed char)i;
+            }
+            if (i == entries) return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int printList(const char       *listName,
+                     const char       *symbolsName,
+                     const char       *hashName,
+                     const Ics_Symbol *list,
+                     int               entries)
+{
+    signed char  table[1 << MAX_BITS];
+    ics_t_uint32 seed;
+    int          bits;
+    int          i;
+
+
+    if (!findHash(list, entries, &bits, &seed, table)) {
+        fprintf(stderr, "No perfect hash found for %s\n", listName);
+        return 0;
+    }
+    printf("static const signed char %s[%d] =\n{", hashName, 1 << bits);
+    for (i = 0; i < (1 << bits); i++) {
+        printf("%s%3d%s", i % 16 ? " " : "\n    ", table[i],
+               i + 1 < (1 << bits) ? "," : "");
+    }
+    printf("\n};\n\n\n");
+    printf("typedef char icsCheck%s[\n    sizeof(%s) / sizeof(Ics_Symbol) == %d "
+           "? 1 : -1];\n\n\n", hashName + 2, symbolsName, entries);
+    printf("Ics_SymbolList %s =\n{\n", listName);
+    printf("    sizeof(%s) / sizeof(Ics_Symbol),\n", symbolsName);
+    printf("    %s,\n", symbolsName);
+    printf("    0x%08lxu,\n", (unsigned long)seed);
+    printf("    %d,\n", bits);
+    printf("    %s\n};\n\n\n", hashName);
+    return 1;
+}
+
+
+#define PRINT_LIST(LIST, SYMBOLS, HASH)                                  \
+    printList(#LIST, #SYMBOLS, #HASH, SYMBOLS,                           \
+              (int)(sizeof(SYMBOLS) / sizeof(Ics_Symbol)))
+
+
+int main(void)
+{
+    printf("/* Perfect hash tables for the symbol lists above, generated by\n"
+           "   support/symbol_hash.c. Regenerate them when changing the lists; "
+           "the checks\n   below fail to compile when the number of symbols "
+           "changes. */\n");
+    printf("#ifndef ICS_SYMBOL_HASH_GENERATOR\n\n\n");
+    if (!PRINT_LIST(G_Categories, G_CatSymbols, G_CatHash)) return 1;
+    if (!PRINT_LIST(G_SubCategories, G_SubCatSymbols, G_SubCatHash)) return 1;
+    if (!PRINT_LIST(G_SubSubCategories, G_SubSubCatSymbols, G_SubSubCatHash)) {
+        return 1;
+    }
+    if (!PRINT_LIST(G_Values, G_ValueSymbols, G_ValueHash)) return 1;
+    printf("#endif\n");
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+#define NX 67
+#define NY 45
+#define NZ 3
+#define N (NX * NY * NZ)
+
+/* Checks the result of a read. */
+static void check(Ics_Error retval, int ok, const char* what) {
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read %s: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (!ok) {
+      fprintf(stderr, "Data read %s not as expected.\n", what);
+      exit(-1);
+   }
+}
+
+/* Opens the file for writing a binary image. */
+static ICS* open_write(const char* filename, Ics_Compression compression) {
+   ICS*      ip;
+   size_t    dims[3] = {NX, NY, NZ};
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_binary, 3, dims);
+   IcsSetCompression(ip, compression, 6);
+   return ip;
+}
+
+/* Closes the file after writing. */
+static void close_write(ICS* ip, const char* what) {
+   Ics_Error retval;
+
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write %s: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+/* Reads the binary image back in several ways and compares it to mask. */
+static void check_file(const char* filename, const unsigned char* mask,
+                       int uncompressed) {
+   ICS*           ip;
+   Ics_DataType   dt;
+   int            ndims;
+   size_t         dims[ICS_MAXDIM];
+   size_t         offset[3] = {3, 5, 1};
+   size_t         size[3] = {50, 30, 2};
+   size_t         sampling[3] = {3, 2, 1};
+   ptrdiff_t      strides[3] = {NY, 1, NX * NY};
+   unsigned char  buf[N];
+   float          f[N];
+   const void*    map;
+   size_t         x, y, z, ii;
+   int            ok = 1;
+   Ics_Error      retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   if (dt != Ics_binary || IcsGetDataSize(ip) != N) {
+      fprintf(stderr, "Binary image read with the wrong layout.\n");
+      exit(-1);
+   }
+
+   /* As a whole */
+   retval = IcsGetData(ip, buf, N);
+   check(retval, memcmp(buf, mask, N) == 0, "binary data");
+
+   /* A subsampled region */
+   check(IcsGetROIData(ip, offset, size, sampling, buf, 17 * 15 * 2), 1,
+         "ROI");
+   ii = 0;
+   for (z = offset[2]; z < offset[2] + size[2]; z += sampling[2]) {
+      for (y = offset[1]; y < offset[1] + size[1]; y += sampling[1]) {
+         for (x = offset[0]; x < offset[0] + size[0]; x += sampling[0]) {
+            ok &= buf[ii++] == mask[(z * NY + y) * NX + x];
+         }
+      }
+   }
+   check(IcsErr_Ok, ok, "ROI");
+
+   /* Into a transposed destination */
+   check(IcsGetDataWithStrides(ip, buf, N, strides, 3), 1, "with strides");
+   for (z = 0; z < NZ; z++) {
+      for (y = 0; y < NY; y++) {
+         for (x = 0; x < NX; x++) {
+            ok &= buf[(z * NX + x) * NY + y] == mask[(z * NY + y) * NX + x];
+         }
+      }
+   }
+   check(IcsErr_Ok, ok, "with strides");
+
+   /* Converted to float */
+   check(IcsGetDataAs(ip, Ics_real32, f, sizeof(f)), 1, "as float");
+   for (ii = 0; ii < N; ii++) {
+      ok &= f[ii] == (float)mask[ii];
+   }
+   check(IcsErr_Ok, ok, "as float");
+
+   /* Mapped */
+   retval = IcsMapData(ip, &map, NULL);
+   check(retval, memcmp(map, mask, N) == 0, "mapped");
+
+   /* At an offset that is not at the start of a byte */
+   if (uncompressed) {
+      retval = IcsOpenIds(ip);
+      if (retval == IcsErr_Ok) {
+         retval = IcsReadIdsAt(ip, 1003, buf, 3);
+      }
+      if (retval == IcsErr_Ok) {
+         retval = IcsReadIdsAt(ip, 1006, buf + 3, 2017);
+      }
+      check(retval, memcmp(buf, mask + 1003, 2020) == 0, "at offset");
+   }
+   IcsClose(ip);
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*           ip;
+   unsigned char* mask;
+   unsigned char  values[N];
+   unsigned char  transposed[N];
+   float          f[N];
+   ptrdiff_t      strides[3] = {NY, 1, NX * NY};
+   size_t         x, y, z, ii, n;
+   void*          buf;
+   size_t         len;
+   FILE*          fp;
+   long           fsize;
+   Ics_Error      retval;
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   /* A mask, and the same mask with values other than 1 for true */
+   mask = malloc(N);
+   if (mask == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N; ii++) {
+      mask[ii] = (unsigned char)((ii * 2654435761u >> 13) & 1);
+      values[ii] = (unsigned char)(mask[ii] * (ii % 255 + 1));
+   }
+
+   /* Uncompressed; eight imels go into each byte of the IDS file */
+   retval = IcsOpen(&ip, argv[1], "w1");
+   if (retval == IcsErr_Ok) {
+      size_t dims[3] = {NX, NY, NZ};
+      IcsSetLayout(ip, Ics_binary, 3, dims);
+      IcsSetData(ip, values, N);
+      retval = IcsClose(ip);
+   }
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write version 1 file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   len = strlen(argv[1]);
+   if (len >= 4 && strcmp(argv[1] + len - 4, ".ics") == 0) {
+      char idsname[1024];
+      snprintf(idsname, sizeof(idsname), "%.*s.ids", (int)(len - 4), argv[1]);
+      fp = fopen(idsname, "rb");
+      if (fp == NULL) {
+         fprintf(stderr, "Could not open the IDS file.\n");
+         exit(-1);
+      }
+      fseek(fp, 0, SEEK_END);
+      fsize = ftell(fp);
+      fclose(fp);
+      if (fsize != (N + 7) / 8) {
+         fprintf(stderr, "Binary data was not packed into bits.\n");
+         exit(-1);
+      }
+   }
+   check_file(argv[1], mask, 1);
+   ip = open_write(argv[1], IcsCompr_uncompressed);
+   IcsSetData(ip, values, N);
+   close_write(ip, "binary data");
+   check_file(argv[1], mask, 1);
+
+#ifdef ICS_ZLIB
+   ip = open_write(argv[1], IcsCompr_gzip);
+   IcsSetData(ip, mask, N);
+   close_write(ip, "compressed binary data");
+   check_file(argv[1], mask, 0);
+
+   /* Bits are not split into chunks, this is written as gzip */
+   ip = open_write(argv[1], IcsCompr_chunked_gzip);
+   IcsSetData(ip, mask, N);
+   close_write(ip, "chunked binary data");
+   check_file(argv[1], mask, 0);
+#endif
+
+   /* From strided data */
+   for (z = 0; z < NZ; z++) {
+      for (y = 0; y < NY; y++) {
+         for (x = 0; x < NX; x++) {
+            transposed[(z * NX + x) * NY + y] = mask[(z * NY + y) * NX + x];
+         }
+      }
+   }
+   ip = open_write(argv[1], IcsCompr_uncompressed);
+   IcsSetDataWithStrides(ip, transposed, N, strides, 3);
+   close_write(ip, "binary data with strides");
+   check_file(argv[1], mask, 1);
+
+   /* Converted from float */
+   for (ii = 0; ii < N; ii++) {
+      f[ii] = mask[ii] ? 0.25f : 0.0f;
+   }
+   ip = open_write(argv[1], IcsCompr_uncompressed);
+   IcsSetDataAs(ip, Ics_real32, f, sizeof(f));
+   close_write(ip, "binary data from float");
+   check_file(argv[1], mask, 1);
+
+   /* In blocks that do not fill whole bytes */
+   ip = open_write(argv[1], IcsCompr_uncompressed);
+   retval = IcsOpenWriteStream(ip);
+   for (ii = 0; retval == IcsErr_Ok && ii < N; ii += n) {
+      n = ii % 3 == 0 ? 5 : ii % 3 == 1 ? 13 : 1000;
+      n = ii + n > N ? N - ii : n;
+      retval = IcsWriteDataBlock(ip, values + ii, n);
+   }
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write binary data in blocks: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   close_write(ip, "binary data in blocks");
+   check_file(argv[1], mask, 1);
+
+   /* In memory */
+   retval = IcsOpenMemory(&ip, NULL, 0, "w2");
+   if (retval == IcsErr_Ok) {
+      size_t dims[3] = {NX, NY, NZ};
+      IcsSetLayout(ip, Ics_binary, 3, dims);
+      IcsSetData(ip, mask, N);
+      retval = IcsWriteMemory(ip, &buf, &len);
+      IcsClose(ip);
+   }
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write binary data to memory: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsOpenMemory(&ip, buf, len, "r");
+   retval = IcsGetData(ip, values, N);
+   check(retval, memcmp(values, mask, N) == 0, "from memory");
+   IcsClose(ip);
+   free(buf);
+
+   free(mask);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_binary result_bin.ics
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+#define NIMELS (4 * 1024 * 1024 + 3)
+#define REPEATS 8
+
+/* Fill the byte order of the machine, as IcsFillByteOrder does. */
+static void machine_order(Ics_DataType dt, int bytes, int order[]) {
+   unsigned int one = 1;
+   int little = *(char*)&one;
+   int half = bytes / 2;
+   int ii;
+   for (ii = 0; ii < bytes; ii++) {
+      if (little) {
+         order[ii] = ii + 1;
+      } else if (dt == Ics_complex32 || dt == Ics_complex64) {
+         order[ii] = ii < half ? half - ii : bytes - (ii - half);
+      } else {
+         order[ii] = bytes - ii;
+      }
+   }
+}
+
+/* Reorders one buffer and checks it against a byte-by-byte reordering. */
+static int test_order(const char* name, Ics_DataType dt, int bytes,
+                      const int src[]) {
+   int     dst[ICS_MAX_IMEL_SIZE];
+   int     order[ICS_MAX_IMEL_SIZE];
+   size_t  length = (size_t)NIMELS * (size_t)bytes;
+   size_t  ii;
+   int     jj, kk;
+   char*   buf1;
+   char*   buf2;
+   clock_t start;
+   double  seconds;
+   Ics_Error retval;
+
+   buf1 = malloc(length);
+   buf2 = malloc(length);
+   if (buf1 == NULL || buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      return -1;
+   }
+   for (ii = 0; ii < length; ii++) {
+      buf1[ii] = (char)(ii * 7 + ii / 251);
+   }
+   machine_order(dt, bytes, dst);
+   for (jj = 0; jj < bytes; jj++) {
+      order[jj] = src[jj];
+   }
+
+   /* Correctness */
+   memcpy(buf2, buf1, length);
+   retval = IcsReorderIds(buf2, length, dt, order, bytes);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not reorder %s data: %s\n", name,
+              IcsGetErrorText(retval));
+      return -1;
+   }
+   for (ii = 0; ii < length; ii += (size_t)bytes) {
+      for (jj = 0; jj < bytes; jj++) {
+         for (kk = 0; kk < bytes; kk++) {
+            if (src[kk] == dst[jj]) break;
+         }
+         if (buf2[ii + (size_t)jj] != buf1[ii + (size_t)kk]) {
+            fprintf(stderr, "Reordered %s data is not correct.\n", name);
+            return -1;
+         }
+      }
+   }
+
+   /* Speed */
+   start = clock();
+   for (jj = 0; jj < REPEATS; jj++) {
+      IcsReorderIds(buf2, length, dt, order, bytes);
+   }
+   seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+   if (seconds > 0) {
+      printf("%-20s %6.2f GB/s\n", name,
+             (double)length * REPEATS / seconds / 1e9);
+   }
+
+   free(buf1);
+   free(buf2);
+   return 0;
+}
+
+int main(void) {
+   int big16[2] = {2, 1};
+   int big32[4] = {4, 3, 2, 1};
+   int big64[8] = {8, 7, 6, 5, 4, 3, 2, 1};
+   int bigc32[8] = {4, 3, 2, 1, 8, 7, 6, 5};
+   int bigc64[16] = {8, 7, 6, 5, 4, 3, 2, 1, 16, 15, 14, 13, 12, 11, 10, 9};
+   int little16[2] = {1, 2};
+   int little32[4] = {1, 2, 3, 4};
+   int little64[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+   int littlec32[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+   int littlec64[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+   int exotic32[4] = {3, 4, 1, 2};
+   unsigned int one = 1;
+   int little = *(char*)&one;
+
+   /* Each data type is converted from the byte order opposite the machine's */
+   if (test_order("uint16", Ics_uint16, 2, little ? big16 : little16) ||
+       test_order("real32", Ics_real32, 4, little ? big32 : little32) ||
+       test_order("real64", Ics_real64, 8, little ? big64 : little64) ||
+       test_order("complex32", Ics_complex32, 8, little ? bigc32 : littlec32) ||
+       test_order("complex64", Ics_complex64, 16, little ? bigc64 : littlec64) ||
+       test_order("sint32 (3 4 1 2)", Ics_sint32, 4, exotic32)) {
+      exit(-1);
+   }
+
+   exit(0);
+}
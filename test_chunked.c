@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+
+#define NX 300
+#define NY 200
+#define NZ 20
+
+/* Reads a region of the image and compares it with the original data. */
+static void read_roi(ICS* ip, const unsigned short* data, const size_t* offset,
+                     const size_t* size, const size_t* sampling) {
+   size_t          n = 1, ii, x, y, z;
+   unsigned short* buf;
+   unsigned short* p;
+   Ics_Error       retval;
+
+   for (ii = 0; ii < 3; ii++) {
+      n *= (size[ii] + sampling[ii] - 1) / sampling[ii];
+   }
+   buf = malloc(n * sizeof(unsigned short));
+   if (buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetROIData(ip, offset, size, sampling, buf,
+                          n * sizeof(unsigned short));
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read ROI: %s\n", IcsGetErrorText(retval));
+      exit(-1);
+   }
+   p = buf;
+   for (z = offset[2]; z < offset[2] + size[2]; z += sampling[2]) {
+      for (y = offset[1]; y < offset[1] + size[1]; y += sampling[1]) {
+         for (x = offset[0]; x < offset[0] + size[0]; x += sampling[0]) {
+            if (*p++ != data[x + NX * (y + NY * z)]) {
+               fprintf(stderr, "ROI data does not match at (%lu,%lu,%lu).\n",
+                       (unsigned long)x, (unsigned long)y, (unsigned long)z);
+               exit(-1);
+            }
+         }
+      }
+   }
+   free(buf);
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   size_t          chunks[3] = {64, 48, 8};
+   size_t          chunks2[3];
+   size_t          bufsize = NX * NY * NZ * sizeof(unsigned short);
+   size_t          offset1[3] = {10, 20, 3}, size1[3] = {100, 50, 10};
+   size_t          offset2[3] = {0, 0, 0}, size2[3] = {NX, NY, NZ};
+   size_t          offset3[3] = {63, 47, 7}, size3[3] = {2, 2, 2};
+   size_t          sampling1[3] = {1, 1, 1}, sampling2[3] = {7, 5, 3};
+   size_t          ii;
+   unsigned short* data;
+   unsigned short* buf;
+   Ics_Error       retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   /* Write an image as compressed chunks */
+   data = malloc(bufsize);
+   buf = malloc(bufsize);
+   if (data == NULL || buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < NX * NY * NZ; ii++) {
+      data[ii] = (unsigned short)((ii % NX) * (ii / NX % NY) + ii / (NX * NY)
+                                  + ((ii * 2654435761u) >> 29));
+   }
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetData(ip, data, bufsize);
+   IcsSetCompression(ip, IcsCompr_chunked_gzip, 6);
+   IcsSetCompressionThreads(ip, 4);
+   retval = IcsSetChunkSize(ip, chunks);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not set the chunk size: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Read it back */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetChunkSize(ip, chunks2);
+   if (chunks2[0] != chunks[0] || chunks2[1] != chunks[1] ||
+       chunks2[2] != chunks[2]) {
+      fprintf(stderr, "Chunk size in output file not same as written.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, buf, bufsize) != 0) {
+      fprintf(stderr, "Data in output file does not match data in input.\n");
+      exit(-1);
+   }
+
+   /* Read regions of the image, with more threads */
+   IcsSetCompressionThreads(ip, 0);
+   read_roi(ip, data, offset1, size1, sampling1);
+   read_roi(ip, data, offset2, size2, sampling2);
+   read_roi(ip, data, offset1, size1, sampling2);
+   read_roi(ip, data, offset3, size3, sampling1);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   free(data);
+   free(buf);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_chunked result_v2zc.ics
@@ -0,0 +1,290 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+#define NX 67
+#define NY 45
+#define NZ 3
+#define N (NX * NY * NZ)
+#define NHALF 8
+
+/* Writes the image with the given compression. */
+static void write_file(const char* filename, Ics_DataType dt, int ndims,
+                       const size_t* dims, const void* data, size_t bufsize,
+                       Ics_Compression compression) {
+   ICS*      ip;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, ndims, dims);
+   IcsSetData(ip, data, bufsize);
+   IcsSetCompression(ip, compression, 6);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+/* Opens the file for reading. */
+static ICS* open_file(const char* filename) {
+   ICS*      ip;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   return ip;
+}
+
+/* Checks the result of a read. */
+static void check(Ics_Error retval, int ok, const char* what) {
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read %s: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (!ok) {
+      fprintf(stderr, "Data read %s not as expected.\n", what);
+      exit(-1);
+   }
+}
+
+/* Writes the uint16 image and reads it back converted in several ways. */
+static void check_conversions(const char* filename,
+                              const unsigned short* data,
+                              Ics_Compression compression) {
+   ICS*          ip;
+   size_t        dims[3] = {NX, NY, NZ};
+   size_t        offset[3] = {3, 5, 1};
+   size_t        size[3] = {50, 30, 2};
+   size_t        sampling[3] = {3, 2, 1};
+   ptrdiff_t     strides[3] = {NY, 1, NX * NY};
+   float*        f;
+   double*       d;
+   short*        s;
+   unsigned char c[N];
+   size_t        x, y, z, ii;
+   double        v;
+   int           ok;
+
+   f = malloc(N * sizeof(float));
+   d = malloc(N * sizeof(double));
+   s = malloc(N * sizeof(short));
+   if (f == NULL || d == NULL || s == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   write_file(filename, Ics_uint16, 3, dims, data, N * sizeof(short),
+              compression);
+   ip = open_file(filename);
+
+   /* To float */
+   ok = 1;
+   check(IcsGetDataAs(ip, Ics_real32, f, N * sizeof(float)), 1, "as float");
+   for (ii = 0; ii < N; ii++) {
+      ok &= f[ii] == (float)data[ii];
+   }
+   check(IcsErr_Ok, ok, "as float");
+
+   /* Scaled to sint16, halves are rounded away from zero */
+   IcsSetConversionScale(ip, 0.5, -10000.0);
+   check(IcsGetDataAs(ip, Ics_sint16, s, N * sizeof(short)), 1, "scaled");
+   for (ii = 0; ii < N; ii++) {
+      v = data[ii] * 0.5 - 10000.0;
+      v = v < 0 ? v - 0.5 : v + 0.5;
+      ok &= s[ii] == (short)v;
+   }
+   check(IcsErr_Ok, ok, "scaled");
+   IcsSetConversionScale(ip, 1.0, 0.0);
+
+   /* To uint8, saturating */
+   check(IcsGetDataAs(ip, Ics_uint8, c, N), 1, "as uint8");
+   for (ii = 0; ii < N; ii++) {
+      ok &= c[ii] == (data[ii] > 255 ? 255 : data[ii]);
+   }
+   check(IcsErr_Ok, ok, "as uint8");
+
+   /* A subsampled region as double */
+   check(IcsGetROIDataAs(ip, offset, size, sampling, Ics_real64, d,
+                         17 * 15 * 2 * sizeof(double)), 1, "ROI");
+   ii = 0;
+   for (z = offset[2]; z < offset[2] + size[2]; z += sampling[2]) {
+      for (y = offset[1]; y < offset[1] + size[1]; y += sampling[1]) {
+         for (x = offset[0]; x < offset[0] + size[0]; x += sampling[0]) {
+            ok &= d[ii++] == (double)data[(z * NY + y) * NX + x];
+         }
+      }
+   }
+   check(IcsErr_Ok, ok, "ROI");
+
+   /* Into a transposed destination as float */
+   check(IcsGetDataWithStridesAs(ip, Ics_real32, f, 0, strides, 3), 1,
+         "with strides");
+   for (z = 0; z < NZ; z++) {
+      for (y = 0; y < NY; y++) {
+         for (x = 0; x < NX; x++) {
+            ok &= f[(z * NX + x) * NY + y] ==
+                  (float)data[(z * NY + y) * NX + x];
+         }
+      }
+   }
+   check(IcsErr_Ok, ok, "with strides");
+
+   /* Complex data can't be made from real data */
+   if (IcsGetDataAs(ip, Ics_complex32, f, N * sizeof(float)) !=
+       IcsErr_IllParameter) {
+      fprintf(stderr, "Real data was converted to complex.\n");
+      exit(-1);
+   }
+
+   IcsClose(ip);
+   free(f);
+   free(d);
+   free(s);
+}
+
+/* Writes float data converted to scaled uint16, and reads it back. */
+static void check_write(const char* filename, const float* data,
+                        Ics_Compression compression) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   unsigned short* u;
+   size_t          ii;
+   double          v;
+   int             ok = 1;
+   Ics_Error       retval;
+
+   u = malloc(N * sizeof(unsigned short));
+   if (u == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   if (IcsSetDataAs(ip, Ics_complex32, data, N * 8) != IcsErr_IllParameter) {
+      fprintf(stderr, "Complex data was accepted for a real image.\n");
+      exit(-1);
+   }
+   IcsSetConversionScale(ip, 2.0, 100.0);
+   IcsSetDataAs(ip, Ics_real32, data, N * sizeof(float));
+   IcsSetCompression(ip, compression, 6);
+   /* Writing the data must leave the header as it was */
+   retval = IcsWriteIcs(ip, NULL);
+   if (retval == IcsErr_Ok) retval = IcsWriteIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write converted data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (ip->data != data || ip->dataLength != N * sizeof(float) ||
+       ip->dataType != Ics_real32) {
+      fprintf(stderr, "Writing converted data modified the header.\n");
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write converted data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   ip = open_file(filename);
+   retval = IcsGetData(ip, u, N * sizeof(unsigned short));
+   for (ii = 0; ii < N; ii++) {
+      v = data[ii] * 2.0 + 100.0;
+      v = v < 0 ? 0 : v > 65535 ? 65535 : v + 0.5;
+      ok &= u[ii] == (unsigned short)v;
+   }
+   check(retval, ok, "data written converted");
+   IcsClose(ip);
+   free(u);
+}
+
+int main(int argc, const char* argv[]) {
+   unsigned short* data;
+   float*          fdata;
+   size_t          dims[1] = {NHALF};
+   float           values[NHALF] = {0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 1e6f,
+                                    5.9604645e-8f, 0.333333f};
+   unsigned short  bits[NHALF] = {0x0000, 0x3C00, 0xC000, 0x3800, 0x7BFF,
+                                  0x7C00, 0x0001, 0x3555};
+   unsigned short  half[NHALF];
+   float           back[NHALF];
+   ICS*            ip;
+   size_t          ii;
+   Ics_Error       retval;
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(N * sizeof(unsigned short));
+   if (data == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N; ii++) {
+      data[ii] = (unsigned short)(ii * 2654435761u >> 16);
+   }
+
+   check_conversions(argv[1], data, IcsCompr_uncompressed);
+#ifdef ICS_ZLIB
+   check_conversions(argv[1], data, IcsCompr_gzip);
+   check_conversions(argv[1], data, IcsCompr_chunked_gzip);
+#endif
+
+   /* Float data written as uint16; values out of range are clipped */
+   fdata = malloc(N * sizeof(float));
+   if (fdata == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N; ii++) {
+      fdata[ii] = (float)data[ii] * 0.375f - 3000.25f;
+   }
+   check_write(argv[1], fdata, IcsCompr_uncompressed);
+#ifdef ICS_ZLIB
+   check_write(argv[1], fdata, IcsCompr_gzip);
+   check_write(argv[1], fdata, IcsCompr_chunked_gzip);
+#endif
+#ifdef ICS_ZSTD
+   check_write(argv[1], fdata, IcsCompr_zstd);
+#endif
+   free(fdata);
+
+   /* Half precision, from and to single precision */
+   write_file(argv[1], Ics_real32, 1, dims, values, sizeof(values),
+              IcsCompr_uncompressed);
+   ip = open_file(argv[1]);
+   retval = IcsGetDataAs(ip, Ics_real16, half, sizeof(half));
+   check(retval, memcmp(half, bits, sizeof(bits)) == 0, "as real16");
+   IcsClose(ip);
+   write_file(argv[1], Ics_real16, 1, dims, bits, sizeof(bits),
+              IcsCompr_uncompressed);
+   ip = open_file(argv[1]);
+   retval = IcsGetDataAs(ip, Ics_real32, back, sizeof(back));
+   check(retval, back[1] == 1.0f && back[2] == -2.0f && back[4] == 65504.0f &&
+                 back[5] > 65504.0f && back[6] == 5.9604644775390625e-8f &&
+                 back[7] == 0.333251953125f, "from real16");
+   IcsClose(ip);
+
+   free(data);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_convert result_cv.ics
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+#include "test_util.h"
+
+#define NX 203
+#define NY 37
+#define NZ 5
+#define N (NX * NY * NZ)
+
+/* Seeks, reads a region, and writes with several threads, with strides and as
+   chunks, all with the given filter and predictor. */
+static void check_encoded(const char* filename, const unsigned short* data16,
+                          unsigned short* transposed, char* buf,
+                          unsigned short* roi, Ics_Filter filter,
+                          Ics_Predictor predictor) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   size_t          offsets[] = {5000, 123, 40601, 2 * NX, 70001, 0};
+   size_t          sizes[] = {2, 2 * NX, 7000, 2 * NX + 2, 6, 30000};
+   size_t          roi_offset[3] = {3, 5, 1}, roi_size[3] = {150, 20, 3};
+   size_t          roi_sampling[3] = {1, 3, 2};
+   ptrdiff_t       strides[3] = {1, NX * NZ, NX};
+   size_t          bufsize = N * sizeof(unsigned short);
+   size_t          ii, jj, kk, x, y, z;
+   const char*     data = (const char*)data16;
+   unsigned short* p;
+   Ics_Error       retval;
+
+   /* Seek forwards and backwards, to positions within lines */
+   write_image(filename, Ics_uint16, dims, data16, bufsize, NULL,
+               IcsCompr_gzip, 6, 1, filter, predictor);
+   check_encoding(filename, filter, predictor);
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsOpenIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   for (ii = 0; ii < sizeof(offsets) / sizeof(offsets[0]); ii++) {
+      read_at(ip, data, offsets[ii], sizes[ii], buf);
+      /* Continue reading where the previous read stopped */
+      retval = IcsReadIdsBlock(ip, buf, 1000);
+      if (retval != IcsErr_Ok ||
+          memcmp(data + offsets[ii] + sizes[ii], buf, 1000) != 0) {
+         fprintf(stderr, "Could not continue reading.\n");
+         exit(-1);
+      }
+   }
+   retval = IcsCloseIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Read a region */
+   retval = IcsGetROIData(ip, roi_offset, roi_size, roi_sampling, roi,
+                          150 * 7 * 2 * sizeof(unsigned short));
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read ROI: %s\n", IcsGetErrorText(retval));
+      exit(-1);
+   }
+   p = roi;
+   for (z = roi_offset[2]; z < roi_offset[2] + roi_size[2];
+        z += roi_sampling[2]) {
+      for (y = roi_offset[1]; y < roi_offset[1] + roi_size[1];
+           y += roi_sampling[1]) {
+         for (x = roi_offset[0]; x < roi_offset[0] + roi_size[0];
+              x += roi_sampling[0]) {
+            if (*p++ != data16[x + NX * (y + NY * z)]) {
+               fprintf(stderr, "ROI data does not match.\n");
+               exit(-1);
+            }
+         }
+      }
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Multiple threads */
+   write_image(filename, Ics_uint16, dims, data16, bufsize, NULL,
+               IcsCompr_gzip, 6, 4, filter, predictor);
+   check_data(filename, data16, bufsize, buf);
+
+   /* Strided data, with the 2nd and 3rd dimension swapped in memory */
+   for (kk = 0; kk < NZ; kk++) {
+      for (jj = 0; jj < NY; jj++) {
+         memcpy(transposed + (ptrdiff_t)jj * strides[1]
+                           + (ptrdiff_t)kk * strides[2],
+                data16 + (jj + kk * NY) * NX, NX * sizeof(unsigned short));
+      }
+   }
+   write_image(filename, Ics_uint16, dims, transposed, bufsize, strides,
+               IcsCompr_gzip, 6, 1, filter, predictor);
+   check_data(filename, data16, bufsize, buf);
+   write_image(filename, Ics_uint16, dims, transposed, bufsize, strides,
+               IcsCompr_gzip, 6, 3, filter, predictor);
+   check_data(filename, data16, bufsize, buf);
+
+   /* Chunked data */
+   write_image(filename, Ics_uint16, dims, transposed, bufsize, strides,
+               IcsCompr_chunked_gzip, 6, 2, filter, predictor);
+   check_encoding(filename, filter, predictor);
+   check_data(filename, data16, bufsize, buf);
+}
+
+int main(int argc, const char* argv[]) {
+   size_t          dims[3] = {NX, NY, NZ};
+   Ics_DataType    types[] = {Ics_uint8, Ics_uint16, Ics_sint32, Ics_real64,
+                              Ics_complex32};
+   size_t          typesizes[] = {1, 2, 4, 8, 8};
+   Ics_DataType    inttypes[] = {Ics_uint8, Ics_sint16, Ics_uint32,
+                                 Ics_sint64};
+   size_t          inttypesizes[] = {1, 2, 4, 8};
+   Ics_Filter      filters[] = {IcsFilter_shuffle, IcsFilter_bitshuffle};
+   size_t          ii, tt, ff;
+   size_t          bufsize;
+   unsigned char*  data;
+   unsigned short* data16;
+   unsigned short* transposed;
+   unsigned short* roi;
+   float*          dataf;
+   char*           buf;
+   long            plain, encoded;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(N * 8);
+   transposed = malloc(N * 8);
+   buf = malloc(N * 8);
+   roi = malloc(N * sizeof(unsigned short));
+   if (data == NULL || transposed == NULL || buf == NULL || roi == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+
+   /* Each data type with each filter */
+   for (tt = 0; tt < sizeof(types) / sizeof(types[0]); tt++) {
+      for (ii = 0; ii < N * typesizes[tt]; ii++) {
+         data[ii] = (unsigned char)((ii / typesizes[tt]) % NX
+                                    + ((ii * 2654435761u) >> 30));
+      }
+      bufsize = N * typesizes[tt];
+      for (ff = 0; ff < 2; ff++) {
+         write_image(argv[1], types[tt], dims, data, bufsize, NULL,
+                     IcsCompr_gzip, 6, 1, filters[ff], IcsPredictor_none);
+         check_encoding(argv[1], filters[ff], IcsPredictor_none);
+         check_data(argv[1], data, bufsize, buf);
+      }
+   }
+
+   /* Each integer type predicted, with and without filter */
+   for (tt = 0; tt < sizeof(inttypes) / sizeof(inttypes[0]); tt++) {
+      for (ii = 0; ii < N * inttypesizes[tt]; ii++) {
+         data[ii] = (unsigned char)((ii / inttypesizes[tt]) % NX
+                                    + ((ii * 2654435761u) >> 30));
+      }
+      bufsize = N * inttypesizes[tt];
+      write_image(argv[1], inttypes[tt], dims, data, bufsize, NULL,
+                  IcsCompr_gzip, 6, 1, IcsFilter_none,
+                  IcsPredictor_horizontal);
+      check_encoding(argv[1], IcsFilter_none, IcsPredictor_horizontal);
+      check_data(argv[1], data, bufsize, buf);
+      write_image(argv[1], inttypes[tt], dims, data, bufsize, NULL,
+                  IcsCompr_gzip, 6, 1, IcsFilter_shuffle,
+                  IcsPredictor_horizontal);
+      check_data(argv[1], data, bufsize, buf);
+   }
+
+   /* Floating-point data is not predicted */
+   dataf = (float*)data;
+   for (ii = 0; ii < N; ii++) {
+      dataf[ii] = (float)(ii % NX) * 0.25f;
+   }
+   bufsize = N * sizeof(float);
+   write_image(argv[1], Ics_real32, dims, data, bufsize, NULL, IcsCompr_gzip,
+               6, 1, IcsFilter_none, IcsPredictor_horizontal);
+   check_encoding(argv[1], IcsFilter_none, IcsPredictor_none);
+   check_data(argv[1], data, bufsize, buf);
+
+   /* Smooth 16-bit data compresses better when predicted */
+   data16 = (unsigned short*)data;
+   for (ii = 0; ii < N; ii++) {
+      data16[ii] = (unsigned short)(1000 + 50 * (ii % NX) + (ii / NX) % NY
+                                    + ((ii * 2654435761u) >> 30));
+   }
+   bufsize = N * sizeof(unsigned short);
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_gzip,
+               6, 1, IcsFilter_none, IcsPredictor_none);
+   plain = file_size(argv[1]);
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_gzip,
+               6, 1, IcsFilter_none, IcsPredictor_horizontal);
+   encoded = file_size(argv[1]);
+   if (encoded >= plain) {
+      fprintf(stderr, "Predicted data does not compress better.\n");
+      exit(-1);
+   }
+
+   /* Noisier, it compresses better when shuffled */
+   for (ii = 0; ii < N; ii++) {
+      data16[ii] = (unsigned short)(1000 + 50 * (ii % NX) + (ii / NX) % NY
+                                    + ((ii * 2654435761u) >> 29));
+   }
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_gzip,
+               6, 1, IcsFilter_none, IcsPredictor_none);
+   plain = file_size(argv[1]);
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_gzip,
+               6, 1, IcsFilter_shuffle, IcsPredictor_none);
+   encoded = file_size(argv[1]);
+   if (encoded >= plain) {
+      fprintf(stderr, "Shuffled data does not compress better.\n");
+      exit(-1);
+   }
+
+   /* Seeking, regions, threads, strides and chunks */
+   check_encoded(argv[1], data16, transposed, buf, roi, IcsFilter_shuffle,
+                 IcsPredictor_none);
+   check_encoded(argv[1], data16, transposed, buf, roi, IcsFilter_bitshuffle,
+                 IcsPredictor_none);
+   check_encoded(argv[1], data16, transposed, buf, roi, IcsFilter_none,
+                 IcsPredictor_horizontal);
+   check_encoded(argv[1], data16, transposed, buf, roi, IcsFilter_shuffle,
+                 IcsPredictor_horizontal);
+
+   free(data);
+   free(transposed);
+   free(buf);
+   free(roi);
+   exit(0);
+}
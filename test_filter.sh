@@ -0,0 +1 @@
+./test_filter result_v2zf.ics
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+#define NX 1000
+#define NY 1000
+#define NZ 12
+#define CHUNK 100000
+
+/* Reads n bytes at offset through a seek, and compares them with the
+   original data. */
+static void read_at(ICS* ip, const char* data, size_t offset, size_t n,
+                    char* buf) {
+   Ics_Error retval;
+
+   retval = IcsSetIdsBlock(ip, (ptrdiff_t)offset, SEEK_SET);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not seek to %lu: %s\n", (unsigned long)offset,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsReadIdsBlock(ip, buf, n);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read at %lu: %s\n", (unsigned long)offset,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data + offset, buf, n) != 0) {
+      fprintf(stderr, "Data read at %lu does not match.\n",
+              (unsigned long)offset);
+      exit(-1);
+   }
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   size_t          bufsize = NX * NY * NZ * sizeof(unsigned short);
+   size_t          offsets[] = {15000000, 3000000, 23000000, 9000001, 0,
+                                9500000, 4194304, 12582912};
+   size_t          ii;
+   unsigned short* data;
+   char*           buf;
+   Ics_Error       retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   /* Write a gzip-compressed image spanning several index points */
+   data = malloc(bufsize);
+   buf = malloc(bufsize);
+   if (data == NULL || buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < NX * NY * NZ; ii++) {
+      data[ii] = (unsigned short)((ii % NX) * (ii / NX % NY) + ii / (NX * NY)
+                                  + ((ii * 2654435761u) >> 29));
+   }
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetData(ip, data, bufsize);
+   IcsSetCompression(ip, IcsCompr_gzip, 1);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Read it back, seeking forwards and backwards */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsOpenIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   for (ii = 0; ii < sizeof(offsets) / sizeof(offsets[0]); ii++) {
+      read_at(ip, (const char*)data, offsets[ii], CHUNK, buf);
+   }
+   /* Read to the end from a seek point, so the CRC is checked */
+   read_at(ip, (const char*)data, 13000000, bufsize - 13000000, buf);
+   retval = IcsCloseIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   /* The index is kept when the data is opened again */
+   retval = IcsOpenIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   read_at(ip, (const char*)data, 21000000, bufsize - 21000000, buf);
+   read_at(ip, (const char*)data, 5000000, CHUNK, buf);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   free(data);
+   free(buf);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_gzip_seek result_v2zs.ics
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+
+#define REPEAT 16
+#define PADDED 192 /* Line length in memory, more than the image width */
+
+/* Writes the image with several compression threads, reads it back and compares
+   it with the original. buflen is the size of buf, which can be larger than
+   the image of bufsize bytes. */
+static void write_and_compare(const char* name, Ics_DataType dt, int ndims,
+                              size_t* dims, const void* buf, size_t buflen,
+                              size_t bufsize, const ptrdiff_t* strides,
+                              const void* expected) {
+   ICS*      ip;
+   void*     buf2;
+   Ics_Error retval;
+
+   /* Write image */
+   retval = IcsOpen(&ip, name, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, ndims, dims);
+   if (strides) {
+      IcsSetDataWithStrides(ip, buf, buflen, strides, ndims);
+   } else {
+      IcsSetData(ip, buf, buflen);
+   }
+   IcsSetCompression(ip, IcsCompr_gzip, 6);
+   retval = IcsSetCompressionThreads(ip, 4);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not set the number of threads: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, name, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (bufsize != IcsGetDataSize(ip)) {
+      fprintf(stderr, "Data in output file not same size as written.\n");
+      exit(-1);
+   }
+   buf2 = malloc(bufsize);
+   if (buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf2, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read output image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(expected, buf2, bufsize) != 0) {
+      fprintf(stderr, "Data in output file does not match data in input.\n");
+      exit(-1);
+   }
+   free(buf2);
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*         ip;
+   Ics_DataType dt;
+   int          ndims;
+   size_t       dims[ICS_MAXDIM];
+   size_t       bufsize;
+   size_t       ii, jj, kk, nimels;
+   ptrdiff_t    strides[3];
+   unsigned short* buf1;
+   unsigned short* buf2;
+   unsigned short* buf3;
+   unsigned short* buf4;
+   Ics_Error    retval;
+
+
+   if (argc != 3) {
+      fprintf(stderr, "Two file names required: in out\n");
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   if (dt != Ics_uint16 || ndims != 3) {
+      fprintf(stderr, "Expected a 3D 16-bit image.\n");
+      exit(-1);
+   }
+   bufsize = IcsGetDataSize(ip);
+   nimels = bufsize / 2;
+   buf1 = malloc(bufsize * REPEAT);
+   if (buf1 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf1, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Make the image large enough to be split over many blocks */
+   for (ii = 1; ii < REPEAT; ii++) {
+      for (jj = 0; jj < nimels; jj++) {
+         buf1[ii * nimels + jj] = (unsigned short)(buf1[jj] + ii);
+      }
+   }
+   dims[2] *= REPEAT;
+   bufsize *= REPEAT;
+
+   /* Contiguous data */
+   write_and_compare(argv[2], dt, ndims, dims, buf1, bufsize, bufsize, NULL,
+                     buf1);
+
+   /* Strided data: the same image stored with the 2nd and 3rd dimensions
+      swapped in memory */
+   buf2 = malloc(bufsize);
+   if (buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (kk = 0; kk < dims[2]; kk++) {
+      for (jj = 0; jj < dims[1]; jj++) {
+         for (ii = 0; ii < dims[0]; ii++) {
+            buf2[ii + kk * dims[0] + jj * dims[0] * dims[2]] =
+               buf1[ii + jj * dims[0] + kk * dims[0] * dims[1]];
+         }
+      }
+   }
+   strides[0] = 1;
+   strides[1] = (ptrdiff_t)(dims[0] * dims[2]);
+   strides[2] = (ptrdiff_t)dims[0];
+   write_and_compare(argv[2], dt, ndims, dims, buf2, bufsize, bufsize, strides,
+                     buf1);
+
+   /* Non-contiguous lines: every other imel of a buffer twice as large */
+   buf3 = malloc(bufsize * 2);
+   if (buf3 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < bufsize / 2; ii++) {
+      buf3[2 * ii] = buf1[ii];
+      buf3[2 * ii + 1] = 0;
+   }
+   strides[0] = 2;
+   strides[1] = (ptrdiff_t)(2 * dims[0]);
+   strides[2] = (ptrdiff_t)(2 * dims[0] * dims[1]);
+   write_and_compare(argv[2], dt, ndims, dims, buf3, bufsize * 2, bufsize,
+                     strides, buf1);
+
+   /* Padded lines: the buffer size covers the padding after the last line */
+   buf4 = malloc(PADDED * dims[1] * dims[2] * 2);
+   if (buf4 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (jj = 0; jj < dims[1] * dims[2]; jj++) {
+      for (ii = 0; ii < PADDED; ii++) {
+         buf4[jj * PADDED + ii] = ii < dims[0] ? buf1[jj * dims[0] + ii] : 0;
+      }
+   }
+   strides[0] = 1;
+   strides[1] = PADDED;
+   strides[2] = (ptrdiff_t)(PADDED * dims[1]);
+   write_and_compare(argv[2], dt, ndims, dims, buf4,
+                     PADDED * dims[1] * dims[2] * 2, bufsize, strides, buf1);
+
+   free(buf1);
+   free(buf2);
+   free(buf3);
+   free(buf4);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_gzip_threads $srcdir/test/testim.ics result_v2zt.ics
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "libics.h"
+
+#define NX 67
+#define NY 45
+#define N (NX * NY)
+#define NHISTORY 100
+#define NOPENS 5000
+
+/* Reads the image and checks its layout, history and data. */
+static void check_file(const char* filename, const unsigned short* data) {
+   ICS*           ip;
+   Ics_DataType   dt;
+   int            ndims;
+   size_t         dims[ICS_MAXDIM];
+   int            num;
+   char           key[ICS_STRLEN_TOKEN];
+   char           value[ICS_LINE_LENGTH];
+   unsigned short buf[N];
+   Ics_Error      retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open %s for reading: %s\n", filename,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   if (dt != Ics_uint16 || ndims != 2 || dims[0] != NX || dims[1] != NY) {
+      fprintf(stderr, "Layout of %s not as expected.\n", filename);
+      exit(-1);
+   }
+   IcsGetNumHistoryStrings(ip, &num);
+   if (num != NHISTORY) {
+      fprintf(stderr, "Number of history lines in %s not as expected.\n",
+              filename);
+      exit(-1);
+   }
+   retval = IcsGetHistoryKeyValue(ip, key, value, IcsWhich_First);
+   if (retval != IcsErr_Ok || strcmp(key, "test") != 0 ||
+       strcmp(value, "history line with spaces") != 0) {
+      fprintf(stderr, "History of %s not as expected.\n", filename);
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf, sizeof(buf));
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read image data from %s: %s\n", filename,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(buf, data, sizeof(buf)) != 0) {
+      fprintf(stderr, "Image data in %s not as expected.\n", filename);
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close %s: %s\n", filename,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+/* Copies the file, writing the header lines with CR/LF line endings. */
+static void convert_to_crlf(const char* in, const char* out) {
+   FILE*  fp;
+   char*  buf;
+   char*  end;
+   long   pos;
+   size_t size;
+   long   ii;
+
+   fp = fopen(in, "rb");
+   if (fp == NULL) {
+      fprintf(stderr, "Could not open output file.\n");
+      exit(-1);
+   }
+   fseek(fp, 0, SEEK_END);
+   pos = ftell(fp);
+   if (pos < 0) {
+      fprintf(stderr, "Could not get the size of the output file.\n");
+      exit(-1);
+   }
+   size = (size_t)pos;
+   fseek(fp, 0, SEEK_SET);
+   buf = malloc(size + 1);
+   if (buf == NULL || fread(buf, 1, size, fp) != size) {
+      fprintf(stderr, "Could not read output file.\n");
+      exit(-1);
+   }
+   fclose(fp);
+   buf[size] = '\0';
+
+   /* The header ends with the line that starts with "end" */
+   end = strstr(buf, "\nend");
+   if (end == NULL || (end = strchr(end + 1, '\n')) == NULL) {
+      fprintf(stderr, "Could not find the end of the header.\n");
+      exit(-1);
+   }
+   fp = fopen(out, "wb");
+   if (fp == NULL) {
+      fprintf(stderr, "Could not open file for writing.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii <= end - buf; ii++) {
+      if (buf[ii] == '\n') {
+         putc('\r', fp);
+      }
+      putc(buf[ii], fp);
+   }
+   fwrite(end + 1, 1, size - (size_t)(end + 1 - buf), fp);
+   fclose(fp);
+   free(buf);
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*           ip;
+   Ics_Error      retval;
+   size_t         dims[2] = {NX, NY};
+   unsigned short data[N];
+   char           crlfname[ICS_MAXPATHLEN];
+   int            ii;
+   clock_t        start;
+   double         seconds;
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   for (ii = 0; ii < N; ii++) {
+      data[ii] = (unsigned short)(ii * 7);
+   }
+
+   /* Write a file with a long header */
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 2, dims);
+   IcsSetData(ip, data, sizeof(data));
+   IcsSetCompression(ip, IcsCompr_uncompressed, 0);
+   for (ii = 0; ii < NHISTORY; ii++) {
+      retval = IcsAddHistory(ip, "test", "history line with spaces");
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not add history line: %s\n",
+                 IcsGetErrorText(retval));
+         exit(-1);
+      }
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   check_file(argv[1], data);
+
+   /* The same file with CR/LF line endings */
+   strcpy(crlfname, argv[1]);
+   strcpy(crlfname + strlen(crlfname) - 4, "_crlf.ics");
+   convert_to_crlf(argv[1], crlfname);
+   check_file(crlfname, data);
+
+   /* Report the rate at which headers are read */
+   start = clock();
+   for (ii = 0; ii < NOPENS; ii++) {
+      retval = IcsOpen(&ip, argv[1], "r");
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not open output file for reading: %s\n",
+                 IcsGetErrorText(retval));
+         exit(-1);
+      }
+      IcsClose(ip);
+   }
+   seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+   if (seconds > 0) {
+      printf("Header-only opens per second: %.0f\n", NOPENS / seconds);
+   }
+
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_header result_h.ics
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+#define NHISTORY 200
+
+/* Number of calls to each of the callbacks */
+static int opens, closes, reads, writes, seeks, readAts, renames, removes;
+
+/* Callbacks that do the I/O through stdio, and count the calls. */
+static void* io_open(void* userData, const char* path, const char* mode) {
+   (void)userData;
+   opens++;
+   return fopen(path, mode);
+}
+
+static ptrdiff_t io_read(void* handle, void* buf, size_t n) {
+   size_t res;
+   reads++;
+   res = fread(buf, 1, n, (FILE*)handle);
+   if (res == 0 && ferror((FILE*)handle)) {
+      return -1;
+   }
+   return (ptrdiff_t)res;
+}
+
+static ptrdiff_t io_write(void* handle, const void* buf, size_t n) {
+   writes++;
+   return (ptrdiff_t)fwrite(buf, 1, n, (FILE*)handle);
+}
+
+static ptrdiff_t io_seek(void* handle, ptrdiff_t offset, int whence) {
+   seeks++;
+   if (fseek((FILE*)handle, (long)offset, whence) != 0) {
+      return -1;
+   }
+   return (ptrdiff_t)ftell((FILE*)handle);
+}
+
+static int io_close(void* handle) {
+   closes++;
+   return fclose((FILE*)handle);
+}
+
+/* Restores the position, this test does not read from several threads. */
+static ptrdiff_t io_readAt(void* handle, void* buf, size_t n, size_t offset) {
+   FILE*  fp  = (FILE*)handle;
+   long   pos = ftell(fp);
+   size_t res;
+   readAts++;
+   if (pos < 0 || fseek(fp, (long)offset, SEEK_SET) != 0) {
+      return -1;
+   }
+   res = fread(buf, 1, n, fp);
+   if (fseek(fp, pos, SEEK_SET) != 0) {
+      return -1;
+   }
+   return (ptrdiff_t)res;
+}
+
+static int io_remove(void* userData, const char* path) {
+   (void)userData;
+   removes++;
+   return remove(path);
+}
+
+static int io_rename(void* userData, const char* from, const char* to) {
+   (void)userData;
+   renames++;
+   return rename(from, to);
+}
+
+/* Writes the image with the given compression. */
+static void write_file(const char* filename, Ics_DataType dt, int ndims,
+                       const size_t* dims, const void* data, size_t bufsize,
+                       Ics_Compression compression) {
+   ICS*      ip;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, ndims, dims);
+   IcsSetData(ip, data, bufsize);
+   IcsSetCompression(ip, compression, 6);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+/* Reads the image and compares it to data. */
+static void check_file(const char* filename, const void* data,
+                       size_t bufsize) {
+   ICS*        ip;
+   void*       buf;
+   const void* map;
+   Ics_Error   retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (IcsGetDataSize(ip) != bufsize) {
+      fprintf(stderr, "Data in output file not the right size.\n");
+      exit(-1);
+   }
+   buf = malloc(bufsize);
+   if (buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read output image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, buf, bufsize) != 0) {
+      fprintf(stderr, "Data in output file does not match data in input.\n");
+      exit(-1);
+   }
+   retval = IcsMapData(ip, &map, NULL);
+   if (retval != IcsErr_Ok || memcmp(data, map, bufsize) != 0) {
+      fprintf(stderr, "Could not map output image data.\n");
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   free(buf);
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*         ip;
+   Ics_DataType dt;
+   int          ndims;
+   size_t       dims[ICS_MAXDIM];
+   size_t       bufsize;
+   void*        data;
+   void*        plane;
+   int          ii, num;
+   Ics_IoVTable vtable;
+   Ics_Error    retval;
+
+
+   if (argc != 3) {
+      fprintf(stderr, "Two file names required: in out\n");
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   bufsize = IcsGetDataSize(ip);
+   data = malloc(bufsize);
+   plane = malloc(bufsize / 2);
+   if (data == NULL || plane == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, data, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsClose(ip);
+
+   /* Install the callbacks */
+   memset(&vtable, 0, sizeof(vtable));
+   vtable.open = io_open;
+   vtable.read = io_read;
+   vtable.seek = io_seek;
+   if (IcsSetIoVTable(&vtable) != IcsErr_IllParameter) {
+      fprintf(stderr, "Callbacks without close were accepted.\n");
+      exit(-1);
+   }
+   vtable.write = io_write;
+   vtable.close = io_close;
+   vtable.readAt = io_readAt;
+   vtable.remove = io_remove;
+   vtable.rename = io_rename;
+   retval = IcsSetIoVTable(&vtable);
+   if (retval == IcsErr_NotValidAction) {
+      printf("Custom I/O is not supported on this platform.\n");
+      exit(0);
+   }
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not set the callbacks: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Write and read through the callbacks */
+   write_file(argv[2], dt, ndims, dims, data, bufsize, IcsCompr_uncompressed);
+   if (writes == 0) {
+      fprintf(stderr, "The file was not written through the callbacks.\n");
+      exit(-1);
+   }
+   check_file(argv[2], data, bufsize);
+   if (reads == 0 || seeks == 0) {
+      fprintf(stderr, "The file was not read through the callbacks.\n");
+      exit(-1);
+   }
+#ifdef ICS_ZLIB
+   write_file(argv[2], dt, ndims, dims, data, bufsize, IcsCompr_gzip);
+   check_file(argv[2], data, bufsize);
+   write_file(argv[2], dt, ndims, dims, data, bufsize, IcsCompr_uncompressed);
+#endif
+
+   /* Positional reads */
+   IcsOpen(&ip, argv[2], "r");
+   retval = IcsOpenIds(ip);
+   if (retval == IcsErr_Ok) {
+      retval = IcsReadIdsAt(ip, bufsize / 2, plane, bufsize / 2);
+   }
+   if (retval != IcsErr_Ok || readAts == 0 ||
+       memcmp(plane, (char*)data + bufsize / 2, bufsize / 2) != 0) {
+      fprintf(stderr, "Could not read data at offset through the callbacks.\n");
+      exit(-1);
+   }
+   IcsClose(ip);
+
+   /* Updating a file; the header does not fit before the data */
+   retval = IcsOpen(&ip, argv[2], "rw");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open file for update: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   for (ii = 0; ii < NHISTORY; ii++) {
+      IcsAddHistory(ip, "test", "a history line added in update mode");
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok || renames == 0 || removes == 0) {
+      fprintf(stderr, "Could not update file through the callbacks.\n");
+      exit(-1);
+   }
+   check_file(argv[2], data, bufsize);
+   IcsOpen(&ip, argv[2], "r");
+   IcsGetNumHistoryStrings(ip, &num);
+   IcsClose(ip);
+   if (num != NHISTORY) {
+      fprintf(stderr, "Number of history lines not as expected.\n");
+      exit(-1);
+   }
+   if (opens != closes) {
+      fprintf(stderr, "Not all files opened were closed.\n");
+      exit(-1);
+   }
+
+   /* Back to the built-in I/O */
+   IcsSetIoVTable(NULL);
+   ii = opens;
+   check_file(argv[2], data, bufsize);
+   if (opens != ii) {
+      fprintf(stderr, "The callbacks were used after removing them.\n");
+      exit(-1);
+   }
+
+   free(plane);
+   free(data);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_io $srcdir/test/testim.ics result_io.ics
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include "libics.h"
+
+#define NX 17
+#define NY 13
+#define N (NX * NY)
+
+/* Locales that use a comma as decimal separator. The test runs in the "C"
+   locale if none of these is installed. */
+static const char* locales[] = {
+   "de_DE.UTF-8", "de_DE.utf8", "de_DE", "nl_NL.UTF-8", "fr_FR.UTF-8",
+   "German", NULL
+};
+
+int main(int argc, const char* argv[]) {
+   ICS*           ip;
+   Ics_Error      retval;
+   size_t         dims[2] = {NX, NY};
+   unsigned short data[N];
+   char           before[256];
+   char           header[4096];
+   double         origin, scale;
+   char           units[ICS_STRLEN_TOKEN];
+   FILE*          fp;
+   size_t         n;
+   int            ii;
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   for (ii = 0; locales[ii] != NULL; ii++) {
+      if (setlocale(LC_ALL, locales[ii]) != NULL) {
+         break;
+      }
+   }
+   strcpy(before, setlocale(LC_ALL, NULL));
+   for (ii = 0; ii < N; ii++) {
+      data[ii] = (unsigned short)ii;
+   }
+
+   /* Write a file with non-integer positions */
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 2, dims);
+   IcsSetData(ip, data, sizeof(data));
+   IcsSetCompression(ip, IcsCompr_uncompressed, 0);
+   IcsSetPosition(ip, 0, 1.5, 0.25, "micrometer");
+   IcsSetPosition(ip, 1, -2.5, 0.125, "micrometer");
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (strcmp(before, setlocale(LC_ALL, NULL)) != 0) {
+      fprintf(stderr, "Writing changed the locale of the program.\n");
+      exit(-1);
+   }
+
+   /* The header must use a decimal point */
+   fp = fopen(argv[1], "rb");
+   if (fp == NULL) {
+      fprintf(stderr, "Could not open output file.\n");
+      exit(-1);
+   }
+   n = fread(header, 1, sizeof(header) - 1, fp);
+   fclose(fp);
+   header[n] = '\0';
+   if (strstr(header, "0.25") == NULL || strstr(header, "0.125") == NULL) {
+      fprintf(stderr, "Numbers in the header not formatted in the C locale.\n");
+      exit(-1);
+   }
+
+   /* Read it back */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetPosition(ip, 0, &origin, &scale, units);
+   if (origin != 1.5 || scale != 0.25) {
+      fprintf(stderr, "Position of dimension 0 not as expected.\n");
+      exit(-1);
+   }
+   IcsGetPosition(ip, 1, &origin, &scale, units);
+   if (origin != -2.5 || scale != 0.125) {
+      fprintf(stderr, "Position of dimension 1 not as expected.\n");
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close file: %s\n", IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (strcmp(before, setlocale(LC_ALL, NULL)) != 0) {
+      fprintf(stderr, "Reading changed the locale of the program.\n");
+      exit(-1);
+   }
+
+   exit(0);
+}
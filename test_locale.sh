@@ -0,0 +1 @@
+./test_locale result_loc.ics
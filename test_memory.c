@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+/* Reads the image from the ICS file in memory and compares it to data. */
+static void check_memory(const char* buf, size_t len, const void* data,
+                         size_t bufsize, const char* what) {
+   ICS*        ip;
+   void*       buf2;
+   const void* map;
+   Ics_Error   retval;
+
+   retval = IcsOpenMemory(&ip, buf, len, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open %s file in memory: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (IcsGetDataSize(ip) != bufsize) {
+      fprintf(stderr, "Data in %s file in memory not the right size.\n", what);
+      exit(-1);
+   }
+   buf2 = malloc(bufsize);
+   if (buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf2, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read %s image data from memory: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, buf2, bufsize) != 0) {
+      fprintf(stderr, "Data read from %s file in memory is different.\n",
+              what);
+      exit(-1);
+   }
+   retval = IcsMapData(ip, &map, NULL);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not map %s image data in memory: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, map, bufsize) != 0) {
+      fprintf(stderr, "Data mapped from %s file in memory is different.\n",
+              what);
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close %s file in memory: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   free(buf2);
+}
+
+/* Writes the image into memory with the given compression, and reads it
+   back. */
+static void write_memory(Ics_DataType dt, int ndims, const size_t* dims,
+                         const void* data, size_t bufsize,
+                         Ics_Compression compression, const char* what) {
+   ICS*      ip;
+   void*     buf;
+   size_t    len;
+   Ics_Error retval;
+
+   retval = IcsOpenMemory(&ip, NULL, 0, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open %s file in memory for writing: %s\n",
+              what, IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, ndims, dims);
+   IcsSetData(ip, data, bufsize);
+   IcsSetCompression(ip, compression, 6);
+   IcsAddHistory(ip, "test", "in memory");
+   retval = IcsWriteMemory(ip, &buf, &len);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write %s file to memory: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close %s file in memory: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   check_memory(buf, len, data, bufsize, what);
+   free(buf);
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*         ip;
+   Ics_DataType dt;
+   int          ndims;
+   size_t       dims[ICS_MAXDIM];
+   size_t       bufsize;
+   void*        data;
+   char*        buf;
+   size_t       len;
+   void*        plane;
+   const void*  map;
+   Ics_Error    retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   bufsize = IcsGetDataSize(ip);
+   data = malloc(bufsize);
+   if (data == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, data, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsClose(ip);
+
+   /* Write to and read from memory */
+   write_memory(dt, ndims, dims, data, bufsize, IcsCompr_uncompressed,
+                "uncompressed");
+#ifdef ICS_ZLIB
+   write_memory(dt, ndims, dims, data, bufsize, IcsCompr_gzip, "gzip");
+   write_memory(dt, ndims, dims, data, bufsize, IcsCompr_chunked_gzip,
+                "chunked gzip");
+#endif
+
+   /* Uncompressed data is read in place */
+   retval = IcsOpenMemory(&ip, NULL, 0, "w");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open file in memory for writing: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, ndims, dims);
+   IcsSetData(ip, data, bufsize);
+   IcsSetCompression(ip, IcsCompr_uncompressed, 0);
+   retval = IcsWriteMemory(ip, (void**)&buf, &len);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write file to memory: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsClose(ip);
+   IcsOpenMemory(&ip, buf, len, "r");
+   retval = IcsMapData(ip, &map, NULL);
+   if (retval != IcsErr_Ok ||
+       (const char*)map != buf + len - bufsize) {
+      fprintf(stderr, "Uncompressed data in memory was not mapped in place.\n");
+      exit(-1);
+   }
+   plane = malloc(bufsize / 2);
+   if (plane == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsOpenIds(ip);
+   if (retval == IcsErr_Ok) {
+      retval = IcsReadIdsAt(ip, bufsize / 2, plane, bufsize / 2);
+   }
+   if (retval != IcsErr_Ok ||
+       memcmp(plane, (char*)data + bufsize / 2, bufsize / 2) != 0) {
+      fprintf(stderr, "Could not read data in memory at offset.\n");
+      exit(-1);
+   }
+   IcsClose(ip);
+
+   /* A truncated file must not be read past its end */
+   IcsOpenMemory(&ip, buf, len - 1, "r");
+   IcsOpenIds(ip);
+   if (IcsReadIdsAt(ip, bufsize / 2, plane, bufsize / 2) !=
+       IcsErr_EndOfStream) {
+      fprintf(stderr, "Reading a truncated file in memory did not fail.\n");
+      exit(-1);
+   }
+   IcsClose(ip);
+   free(plane);
+   free(buf);
+
+   /* Invalid modes */
+   if (IcsOpenMemory(&ip, NULL, 0, "r") != IcsErr_IllParameter ||
+       IcsOpenMemory(&ip, data, bufsize, "rw") != IcsErr_IllParameter ||
+       IcsOpenMemory(&ip, NULL, 0, "w1") != IcsErr_IllParameter) {
+      fprintf(stderr, "Invalid modes were accepted.\n");
+      exit(-1);
+   }
+
+   free(data);
+   exit(0);
+}
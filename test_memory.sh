@@ -0,0 +1 @@
+./test_memory $srcdir/test/testim.ics
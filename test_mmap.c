@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+
+int main(int argc, const char* argv[]) {
+   ICS*         ip;
+   Ics_DataType dt;
+   int          ndims;
+   size_t       dims[ICS_MAXDIM];
+   size_t       bufsize;
+   size_t       imelsize;
+   size_t       ii, jj;
+   ptrdiff_t    strides[ICS_MAXDIM];
+   ptrdiff_t    stride;
+   char         idsname[1024];
+   char*        buf1;
+   char*        buf2;
+   const void*  data;
+   FILE*        fp;
+   unsigned int one = 1;
+   Ics_Error    retval;
+
+
+   if (argc != 3) {
+      fprintf(stderr, "Two file names required: in out\n");
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   bufsize = IcsGetDataSize(ip);
+   imelsize = IcsGetImelSize(ip);
+   buf1 = malloc(bufsize);
+   if (buf1 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf1, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Map image */
+   retval = IcsMapData(ip, &data, strides);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not map input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   stride = 1;
+   for (ii = 0; ii < (size_t)ndims; ii++) {
+      if (strides[ii] != stride) {
+         fprintf(stderr, "Strides of mapped data are not correct.\n");
+         exit(-1);
+      }
+      stride *= (ptrdiff_t)dims[ii];
+   }
+   if (memcmp(buf1, data, bufsize) != 0) {
+      fprintf(stderr, "Mapped data does not match data read.\n");
+      exit(-1);
+   }
+   retval = IcsUnmapData(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not unmap input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Write data with the opposite byte order, at an odd offset */
+   buf2 = malloc(bufsize);
+   if (buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < bufsize; ii += imelsize) {
+      for (jj = 0; jj < imelsize; jj++) {
+         buf2[ii + jj] = buf1[ii + imelsize - 1 - jj];
+      }
+   }
+   snprintf(idsname, sizeof(idsname), "%s.ids", argv[2]);
+   fp = fopen(idsname, "wb");
+   if (fp == NULL) {
+      fprintf(stderr, "Could not open output data file.\n");
+      exit(-1);
+   }
+   if (fwrite("offset", 1, 7, fp) != 7 ||
+       fwrite(buf2, 1, bufsize, fp) != bufsize) {
+      fprintf(stderr, "Could not write output data file.\n");
+      exit(-1);
+   }
+   fclose(fp);
+
+   /* Write header */
+   retval = IcsOpen(&ip, argv[2], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, ndims, dims);
+   IcsSetSource(ip, idsname, 7);
+   IcsSetByteOrder(ip, *(char*)&one ? IcsByteOrder_bigEndian
+                                    : IcsByteOrder_littleEndian);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Map image */
+   retval = IcsOpen(&ip, argv[2], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsMapData(ip, &data, NULL);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not map output image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(buf1, data, bufsize) != 0) {
+      fprintf(stderr, "Mapped data in output file does not match data in input.\n");
+      exit(-1);
+   }
+   /* IcsClose must release the mapping */
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   free(buf1);
+   free(buf2);
+   exit(0);
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+int main(int argc, const char* argv[]) {
+   ICS*         ip;
+   Ics_DataType dt;
+   int          ndims;
+   size_t       dims[ICS_MAXDIM];
+   size_t       bufsize;
+   size_t       planesize;
+   size_t       nplanes;
+   size_t       ii;
+   char*        buf1;
+   char*        buf2;
+   Ics_Error    retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   bufsize = IcsGetDataSize(ip);
+   planesize = dims[0] * dims[1] * IcsGetImelSize(ip);
+   nplanes = bufsize / planesize;
+   buf1 = malloc(bufsize);
+   buf2 = malloc(bufsize);
+   if (buf1 == NULL || buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf1, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Read planes in reverse order, interleaved with block reads */
+   retval = IcsOpenIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   memset(buf2, 0, bufsize);
+   for (ii = nplanes; ii > 1; ii--) {
+      retval = IcsReadIdsAt(ip, (ii - 1) * planesize,
+                            buf2 + (ii - 1) * planesize, planesize);
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not read input data at offset: %s\n",
+                 IcsGetErrorText(retval));
+         exit(-1);
+      }
+   }
+   retval = IcsReadIdsBlock(ip, buf2, planesize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input data block: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(buf1, buf2, bufsize) != 0) {
+      fprintf(stderr, "Data read at offsets does not match data read.\n");
+      exit(-1);
+   }
+
+   /* Out of range reads must fail */
+   retval = IcsReadIdsAt(ip, bufsize - planesize + 2, buf2, planesize);
+   if (retval != IcsErr_EndOfStream) {
+      fprintf(stderr, "Reading past the end of the data did not fail.\n");
+      exit(-1);
+   }
+   retval = IcsReadIdsAt(ip, (size_t)0 - planesize, buf2, planesize);
+   if (retval != IcsErr_EndOfStream) {
+      fprintf(stderr, "Reading at an offset that wraps around did not fail.\n");
+      exit(-1);
+   }
+   retval = IcsCloseIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close input data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   free(buf1);
+   free(buf2);
+   exit(0);
+}
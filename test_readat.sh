@@ -0,0 +1 @@
+./test_readat $srcdir/test/testim.ics
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "libics.h"
+#include "libics_ll.h"
+
+#define NTHREADS 4
+
+/* Each thread reads every NTHREADS-th image line, starting at its own. */
+typedef struct {
+   ICS*      ip;
+   char*     buf;
+   size_t    linesize;
+   size_t    nlines;
+   size_t    first;
+   Ics_Error retval;
+} Task;
+
+static void* read_lines(void* arg) {
+   Task*  task = (Task*)arg;
+   size_t ii;
+
+   task->retval = IcsErr_Ok;
+   for (ii = task->first; ii < task->nlines; ii += NTHREADS) {
+      task->retval = IcsReadIdsAt(task->ip, ii * task->linesize,
+                                  task->buf + ii * task->linesize,
+                                  task->linesize);
+      if (task->retval != IcsErr_Ok) {
+         break;
+      }
+   }
+   return NULL;
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*         ip;
+   Ics_DataType dt;
+   int          ndims;
+   size_t       dims[ICS_MAXDIM];
+   size_t       bufsize;
+   size_t       linesize;
+   size_t       ii;
+   char*        buf1;
+   char*        buf2;
+   pthread_t    threads[NTHREADS];
+   Task         tasks[NTHREADS];
+   Ics_Error    retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   /* Read image */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetLayout(ip, &dt, &ndims, dims);
+   bufsize = IcsGetDataSize(ip);
+   linesize = dims[0] * IcsGetImelSize(ip);
+   buf1 = malloc(bufsize);
+   buf2 = malloc(bufsize);
+   if (buf1 == NULL || buf2 == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf1, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read input image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Read disjoint lines from several threads through the same handle */
+   retval = IcsOpenIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open input data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   memset(buf2, 0, bufsize);
+   for (ii = 0; ii < NTHREADS; ii++) {
+      tasks[ii].ip = ip;
+      tasks[ii].buf = buf2;
+      tasks[ii].linesize = linesize;
+      tasks[ii].nlines = bufsize / linesize;
+      tasks[ii].first = ii;
+      if (pthread_create(&threads[ii], NULL, read_lines, &tasks[ii]) != 0) {
+         fprintf(stderr, "Could not start a thread.\n");
+         exit(-1);
+      }
+   }
+   for (ii = 0; ii < NTHREADS; ii++) {
+      pthread_join(threads[ii], NULL);
+   }
+   for (ii = 0; ii < NTHREADS; ii++) {
+      if (tasks[ii].retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not read input data at offset: %s\n",
+                 IcsGetErrorText(tasks[ii].retval));
+         exit(-1);
+      }
+   }
+   if (memcmp(buf1, buf2, bufsize) != 0) {
+      fprintf(stderr, "Data read by threads does not match data read.\n");
+      exit(-1);
+   }
+
+   retval = IcsCloseIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close input data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close input file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   free(buf1);
+   free(buf2);
+   exit(0);
+}
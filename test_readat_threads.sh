@@ -0,0 +1 @@
+./test_readat_threads $srcdir/test/testim.ics
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+
+#define NX 301
+#define NY 97
+#define NZ 13
+#define N (NX * NY * NZ)
+#define NROI 8
+
+/* Regions to read: offset, size and sampling along x, y and z. Lines are
+   contiguous, close together, and further apart than a plane. */
+static const size_t rois[NROI][9] = {
+   {0, 0, 0, NX, NY, NZ, 1, 1, 1},       /* the whole image */
+   {0, 40, 0, NX, 3, NZ, 1, 1, 1},       /* a thin slab */
+   {17, 0, 2, 5, NY, 9, 1, 1, 1},        /* narrow columns */
+   {3, 1, 0, 290, 95, NZ, 1, 7, 2},      /* lines a few lines apart */
+   {3, 10, 0, 290, 1, NZ, 1, 1, 2},      /* lines two planes apart */
+   {1, 2, 3, 299, 90, 10, 4, 3, 1},      /* subsampled lines */
+   {NX - 1, NY - 1, 0, 1, 1, NZ, 1, 1, 1},
+   {100, 50, 6, 1, 1, 1, 1, 1, 1}        /* a single imel */
+};
+
+/* Callbacks that do the I/O through stdio, without reading at an offset. */
+static void* io_open(void* userData, const char* path, const char* mode) {
+   (void)userData;
+   return fopen(path, mode);
+}
+
+static ptrdiff_t io_read(void* handle, void* buf, size_t n) {
+   size_t res = fread(buf, 1, n, (FILE*)handle);
+   if (res == 0 && ferror((FILE*)handle)) {
+      return -1;
+   }
+   return (ptrdiff_t)res;
+}
+
+static ptrdiff_t io_write(void* handle, const void* buf, size_t n) {
+   return (ptrdiff_t)fwrite(buf, 1, n, (FILE*)handle);
+}
+
+static ptrdiff_t io_seek(void* handle, ptrdiff_t offset, int whence) {
+   if (fseek((FILE*)handle, (long)offset, whence) != 0) {
+      return -1;
+   }
+   return (ptrdiff_t)ftell((FILE*)handle);
+}
+
+static int io_close(void* handle) {
+   return fclose((FILE*)handle);
+}
+
+/* Writes the image with the given compression. */
+static void write_file(const char* filename, const unsigned short* data,
+                       Ics_Compression compression) {
+   ICS*      ip;
+   size_t    dims[3] = {NX, NY, NZ};
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetData(ip, data, N * sizeof(unsigned short));
+   IcsSetCompression(ip, compression, 6);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+/* Reads each of the regions, as stored and as float, into a contiguous
+   destination, into a transposed and padded one, and into one with the planes
+   in reverse order, and with several threads, and compares them to data. */
+static void check_rois(const char* filename, const unsigned short* data,
+                       const char* what) {
+   ICS*            ip;
+   unsigned short* roi;
+   float*          froi;
+   unsigned short* troi;
+   float*          rroi;
+   unsigned short* proi;
+   const size_t*   r;
+   size_t          x, y, z, ii, n, nx, ny, nz;
+   ptrdiff_t       tstrides[3], rstrides[3];
+   int             jj, ok;
+   Ics_Error       retval;
+
+   roi = malloc(N * sizeof(unsigned short));
+   froi = malloc(N * sizeof(float));
+   troi = malloc(NX * (NY + 1) * NZ * sizeof(unsigned short));
+   rroi = malloc(N * sizeof(float));
+   proi = malloc(N * sizeof(unsigned short));
+   if (roi == NULL || froi == NULL || troi == NULL || rroi == NULL ||
+       proi == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open %s file for reading: %s\n", what,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   for (jj = 0; jj < NROI; jj++) {
+      r = rois[jj];
+      nx = (r[3] + r[6] - 1) / r[6];
+      ny = (r[4] + r[7] - 1) / r[7];
+      nz = (r[5] + r[8] - 1) / r[8];
+      n = nx * ny * nz;
+      tstrides[0] = (ptrdiff_t)ny + 1;
+      tstrides[1] = 1;
+      tstrides[2] = ((ptrdiff_t)ny + 1) * (ptrdiff_t)nx;
+      rstrides[0] = 1;
+      rstrides[1] = (ptrdiff_t)nx;
+      rstrides[2] = -(ptrdiff_t)(nx * ny);
+      retval = IcsGetROIData(ip, r, r + 3, r + 6, roi,
+                             n * sizeof(unsigned short));
+      if (retval == IcsErr_Ok) {
+         retval = IcsGetROIDataAs(ip, r, r + 3, r + 6, Ics_real32, froi,
+                                  n * sizeof(float));
+      }
+      if (retval == IcsErr_Ok) {
+         retval = IcsGetROIDataWithStrides(ip, r, r + 3, r + 6, troi, 0,
+                                           tstrides, 3);
+      }
+      if (retval == IcsErr_Ok) {
+         retval = IcsGetROIDataWithStridesAs(ip, r, r + 3, r + 6, Ics_real32,
+                                             rroi + (nz - 1) * nx * ny, 0,
+                                             rstrides, 3);
+      }
+      if (retval == IcsErr_Ok) {
+         retval = IcsGetROIDataParallel(ip, r, r + 3, r + 6, proi,
+                                        n * sizeof(unsigned short), 4);
+      }
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not read region %d of %s file: %s\n", jj,
+                 what, IcsGetErrorText(retval));
+         exit(-1);
+      }
+      ok = 1;
+      ii = 0;
+      for (z = r[2]; z < r[2] + r[5]; z += r[8]) {
+         for (y = r[1]; y < r[1] + r[4]; y += r[7]) {
+            for (x = r[0]; x < r[0] + r[3]; x += r[6]) {
+               ok &= roi[ii] == data[(z * NY + y) * NX + x];
+               ok &= froi[ii] == (float)data[(z * NY + y) * NX + x];
+               ok &= troi[(ii / (nx * ny)) * (ny + 1) * nx +
+                          (ii % nx) * (ny + 1) + (ii / nx) % ny] == roi[ii];
+               ok &= rroi[(nz - 1 - ii / (nx * ny)) * nx * ny +
+                          ii % (nx * ny)] == froi[ii];
+               ok &= proi[ii] == roi[ii];
+               ii++;
+            }
+         }
+      }
+      if (!ok || ii != n) {
+         fprintf(stderr, "Region %d of %s file not as expected.\n", jj, what);
+         exit(-1);
+      }
+   }
+   IcsClose(ip);
+   free(roi);
+   free(froi);
+   free(troi);
+   free(rroi);
+   free(proi);
+}
+
+int main(int argc, const char* argv[]) {
+   unsigned short* data;
+   Ics_IoVTable    vtable;
+   size_t          ii;
+   Ics_Error       retval;
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(N * sizeof(unsigned short));
+   if (data == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N; ii++) {
+      data[ii] = (unsigned short)(ii * 2654435761u >> 16);
+   }
+
+   write_file(argv[1], data, IcsCompr_uncompressed);
+   check_rois(argv[1], data, "uncompressed");
+#ifdef ICS_ZLIB
+   write_file(argv[1], data, IcsCompr_gzip);
+   check_rois(argv[1], data, "gzip");
+   write_file(argv[1], data, IcsCompr_chunked_gzip);
+   check_rois(argv[1], data, "chunked");
+#endif
+
+   /* Through a stream that cannot be read at an offset */
+   memset(&vtable, 0, sizeof(vtable));
+   vtable.open = io_open;
+   vtable.read = io_read;
+   vtable.write = io_write;
+   vtable.seek = io_seek;
+   vtable.close = io_close;
+   retval = IcsSetIoVTable(&vtable);
+   if (retval == IcsErr_Ok) {
+      write_file(argv[1], data, IcsCompr_uncompressed);
+      check_rois(argv[1], data, "sequentially read");
+      IcsSetIoVTable(NULL);
+   } else if (retval != IcsErr_NotValidAction) {
+      fprintf(stderr, "Could not set the callbacks: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   free(data);
+   exit(0);
+}
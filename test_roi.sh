@@ -0,0 +1 @@
+./test_roi result_roi.ics
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "test_util.h"
+
+#define NX 211
+#define NY 37
+#define NZ 5
+#define N (NX * NY * NZ)
+
+/* Writes the image in blocks of irregular sizes, that do not align with the
+   lines. */
+static void write_stream(const char* filename, const char* mode,
+                         const unsigned short* data,
+                         Ics_Compression compression, Ics_Filter filter,
+                         Ics_Predictor predictor, int finish) {
+   ICS*                 ip;
+   size_t               dims[3] = {NX, NY, NZ};
+   size_t               sizes[] = {2, 1000, 3 * NX * 2, 7, 60000};
+   size_t               bufsize = N * sizeof(unsigned short);
+   size_t               n, ii = 0;
+   const unsigned char* p = (const unsigned char*)data;
+   Ics_Error            retval;
+
+   retval = IcsOpen(&ip, filename, mode);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetCompression(ip, compression, 6);
+   IcsSetFilter(ip, filter);
+   IcsSetPredictor(ip, predictor);
+   retval = IcsOpenWriteStream(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output stream: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   while (bufsize > 0) {
+      n = sizes[ii++ % (sizeof(sizes) / sizeof(sizes[0]))];
+      if (n > bufsize) n = bufsize;
+      retval = IcsWriteDataBlock(ip, p, n);
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not write data block: %s\n",
+                 IcsGetErrorText(retval));
+         exit(-1);
+      }
+      p += n;
+      bufsize -= n;
+   }
+   if (IcsWriteDataBlock(ip, data, 2) != IcsErr_FSizeConflict) {
+      fprintf(stderr, "Writing past the end of the image was not refused.\n");
+      exit(-1);
+   }
+   if (finish) {
+      retval = IcsFinishWrite(ip);
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not finish writing: %s\n",
+                 IcsGetErrorText(retval));
+         exit(-1);
+      }
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   size_t          ii;
+   unsigned short* data;
+   void*           buf;
+   Ics_Error       retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(N * sizeof(unsigned short));
+   buf = malloc(N * sizeof(unsigned short));
+   if (data == NULL || buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N; ii++) {
+      data[ii] = (unsigned short)(1000 + 50 * (ii % NX) + (ii / NX) % NY
+                                  + ((ii * 2654435761u) >> 30));
+   }
+
+   /* Uncompressed, in one or two files */
+   write_stream(argv[1], "w2", data, IcsCompr_uncompressed, IcsFilter_none,
+                IcsPredictor_none, 1);
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+   write_stream(argv[1], "w1", data, IcsCompr_uncompressed, IcsFilter_none,
+                IcsPredictor_none, 0);
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+
+   /* Compressed, with and without filter and predictor */
+   write_stream(argv[1], "w2", data, IcsCompr_gzip, IcsFilter_none,
+                IcsPredictor_none, 0);
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+   write_stream(argv[1], "w2", data, IcsCompr_gzip, IcsFilter_shuffle,
+                IcsPredictor_none, 1);
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+   write_stream(argv[1], "w2", data, IcsCompr_gzip, IcsFilter_shuffle,
+                IcsPredictor_horizontal, 1);
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+   write_stream(argv[1], "w1", data, IcsCompr_gzip, IcsFilter_none,
+                IcsPredictor_horizontal, 0);
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+
+   /* Too little data */
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetCompression(ip, IcsCompr_gzip, 6);
+   IcsOpenWriteStream(ip);
+   IcsWriteDataBlock(ip, data, 1000);
+   if (IcsFinishWrite(ip) != IcsErr_FSizeConflict) {
+      fprintf(stderr, "Missing data was not reported.\n");
+      exit(-1);
+   }
+   if (IcsWriteDataBlock(ip, data, 1000) != IcsErr_NotValidAction) {
+      fprintf(stderr, "Writing after finishing was not refused.\n");
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Chunked data cannot be streamed */
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetCompression(ip, IcsCompr_chunked_gzip, 6);
+   if (IcsOpenWriteStream(ip) != IcsErr_UnknownCompression) {
+      fprintf(stderr, "Streaming chunked data was not refused.\n");
+      exit(-1);
+   }
+   IcsSetData(ip, data, N * sizeof(unsigned short));
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   check_data(argv[1], data, N * sizeof(unsigned short), buf);
+
+   free(data);
+   free(buf);
+   exit(0);
+}
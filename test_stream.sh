@@ -0,0 +1 @@
+./test_stream result_v2s.ics
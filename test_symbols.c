@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+
+/* The symbol lists and hash tables are internal, so they are compiled in. */
+#include "libics_data.c"
+
+/* Looks up every symbol in the list, also in upper case, and checks that its
+   own token is found. Returns the number of failures. */
+static int check_list(const char* what, const Ics_SymbolList* listSpec) {
+   char   name[ICS_STRLEN_TOKEN];
+   int    failures = 0;
+   int    ii;
+   size_t jj;
+
+   for (ii = 0; ii < listSpec->entries; ii++) {
+      if (IcsGetSymbolToken(listSpec->list[ii].name, listSpec) !=
+          listSpec->list[ii].token) {
+         fprintf(stderr, "%s symbol \"%s\" not found.\n", what,
+                 listSpec->list[ii].name);
+         failures++;
+         continue;
+      }
+      for (jj = 0; listSpec->list[ii].name[jj] != '\0'; jj++) {
+         name[jj] = (char)toupper((unsigned char)listSpec->list[ii].name[jj]);
+      }
+      name[jj] = '\0';
+      if (IcsGetSymbolToken(name, listSpec) != listSpec->list[ii].token) {
+         fprintf(stderr, "%s symbol \"%s\" not found.\n", what, name);
+         failures++;
+      }
+   }
+   if (IcsGetSymbolToken("no such symbol", listSpec) != ICSTOK_NONE) {
+      fprintf(stderr, "Unknown %s symbol found.\n", what);
+      failures++;
+   }
+   return failures;
+}
+
+int main(void) {
+   int failures = 0;
+
+   failures += check_list("Category", &G_Categories);
+   failures += check_list("Subcategory", &G_SubCategories);
+   failures += check_list("Subsubcategory", &G_SubSubCategories);
+   failures += check_list("Value", &G_Values);
+   if (failures != 0) {
+      fprintf(stderr, "The symbol hash tables in libics_data.c are out of date,"
+              " regenerate them with support/symbol_hash.c.\n");
+      exit(-1);
+   }
+   exit(0);
+}
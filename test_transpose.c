@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+
+#define NX 1031
+#define NY 523
+#define NZ 3
+#define N (NX * NY * NZ)
+
+/* Writes the image, stored in memory with the first two dimensions swapped,
+   and checks that it reads back in the expected order, and into the same
+   swapped layout. */
+static void check_transposed(const char* filename, Ics_DataType dt,
+                             size_t size, const unsigned char* data,
+                             unsigned char* expected, unsigned char* buf) {
+   ICS*      ip;
+   size_t    dims[3] = {NX, NY, NZ};
+   ptrdiff_t strides[3] = {NY, 1, NX * NY};
+   size_t    bufsize = N * size;
+   size_t    x, y, z;
+   Ics_Error retval;
+
+   for (z = 0; z < NZ; z++) {
+      for (y = 0; y < NY; y++) {
+         for (x = 0; x < NX; x++) {
+            memcpy(expected + ((z * NY + y) * NX + x) * size,
+                   data + ((z * NX + x) * NY + y) * size, size);
+         }
+      }
+   }
+
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, 3, dims);
+   IcsSetDataWithStrides(ip, data, bufsize, strides, 3);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (bufsize != IcsGetDataSize(ip)) {
+      fprintf(stderr, "Data in output file not same size as written.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read output image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(expected, buf, bufsize) != 0) {
+      fprintf(stderr, "Data in output file does not match data in input.\n");
+      exit(-1);
+   }
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsGetDataWithStrides(ip, buf, bufsize, strides, 3);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read output image data using strides: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, buf, bufsize) != 0) {
+      fprintf(stderr, "Data read with strides does not match data in input.\n");
+      exit(-1);
+   }
+}
+
+int main(int argc, const char* argv[]) {
+   Ics_DataType   types[] = {Ics_uint8, Ics_sint16, Ics_real32, Ics_real64,
+                             Ics_complex64};
+   size_t         typesizes[] = {1, 2, 4, 8, 16};
+   size_t         ii, tt;
+   unsigned char* data;
+   unsigned char* expected;
+   unsigned char* buf;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(N * 16);
+   expected = malloc(N * 16);
+   buf = malloc(N * 16);
+   if (data == NULL || expected == NULL || buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N * 16; ii++) {
+      data[ii] = (unsigned char)((ii * 2654435761u) >> 24);
+   }
+
+   for (tt = 0; tt < sizeof(types) / sizeof(types[0]); tt++) {
+      check_transposed(argv[1], types[tt], typesizes[tt], data, expected, buf);
+   }
+
+   free(data);
+   free(expected);
+   free(buf);
+   exit(0);
+}
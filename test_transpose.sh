@@ -0,0 +1 @@
+./test_transpose result_tr.ics
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+
+#define NX 211
+#define NY 37
+#define NZ 5
+#define N (NX * NY * NZ)
+
+/* Returns the size of a file. */
+static long file_size(const char* filename) {
+   FILE* fp;
+   long  size;
+
+   fp = fopen(filename, "rb");
+   if (fp == NULL) {
+      fprintf(stderr, "Could not open output file.\n");
+      exit(-1);
+   }
+   fseek(fp, 0, SEEK_END);
+   size = ftell(fp);
+   fclose(fp);
+   return size;
+}
+
+/* Opens the file for updating and adds n history lines. */
+static void add_history(const char* filename, int n) {
+   ICS*      ip;
+   int       ii;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "rw");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open file for update: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   for (ii = 0; ii < n; ii++) {
+      retval = IcsAddHistory(ip, "test", "a history line added in update mode");
+      if (retval != IcsErr_Ok) {
+         fprintf(stderr, "Could not add history line: %s\n",
+                 IcsGetErrorText(retval));
+         exit(-1);
+      }
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not update file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+/* Reads the image and checks the data and the number of history lines. */
+static void check_file(const char* filename, const unsigned short* data,
+                       void* buf, int nHistory) {
+   ICS*      ip;
+   size_t    bufsize = N * sizeof(unsigned short);
+   int       num;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetNumHistoryStrings(ip, &num);
+   if (num != nHistory) {
+      fprintf(stderr, "Number of history lines not as expected.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read output image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, buf, bufsize) != 0) {
+      fprintf(stderr, "Data in output file does not match data in input.\n");
+      exit(-1);
+   }
+}
+
+int main(int argc, const char* argv[]) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   size_t          ii;
+   unsigned short* data;
+   void*           buf;
+   long            size;
+   Ics_Error       retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(N * sizeof(unsigned short));
+   buf = malloc(N * sizeof(unsigned short));
+   if (data == NULL || buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < N; ii++) {
+      data[ii] = (unsigned short)(ii * 2654435761u >> 16);
+   }
+
+   /* Write a file with room for the header to grow */
+   retval = IcsOpen(&ip, argv[1], "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, Ics_uint16, 3, dims);
+   IcsSetData(ip, data, N * sizeof(unsigned short));
+   IcsSetHeaderPadding(ip, 4096);
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   size = file_size(argv[1]);
+   check_file(argv[1], data, buf, 0);
+
+   /* Lines that fit in the padding are written in place */
+   add_history(argv[1], 10);
+   if (file_size(argv[1]) != size) {
+      fprintf(stderr, "Header was not updated in place.\n");
+      exit(-1);
+   }
+   check_file(argv[1], data, buf, 10);
+   add_history(argv[1], 10);
+   if (file_size(argv[1]) != size) {
+      fprintf(stderr, "Header was not updated in place.\n");
+      exit(-1);
+   }
+   check_file(argv[1], data, buf, 20);
+
+   /* Too many lines: the data is copied */
+   add_history(argv[1], 200);
+   if (file_size(argv[1]) <= size) {
+      fprintf(stderr, "File did not grow with the header.\n");
+      exit(-1);
+   }
+   check_file(argv[1], data, buf, 220);
+
+   free(data);
+   free(buf);
+   exit(0);
+}
@@ -0,0 +1 @@
+./test_update result_v2u.ics
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+#include "test_util.h"
+
+void write_image(const char* filename, Ics_DataType dt, const size_t* dims,
+                 const void* data, size_t bufsize, const ptrdiff_t* strides,
+                 Ics_Compression compression, int level, int nthreads,
+                 Ics_Filter filter, Ics_Predictor predictor) {
+   ICS*      ip;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "w2");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsSetLayout(ip, dt, 3, dims);
+   if (strides) {
+      IcsSetDataWithStrides(ip, data, bufsize, strides, 3);
+   } else {
+      IcsSetData(ip, data, bufsize);
+   }
+   IcsSetCompression(ip, compression, level);
+   IcsSetCompressionThreads(ip, nthreads);
+   retval = IcsSetFilter(ip, filter);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not set filter: %s\n", IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsSetPredictor(ip, predictor);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not set predictor: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not write output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+}
+
+void check_data(const char* filename, const void* data, size_t bufsize,
+                void* buf) {
+   ICS*      ip;
+   Ics_Error retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (bufsize != IcsGetDataSize(ip)) {
+      fprintf(stderr, "Data in output file not same size as written.\n");
+      exit(-1);
+   }
+   retval = IcsGetData(ip, buf, bufsize);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read output image data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp(data, buf, bufsize) != 0) {
+      fprintf(stderr, "Data in output file does not match data in input.\n");
+      exit(-1);
+   }
+}
+
+void check_encoding(const char* filename, Ics_Filter filter,
+                    Ics_Predictor predictor) {
+   ICS*          ip;
+   Ics_Filter    filter2;
+   Ics_Predictor predictor2;
+   Ics_Error     retval;
+
+   retval = IcsOpen(&ip, filename, "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   IcsGetFilter(ip, &filter2);
+   if (filter2 != filter) {
+      fprintf(stderr, "Filter in output file not as expected.\n");
+      exit(-1);
+   }
+   IcsGetPredictor(ip, &predictor2);
+   if (predictor2 != predictor) {
+      fprintf(stderr, "Predictor in output file not as expected.\n");
+      exit(-1);
+   }
+   IcsClose(ip);
+}
+
+void read_at(ICS* ip, const void* data, size_t offset, size_t n, void* buf) {
+   Ics_Error retval;
+
+   retval = IcsSetIdsBlock(ip, (ptrdiff_t)offset, SEEK_SET);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not seek to %lu: %s\n", (unsigned long)offset,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsReadIdsBlock(ip, buf, n);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not read at %lu: %s\n", (unsigned long)offset,
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   if (memcmp((const char*)data + offset, buf, n) != 0) {
+      fprintf(stderr, "Data read at %lu does not match.\n",
+              (unsigned long)offset);
+      exit(-1);
+   }
+}
+
+long file_size(const char* filename) {
+   FILE* fp;
+   long  size;
+
+   fp = fopen(filename, "rb");
+   if (fp == NULL) {
+      fprintf(stderr, "Could not open output file.\n");
+      exit(-1);
+   }
+   fseek(fp, 0, SEEK_END);
+   size = ftell(fp);
+   fclose(fp);
+   return size;
+}
@@ -0,0 +1,32 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stddef.h>
+#include "libics.h"
+
+/* Helpers shared by the compression tests. Each of them exits the program
+   with an error message when something fails. */
+
+/* Writes a 3D image with the given compression, level, number of threads,
+   filter and predictor. strides can be NULL for contiguous data. */
+void write_image(const char* filename, Ics_DataType dt, const size_t* dims,
+                 const void* data, size_t bufsize, const ptrdiff_t* strides,
+                 Ics_Compression compression, int level, int nthreads,
+                 Ics_Filter filter, Ics_Predictor predictor);
+
+/* Reads the whole image into buf and compares it with the original data. */
+void check_data(const char* filename, const void* data, size_t bufsize,
+                void* buf);
+
+/* Checks the filter and predictor recorded in the file. */
+void check_encoding(const char* filename, Ics_Filter filter,
+                    Ics_Predictor predictor);
+
+/* Reads n bytes at offset through a seek, and compares them with the
+   original data. */
+void read_at(ICS* ip, const void* data, size_t offset, size_t n, void* buf);
+
+/* Returns the size of a file. */
+long file_size(const char* filename);
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libics.h"
+#include "libics_ll.h"
+#include "test_util.h"
+
+#define NX 500
+#define NY 400
+#define NZ 10
+#define CHUNK 100000
+
+int main(int argc, const char* argv[]) {
+   ICS*            ip;
+   size_t          dims[3] = {NX, NY, NZ};
+   size_t          bufsize = NX * NY * NZ * sizeof(unsigned short);
+   size_t          offsets[] = {1500000, 300000, 3000000, 900001, 0};
+   ptrdiff_t       strides[3] = {1, NX * NZ, NX};
+   size_t          ii, jj, kk;
+   unsigned short* data;
+   unsigned short* transposed;
+   char*           buf;
+   Ics_Error       retval;
+
+
+   if (argc != 2) {
+      fprintf(stderr, "One file name required\n");
+      exit(-1);
+   }
+
+   data = malloc(bufsize);
+   transposed = malloc(bufsize);
+   buf = malloc(bufsize);
+   if (data == NULL || transposed == NULL || buf == NULL) {
+      fprintf(stderr, "Could not allocate memory.\n");
+      exit(-1);
+   }
+   for (ii = 0; ii < NX * NY * NZ; ii++) {
+      data[ii] = (unsigned short)((ii % NX) * (ii / NX % NY) + ii / (NX * NY)
+                                  + ((ii * 2654435761u) >> 29));
+   }
+
+   /* Contiguous data, default level, several threads */
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_zstd,
+               0, 4, IcsFilter_none, IcsPredictor_none);
+   check_data(argv[1], data, bufsize, buf);
+
+   /* Seek forwards and backwards */
+   retval = IcsOpen(&ip, argv[1], "r");
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output file for reading: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   retval = IcsOpenIds(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not open output data: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+   for (ii = 0; ii < sizeof(offsets) / sizeof(offsets[0]); ii++) {
+      read_at(ip, data, offsets[ii], CHUNK, buf);
+   }
+   read_at(ip, data, 2000000, bufsize - 2000000, buf);
+   retval = IcsReadIdsBlock(ip, buf, 2);
+   if (retval != IcsErr_EndOfStream) {
+      fprintf(stderr, "Reading past the end did not fail.\n");
+      exit(-1);
+   }
+   retval = IcsClose(ip);
+   if (retval != IcsErr_Ok) {
+      fprintf(stderr, "Could not close output file: %s\n",
+              IcsGetErrorText(retval));
+      exit(-1);
+   }
+
+   /* Strided data, with the 2nd and 3rd dimension swapped in memory */
+   for (kk = 0; kk < NZ; kk++) {
+      for (jj = 0; jj < NY; jj++) {
+         memcpy(transposed + (ptrdiff_t)jj * strides[1]
+                           + (ptrdiff_t)kk * strides[2],
+                data + (jj + kk * NY) * NX, NX * sizeof(unsigned short));
+      }
+   }
+   write_image(argv[1], Ics_uint16, dims, transposed, bufsize, strides,
+               IcsCompr_zstd, 3, 1, IcsFilter_none, IcsPredictor_none);
+   check_data(argv[1], data, bufsize, buf);
+
+   /* Filtered data */
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_zstd,
+               3, 2, IcsFilter_shuffle, IcsPredictor_none);
+   check_data(argv[1], data, bufsize, buf);
+   write_image(argv[1], Ics_uint16, dims, transposed, bufsize, strides,
+               IcsCompr_zstd, 3, 1, IcsFilter_bitshuffle, IcsPredictor_none);
+   check_data(argv[1], data, bufsize, buf);
+
+   /* Predicted data */
+   write_image(argv[1], Ics_uint16, dims, data, bufsize, NULL, IcsCompr_zstd,
+               3, 2, IcsFilter_none, IcsPredictor_horizontal);
+   check_data(argv[1], data, bufsize, buf);
+   write_image(argv[1], Ics_uint16, dims, transposed, bufsize, strides,
+               IcsCompr_zstd, 3, 1, IcsFilter_shuffle, IcsPredictor_horizontal);
+   check_data(argv[1], data, bufsize, buf);
+
+   free(data);
+   free(transposed);
+   free(buf);
+   exit(0);
+}
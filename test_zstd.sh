@@ -0,0 +1 @@
+./test_zstd result_v2zstd.ics